@@ -21,7 +21,8 @@ struct Uniforms
     float f0;
     float4 tex0scaleOffset;
     float4 tilesXY;
-    matrix_float4x4 boneMatrices[ 80 ];
+    uint boneOffset; // Index of the first joint in the bone palette buffer.
+    uint bonePadding[ 3 ];
     int isVR;
     int kernelSize;
     float2 bloomParams;
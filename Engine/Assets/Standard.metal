@@ -117,14 +117,15 @@ vertex StandardColorInOut standard_vertex( StandardVertex vert [[stage_in]],
 
 vertex StandardColorInOut standard_skin_vertex( StandardVertexSkin vert [[stage_in]],
                                constant Uniforms& uniforms [[ buffer(5) ]],
+                               const device matrix_float4x4* bonePalette [[ buffer(6) ]],
                                unsigned int vid [[ vertex_id ]] )
 {
     StandardColorInOut out;
 
-    matrix_float4x4 boneTransform = uniforms.boneMatrices[ vert.boneIndex.x ] * vert.boneWeights.x +
-                                    uniforms.boneMatrices[ vert.boneIndex.y ] * vert.boneWeights.y +
-                                    uniforms.boneMatrices[ vert.boneIndex.z ] * vert.boneWeights.z +
-                                    uniforms.boneMatrices[ vert.boneIndex.w ] * vert.boneWeights.w;
+    matrix_float4x4 boneTransform = bonePalette[ uniforms.boneOffset + vert.boneIndex.x ] * vert.boneWeights.x +
+                                    bonePalette[ uniforms.boneOffset + vert.boneIndex.y ] * vert.boneWeights.y +
+                                    bonePalette[ uniforms.boneOffset + vert.boneIndex.z ] * vert.boneWeights.z +
+                                    bonePalette[ uniforms.boneOffset + vert.boneIndex.w ] * vert.boneWeights.w;
     
     float4 skinnedPposition = boneTransform * float4( vert.position, 1.0f );
     float4 skinnedNormal = boneTransform * float4( vert.normal, 0.0f );
@@ -8,5 +8,5 @@ struct VSOutput
 float4 main( VSOutput vsOut ) : SV_Target
 {
     float linearDepth = vsOut.mvPosition.z;
-    return float4( linearDepth, vsOut.normal );
+    return float4( linearDepth, normalize( vsOut.normal ) );
 }
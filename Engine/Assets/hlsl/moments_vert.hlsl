@@ -5,7 +5,7 @@ struct VSOutput
 
 #include "ubo.h"
 
-VSOutput main( float3 pos : POSITION, float3 normal : NORMAL )
+VSOutput main( float3 pos : POSITION )
 {
     VSOutput vsOut;
     vsOut.pos = mul( localToClip, float4( pos, 1.0f ) );
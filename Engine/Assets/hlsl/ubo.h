@@ -35,7 +35,8 @@ cbuffer cbPerFrame : register(b0)
     float f0;
     float4 tex0scaleOffset;
     float4 tilesXY;
-    matrix boneMatrices[ 80 ];
+    uint boneOffset; // Index of the first joint in bonePalette.
+    uint3 bonePadding;
     int isVR;
     int kernelSize;
     float2 bloomParams;
@@ -54,6 +55,7 @@ Buffer<float4> spotLightColors : register(t9);
 RWTexture2D<float4> rwTexture : register(u1);
 RWStructuredBuffer< Particle > particles : register(u2);
 RWBuffer<uint> perTileParticleIndexBuffer : register(u3);
+StructuredBuffer< matrix > bonePalette : register(t10);
 
 #else
 
@@ -85,7 +87,8 @@ RWBuffer<uint> perTileParticleIndexBuffer : register(u3);
     float f0;
     float4 tex0scaleOffset;
     float4 tilesXY;
-    matrix boneMatrices[ 80 ];
+    uint boneOffset; // Index of the first joint in bonePalette.
+    uint3 bonePadding;
     int isVR;
     int kernelSize;
     float2 bloomParams;
@@ -103,4 +106,5 @@ RWBuffer<uint> perTileParticleIndexBuffer : register(u3);
 [[vk::binding( 14 )]] RWTexture2D<float4> rwTexture;
 [[vk::binding( 15 )]] RWStructuredBuffer< Particle > particles;
 [[vk::binding( 16 )]] RWBuffer<uint> perTileParticleIndexBuffer;
+[[vk::binding( 17 )]] StructuredBuffer< matrix > bonePalette;
 #endif
@@ -36,6 +36,9 @@ ae3d::GameObject::~GameObject()
 GameObject& ae3d::GameObject::operator=( const GameObject& go )
 {
     name = go.name;
+    layer = go.layer;
+    isEnabled = go.isEnabled;
+    isStatic = go.isStatic;
     
     for (unsigned i = 0; i < MaxComponents; ++i)
     {
@@ -151,6 +154,9 @@ std::string ae3d::GameObject::GetSerialized() const
     serializedName += "\n";
     serializedName += "enabled ";
     serializedName += (isEnabled ? "1" : "0");
+    serializedName += "\n";
+    serializedName += "static ";
+    serializedName += (isStatic ? "1" : "0");
     serializedName += "\n\n";
 
     return serializedName;
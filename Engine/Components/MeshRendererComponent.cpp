@@ -1,10 +1,15 @@
 // This is an independent project of an individual developer. Dear PVS-Studio, please check it.
 // PVS-Studio Static Code Analyzer for C, C++, C#, and Java: http://www.viva64.com
 #include "MeshRendererComponent.hpp"
+#include <cmath>
+#include <map>
 #include <string>
+#include <utility>
 #include <vector>
+#include "Animation.hpp"
 #include "Frustum.hpp"
 #include "GfxDevice.hpp"
+#include "Jobs.hpp"
 #include "Matrix.hpp"
 #include "Mesh.hpp"
 #include "Material.hpp"
@@ -19,7 +24,7 @@ using namespace ae3d;
 
 namespace GfxDeviceGlobal
 {
-    extern PerObjectUboStruct perObjectUboStruct;
+    extern thread_local PerObjectUboStruct perObjectUboStruct;
 }
 
 namespace MathUtil
@@ -138,27 +143,298 @@ void ae3d::MeshRendererComponent::Cull( const class Frustum& cameraFrustum, cons
     Statistics::IncFrustumCullTime( System::EndTimer() );
 }
 
-void ae3d::MeshRendererComponent::ApplySkin( unsigned subMeshIndex )
+void ae3d::MeshRendererComponent::RequestStreamedMips( const Matrix44& localToView, const Matrix44& viewToClip, bool isPerspective, float viewportHeight )
 {
+    if (!mesh || isCulled)
+    {
+        return;
+    }
+
+    Vec3 aabbMinView;
+    Vec3 aabbMaxView;
+    Matrix44::TransformPoint( mesh->GetAABBMin(), localToView, &aabbMinView );
+    Matrix44::TransformPoint( mesh->GetAABBMax(), localToView, &aabbMaxView );
+
+    // Projected diameter of the bounding sphere. Assumes that textures cover the mesh once.
+    const float radius = (aabbMaxView - aabbMinView).Length() * 0.5f;
+    float screenSize = radius * viewToClip.m[ 5 ] * viewportHeight;
+
+    if (isPerspective)
+    {
+        const float distance = ((aabbMinView + aabbMaxView) * 0.5f).Length();
+        // Inside the bounds the texture can be seen from any distance, so the most detailed mip is requested.
+        screenSize = distance > radius ? screenSize / distance : viewportHeight * 1024;
+    }
+
+    int subMeshCount = 0;
+    mesh->GetSubMeshes( subMeshCount );
+
+    for (int subMeshIndex = 0; subMeshIndex < subMeshCount; ++subMeshIndex)
+    {
+        if (!isSubMeshCulled[ subMeshIndex ])
+        {
+            materials[ subMeshIndex ]->RequestStreamedMips( screenSize );
+        }
+    }
+}
+
+// Quantized positions are dequantized by folding outDequantize into object matrices. outQuantize is its inverse.
+static void GetPositionDequantization( const VertexBuffer& vertexBuffer, Matrix44& outDequantize, Matrix44& outQuantize )
+{
+    const Vec4& dequantization = vertexBuffer.GetPositionDequantization();
+    const float invScale = 1.0f / dequantization.w;
+
+    outDequantize.MakeIdentity();
+    outDequantize.Scale( dequantization.w, dequantization.w, dequantization.w );
+    outDequantize.SetTranslation( Vec3( dequantization.x, dequantization.y, dequantization.z ) );
+
+    outQuantize.MakeIdentity();
+    outQuantize.Scale( invScale, invScale, invScale );
+    outQuantize.SetTranslation( Vec3( -dequantization.x * invScale, -dequantization.y * invScale, -dequantization.z * invScale ) );
+}
+
+/// Poses are shared between instances by their sampled frame, so it's quantized to avoid float noise creating distinct poses.
+static const int poseSubFrames = 16;
+
+static int QuantizePoseFrame( float frame )
+{
+    return (int)std::floor( frame * poseSubFrames + 0.5f );
+}
+
+void ae3d::MeshRendererComponent::UpdateSkinPalette()
+{
+    if (!mesh)
+    {
+        return;
+    }
+
     int subMeshCount = 0;
     SubMesh* subMeshes = mesh->GetSubMeshes( subMeshCount );
 
-    if (!subMeshes[ subMeshIndex ].joints.empty())
+    // Async loads and hot reloads replace submeshes after SetMesh().
+    if (subMeshes != skinPaletteSubMeshes)
     {
-        for (std::size_t j = 0; j < subMeshes[ subMeshIndex ].joints.size(); ++j)
+        skinPaletteSubMeshes = subMeshes;
+        skinPaletteOffsets.Allocate( subMeshCount );
+        unsigned jointCount = 0;
+
+        for (int subMeshIndex = 0; subMeshIndex < subMeshCount; ++subMeshIndex)
         {
-            const auto& joint = subMeshes[ subMeshIndex ].joints[ j ];
-            
-            if (!joint.animTransforms.empty())
+            skinPaletteOffsets[ subMeshIndex ] = jointCount;
+            jointCount += (unsigned)subMeshes[ subMeshIndex ].joints.size();
+        }
+
+        skinPalette.Allocate( jointCount );
+        isSkinPaletteValid = false;
+    }
+
+    const float poseFrame = QuantizePoseFrame( animFrame ) / (float)poseSubFrames;
+
+    if (skinPalette.count == 0 || (isSkinPaletteValid && skinPaletteFrame == poseFrame))
+    {
+        return;
+    }
+
+    for (int subMeshIndex = 0; subMeshIndex < subMeshCount; ++subMeshIndex)
+    {
+        const std::vector< Joint >& joints = subMeshes[ subMeshIndex ].joints;
+
+        if (joints.empty())
+        {
+            continue;
+        }
+
+        const bool hasQuantizedPositions = subMeshes[ subMeshIndex ].vertexBuffer.HasQuantizedPositions();
+        Matrix44 dequantize, quantize;
+
+        if (hasQuantizedPositions)
+        {
+            GetPositionDequantization( subMeshes[ subMeshIndex ].vertexBuffer, dequantize, quantize );
+        }
+
+        // Sampling reads parents' global transforms, so they are converted into bone matrices only after all joints are sampled.
+        Matrix44* palette = &skinPalette[ skinPaletteOffsets[ subMeshIndex ] ];
+        Animation::Sample( joints.data(), joints.size(), poseFrame, palette );
+
+        for (std::size_t j = 0; j < joints.size(); ++j)
+        {
+            if (Animation::GetFrameCount( joints[ j ].animation ) > 0)
             {
-                const std::size_t frames = joint.animTransforms.size();
-                Matrix44::Multiply( joint.globalBindposeInverse,
-                                   joint.animTransforms[ animFrame % frames ],
-                                   GfxDeviceGlobal::perObjectUboStruct.boneMatrices[ j ] );
+                Matrix44& boneMatrix = palette[ j ];
+                Matrix44::Multiply( joints[ j ].globalBindposeInverse, boneMatrix, boneMatrix );
+
+                // Object matrices already dequantize, so bones operate in quantized space.
+                if (hasQuantizedPositions)
+                {
+                    Matrix44::Multiply( dequantize, boneMatrix, boneMatrix );
+                    Matrix44::Multiply( boneMatrix, quantize, boneMatrix );
+                }
             }
         }
     }
 
+    skinPaletteFrame = poseFrame;
+    isSkinPaletteValid = true;
+    Statistics::IncSkinPaletteUpdates();
+}
+
+static bool HasJoints( const SubMesh* subMeshes, int subMeshCount )
+{
+    for (int subMeshIndex = 0; subMeshIndex < subMeshCount; ++subMeshIndex)
+    {
+        if (!subMeshes[ subMeshIndex ].joints.empty())
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void ae3d::MeshRendererComponent::UpdateSkinPalettes( MeshRendererComponent** renderers, int count )
+{
+    // Instances that play the same frame of the same mesh have the same pose.
+    std::map< std::pair< const SubMesh*, int >, MeshRendererComponent* > poses;
+    std::vector< MeshRendererComponent* > owners;
+
+    for (int i = 0; i < count; ++i)
+    {
+        MeshRendererComponent* renderer = renderers[ i ];
+        renderer->skinPaletteSource = nullptr;
+
+        if (!renderer->mesh)
+        {
+            continue;
+        }
+
+        int subMeshCount = 0;
+        const SubMesh* subMeshes = renderer->mesh->GetSubMeshes( subMeshCount );
+
+        if (!HasJoints( subMeshes, subMeshCount ))
+        {
+            continue;
+        }
+
+        auto pose = poses.insert( std::make_pair( std::make_pair( subMeshes, QuantizePoseFrame( renderer->animFrame ) ), renderer ) );
+
+        if (pose.second)
+        {
+            owners.push_back( renderer );
+        }
+        else
+        {
+            renderer->skinPaletteSource = pose.first->second;
+        }
+    }
+
+    Jobs::ParallelFor( (int)owners.size(), 16, [ & ]( int begin, int end )
+    {
+        for (int i = begin; i < end; ++i)
+        {
+            owners[ i ]->UpdateSkinPalette();
+        }
+    } );
+
+    // Only animated meshes' joints are uploaded, once per pose.
+    static std::vector< Matrix44 > bonePalette;
+    bonePalette.clear();
+
+    for (MeshRendererComponent* owner : owners)
+    {
+        owner->skinPaletteGpuOffset = (unsigned)bonePalette.size();
+        bonePalette.insert( bonePalette.end(), owner->skinPalette.elements, owner->skinPalette.elements + owner->skinPalette.count );
+    }
+
+    if (!bonePalette.empty())
+    {
+        const unsigned firstIndex = GfxDevice::UploadBonePalette( bonePalette.data(), (unsigned)bonePalette.size() );
+
+        for (MeshRendererComponent* owner : owners)
+        {
+            owner->skinPaletteGpuOffset += firstIndex;
+        }
+    }
+}
+
+void ae3d::MeshRendererComponent::ApplySkin( unsigned subMeshIndex )
+{
+    int subMeshCount = 0;
+    SubMesh* subMeshes = mesh->GetSubMeshes( subMeshCount );
+
+    if (subMeshes[ subMeshIndex ].joints.empty())
+    {
+        return;
+    }
+
+    const MeshRendererComponent& source = skinPaletteSource ? *skinPaletteSource : *this;
+    System::Assert( source.isSkinPaletteValid && source.skinPaletteSubMeshes == subMeshes, "skin palette has not been updated" );
+
+    GfxDeviceGlobal::perObjectUboStruct.boneOffset = source.skinPaletteGpuOffset + source.skinPaletteOffsets[ subMeshIndex ];
+}
+
+static void GetDrawState( const Material& material, bool isOverrideShader, GfxDevice::CullMode& outCullMode, GfxDevice::BlendMode& outBlendMode, GfxDevice::DepthFunc& outDepthFunc )
+{
+    outCullMode = (isOverrideShader || material.IsBackFaceCulled()) ? GfxDevice::CullMode::Back : GfxDevice::CullMode::Off;
+    outBlendMode = (!isOverrideShader && material.GetBlendingMode() == Material::BlendingMode::Alpha) ? GfxDevice::BlendMode::AlphaBlend : GfxDevice::BlendMode::Off;
+
+    if (material.GetDepthFunction() == Material::DepthFunction::LessOrEqualWriteOn)
+    {
+        outDepthFunc = GfxDevice::DepthFunc::LessOrEqualWriteOn;
+    }
+    else if (material.GetDepthFunction() == Material::DepthFunction::NoneWriteOff)
+    {
+        outDepthFunc = GfxDevice::DepthFunc::NoneWriteOff;
+    }
+    else
+    {
+        System::Assert( false, "material has unhandled depth function" );
+        outDepthFunc = GfxDevice::DepthFunc::NoneWriteOff;
+    }
+}
+
+void ae3d::MeshRendererComponent::CreatePSOs( RenderTexture* target, Shader* overrideShader, Shader* overrideSkinShader )
+{
+#if RENDERER_VULKAN
+    if (!mesh)
+    {
+        return;
+    }
+
+    int subMeshCount = 0;
+    SubMesh* subMeshes = mesh->GetSubMeshes( subMeshCount );
+
+    for (int subMeshIndex = 0; subMeshIndex < subMeshCount && subMeshIndex < (int)materials.count; ++subMeshIndex)
+    {
+        if (!materials[ subMeshIndex ])
+        {
+            continue;
+        }
+
+        Shader* shader = overrideShader ? overrideShader : materials[ subMeshIndex ]->GetShader();
+
+        if (overrideSkinShader && !subMeshes[ subMeshIndex ].joints.empty())
+        {
+            shader = overrideSkinShader;
+        }
+
+        if (!shader)
+        {
+            continue;
+        }
+
+        GfxDevice::CullMode cullMode;
+        GfxDevice::BlendMode blendMode;
+        GfxDevice::DepthFunc depthFunc;
+        GetDrawState( *materials[ subMeshIndex ], overrideShader != nullptr, cullMode, blendMode, depthFunc );
+
+        GfxDevice::CreatePSOIfMissing( subMeshes[ subMeshIndex ].vertexBuffer, *shader, blendMode, depthFunc, cullMode,
+                                       isWireframe ? GfxDevice::FillMode::Wireframe : GfxDevice::FillMode::Solid, GfxDevice::PrimitiveTopology::Triangles, target );
+    }
+#else
+    (void)target;
+    (void)overrideShader;
+    (void)overrideSkinShader;
+#endif
 }
 
 void ae3d::MeshRendererComponent::Render( const Matrix44& localToView, const Matrix44& localToClip, const Matrix44& localToWorld,
@@ -197,8 +473,10 @@ void ae3d::MeshRendererComponent::Render( const Matrix44& localToView, const Mat
             shader = overrideSkinShader;
         }
         
-        GfxDevice::CullMode cullMode = GfxDevice::CullMode::Back;
-        GfxDevice::BlendMode blendMode = GfxDevice::BlendMode::Off;
+        GfxDevice::CullMode cullMode;
+        GfxDevice::BlendMode blendMode;
+        GfxDevice::DepthFunc depthFunc;
+        GetDrawState( *materials[ subMeshIndex ], overrideShader != nullptr, cullMode, blendMode, depthFunc );
 
 #if AE3D_OPENVR
         GfxDeviceGlobal::perObjectUboStruct.isVR = 1;
@@ -228,83 +506,95 @@ void ae3d::MeshRendererComponent::Render( const Matrix44& localToView, const Mat
             GfxDeviceGlobal::perObjectUboStruct.localToShadowClip = localToShadowClip;
 
             ApplySkin( subMeshIndex );
-            
-            if (!materials[ subMeshIndex ]->IsBackFaceCulled())
-            {
-                cullMode = GfxDevice::CullMode::Off;
-            }
-            
-            if (materials[ subMeshIndex ]->GetBlendingMode() == Material::BlendingMode::Alpha)
-            {
-                blendMode = GfxDevice::BlendMode::AlphaBlend;
-            }
         }
-        
-        GfxDevice::DepthFunc depthFunc;
-        
-        if (materials[ subMeshIndex ]->GetDepthFunction() == Material::DepthFunction::LessOrEqualWriteOn)
-        {
-            depthFunc = GfxDevice::DepthFunc::LessOrEqualWriteOn;
-        }
-        else if (materials[ subMeshIndex ]->GetDepthFunction() == Material::DepthFunction::NoneWriteOff)
-        {
-            depthFunc = GfxDevice::DepthFunc::NoneWriteOff;
-        }
-        else
+
+        if (subMeshes[ subMeshIndex ].vertexBuffer.HasQuantizedPositions())
         {
-            System::Assert( false, "material has unhandled depth function" );
-            depthFunc = GfxDevice::DepthFunc::NoneWriteOff;
+            Matrix44 dequantize, quantize;
+            GetPositionDequantization( subMeshes[ subMeshIndex ].vertexBuffer, dequantize, quantize );
+
+            auto& ubo = GfxDeviceGlobal::perObjectUboStruct;
+            Matrix44::Multiply( dequantize, ubo.localToClip, ubo.localToClip );
+            Matrix44::Multiply( dequantize, ubo.localToView, ubo.localToView );
+
+            if (!overrideShader)
+            {
+                Matrix44::Multiply( dequantize, ubo.localToWorld, ubo.localToWorld );
+                Matrix44::Multiply( dequantize, ubo.localToShadowClip, ubo.localToShadowClip );
+            }
         }
         
         GfxDevice::Draw( subMeshes[ subMeshIndex ].vertexBuffer, 0, subMeshes[ subMeshIndex ].vertexBuffer.GetFaceCount() / 3,
                          *shader, blendMode, depthFunc, cullMode, isWireframe ? GfxDevice::FillMode::Wireframe : GfxDevice::FillMode::Solid, GfxDevice::PrimitiveTopology::Triangles );
+    }
+}
 
-        if (isAabbDrawingEnabled)
-        {
-            Vec3 aabb[ 8 ];
-            MathUtil::GetCorners( mesh->GetAABBMin(), mesh->GetAABBMax(), aabb );
-    
-            Vec3 aabbMin, aabbMax;
-            MathUtil::GetMinMax( aabb, 8, aabbMin, aabbMax );
+void ae3d::MeshRendererComponent::RenderBoundingBox( const Matrix44& localToView, const Matrix44& localToClip )
+{
+    if (!isAabbDrawingEnabled || isCulled || !mesh || !isEnabled)
+    {
+        return;
+    }
 
-            const int lineCount = 24;
-            Vec3 lines[ lineCount ] =
-            {
-                Vec3( aabbMin.x, aabbMin.y, aabbMin.z ) * 1.1f,
-                Vec3( aabbMax.x, aabbMin.y, aabbMin.z ) * 1.1f,
-                Vec3( aabbMax.x, aabbMin.y, aabbMax.z ) * 1.1f,
-                Vec3( aabbMin.x, aabbMin.y, aabbMax.z ) * 1.1f,
-
-                Vec3( aabbMin.x, aabbMax.y, aabbMin.z ) * 1.1f,
-                Vec3( aabbMax.x, aabbMax.y, aabbMin.z ) * 1.1f,
-                Vec3( aabbMax.x, aabbMax.y, aabbMax.z ) * 1.1f,
-                Vec3( aabbMin.x, aabbMax.y, aabbMax.z ) * 1.1f,
-
-                Vec3( aabbMin.x, aabbMax.y, aabbMin.z ) * 1.1f,
-                Vec3( aabbMin.x, aabbMax.y, aabbMax.z ) * 1.1f,
-                Vec3( aabbMax.x, aabbMax.y, aabbMin.z ) * 1.1f,
-                Vec3( aabbMax.x, aabbMax.y, aabbMax.z ) * 1.1f,
-
-                Vec3( aabbMin.x, aabbMin.y, aabbMin.z ) * 1.1f,
-                Vec3( aabbMin.x, aabbMin.y, aabbMax.z ) * 1.1f,
-                Vec3( aabbMax.x, aabbMin.y, aabbMin.z ) * 1.1f,
-                Vec3( aabbMax.x, aabbMin.y, aabbMax.z ) * 1.1f,
-
-                Vec3( aabbMin.x, aabbMin.y, aabbMin.z ) * 1.1f,
-                Vec3( aabbMin.x, aabbMax.y, aabbMin.z ) * 1.1f,
-                Vec3( aabbMax.x, aabbMin.y, aabbMin.z ) * 1.1f,
-                Vec3( aabbMax.x, aabbMax.y, aabbMin.z ) * 1.1f,
-
-                Vec3( aabbMin.x, aabbMin.y, aabbMax.z ) * 1.1f,
-                Vec3( aabbMin.x, aabbMax.y, aabbMax.z ) * 1.1f,
-                Vec3( aabbMax.x, aabbMin.y, aabbMax.z ) * 1.1f,
-                Vec3( aabbMax.x, aabbMax.y, aabbMax.z ) * 1.1f,
-            };
-
-            GfxDevice::UpdateLineBuffer( aabbLineHandle, lines, lineCount, Vec3( 1, 0, 0 ) );
-            GfxDevice::DrawLines( aabbLineHandle, *shader );
-        }
+    // Lines are drawn with the shader of the first visible submesh.
+    int subMeshIndex = 0;
+
+    while (subMeshIndex < (int)isSubMeshCulled.count && isSubMeshCulled[ subMeshIndex ])
+    {
+        ++subMeshIndex;
     }
+
+    if (subMeshIndex == (int)isSubMeshCulled.count)
+    {
+        return;
+    }
+
+    materials[ subMeshIndex ]->Apply();
+    GfxDeviceGlobal::perObjectUboStruct.localToClip = localToClip;
+    GfxDeviceGlobal::perObjectUboStruct.localToView = localToView;
+
+    Vec3 aabb[ 8 ];
+    MathUtil::GetCorners( mesh->GetAABBMin(), mesh->GetAABBMax(), aabb );
+
+    Vec3 aabbMin, aabbMax;
+    MathUtil::GetMinMax( aabb, 8, aabbMin, aabbMax );
+
+    const int lineCount = 24;
+    Vec3 lines[ lineCount ] =
+    {
+        Vec3( aabbMin.x, aabbMin.y, aabbMin.z ) * 1.1f,
+        Vec3( aabbMax.x, aabbMin.y, aabbMin.z ) * 1.1f,
+        Vec3( aabbMax.x, aabbMin.y, aabbMax.z ) * 1.1f,
+        Vec3( aabbMin.x, aabbMin.y, aabbMax.z ) * 1.1f,
+
+        Vec3( aabbMin.x, aabbMax.y, aabbMin.z ) * 1.1f,
+        Vec3( aabbMax.x, aabbMax.y, aabbMin.z ) * 1.1f,
+        Vec3( aabbMax.x, aabbMax.y, aabbMax.z ) * 1.1f,
+        Vec3( aabbMin.x, aabbMax.y, aabbMax.z ) * 1.1f,
+
+        Vec3( aabbMin.x, aabbMax.y, aabbMin.z ) * 1.1f,
+        Vec3( aabbMin.x, aabbMax.y, aabbMax.z ) * 1.1f,
+        Vec3( aabbMax.x, aabbMax.y, aabbMin.z ) * 1.1f,
+        Vec3( aabbMax.x, aabbMax.y, aabbMax.z ) * 1.1f,
+
+        Vec3( aabbMin.x, aabbMin.y, aabbMin.z ) * 1.1f,
+        Vec3( aabbMin.x, aabbMin.y, aabbMax.z ) * 1.1f,
+        Vec3( aabbMax.x, aabbMin.y, aabbMin.z ) * 1.1f,
+        Vec3( aabbMax.x, aabbMin.y, aabbMax.z ) * 1.1f,
+
+        Vec3( aabbMin.x, aabbMin.y, aabbMin.z ) * 1.1f,
+        Vec3( aabbMin.x, aabbMax.y, aabbMin.z ) * 1.1f,
+        Vec3( aabbMax.x, aabbMin.y, aabbMin.z ) * 1.1f,
+        Vec3( aabbMax.x, aabbMax.y, aabbMin.z ) * 1.1f,
+
+        Vec3( aabbMin.x, aabbMin.y, aabbMax.z ) * 1.1f,
+        Vec3( aabbMin.x, aabbMax.y, aabbMax.z ) * 1.1f,
+        Vec3( aabbMax.x, aabbMin.y, aabbMax.z ) * 1.1f,
+        Vec3( aabbMax.x, aabbMax.y, aabbMax.z ) * 1.1f,
+    };
+
+    GfxDevice::UpdateLineBuffer( aabbLineHandle, lines, lineCount, Vec3( 1, 0, 0 ) );
+    GfxDevice::DrawLines( aabbLineHandle, *materials[ subMeshIndex ]->GetShader() );
 }
 
 void ae3d::MeshRendererComponent::SetMaterial( Material* material, unsigned subMeshIndex )
@@ -334,6 +624,11 @@ void ae3d::MeshRendererComponent::EnableBoundingBoxDrawing( bool enable )
     }
 }
 
+void ae3d::MeshRendererComponent::SetAnimationTime( float seconds )
+{
+    animFrame = seconds * animationFramesPerSecond;
+}
+
 bool ae3d::MeshRendererComponent::IsBoundingBoxDrawingEnabled() const
 {
     return isAabbDrawingEnabled;
@@ -342,6 +637,7 @@ bool ae3d::MeshRendererComponent::IsBoundingBoxDrawingEnabled() const
 void ae3d::MeshRendererComponent::SetMesh( Mesh* aMesh )
 {
     mesh = aMesh;
+    isSkinPaletteValid = false;
 
     if (mesh != nullptr)
     {
@@ -17,7 +17,7 @@ namespace GfxDeviceGlobal
     extern D3D12_UNORDERED_ACCESS_VIEW_DESC uav2Desc;
     extern D3D12_UNORDERED_ACCESS_VIEW_DESC uav3Desc;
     extern ID3D12GraphicsCommandList* graphicsCommandList;
-    extern PerObjectUboStruct perObjectUboStruct;
+    extern thread_local PerObjectUboStruct perObjectUboStruct;
 }
 
 void TransitionResource( GpuResource& gpuResource, D3D12_RESOURCE_STATES newState );
@@ -29,7 +29,7 @@ extern id< MTLBuffer > particleTileBuffer;
 
 namespace GfxDeviceGlobal
 {
-    extern PerObjectUboStruct perObjectUboStruct;
+    extern thread_local PerObjectUboStruct perObjectUboStruct;
 }
 #endif
 
@@ -37,7 +37,7 @@ namespace GfxDeviceGlobal
 namespace GfxDeviceGlobal
 {
     extern VkCommandBuffer computeCmdBuffer;
-    extern PerObjectUboStruct perObjectUboStruct;
+    extern thread_local PerObjectUboStruct perObjectUboStruct;
 }
 
 extern VkBuffer particleTileBuffer;
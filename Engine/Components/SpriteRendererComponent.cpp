@@ -20,7 +20,7 @@ unsigned nextFreeSpriteComponent = 0;
 
 namespace GfxDeviceGlobal
 {
-    extern PerObjectUboStruct perObjectUboStruct;
+    extern thread_local PerObjectUboStruct perObjectUboStruct;
 }
 
 struct Drawable
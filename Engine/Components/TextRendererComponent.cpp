@@ -16,7 +16,7 @@ unsigned nextFreeTextComponent = 0;
 
 namespace GfxDeviceGlobal
 {
-    extern PerObjectUboStruct perObjectUboStruct;
+    extern thread_local PerObjectUboStruct perObjectUboStruct;
 }
 
 unsigned ae3d::TextRendererComponent::New()
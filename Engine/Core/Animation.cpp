@@ -0,0 +1,351 @@
+// This is an independent project of an individual developer. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++, C#, and Java: http://www.viva64.com
+
+#include "Animation.hpp"
+#include <algorithm>
+#include <cmath>
+#include "Matrix.hpp"
+#include "Quaternion.hpp"
+#include "SubMesh.hpp"
+#include "System.hpp"
+
+using namespace ae3d;
+
+/// Largest allowed rotation error of a removed key in radians.
+static const float rotationTolerance = 0.0005f;
+/// Largest allowed translation error of a removed key relative to the translation range of the joint.
+static const float translationTolerance = 0.0002f;
+/// Largest allowed scale error of a removed key.
+static const float scaleTolerance = 0.0001f;
+
+struct JointPose
+{
+    Vec3 translation;
+    Quaternion rotation;
+    Vec3 scale;
+};
+
+static Quaternion Nlerp( const Quaternion& a, const Quaternion& b, float t )
+{
+    // Shortest path.
+    const float sign = a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w < 0 ? -1.0f : 1.0f;
+    Quaternion result( Vec3( a.x + (b.x * sign - a.x) * t, a.y + (b.y * sign - a.y) * t, a.z + (b.z * sign - a.z) * t ), a.w + (b.w * sign - a.w) * t );
+    const float length = std::sqrt( result.x * result.x + result.y * result.y + result.z * result.z + result.w * result.w );
+    return Quaternion( Vec3( result.x / length, result.y / length, result.z / length ), result.w / length );
+}
+
+static Vec3 Lerp( const Vec3& a, const Vec3& b, float t )
+{
+    return a + (b - a) * t;
+}
+
+/// Joints transform row vectors: the rows of the upper 3x3 part are the scaled basis vectors.
+static JointPose Decompose( const Matrix44& matrix )
+{
+    JointPose pose;
+    pose.translation = Vec3( matrix.m[ 12 ], matrix.m[ 13 ], matrix.m[ 14 ] );
+
+    Vec3 rows[ 3 ] = { Vec3( matrix.m[ 0 ], matrix.m[ 1 ], matrix.m[ 2 ] ), Vec3( matrix.m[ 4 ], matrix.m[ 5 ], matrix.m[ 6 ] ), Vec3( matrix.m[ 8 ], matrix.m[ 9 ], matrix.m[ 10 ] ) };
+    pose.scale = Vec3( rows[ 0 ].Length(), rows[ 1 ].Length(), rows[ 2 ].Length() );
+
+    // Mirroring is stored as negative scale.
+    if (Vec3::Dot( Vec3::Cross( rows[ 0 ], rows[ 1 ] ), rows[ 2 ] ) < 0)
+    {
+        pose.scale.x = -pose.scale.x;
+    }
+
+    Matrix44 rotation;
+    rotation.MakeIdentity();
+    const float scales[ 3 ] = { pose.scale.x, pose.scale.y, pose.scale.z };
+
+    for (int r = 0; r < 3; ++r)
+    {
+        const float invScale = scales[ r ] != 0 ? 1.0f / scales[ r ] : 0.0f;
+        rotation.m[ r * 4 + 0 ] = rows[ r ].x * invScale;
+        rotation.m[ r * 4 + 1 ] = rows[ r ].y * invScale;
+        rotation.m[ r * 4 + 2 ] = rows[ r ].z * invScale;
+    }
+
+    pose.rotation.FromMatrix( rotation );
+    return pose;
+}
+
+static void Compose( const JointPose& pose, Matrix44& outMatrix )
+{
+    // GetMatrix() creates the transpose of the matrix that FromMatrix() reads.
+    Matrix44 rotation;
+    pose.rotation.GetMatrix( rotation );
+    rotation.Transpose( outMatrix );
+
+    const float scales[ 3 ] = { pose.scale.x, pose.scale.y, pose.scale.z };
+
+    for (int r = 0; r < 3; ++r)
+    {
+        outMatrix.m[ r * 4 + 0 ] *= scales[ r ];
+        outMatrix.m[ r * 4 + 1 ] *= scales[ r ];
+        outMatrix.m[ r * 4 + 2 ] *= scales[ r ];
+    }
+
+    outMatrix.SetTranslation( pose.translation );
+}
+
+/// \return Frames of keys that are needed to reproduce samples within tolerance by interpolation.
+template< typename T, typename Interpolate, typename IsClose >
+static std::vector< std::uint16_t > ReduceKeys( const std::vector< T >& samples, Interpolate interpolate, IsClose isClose )
+{
+    std::vector< std::uint16_t > frames( 1, 0 );
+    std::size_t start = 0;
+
+    for (std::size_t end = 2; end < samples.size(); ++end)
+    {
+        bool isReproduced = true;
+
+        for (std::size_t f = start + 1; f < end && isReproduced; ++f)
+        {
+            isReproduced = isClose( interpolate( samples[ start ], samples[ end ], (float)(f - start) / (float)(end - start) ), samples[ f ] );
+        }
+
+        if (!isReproduced)
+        {
+            start = end - 1;
+            frames.push_back( (std::uint16_t)start );
+        }
+    }
+
+    if (samples.size() > 1)
+    {
+        frames.push_back( (std::uint16_t)(samples.size() - 1) );
+    }
+
+    return frames;
+}
+
+static void QuantizeRotation( const Quaternion& rotation, std::uint16_t* outValues )
+{
+    float components[ 4 ] = { rotation.x, rotation.y, rotation.z, rotation.w };
+    int largest = 0;
+
+    for (int c = 1; c < 4; ++c)
+    {
+        largest = std::fabs( components[ c ] ) > std::fabs( components[ largest ] ) ? c : largest;
+    }
+
+    // q and -q are the same rotation, so the largest component can be positive and reconstructed from the others.
+    const float sign = components[ largest ] < 0 ? -1.0f : 1.0f;
+    int v = 0;
+
+    for (int c = 0; c < 4; ++c)
+    {
+        if (c != largest)
+        {
+            // Other components are in range [-1/sqrt(2), 1/sqrt(2)].
+            const float normalized = std::min( std::max( components[ c ] * sign * 0.70710678f + 0.5f, 0.0f ), 1.0f );
+            outValues[ v ] = (std::uint16_t)((std::uint16_t)(normalized * 32767 + 0.5f) << 1);
+            ++v;
+        }
+    }
+
+    outValues[ 0 ] |= largest & 1;
+    outValues[ 1 ] |= (largest >> 1) & 1;
+}
+
+static Quaternion DequantizeRotation( const std::uint16_t* values )
+{
+    const int largest = (values[ 0 ] & 1) | ((values[ 1 ] & 1) << 1);
+    float components[ 4 ];
+    float sum = 0;
+    int v = 0;
+
+    for (int c = 0; c < 4; ++c)
+    {
+        if (c != largest)
+        {
+            components[ c ] = ((values[ v ] >> 1) / 32767.0f - 0.5f) * 1.41421356f;
+            sum += components[ c ] * components[ c ];
+            ++v;
+        }
+    }
+
+    components[ largest ] = std::sqrt( std::max( 1.0f - sum, 0.0f ) );
+    return Quaternion( Vec3( components[ 0 ], components[ 1 ], components[ 2 ] ), components[ 3 ] );
+}
+
+/// \return Index of the key that starts the segment that contains the frame and the position in the segment (0-1).
+static std::size_t FindKey( const std::vector< std::uint16_t >& frames, float frame, float& outT )
+{
+    const std::size_t next = (std::size_t)(std::upper_bound( frames.begin(), frames.end(), frame ) - frames.begin());
+
+    if (next == 0 || next >= frames.size())
+    {
+        outT = 0;
+        return next == 0 ? 0 : frames.size() - 1;
+    }
+
+    outT = (frame - frames[ next - 1 ]) / (float)(frames[ next ] - frames[ next - 1 ]);
+    return next - 1;
+}
+
+static JointPose SamplePose( const JointAnimation& animation, float frame )
+{
+    JointPose pose;
+    float t;
+    std::size_t key = FindKey( animation.translationFrames, frame, t );
+    std::size_t nextKey = std::min( key + 1, animation.translationFrames.size() - 1 );
+    const std::uint16_t* q0 = &animation.translations[ key * 3 ];
+    const std::uint16_t* q1 = &animation.translations[ nextKey * 3 ];
+    const Vec3& scale = animation.translationScale;
+    const Vec3 translation0 = animation.translationMin + Vec3( q0[ 0 ] * scale.x, q0[ 1 ] * scale.y, q0[ 2 ] * scale.z );
+    const Vec3 translation1 = animation.translationMin + Vec3( q1[ 0 ] * scale.x, q1[ 1 ] * scale.y, q1[ 2 ] * scale.z );
+    pose.translation = Lerp( translation0, translation1, t );
+
+    key = FindKey( animation.rotationFrames, frame, t );
+    nextKey = std::min( key + 1, animation.rotationFrames.size() - 1 );
+    pose.rotation = Nlerp( DequantizeRotation( &animation.rotations[ key * 3 ] ), DequantizeRotation( &animation.rotations[ nextKey * 3 ] ), t );
+
+    key = FindKey( animation.scaleFrames, frame, t );
+    nextKey = std::min( key + 1, animation.scaleFrames.size() - 1 );
+    pose.scale = Lerp( animation.scales[ key ], animation.scales[ nextKey ], t );
+
+    return pose;
+}
+
+int ae3d::Animation::GetFrameCount( const JointAnimation& animation )
+{
+    return animation.translationFrames.empty() ? 0 : animation.translationFrames.back() + 1;
+}
+
+std::size_t ae3d::Animation::GetMemoryUsage( const JointAnimation& animation )
+{
+    return (animation.translationFrames.size() + animation.translations.size() + animation.rotationFrames.size() + animation.rotations.size() +
+            animation.scaleFrames.size()) * sizeof( std::uint16_t ) + animation.scales.size() * sizeof( Vec3 );
+}
+
+void ae3d::Animation::Compress( const std::vector< Matrix44 >* globalTransforms, Joint* joints, std::size_t jointCount )
+{
+    for (std::size_t j = 0; j < jointCount; ++j)
+    {
+        const std::vector< Matrix44 >& transforms = globalTransforms[ j ];
+        JointAnimation& animation = joints[ j ].animation;
+        animation = JointAnimation();
+
+        if (transforms.empty())
+        {
+            continue;
+        }
+
+        System::Assert( transforms.size() <= 65536, "Animation is too long!" );
+
+        // Interpolating in the parent's space keeps the lengths of bones. Parents are sampled before their children.
+        const int parent = joints[ j ].parentIndex;
+        animation.isRelativeToParent = parent >= 0 && parent < (int)j && globalTransforms[ parent ].size() == transforms.size();
+
+        std::vector< Vec3 > translations( transforms.size() );
+        std::vector< Quaternion > rotations( transforms.size() );
+        std::vector< Vec3 > scales( transforms.size() );
+
+        for (std::size_t f = 0; f < transforms.size(); ++f)
+        {
+            Matrix44 local = transforms[ f ];
+
+            if (animation.isRelativeToParent)
+            {
+                Matrix44 parentInverse;
+                Matrix44::Invert( globalTransforms[ parent ][ f ], parentInverse );
+                Matrix44::Multiply( transforms[ f ], parentInverse, local );
+            }
+
+            const JointPose pose = Decompose( local );
+            translations[ f ] = pose.translation;
+            rotations[ f ] = pose.rotation;
+            scales[ f ] = pose.scale;
+        }
+
+        Vec3 translationMax = translations[ 0 ];
+        animation.translationMin = translations[ 0 ];
+
+        for (const Vec3& translation : translations)
+        {
+            animation.translationMin = Vec3::Min2( animation.translationMin, translation );
+            translationMax = Vec3::Max2( translationMax, translation );
+        }
+
+        const Vec3 range = translationMax - animation.translationMin;
+        animation.translationScale = range / 65535.0f;
+        const float translationError = std::max( std::max( std::max( range.x, range.y ), range.z ) * translationTolerance, 0.000001f );
+        const float rotationErrorCos = std::cos( rotationTolerance * 0.5f );
+
+        animation.translationFrames = ReduceKeys( translations, Lerp, [translationError]( const Vec3& a, const Vec3& b )
+        {
+            return (a - b).Length() <= translationError;
+        } );
+
+        animation.rotationFrames = ReduceKeys( rotations, Nlerp, [rotationErrorCos]( const Quaternion& a, const Quaternion& b )
+        {
+            return std::fabs( a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w ) >= rotationErrorCos;
+        } );
+
+        animation.scaleFrames = ReduceKeys( scales, Lerp, []( const Vec3& a, const Vec3& b )
+        {
+            return std::fabs( a.x - b.x ) <= scaleTolerance && std::fabs( a.y - b.y ) <= scaleTolerance && std::fabs( a.z - b.z ) <= scaleTolerance;
+        } );
+
+        for (std::uint16_t frame : animation.translationFrames)
+        {
+            const Vec3 offset = translations[ frame ] - animation.translationMin;
+            const float offsets[ 3 ] = { offset.x, offset.y, offset.z };
+            const float steps[ 3 ] = { animation.translationScale.x, animation.translationScale.y, animation.translationScale.z };
+
+            for (int c = 0; c < 3; ++c)
+            {
+                animation.translations.push_back( (std::uint16_t)(steps[ c ] > 0 ? std::min( offsets[ c ] / steps[ c ] + 0.5f, 65535.0f ) : 0) );
+            }
+        }
+
+        for (std::uint16_t frame : animation.rotationFrames)
+        {
+            std::uint16_t values[ 3 ];
+            QuantizeRotation( rotations[ frame ], values );
+            animation.rotations.insert( animation.rotations.end(), values, values + 3 );
+        }
+
+        for (std::uint16_t frame : animation.scaleFrames)
+        {
+            animation.scales.push_back( scales[ frame ] );
+        }
+    }
+}
+
+void ae3d::Animation::Sample( const Joint* joints, std::size_t jointCount, float frame, Matrix44* outGlobalTransforms )
+{
+    for (std::size_t j = 0; j < jointCount; ++j)
+    {
+        const JointAnimation& animation = joints[ j ].animation;
+        const int frameCount = GetFrameCount( animation );
+
+        if (frameCount == 0)
+        {
+            continue;
+        }
+
+        const float loopedFrame = frame - std::floor( frame / frameCount ) * frameCount;
+        const float lastFrame = (float)(frameCount - 1);
+        JointPose pose = SamplePose( animation, std::min( loopedFrame, lastFrame ) );
+
+        // Between the last and the first frame.
+        if (loopedFrame > lastFrame)
+        {
+            const JointPose firstPose = SamplePose( animation, 0 );
+            const float t = loopedFrame - lastFrame;
+            pose.translation = Lerp( pose.translation, firstPose.translation, t );
+            pose.rotation = Nlerp( pose.rotation, firstPose.rotation, t );
+            pose.scale = Lerp( pose.scale, firstPose.scale, t );
+        }
+
+        Compose( pose, outGlobalTransforms[ j ] );
+
+        if (animation.isRelativeToParent)
+        {
+            Matrix44::Multiply( outGlobalTransforms[ j ], outGlobalTransforms[ joints[ j ].parentIndex ], outGlobalTransforms[ j ] );
+        }
+    }
+}
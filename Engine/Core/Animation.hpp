@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "Vec3.hpp"
+
+namespace ae3d
+{
+    struct Joint;
+    struct Matrix44;
+
+    /// convert_fbx samples animations at 24 frames per second.
+    static const float animationFramesPerSecond = 24;
+
+    /**
+     Animation of a joint as keyframed translation, rotation and scale in its parent's space.
+     Keys that interpolation of their neighbors reproduces are removed, so the frames of a track's keys are in ascending order
+     and the first key is at frame 0 and the last at the last frame.
+     */
+    struct JointAnimation
+    {
+        /// Translation = translationMin + quantized translation (0-65535) * translationScale.
+        std::vector< std::uint16_t > translationFrames;
+        std::vector< std::uint16_t > translations;
+        Vec3 translationMin;
+        Vec3 translationScale;
+        /// Rotations are quaternions without their largest component, 3 values per key. Every value has 15 bits of
+        /// the component and the largest component's index in the lowest bits of the first two values.
+        std::vector< std::uint16_t > rotationFrames;
+        std::vector< std::uint16_t > rotations;
+        std::vector< std::uint16_t > scaleFrames;
+        std::vector< Vec3 > scales;
+        /// True if the animation is in the parent's space. False if in model space.
+        bool isRelativeToParent = false;
+    };
+
+    namespace Animation
+    {
+        /// Creates joint animations from model-space transforms that are sampled every frame.
+        /// \param globalTransforms Transforms of every joint. Joints without animation have no transforms.
+        /// \param joints Joints whose animations are created.
+        /// \param jointCount Joint count.
+        void Compress( const std::vector< Matrix44 >* globalTransforms, Joint* joints, std::size_t jointCount );
+
+        /// Samples model-space transforms of joints.
+        /// \param joints Joints.
+        /// \param jointCount Joint count.
+        /// \param frame Frame. Loops over the animation and interpolates between frames.
+        /// \param outGlobalTransforms Model-space transforms of every joint. Joints without animation are left untouched.
+        void Sample( const Joint* joints, std::size_t jointCount, float frame, Matrix44* outGlobalTransforms );
+
+        /// \return Number of frames in the animation or 0 if it's not animated.
+        int GetFrameCount( const JointAnimation& animation );
+
+        /// \return Memory used by keys in bytes.
+        std::size_t GetMemoryUsage( const JointAnimation& animation );
+    }
+}
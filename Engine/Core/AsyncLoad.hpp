@@ -0,0 +1,21 @@
+#pragma once
+
+#include <functional>
+
+/// Runs asset file reading and decoding on loader threads. Results are finished, usually uploaded to the GPU,
+/// on the thread that calls System::ProcessAsyncLoads().
+namespace AsyncLoad
+{
+    /// \param work Runs on a loader thread. Must not use graphics APIs or engine state shared with the render thread.
+    /// \param finish Runs in System::ProcessAsyncLoads() after work has completed.
+    void Enqueue( const std::function< void() >& work, const std::function< void() >& finish );
+
+    /// Runs finish callbacks of completed work until budgetMs has elapsed. At least one is run if available.
+    void ProcessFinished( float budgetMs );
+
+    /// \return Count of enqueued loads whose finish callback has not run yet.
+    int GetPendingCount();
+
+    /// Stops loader threads. Work that has not been finished is discarded.
+    void Deinit();
+}
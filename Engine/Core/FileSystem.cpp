@@ -5,10 +5,18 @@
 #include <vector>
 #if VK_USE_PLATFORM_ANDROID_KHR
 #include <android/asset_manager.h>
+#elif _MSC_VER
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #endif
 
 #if RENDERER_METAL
-const char* GetFullPath( const char* fileName )
+std::string GetFullPath( const char* fileName )
 {
     if (fileName && fileName[ 0 ] == '/')
     {
@@ -23,15 +31,14 @@ const char* GetFullPath( const char* fileName )
     NSString *dir = [b resourcePath];
     NSString* fName = [NSString stringWithUTF8String: nameWithSlash.c_str()];
     dir = [dir stringByAppendingString:fName];
-    return [dir fileSystemRepresentation];
+    return std::string( [dir fileSystemRepresentation] );
 }
 #else
-const char* GetFullPath( const char* fileName )
+std::string GetFullPath( const char* fileName )
 {
-    static std::string fName;
-    fName = fileName;
+    std::string fName( fileName );
     std::replace( std::begin( fName ), std::end( fName ), '\\', '/' );
-    return fName.c_str();
+    return fName;
 }
 #endif
 
@@ -59,7 +66,7 @@ extern AAssetManager* assetManager;
 ae3d::FileSystem::FileContentsData ae3d::FileSystem::FileContents( const char* path )
 {
     ae3d::FileSystem::FileContentsData outData;
-    outData.path = outData.path = path == nullptr ? "" : std::string( GetFullPath( path ) );
+    outData.path = path == nullptr ? "" : GetFullPath( path );
 
     AAsset* file = AAssetManager_open( assetManager, path, AASSET_MODE_BUFFER );
 
@@ -77,7 +84,7 @@ ae3d::FileSystem::FileContentsData ae3d::FileSystem::FileContents( const char* p
 ae3d::FileSystem::FileContentsData ae3d::FileSystem::FileContents( const char* path )
 {
     ae3d::FileSystem::FileContentsData outData;
-    outData.path = path == nullptr ? "" : std::string( GetFullPath( path ) );
+    outData.path = path == nullptr ? "" : GetFullPath( path );
 #if defined __APPLE__
         outData.pathWithoutBundle = path;
 #endif
@@ -113,6 +120,123 @@ ae3d::FileSystem::FileContentsData ae3d::FileSystem::FileContents( const char* p
 }
 #endif
 
+#if !VK_USE_PLATFORM_ANDROID_KHR
+static bool IsInPakFile( const std::string& path )
+{
+    for (const auto& pakFile : Global::pakFiles)
+    {
+        for (const auto& entry : pakFile.entries)
+        {
+            if (entry.path == path)
+            {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+#endif
+
+void ae3d::FileSystem::MapFile( const char* path, MappedFile& outFile )
+{
+    UnmapFile( outFile );
+    outFile.path = path == nullptr ? "" : GetFullPath( path );
+
+#if VK_USE_PLATFORM_ANDROID_KHR
+    const bool canMap = false;
+#else
+    const bool canMap = !IsInPakFile( outFile.path );
+#endif
+
+    if (!canMap)
+    {
+        outFile.readContents = FileContents( path ).data;
+        outFile.data = outFile.readContents.empty() ? nullptr : outFile.readContents.data();
+        outFile.size = outFile.readContents.size();
+        return;
+    }
+
+#if _MSC_VER
+    HANDLE file = CreateFileA( outFile.path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr );
+
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        System::Print( "FileSystem: Could not open %s.\n", outFile.path.c_str() );
+        return;
+    }
+
+    LARGE_INTEGER fileSize = {};
+    GetFileSizeEx( file, &fileSize );
+    HANDLE mapping = fileSize.QuadPart > 0 ? CreateFileMappingA( file, nullptr, PAGE_READONLY, 0, 0, nullptr ) : nullptr;
+    CloseHandle( file );
+
+    if (mapping == nullptr)
+    {
+        System::Print( "FileSystem: Could not map %s.\n", outFile.path.c_str() );
+        return;
+    }
+
+    outFile.data = static_cast< const unsigned char* >( MapViewOfFile( mapping, FILE_MAP_READ, 0, 0, 0 ) );
+
+    if (outFile.data == nullptr)
+    {
+        CloseHandle( mapping );
+        System::Print( "FileSystem: Could not map %s.\n", outFile.path.c_str() );
+        return;
+    }
+
+    outFile.size = (std::size_t)fileSize.QuadPart;
+    outFile.handle = mapping;
+#elif !VK_USE_PLATFORM_ANDROID_KHR
+    const int file = open( outFile.path.c_str(), O_RDONLY );
+
+    if (file == -1)
+    {
+        System::Print( "FileSystem: Could not open %s.\n", outFile.path.c_str() );
+        return;
+    }
+
+    struct stat fileStat = {};
+    void* mapping = MAP_FAILED;
+
+    if (fstat( file, &fileStat ) == 0 && fileStat.st_size > 0)
+    {
+        mapping = mmap( nullptr, (std::size_t)fileStat.st_size, PROT_READ, MAP_PRIVATE, file, 0 );
+    }
+
+    close( file );
+
+    if (mapping == MAP_FAILED)
+    {
+        System::Print( "FileSystem: Could not map %s.\n", outFile.path.c_str() );
+        return;
+    }
+
+    outFile.data = static_cast< const unsigned char* >( mapping );
+    outFile.size = (std::size_t)fileStat.st_size;
+    outFile.handle = mapping;
+#endif
+}
+
+void ae3d::FileSystem::UnmapFile( MappedFile& file )
+{
+    if (file.handle != nullptr)
+    {
+#if _MSC_VER
+        UnmapViewOfFile( file.data );
+        CloseHandle( file.handle );
+#elif !VK_USE_PLATFORM_ANDROID_KHR
+        munmap( file.handle, file.size );
+#endif
+    }
+
+    file.data = nullptr;
+    file.size = 0;
+    file.handle = nullptr;
+    file.readContents.clear();
+}
+
 void ae3d::FileSystem::LoadPakFile( const char* path )
 {
     if (path == nullptr)
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <cstdint>
+
+/// Hash map with 64-bit keys that stores its entries in one array and resolves collisions by linear probing.
+template< typename T > struct FlatHashMap
+{
+    FlatHashMap() noexcept {}
+
+    FlatHashMap( const FlatHashMap< T >& ) = delete;
+    FlatHashMap< T >& operator=( const FlatHashMap< T >& ) = delete;
+
+    ~FlatHashMap() noexcept
+    {
+        delete[] slots;
+        slots = nullptr;
+    }
+
+    /// \param key Key.
+    /// \return Value for key or null if the key is not in the map.
+    T* Find( std::uint64_t key ) const
+    {
+        if (capacity == 0)
+        {
+            return nullptr;
+        }
+
+        for (unsigned i = Hash( key ) & (capacity - 1); slots[ i ].used; i = (i + 1) & (capacity - 1))
+        {
+            if (slots[ i ].key == key)
+            {
+                return &slots[ i ].value;
+            }
+        }
+
+        return nullptr;
+    }
+
+    /// \param key Key. If it already exists, its value is replaced.
+    /// \param value Value.
+    void Insert( std::uint64_t key, const T& value )
+    {
+        // Keeps load factor under 3/4 so probe sequences stay short.
+        if ((count + 1) * 4 > capacity * 3)
+        {
+            Grow();
+        }
+
+        unsigned i = Hash( key ) & (capacity - 1);
+
+        while (slots[ i ].used && slots[ i ].key != key)
+        {
+            i = (i + 1) & (capacity - 1);
+        }
+
+        if (!slots[ i ].used)
+        {
+            slots[ i ].used = true;
+            slots[ i ].key = key;
+            ++count;
+        }
+
+        slots[ i ].value = value;
+    }
+
+    /// Removes all entries but keeps the storage.
+    void Clear()
+    {
+        for (unsigned i = 0; i < capacity; ++i)
+        {
+            slots[ i ].used = false;
+        }
+
+        count = 0;
+    }
+
+    /// \param function Called with ( key, value ) for each entry.
+    template< typename F > void ForEach( F function ) const
+    {
+        for (unsigned i = 0; i < capacity; ++i)
+        {
+            if (slots[ i ].used)
+            {
+                function( slots[ i ].key, slots[ i ].value );
+            }
+        }
+    }
+
+    /// \return Entry count.
+    unsigned GetCount() const { return count; }
+
+private:
+    struct Slot
+    {
+        std::uint64_t key = 0;
+        T value = T();
+        bool used = false;
+    };
+
+    static unsigned Hash( std::uint64_t key )
+    {
+        // MurmurHash3 finalizer. Keys can be pointer sums whose low bits are mostly equal.
+        key ^= key >> 33;
+        key *= 0xff51afd7ed558ccdULL;
+        key ^= key >> 33;
+        key *= 0xc4ceb9fe1a85ec53ULL;
+        key ^= key >> 33;
+        return (unsigned)key;
+    }
+
+    void Grow()
+    {
+        Slot* oldSlots = slots;
+        const unsigned oldCapacity = capacity;
+
+        capacity = capacity == 0 ? 64 : capacity * 2;
+        slots = new Slot[ capacity ]();
+        count = 0;
+
+        for (unsigned i = 0; i < oldCapacity; ++i)
+        {
+            if (oldSlots[ i ].used)
+            {
+                Insert( oldSlots[ i ].key, oldSlots[ i ].value );
+            }
+        }
+
+        delete[] oldSlots;
+    }
+
+    Slot* slots = nullptr;
+    unsigned capacity = 0;
+    unsigned count = 0;
+};
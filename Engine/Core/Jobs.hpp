@@ -0,0 +1,16 @@
+#pragma once
+
+#include <functional>
+
+/// Splits per-frame work into ranges that run on worker threads and the calling thread.
+namespace Jobs
+{
+    /// Calls work for ranges of [0, count) and returns after all of them have completed. Worker threads are created on first use.
+    /// \param count Item count.
+    /// \param minItemsPerJob Ranges are at least this long, so small counts run on the calling thread.
+    /// \param work Called with the begin and end of a range. Ranges can run concurrently.
+    void ParallelFor( int count, int minItemsPerJob, const std::function< void( int, int ) >& work );
+
+    /// Stops worker threads.
+    void Deinit();
+}
@@ -1,6 +1,7 @@
 // This is an independent project of an individual developer. Dear PVS-Studio, please check it.
 // PVS-Studio Static Code Analyzer for C, C++, C#, and Java: http://www.viva64.com
 #include "Vec3.hpp"
+#include <cmath>
 #include <random>
 #include <ctime>
 
@@ -107,4 +108,28 @@ namespace MathUtil
     {
         return 1 + static_cast< int >(floor( log2( Max( width, height ) ) ));
     }
+
+    float HalfToFloat( unsigned short half )
+    {
+        const unsigned sign = (half >> 15) & 1;
+        const unsigned exponent = (half >> 10) & 0x1F;
+        const unsigned mantissa = half & 0x3FF;
+
+        float result;
+
+        if (exponent == 0)
+        {
+            result = mantissa / 16777216.0f; // Subnormal: mantissa * 2^-24
+        }
+        else if (exponent == 31)
+        {
+            result = mantissa == 0 ? 65504.0f : 0.0f;
+        }
+        else
+        {
+            result = (1.0f + mantissa / 1024.0f) * ldexpf( 1.0f, (int)exponent - 15 );
+        }
+
+        return sign ? -result : result;
+    }
 }
@@ -4,11 +4,18 @@
 #include "Mesh.hpp"
 #include <vector>
 #include <cstdint>
+#include <cstring>
+#include <list>
+#include <memory>
 #include <sstream>
 #include <string>
+#include <unordered_map>
+#include "Animation.hpp"
+#include "AsyncLoad.hpp"
 #include "FileSystem.hpp"
 #include "FileWatcher.hpp"
 #include "Matrix.hpp"
+#include "MeshCodec.hpp"
 #include "SubMesh.hpp"
 #include "System.hpp"
 #include "VertexBuffer.hpp"
@@ -17,33 +24,120 @@ using namespace ae3d;
 
 extern ae3d::FileWatcher fileWatcher;
 
-struct ae3d::Mesh::Impl
+namespace MathUtil
+{
+    float HalfToFloat( unsigned short half );
+}
+
+/// Loaded mesh contents. Shared by all Mesh instances loaded from the same path and not modified after loading.
+/// Vertex buffers are released when the last reference goes.
+struct MeshData
 {
-    Impl() noexcept
+    MeshData() = default;
+    MeshData( const MeshData& ) = delete;
+    MeshData& operator=( const MeshData& ) = delete;
+
+    /// Copies source's contents. Submeshes share source's vertex buffers and keep them alive until they are replaced.
+    explicit MeshData( const std::shared_ptr< MeshData >& source )
+    : aabbMin( source->aabbMin )
+    , aabbMax( source->aabbMax )
+    , subMeshes( source->subMeshes )
+    , path( source->path )
+    , bufferSource( source )
+    , isBufferShared( source->subMeshes.size(), true )
     {
-        static_assert( sizeof( ae3d::Mesh::Impl ) <= ae3d::Mesh::StorageSize, "Impl too big!");
-        static_assert( ae3d::Mesh::StorageAlign % alignof( ae3d::Mesh::Impl ) == 0, "Impl misaligned!");
     }
-    
+
+    ~MeshData()
+    {
+        for (std::size_t i = 0; i < subMeshes.size(); ++i)
+        {
+            if (!IsBufferShared( i ))
+            {
+                subMeshes[ i ].vertexBuffer.Release();
+            }
+        }
+    }
+
+    bool IsBufferShared( std::size_t subMeshIndex ) const
+    {
+        return subMeshIndex < isBufferShared.size() && isBufferShared[ subMeshIndex ];
+    }
+
     Vec3 aabbMin;
     Vec3 aabbMax;
     std::vector< SubMesh > subMeshes;
     std::string path;
+    std::shared_ptr< MeshData > bufferSource;
+    std::vector< bool > isBufferShared;
+};
+
+struct ae3d::Mesh::Impl
+{
+    Impl()
+    : data( std::make_shared< MeshData >() )
+    {
+        static_assert( sizeof( ae3d::Mesh::Impl ) <= ae3d::Mesh::StorageSize, "Impl too big!");
+        static_assert( ae3d::Mesh::StorageAlign % alignof( ae3d::Mesh::Impl ) == 0, "Impl misaligned!");
+    }
+    
+    std::shared_ptr< MeshData > data;
+    bool keepCpuData = true;
 };
 
 struct MeshCacheEntry
 {
-    std::string path;
-    Vec3 aabbMin;
-    Vec3 aabbMax;
-    std::vector< SubMesh > subMeshes;    
+    std::shared_ptr< MeshData > data;
+    /// Position in gMeshCacheLru.
+    std::list< std::string >::iterator lruPosition;
 };
 
 namespace
 {
 
-std::vector< MeshCacheEntry > gMeshCache;
+// Version c0 layout. All offsets are from the start of the file and vertex, index and depth stream blobs are 16-byte aligned,
+// so they can be uploaded directly from a memory-mapped file.
+struct PackedMeshHeader
+{
+    uint8_t magic[ 2 ];
+    uint16_t subMeshCount;
+    uint32_t fileSize;
+    float aabbMin[ 3 ];
+    float aabbMax[ 3 ];
+};
+
+struct PackedSubMesh
+{
+    float aabbMin[ 3 ];
+    float aabbMax[ 3 ];
+    float positionDequantization[ 4 ];
+    uint32_t vertexCount;
+    uint32_t faceCount;
+    uint8_t vertexFormat;
+    uint8_t indexSize;
+    uint8_t hasDepthStreams;
+    uint8_t reserved;
+    uint32_t nameOffset;
+    uint32_t nameLength;
+    uint32_t vertexOffset;
+    uint32_t indexOffset;
+    uint32_t positionStreamOffset;
+    uint32_t positionNormalStreamOffset;
+    uint32_t jointOffset;
+    uint32_t jointSize;
+    uint32_t reserved2[ 3 ];
+};
+
+static_assert( sizeof( PackedMeshHeader ) == 32, "PackedMeshHeader must match the file layout!" );
+static_assert( sizeof( PackedSubMesh ) == 96, "PackedSubMesh must match the file layout!" );
+
+std::unordered_map< std::string, MeshCacheEntry > gMeshCache;
+// Cached paths from the least to the most recently used.
+std::list< std::string > gMeshCacheLru;
+unsigned gMaxUnusedCachedMeshes = 64;
 std::vector< Mesh* > gMeshInstances;
+// Meshes waiting for an async load of a path.
+std::unordered_map< std::string, std::vector< Mesh* > > gPendingMeshLoads;
 
 struct membuf : std::streambuf
 {
@@ -52,6 +146,14 @@ struct membuf : std::streambuf
         char* p( const_cast<char*>(base) );
         this->setg( p, p, p + size );
     }
+
+    /// \return Next unread byte.
+    const unsigned char* Current() const { return (const unsigned char*)gptr(); }
+
+    /// \return Number of unread bytes.
+    std::size_t Remaining() const { return std::size_t( egptr() - gptr() ); }
+
+    void Skip( std::size_t count ) { gbump( static_cast< int >( count ) ); }
 };
 
 struct imemstream : virtual membuf, std::istream
@@ -63,6 +165,93 @@ struct imemstream : virtual membuf, std::istream
 };
 }
 
+static Vec3 DequantizePosition( const unsigned short position[ 4 ], const Vec4& dequantization )
+{
+    const float scale = dequantization.w / 65535.0f;
+    return Vec3( dequantization.x + position[ 0 ] * scale, dequantization.y + position[ 1 ] * scale, dequantization.z + position[ 2 ] * scale );
+}
+
+static bool ReadJoints( std::istream& is, SubMesh& subMesh, const std::string& path )
+{
+    uint16_t jointCount = 0;
+    is.read( (char*)&jointCount, sizeof( jointCount ) );
+
+    subMesh.joints.resize( jointCount );
+    std::vector< std::vector< Matrix44 > > animTransforms( jointCount );
+
+    for (size_t j = 0; j < subMesh.joints.size(); ++j)
+    {
+        is.read( (char*)&subMesh.joints[ j ].globalBindposeInverse, sizeof( ae3d::Matrix44 ) );
+        is.read( (char*)&subMesh.joints[ j ].parentIndex, 4 );
+        int jointNameLength;
+        is.read( (char*)&jointNameLength, sizeof( int ) );
+
+        if (jointNameLength < 0 || jointNameLength >= 128)
+        {
+            System::Print( "Mesh %s has a joint with too long name, max is 127.\n", path.c_str() );
+            return false;
+        }
+
+        is.read( subMesh.joints[ j ].name, jointNameLength );
+        subMesh.joints[ j ].name[ jointNameLength ] = 0;
+        int animLength;
+        is.read( (char*)&animLength, sizeof( int ) );
+
+        if (animLength < 0 || animLength > 65536)
+        {
+            System::Print( "Mesh %s has a joint with invalid animation length %d.\n", path.c_str(), animLength );
+            return false;
+        }
+
+        animTransforms[ j ].resize( animLength );
+        is.read( (char*)animTransforms[ j ].data(), animTransforms[ j ].size() * sizeof( ae3d::Matrix44 ) );
+    }
+
+    // Files store a model-space matrix for every frame. Keyframes use a fraction of their memory.
+    Animation::Compress( animTransforms.data(), subMesh.joints.data(), subMesh.joints.size() );
+
+    return true;
+}
+
+static void SetSubMeshDebugName( SubMesh& subMesh, const std::string& path )
+{
+    const std::size_t pos = path.find_last_of( '/' );
+    std::string shortPath = path;
+
+    if (pos != std::string::npos)
+    {
+        shortPath = path.substr( pos );
+    }
+
+    std::string subMeshDebugName = shortPath + std::string( ":" ) + subMesh.name;
+    subMesh.vertexBuffer.SetDebugName( subMeshDebugName.c_str() );
+}
+
+static void ReleaseCpuData( SubMesh& subMesh )
+{
+    std::vector< VertexBuffer::VertexPTNTC >().swap( subMesh.verticesPTNTC );
+    std::vector< VertexBuffer::VertexPTNTC_Skinned >().swap( subMesh.verticesPTNTC_Skinned );
+    std::vector< VertexBuffer::VertexPTN >().swap( subMesh.verticesPTN );
+    std::vector< VertexBuffer::VertexPTNTC_Compact >().swap( subMesh.verticesPTNTC_Compact );
+    std::vector< VertexBuffer::VertexPTNTC_Compact_Skinned >().swap( subMesh.verticesPTNTC_Compact_Skinned );
+    std::vector< VertexBuffer::Face >().swap( subMesh.indices );
+}
+
+static void RemovePendingLoad( const Mesh* mesh )
+{
+    for (auto& pending : gPendingMeshLoads)
+    {
+        for (std::size_t i = 0; i < pending.second.size(); ++i)
+        {
+            if (pending.second[ i ] == mesh)
+            {
+                pending.second.erase( std::begin( pending.second ) + i );
+                return;
+            }
+        }
+    }
+}
+
 void AddUniqueInstance( Mesh* mesh )
 {
     bool found = false;
@@ -81,23 +270,57 @@ void AddUniqueInstance( Mesh* mesh )
     }
 }
 
-void MeshReload( const std::string& path )
+static void EraseFromCache( const std::string& path )
 {
-    // Invalidates cache
-    for (std::size_t i = 0; i < gMeshCache.size(); ++i)
+    auto entry = gMeshCache.find( path );
+
+    if (entry != std::end( gMeshCache ))
+    {
+        gMeshCacheLru.erase( entry->second.lruPosition );
+        gMeshCache.erase( entry );
+    }
+}
+
+/// Evicts least recently used meshes that are referenced only by the cache until at most gMaxUnusedCachedMeshes remain.
+static void TrimMeshCache()
+{
+    unsigned unusedCount = 0;
+
+    for (const auto& entry : gMeshCache)
     {
-        if (gMeshCache[ i ].path == path)
+        if (entry.second.data.use_count() == 1)
         {
-            gMeshCache.erase( std::begin( gMeshCache ) + i );
-            break;
+            ++unusedCount;
+        }
+    }
+
+    for (auto path = std::begin( gMeshCacheLru ); path != std::end( gMeshCacheLru ) && unusedCount > gMaxUnusedCachedMeshes;)
+    {
+        auto entry = gMeshCache.find( *path );
+
+        if (entry->second.data.use_count() == 1)
+        {
+            gMeshCache.erase( entry );
+            path = gMeshCacheLru.erase( path );
+            --unusedCount;
+        }
+        else
+        {
+            ++path;
         }
     }
+}
+
+void MeshReload( const std::string& path )
+{
+    // Invalidates cache
+    EraseFromCache( path );
     
     for (auto instance : gMeshInstances)
     {
         if (instance->GetPath() == path)
         {
-            instance->Load( FileSystem::FileContents( path.c_str() ) );
+            instance->Load( path.c_str() );
         }
     }
 }
@@ -109,6 +332,17 @@ ae3d::Mesh::Mesh()
 
 ae3d::Mesh::~Mesh()
 {
+    RemovePendingLoad( this );
+
+    for (std::size_t i = 0; i < gMeshInstances.size(); ++i)
+    {
+        if (gMeshInstances[ i ] == this)
+        {
+            gMeshInstances.erase( std::begin( gMeshInstances ) + i );
+            break;
+        }
+    }
+
     reinterpret_cast< Impl* >(&_storage)->~Impl();
 }
 
@@ -125,56 +359,55 @@ ae3d::Mesh& ae3d::Mesh::operator=( const Mesh& other )
         return *this;
     }
 
-    new(&_storage)Impl();
     reinterpret_cast<Impl&>(_storage) = reinterpret_cast<Impl const&>(other._storage);
     return *this;
 }
 
 const char* ae3d::Mesh::GetPath() const
 {
-    return m().path.c_str();
+    return m().data->path.c_str();
 }
 
 const Vec3& ae3d::Mesh::GetAABBMin() const
 {
-    return m().aabbMin;
+    return m().data->aabbMin;
 }
 
 const Vec3& ae3d::Mesh::GetAABBMax() const
 {
-    return m().aabbMax;
+    return m().data->aabbMax;
 }
 
 const Vec3& ae3d::Mesh::GetSubMeshAABBMin( unsigned subMeshIndex ) const
 {
-    return m().subMeshes[ subMeshIndex < m().subMeshes.size() ? subMeshIndex : 0 ].aabbMin;
+    return m().data->subMeshes[ subMeshIndex < m().data->subMeshes.size() ? subMeshIndex : 0 ].aabbMin;
 }
 
 const Vec3& ae3d::Mesh::GetSubMeshAABBMax( unsigned subMeshIndex ) const
 {
-    return m().subMeshes[ subMeshIndex < m().subMeshes.size() ? subMeshIndex : 0 ].aabbMax;
+    return m().data->subMeshes[ subMeshIndex < m().data->subMeshes.size() ? subMeshIndex : 0 ].aabbMax;
 }
 
 const char* ae3d::Mesh::GetSubMeshName( unsigned index ) const
 {
-    return m().subMeshes[ index < m().subMeshes.size() ? index : 0 ].name.c_str();
+    return m().data->subMeshes[ index < m().data->subMeshes.size() ? index : 0 ].name.c_str();
 }
 
 ae3d::SubMesh* ae3d::Mesh::GetSubMeshes( int& outCount )
 {
-	outCount = (int)m().subMeshes.size();
-    return m().subMeshes.data();
+	outCount = (int)m().data->subMeshes.size();
+    return m().data->subMeshes.data();
 }
 
 void ae3d::Mesh::GetSubMeshFlattenedTriangles( unsigned subMeshIndex, Array< Vec3 >& outTriangles ) const
 {
-    if (subMeshIndex >= m().subMeshes.size())
+    if (subMeshIndex >= m().data->subMeshes.size())
     {
         System::Print( "Invalid submesh index in GetSubMeshFlattenedTriangles\n" );
         return;
     }
     
-    auto& subMesh = m().subMeshes[ subMeshIndex ];
+    auto& subMesh = m().data->subMeshes[ subMeshIndex ];
     const int faceCount = subMesh.vertexBuffer.GetFaceCount();
     outTriangles.Allocate( faceCount * 3 );
     
@@ -198,248 +431,1047 @@ void ae3d::Mesh::GetSubMeshFlattenedTriangles( unsigned subMeshIndex, Array< Vec
             outTriangles[ faceIndex * 3 + 2 ] = subMesh.verticesPTN.at( face.c ).position;
         }
     }
+    else if (!subMesh.verticesPTNTC_Compact.empty())
+    {
+        for (int faceIndex = 0; faceIndex < faceCount / 3; ++faceIndex)
+        {
+            const auto& face = subMesh.indices[ faceIndex ];
+            outTriangles[ faceIndex * 3 + 0 ] = DequantizePosition( subMesh.verticesPTNTC_Compact.at( face.a ).position, subMesh.positionDequantization );
+            outTriangles[ faceIndex * 3 + 1 ] = DequantizePosition( subMesh.verticesPTNTC_Compact.at( face.b ).position, subMesh.positionDequantization );
+            outTriangles[ faceIndex * 3 + 2 ] = DequantizePosition( subMesh.verticesPTNTC_Compact.at( face.c ).position, subMesh.positionDequantization );
+        }
+    }
     else
     {
         System::Print("Empty vertex data in subMesh!\n");
     }
 }
 
-unsigned ae3d::Mesh::GetSubMeshCount() const
+bool ae3d::Mesh::AppendToStaticBatch( unsigned batchIndex, const Mesh& source, unsigned sourceSubMeshIndex, const Matrix44& localToWorld )
 {
-    return (unsigned)m().subMeshes.size();
-}
+    const SubMesh& subMesh = source.m().data->subMeshes[ sourceSubMeshIndex ];
 
-ae3d::Mesh::LoadResult ae3d::Mesh::Load( const FileSystem::FileContentsData& meshData )
-{
-    for (const auto& entry : gMeshCache)
+    if (!subMesh.joints.empty() || !subMesh.verticesPTNTC_Compact_Skinned.empty() || subMesh.GetVertexCount() == 0)
     {
-        if (entry.path == meshData.path)
-        {
-            m().aabbMin = entry.aabbMin;
-            m().aabbMax = entry.aabbMax;
-            m().subMeshes = entry.subMeshes;
-            m().path = entry.path;
-
-            AddUniqueInstance( this );
-            
-            return LoadResult::Success;
-        }
+        return false;
     }
-    
-    if (!meshData.isLoaded)
+
+    if (m().data.use_count() > 1)
     {
-        const float s = 1;
-        
-        const VertexBuffer::VertexPTC vertices[ 8 ] =
-        {
-            { Vec3( -s, -s, s ), 0, 0 },
-            { Vec3( s, -s, s ), 0, 0 },
-            { Vec3( s, -s, -s ), 0, 0 },
-            { Vec3( -s, -s, -s ), 0, 0 },
-            { Vec3( -s, s, s ), 0, 0 },
-            { Vec3( s, s, s ), 0, 0 },
-            { Vec3( s, s, -s ), 0, 0 },
-            { Vec3( -s, s, -s ), 0, 0 }
-        };
-        
-        const VertexBuffer::Face indices[ 12 ] =
-        {
-            { 0, 4, 1 },
-            { 4, 5, 1 },
-            { 1, 5, 2 },
-            { 2, 5, 6 },
-            { 2, 6, 3 },
-            { 3, 6, 7 },
-            { 3, 7, 0 },
-            { 0, 7, 4 },
-            { 4, 7, 5 },
-            { 5, 7, 6 },
-            { 3, 0, 2 },
-            { 2, 0, 1 }
-        };
-        
-        m().subMeshes.resize( 1 );
-        auto& firstSubMesh = m().subMeshes[ 0 ];
-        firstSubMesh.vertexBuffer.Generate( indices, 12, vertices, 8, VertexBuffer::Storage::GPU );
-        firstSubMesh.vertexBuffer.SetDebugName( "default mesh" );
-        firstSubMesh.aabbMin = {-s, -s, -s};
-        firstSubMesh.aabbMax = { s,  s, s };
-        return LoadResult::FileNotFound;
+        m().data = std::make_shared< MeshData >( m().data );
     }
-    
-    uint8_t magic[ 2 ];
-
-    imemstream is( (const char*)meshData.data.data(), meshData.data.size() );
-    is.read( (char*)&magic[ 0 ], sizeof( magic ) );
 
-    if (magic[ 0 ] != 'a' || magic[ 1 ] != '9')
+    if (batchIndex >= m().data->subMeshes.size())
     {
-        System::Print( "%s is corrupted or old format: Wrong magic number!\n", meshData.path.c_str() );
-        return LoadResult::Corrupted;
+        m().data->subMeshes.resize( batchIndex + 1 );
     }
 
-    is.read( (char*)&m().aabbMin, sizeof( m().aabbMin ) );
-    is.read( (char*)&m().aabbMax, sizeof( m().aabbMax ) );
-
-    const auto& aabbMin = m().aabbMin;
-    const auto& aabbMax = m().aabbMax;
-
-    if (aabbMin.x > aabbMax.x || aabbMin.y > aabbMax.y || aabbMin.z > aabbMax.z)
+    // The batch is regenerated by FinishStaticBatch(), so it gets its own buffer instead of replacing the shared one.
+    if (m().data->IsBufferShared( batchIndex ))
     {
-        return LoadResult::Corrupted;
+        m().data->subMeshes[ batchIndex ].vertexBuffer = VertexBuffer();
+        m().data->isBufferShared[ batchIndex ] = false;
     }
-    
-    uint16_t meshCount;
-    is.read( (char*)&meshCount, sizeof( meshCount ) );
 
-    m().subMeshes.clear();
-    m().subMeshes.resize( meshCount );
+    SubMesh& batch = m().data->subMeshes[ batchIndex ];
+    const unsigned baseVertex = (unsigned)batch.verticesPTNTC.size();
+    const std::size_t vertexCount = subMesh.GetVertexCount();
+    batch.verticesPTNTC.resize( baseVertex + vertexCount );
 
-    for (auto& subMesh : m().subMeshes)
+    for (std::size_t v = 0; v < vertexCount; ++v)
     {
-        is.read( (char*)&subMesh.aabbMin, sizeof( subMesh.aabbMin ) );
-        is.read( (char*)&subMesh.aabbMax, sizeof( subMesh.aabbMax ) );
-
-        uint16_t nameLength = 0;
-        is.read( (char*)&nameLength, sizeof( nameLength ) );
-
-        std::vector< char > meshName( nameLength + 1 );
-        is.read( &meshName[ 0 ], nameLength );
-        subMesh.name = std::string( meshName.data(), meshName.size() - 1 );
-
-        uint16_t vertexCount = 0;
-        is.read( (char*)&vertexCount, sizeof( vertexCount ) );
+        VertexBuffer::VertexPTNTC& out = batch.verticesPTNTC[ baseVertex + v ];
 
-        uint8_t vertexFormat = 0;
-        is.read( (char*)&vertexFormat, sizeof( vertexFormat ) );
-        
-        if (vertexFormat == 0) // PTNTC
-        {
-            try { subMesh.verticesPTNTC.resize( vertexCount ); }
-            catch (std::bad_alloc&)
-            {
-                return LoadResult::OutOfMemory;
-            }
-        
-            is.read( (char*)&subMesh.verticesPTNTC[ 0 ].position.x, vertexCount * sizeof( VertexBuffer::VertexPTNTC ) );
-        }
-        else if (vertexFormat == 1) // PTN
+        if (!subMesh.verticesPTNTC.empty())
         {
-            try { subMesh.verticesPTN.resize( vertexCount ); }
-            catch (std::bad_alloc&)
-            {
-                return LoadResult::OutOfMemory;
-            }
-            
-            is.read( (char*)&subMesh.verticesPTN[ 0 ].position.x, vertexCount * sizeof( VertexBuffer::VertexPTN ) );
+            out = subMesh.verticesPTNTC[ v ];
         }
-        else if (vertexFormat == 2) // PTNTC_Skinned
+        else if (!subMesh.verticesPTN.empty())
         {
-            try { subMesh.verticesPTNTC_Skinned.resize( vertexCount ); }
-            catch (std::bad_alloc&)
-            {
-                return LoadResult::OutOfMemory;
-            }
-            
-            is.read( (char*)&subMesh.verticesPTNTC_Skinned[ 0 ].position.x, vertexCount * sizeof( VertexBuffer::VertexPTNTC_Skinned ) );
+            const VertexBuffer::VertexPTN& in = subMesh.verticesPTN[ v ];
+            out.position = in.position;
+            out.u = in.u;
+            out.v = in.v;
+            out.normal = in.normal;
+            out.tangent = Vec4( 1, 0, 0, 1 );
+            out.color = Vec4( 1, 1, 1, 1 );
         }
         else
         {
-            System::Print( "Mesh %s submesh %s has invalid vertex format %d. Only 0, 1 and 2 are valid!\n", meshData.path.c_str(), subMesh.name.c_str(), vertexFormat );
-            return LoadResult::Corrupted;
+            const VertexBuffer::VertexPTNTC_Compact& in = subMesh.verticesPTNTC_Compact[ v ];
+            out.position = DequantizePosition( in.position, subMesh.positionDequantization );
+            out.u = MathUtil::HalfToFloat( in.uv[ 0 ] );
+            out.v = MathUtil::HalfToFloat( in.uv[ 1 ] );
+            out.normal = Vec3( in.normal[ 0 ], in.normal[ 1 ], in.normal[ 2 ] ) * (1.0f / 127.0f);
+            out.tangent = Vec4( in.tangent[ 0 ], in.tangent[ 1 ], in.tangent[ 2 ], in.tangent[ 3 ] ) * (1.0f / 127.0f);
+            out.color = Vec4( in.color[ 0 ], in.color[ 1 ], in.color[ 2 ], in.color[ 3 ] ) * (1.0f / 255.0f);
         }
+    }
 
-        uint16_t faceCount = 0;
-        is.read( (char*)&faceCount, sizeof( faceCount ) );
+    Matrix44 normalMatrix;
+    Matrix44::InverseTranspose( &localToWorld.m[ 0 ], &normalMatrix.m[ 0 ] );
 
-        try { subMesh.indices.resize( faceCount ); }
-        catch (std::bad_alloc&)
-        {
-            return LoadResult::OutOfMemory;
-        }
+    // A mirroring transform flips winding and tangent-space handedness.
+    const float* t = &localToWorld.m[ 0 ];
+    const float determinant = t[ 0 ] * (t[ 5 ] * t[ 10 ] - t[ 6 ] * t[ 9 ]) - t[ 1 ] * (t[ 4 ] * t[ 10 ] - t[ 6 ] * t[ 8 ]) + t[ 2 ] * (t[ 4 ] * t[ 9 ] - t[ 5 ] * t[ 8 ]);
+    const bool isMirrored = determinant < 0;
+
+    for (std::size_t v = baseVertex; v < batch.verticesPTNTC.size(); ++v)
+    {
+        VertexBuffer::VertexPTNTC& vertex = batch.verticesPTNTC[ v ];
+        Matrix44::TransformPoint( vertex.position, localToWorld, &vertex.position );
+        Matrix44::TransformDirection( vertex.normal, normalMatrix, &vertex.normal );
+        vertex.normal = vertex.normal.Normalized();
 
-        is.read( (char*)&subMesh.indices[ 0 ], faceCount * sizeof( VertexBuffer::Face ) );
+        Vec3 tangent( vertex.tangent.x, vertex.tangent.y, vertex.tangent.z );
+        Matrix44::TransformDirection( tangent, localToWorld, &tangent );
+        tangent = tangent.Normalized();
+        vertex.tangent = Vec4( tangent.x, tangent.y, tangent.z, isMirrored ? -vertex.tangent.w : vertex.tangent.w );
+    }
 
-        if (vertexFormat == 0)
-        {
-            subMesh.vertexBuffer.Generate( subMesh.indices.data(), static_cast< int >( subMesh.indices.size() ), subMesh.verticesPTNTC.data(), static_cast< int >( subMesh.verticesPTNTC.size() ) );
-        }
-        else if (vertexFormat == 1)
-        {
-            subMesh.vertexBuffer.Generate( subMesh.indices.data(), static_cast< int >( subMesh.indices.size() ), subMesh.verticesPTN.data(), static_cast< int >( subMesh.verticesPTN.size() ) );
-        }
-        else if (vertexFormat == 2)
+    for (const auto& face : subMesh.indices)
+    {
+        if (isMirrored)
         {
-            subMesh.vertexBuffer.Generate( subMesh.indices.data(), static_cast< int >( subMesh.indices.size() ), subMesh.verticesPTNTC_Skinned.data(), static_cast< int >( subMesh.verticesPTNTC_Skinned.size() ) );
+            batch.indices.push_back( VertexBuffer::Face( baseVertex + face.a, baseVertex + face.c, baseVertex + face.b ) );
         }
         else
         {
-            ae3d::System::Assert( false, "unhandled vertex format" );
+            batch.indices.push_back( VertexBuffer::Face( baseVertex + face.a, baseVertex + face.b, baseVertex + face.c ) );
         }
+    }
 
-        if (vertexFormat == 2)
-        {
-            uint16_t jointCount = 0;
-            is.read( (char*)&jointCount, sizeof( jointCount ) );
+    return true;
+}
 
-            System::Assert( jointCount < 80, "Joint array in PerObjectUboStruct is too small!" );
+void ae3d::Mesh::FinishStaticBatch( const char* name )
+{
+    m().data->path = name;
+    bool isFirstAabb = true;
 
-            subMesh.joints.resize( jointCount );
-            
-            for (size_t j = 0; j < subMesh.joints.size(); ++j)
-            {
-                is.read( (char*)&subMesh.joints[ j ].globalBindposeInverse, sizeof( ae3d::Matrix44 ) );
-                is.read( (char*)&subMesh.joints[ j ].parentIndex, 4 );
-                int jointNameLength;
-                is.read( (char*)&jointNameLength, sizeof( int ) );
-                
-                if (jointNameLength > 128)
-                {
-                    System::Print( "Mesh %s has a joint with too long name, max is 128.\n", meshData.path.c_str() );
-                    return LoadResult::Corrupted;
-                }
+    for (std::size_t i = 0; i < m().data->subMeshes.size(); ++i)
+    {
+        SubMesh& batch = m().data->subMeshes[ i ];
 
-                is.read( subMesh.joints[ j ].name, jointNameLength );
-                subMesh.joints[ j ].name[ jointNameLength ] = 0;
-                int animLength;
-                is.read( (char*)&animLength, sizeof( int ) );
-                subMesh.joints[ j ].animTransforms.resize( animLength );
-                is.read( (char*)subMesh.joints[ j ].animTransforms.data(), subMesh.joints[ j ].animTransforms.size() * sizeof( ae3d::Matrix44 ) );
-            }
+        if (batch.verticesPTNTC.empty())
+        {
+            continue;
         }
-        
-        const std::size_t pos = meshData.path.find_last_of( '/' );
-        std::string shortPath = meshData.path;
-        
-        if (pos != std::string::npos)
+
+        batch.aabbMin = batch.verticesPTNTC[ 0 ].position;
+        batch.aabbMax = batch.verticesPTNTC[ 0 ].position;
+
+        for (const auto& vertex : batch.verticesPTNTC)
         {
-            shortPath = meshData.path.substr( pos );
+            batch.aabbMin = Vec3::Min2( batch.aabbMin, vertex.position );
+            batch.aabbMax = Vec3::Max2( batch.aabbMax, vertex.position );
         }
 
-        std::string subMeshDebugName = shortPath + std::string( ":" ) + subMesh.name;
-        subMesh.vertexBuffer.SetDebugName( subMeshDebugName.c_str() );
+        m().data->aabbMin = isFirstAabb ? batch.aabbMin : Vec3::Min2( m().data->aabbMin, batch.aabbMin );
+        m().data->aabbMax = isFirstAabb ? batch.aabbMax : Vec3::Max2( m().data->aabbMax, batch.aabbMax );
+        isFirstAabb = false;
+
+        batch.name = std::string( "chunk" ) + std::to_string( i );
+        batch.vertexBuffer.Generate( batch.indices.data(), static_cast< int >( batch.indices.size() ), batch.verticesPTNTC.data(), static_cast< int >( batch.verticesPTNTC.size() ) );
+
+        const std::string debugName = std::string( name ) + std::string( ":" ) + batch.name;
+        batch.vertexBuffer.SetDebugName( debugName.c_str() );
     }
-    
-    uint8_t terminator = 0;
-    is.read( (char*)&terminator, sizeof( terminator ) );
+}
 
-    if (terminator != 100)
+unsigned ae3d::Mesh::GetSubMeshCount() const
+{
+    return (unsigned)m().data->subMeshes.size();
+}
+
+void ae3d::Mesh::SetKeepCpuData( bool keep )
+{
+    m().keepCpuData = keep;
+}
+
+void ae3d::Mesh::SetCacheCapacity( unsigned unusedMeshCount )
+{
+    gMaxUnusedCachedMeshes = unusedMeshCount;
+    TrimMeshCache();
+}
+
+void ae3d::Mesh::EvictFromCache( const char* path )
+{
+    EraseFromCache( path );
+}
+
+bool ae3d::Mesh::LoadFromCache( const std::string& path )
+{
+    auto entry = gMeshCache.find( path );
+
+    if (entry == std::end( gMeshCache ))
     {
-        return LoadResult::Corrupted;
+        return false;
+    }
+
+    const std::vector< SubMesh >& cachedSubMeshes = entry->second.data->subMeshes;
+
+    // An entry loaded without CPU data can't serve a mesh that needs it.
+    if (m().keepCpuData && !cachedSubMeshes.empty() && cachedSubMeshes[ 0 ].GetVertexCount() == 0)
+    {
+        return false;
     }
 
-    MeshCacheEntry cacheEntry;
-    cacheEntry.path = meshData.path;
-    cacheEntry.aabbMin = m().aabbMin;
-    cacheEntry.aabbMax = m().aabbMax;
-    cacheEntry.subMeshes = m().subMeshes;
-    gMeshCache.push_back( cacheEntry );
+    m().data = entry->second.data;
+    gMeshCacheLru.splice( std::end( gMeshCacheLru ), gMeshCacheLru, entry->second.lruPosition );
 
     AddUniqueInstance( this );
 
-    fileWatcher.AddFile( meshData.path, MeshReload );
-    
-    m().path = meshData.path;
-    
-    return LoadResult::Success;
+    return true;
+}
+
+void ae3d::Mesh::FinishLoad( const std::string& path )
+{
+    m().data->path = path;
+
+    auto entry = gMeshCache.insert( std::make_pair( path, MeshCacheEntry() ) );
+
+    if (entry.second)
+    {
+        entry.first->second.lruPosition = gMeshCacheLru.insert( std::end( gMeshCacheLru ), path );
+    }
+    else
+    {
+        gMeshCacheLru.splice( std::end( gMeshCacheLru ), gMeshCacheLru, entry.first->second.lruPosition );
+    }
+
+    entry.first->second.data = m().data;
+    TrimMeshCache();
+
+    AddUniqueInstance( this );
+
+    fileWatcher.AddFile( path, MeshReload );
+}
+
+ae3d::Mesh::LoadResult ae3d::Mesh::Load( const char* path )
+{
+    RemovePendingLoad( this );
+
+    if (LoadFromCache( path ))
+    {
+        return LoadResult::Success;
+    }
+
+    FileSystem::MappedFile file;
+    FileSystem::MapFile( path, file );
+
+    // Cached meshes and the file watcher use the resolved path, like Load( const FileSystem::FileContentsData& ).
+    if (file.path != path && LoadFromCache( file.path ))
+    {
+        FileSystem::UnmapFile( file );
+        return LoadResult::Success;
+    }
+
+    if (file.data != nullptr && file.size >= 2 && file.data[ 0 ] == 'c' && file.data[ 1 ] == '0')
+    {
+        const LoadResult result = LoadPacked( file.data, file.size, file.path );
+        FileSystem::UnmapFile( file );
+        return result;
+    }
+
+    FileSystem::FileContentsData meshData;
+    meshData.path = file.path;
+    meshData.isLoaded = file.data != nullptr;
+
+    if (file.data != nullptr)
+    {
+        meshData.data.assign( file.data, file.data + file.size );
+    }
+
+    FileSystem::UnmapFile( file );
+    return Load( meshData );
+}
+
+/// Vertex format and depth streams of a parsed submesh. Only needed until the submesh is uploaded.
+struct SubMeshUpload
+{
+    uint8_t vertexFormat = 0;
+    std::vector< Vec3 > depthPositions;
+    std::vector< VertexBuffer::VertexPN > depthPositionsNormals;
+    std::vector< VertexBuffer::VertexP_Compact > depthPositionsCompact;
+    std::vector< VertexBuffer::VertexPN_Compact > depthPositionsNormalsCompact;
+};
+
+/// \return Cube mesh that is used when a mesh file could not be loaded and while a mesh is loaded asynchronously.
+static std::shared_ptr< MeshData > GetDefaultMeshData()
+{
+    static std::shared_ptr< MeshData > data;
+
+    if (data)
+    {
+        return data;
+    }
+
+    data = std::make_shared< MeshData >();
+    const float s = 1;
+    
+    const VertexBuffer::VertexPTC vertices[ 8 ] =
+    {
+        { Vec3( -s, -s, s ), 0, 0 },
+        { Vec3( s, -s, s ), 0, 0 },
+        { Vec3( s, -s, -s ), 0, 0 },
+        { Vec3( -s, -s, -s ), 0, 0 },
+        { Vec3( -s, s, s ), 0, 0 },
+        { Vec3( s, s, s ), 0, 0 },
+        { Vec3( s, s, -s ), 0, 0 },
+        { Vec3( -s, s, -s ), 0, 0 }
+    };
+    
+    const VertexBuffer::Face indices[ 12 ] =
+    {
+        { 0, 4, 1 },
+        { 4, 5, 1 },
+        { 1, 5, 2 },
+        { 2, 5, 6 },
+        { 2, 6, 3 },
+        { 3, 6, 7 },
+        { 3, 7, 0 },
+        { 0, 7, 4 },
+        { 4, 7, 5 },
+        { 5, 7, 6 },
+        { 3, 0, 2 },
+        { 2, 0, 1 }
+    };
+    
+    data->subMeshes.resize( 1 );
+    auto& firstSubMesh = data->subMeshes[ 0 ];
+    firstSubMesh.vertexBuffer.Generate( indices, 12, vertices, 8, VertexBuffer::Storage::GPU );
+    firstSubMesh.vertexBuffer.SetDebugName( "default mesh" );
+    firstSubMesh.aabbMin = {-s, -s, -s};
+    firstSubMesh.aabbMax = { s,  s, s };
+    return data;
+}
+
+/// Reads a vertex stream. In version b2 it's compressed and prefixed with its encoded size.
+/// \return false if the stream is corrupted.
+static bool ReadVertexStream( imemstream& is, void* destination, std::size_t vertexCount, std::size_t vertexSize, bool isCompressed )
+{
+    if (!isCompressed)
+    {
+        is.read( (char*)destination, vertexCount * vertexSize );
+        return true;
+    }
+
+    uint32_t encodedSize = 0;
+    is.read( (char*)&encodedSize, sizeof( encodedSize ) );
+
+    if (!is || encodedSize > is.Remaining())
+    {
+        return false;
+    }
+
+    const bool isDecoded = MeshCodec::DecodeVertexBuffer( destination, vertexCount, vertexSize, is.Current(), encodedSize );
+    is.Skip( encodedSize );
+    return isDecoded;
+}
+
+/// Reads a face stream. In version b2 it's compressed and prefixed with its encoded size.
+/// \return false if the stream is corrupted.
+static bool ReadFaceStream( imemstream& is, std::vector< VertexBuffer::Face >& faces, uint8_t indexSize, uint32_t vertexCount, bool isCompressed )
+{
+    std::vector< uint32_t > indices;
+
+    if (isCompressed)
+    {
+        uint32_t encodedSize = 0;
+        is.read( (char*)&encodedSize, sizeof( encodedSize ) );
+
+        if (!is || encodedSize > is.Remaining())
+        {
+            return false;
+        }
+
+        indices.resize( faces.size() * 3 );
+        const bool isDecoded = MeshCodec::DecodeIndexBuffer( indices.data(), indices.size(), vertexCount, is.Current(), encodedSize );
+        is.Skip( encodedSize );
+
+        if (!isDecoded)
+        {
+            return false;
+        }
+
+        for (std::size_t f = 0; f < faces.size(); ++f)
+        {
+            faces[ f ] = VertexBuffer::Face( indices[ f * 3 + 0 ], indices[ f * 3 + 1 ], indices[ f * 3 + 2 ] );
+        }
+    }
+    else if (indexSize == 4)
+    {
+        is.read( (char*)faces.data(), faces.size() * sizeof( VertexBuffer::Face ) );
+    }
+    else
+    {
+        std::vector< uint16_t > indices16( faces.size() * 3 );
+        is.read( (char*)indices16.data(), indices16.size() * sizeof( uint16_t ) );
+
+        for (std::size_t f = 0; f < faces.size(); ++f)
+        {
+            faces[ f ] = VertexBuffer::Face( indices16[ f * 3 + 0 ], indices16[ f * 3 + 1 ], indices16[ f * 3 + 2 ] );
+        }
+    }
+
+    return true;
+}
+
+/// Parses a .ae3d file of version a9, b0, b1 or b2 into CPU-side arrays without using graphics APIs, so it can run on a loader thread.
+static Mesh::LoadResult ParseMesh( const FileSystem::FileContentsData& meshData, MeshData& data, std::vector< SubMeshUpload >& outUploads )
+{
+    uint8_t magic[ 2 ];
+
+    imemstream is( (const char*)meshData.data.data(), meshData.data.size() );
+    is.read( (char*)&magic[ 0 ], sizeof( magic ) );
+
+    // a9 has 16-bit vertex and face counts and indices, b0 has 32-bit counts and 16- or 32-bit indices,
+    // b1 adds optional depth streams after indices, b2 compresses vertex, index and depth streams.
+    const bool isVersionB2 = magic[ 0 ] == 'b' && magic[ 1 ] == '2';
+    const bool isVersionB1 = (magic[ 0 ] == 'b' && magic[ 1 ] == '1') || isVersionB2;
+    const bool isVersionB0 = (magic[ 0 ] == 'b' && magic[ 1 ] == '0') || isVersionB1;
+
+    if (!isVersionB0 && (magic[ 0 ] != 'a' || magic[ 1 ] != '9'))
+    {
+        System::Print( "%s is corrupted or old format: Wrong magic number!\n", meshData.path.c_str() );
+        return Mesh::LoadResult::Corrupted;
+    }
+
+    is.read( (char*)&data.aabbMin, sizeof( data.aabbMin ) );
+    is.read( (char*)&data.aabbMax, sizeof( data.aabbMax ) );
+
+    const auto& aabbMin = data.aabbMin;
+    const auto& aabbMax = data.aabbMax;
+
+    if (aabbMin.x > aabbMax.x || aabbMin.y > aabbMax.y || aabbMin.z > aabbMax.z)
+    {
+        return Mesh::LoadResult::Corrupted;
+    }
+    
+    uint16_t meshCount;
+    is.read( (char*)&meshCount, sizeof( meshCount ) );
+
+    data.subMeshes.clear();
+    data.subMeshes.resize( meshCount );
+
+    data.path = meshData.path;
+    outUploads.clear();
+    outUploads.resize( meshCount );
+
+    for (std::size_t subMeshIndex = 0; subMeshIndex < data.subMeshes.size(); ++subMeshIndex)
+    {
+        SubMesh& subMesh = data.subMeshes[ subMeshIndex ];
+        SubMeshUpload& upload = outUploads[ subMeshIndex ];
+
+        is.read( (char*)&subMesh.aabbMin, sizeof( subMesh.aabbMin ) );
+        is.read( (char*)&subMesh.aabbMax, sizeof( subMesh.aabbMax ) );
+
+        uint16_t nameLength = 0;
+        is.read( (char*)&nameLength, sizeof( nameLength ) );
+
+        std::vector< char > meshName( nameLength + 1 );
+        is.read( &meshName[ 0 ], nameLength );
+        subMesh.name = std::string( meshName.data(), meshName.size() - 1 );
+
+        uint32_t vertexCount = 0;
+        is.read( (char*)&vertexCount, isVersionB0 ? 4 : 2 );
+
+        uint8_t& vertexFormat = upload.vertexFormat;
+        is.read( (char*)&vertexFormat, sizeof( vertexFormat ) );
+        
+        if (vertexFormat == 0) // PTNTC
+        {
+            try { subMesh.verticesPTNTC.resize( vertexCount ); }
+            catch (std::bad_alloc&)
+            {
+                return Mesh::LoadResult::OutOfMemory;
+            }
+        
+            if (!ReadVertexStream( is, subMesh.verticesPTNTC.data(), vertexCount, sizeof( VertexBuffer::VertexPTNTC ), isVersionB2 ))
+            {
+                return Mesh::LoadResult::Corrupted;
+            }
+        }
+        else if (vertexFormat == 1) // PTN
+        {
+            try { subMesh.verticesPTN.resize( vertexCount ); }
+            catch (std::bad_alloc&)
+            {
+                return Mesh::LoadResult::OutOfMemory;
+            }
+            
+            if (!ReadVertexStream( is, subMesh.verticesPTN.data(), vertexCount, sizeof( VertexBuffer::VertexPTN ), isVersionB2 ))
+            {
+                return Mesh::LoadResult::Corrupted;
+            }
+        }
+        else if (vertexFormat == 2) // PTNTC_Skinned
+        {
+            try { subMesh.verticesPTNTC_Skinned.resize( vertexCount ); }
+            catch (std::bad_alloc&)
+            {
+                return Mesh::LoadResult::OutOfMemory;
+            }
+            
+            if (!ReadVertexStream( is, subMesh.verticesPTNTC_Skinned.data(), vertexCount, sizeof( VertexBuffer::VertexPTNTC_Skinned ), isVersionB2 ))
+            {
+                return Mesh::LoadResult::Corrupted;
+            }
+        }
+        else if (vertexFormat == 3 || vertexFormat == 4) // PTNTC_Compact, PTNTC_Compact_Skinned
+        {
+            is.read( (char*)&subMesh.positionDequantization, sizeof( subMesh.positionDequantization ) );
+
+            if (!(subMesh.positionDequantization.w > 0))
+            {
+                System::Print( "Mesh %s submesh %s has invalid position range!\n", meshData.path.c_str(), subMesh.name.c_str() );
+                return Mesh::LoadResult::Corrupted;
+            }
+
+            try
+            {
+                if (vertexFormat == 3)
+                {
+                    subMesh.verticesPTNTC_Compact.resize( vertexCount );
+                }
+                else
+                {
+                    subMesh.verticesPTNTC_Compact_Skinned.resize( vertexCount );
+                }
+            }
+            catch (std::bad_alloc&)
+            {
+                return Mesh::LoadResult::OutOfMemory;
+            }
+
+            const bool isRead = vertexFormat == 3 ?
+                ReadVertexStream( is, subMesh.verticesPTNTC_Compact.data(), vertexCount, sizeof( VertexBuffer::VertexPTNTC_Compact ), isVersionB2 ) :
+                ReadVertexStream( is, subMesh.verticesPTNTC_Compact_Skinned.data(), vertexCount, sizeof( VertexBuffer::VertexPTNTC_Compact_Skinned ), isVersionB2 );
+
+            if (!isRead)
+            {
+                return Mesh::LoadResult::Corrupted;
+            }
+        }
+        else
+        {
+            System::Print( "Mesh %s submesh %s has invalid vertex format %d. Only 0-4 are valid!\n", meshData.path.c_str(), subMesh.name.c_str(), vertexFormat );
+            return Mesh::LoadResult::Corrupted;
+        }
+
+        uint32_t faceCount = 0;
+        is.read( (char*)&faceCount, isVersionB0 ? 4 : 2 );
+
+        uint8_t indexSize = 2;
+
+        if (isVersionB0)
+        {
+            is.read( (char*)&indexSize, sizeof( indexSize ) );
+        }
+
+        if (indexSize != 2 && indexSize != 4)
+        {
+            System::Print( "Mesh %s submesh %s has invalid index size %d. Only 2 and 4 are valid!\n", meshData.path.c_str(), subMesh.name.c_str(), indexSize );
+            return Mesh::LoadResult::Corrupted;
+        }
+
+        try { subMesh.indices.resize( faceCount ); }
+        catch (std::bad_alloc&)
+        {
+            return Mesh::LoadResult::OutOfMemory;
+        }
+
+        if (!ReadFaceStream( is, subMesh.indices, indexSize, vertexCount, isVersionB2 ))
+        {
+            System::Print( "Mesh %s submesh %s has corrupted faces!\n", meshData.path.c_str(), subMesh.name.c_str() );
+            return Mesh::LoadResult::Corrupted;
+        }
+
+        uint8_t hasDepthStreams = 0;
+
+        if (isVersionB1)
+        {
+            is.read( (char*)&hasDepthStreams, sizeof( hasDepthStreams ) );
+        }
+
+        if (hasDepthStreams != 0 && vertexFormat != 0 && vertexFormat != 1 && vertexFormat != 3)
+        {
+            System::Print( "Mesh %s submesh %s has depth streams in skinned vertex format %d!\n", meshData.path.c_str(), subMesh.name.c_str(), vertexFormat );
+            return Mesh::LoadResult::Corrupted;
+        }
+
+        if (hasDepthStreams != 0)
+        {
+            try
+            {
+                if (vertexFormat == 3)
+                {
+                    upload.depthPositionsCompact.resize( vertexCount );
+                    upload.depthPositionsNormalsCompact.resize( vertexCount );
+                }
+                else
+                {
+                    upload.depthPositions.resize( vertexCount );
+                    upload.depthPositionsNormals.resize( vertexCount );
+                }
+            }
+            catch (std::bad_alloc&)
+            {
+                return Mesh::LoadResult::OutOfMemory;
+            }
+
+            const bool isRead = vertexFormat == 3 ?
+                ReadVertexStream( is, upload.depthPositionsCompact.data(), vertexCount, sizeof( VertexBuffer::VertexP_Compact ), isVersionB2 ) &&
+                ReadVertexStream( is, upload.depthPositionsNormalsCompact.data(), vertexCount, sizeof( VertexBuffer::VertexPN_Compact ), isVersionB2 ) :
+                ReadVertexStream( is, upload.depthPositions.data(), vertexCount, sizeof( Vec3 ), isVersionB2 ) &&
+                ReadVertexStream( is, upload.depthPositionsNormals.data(), vertexCount, sizeof( VertexBuffer::VertexPN ), isVersionB2 );
+
+            if (!isRead)
+            {
+                return Mesh::LoadResult::Corrupted;
+            }
+        }
+
+        if ((vertexFormat == 2 || vertexFormat == 4) && !ReadJoints( is, subMesh, meshData.path ))
+        {
+            return Mesh::LoadResult::Corrupted;
+        }
+
+    }
+    
+    uint8_t terminator = 0;
+    is.read( (char*)&terminator, sizeof( terminator ) );
+
+    if (terminator != 100)
+    {
+        return Mesh::LoadResult::Corrupted;
+    }
+
+    return Mesh::LoadResult::Success;
+}
+
+/// State of an async load that is shared between the loader thread and the finishing render thread.
+struct PendingMeshLoad
+{
+    std::string path;
+    FileSystem::FileContentsData fileContents;
+    std::shared_ptr< MeshData > data;
+    std::vector< SubMeshUpload > uploads;
+    Mesh::LoadResult result = Mesh::LoadResult::Success;
+    bool isPacked = false;
+};
+
+/// Generates vertex buffers of a mesh parsed by ParseMesh().
+static void UploadMeshData( MeshData& data, const std::vector< SubMeshUpload >& uploads, bool keepCpuData )
+{
+    for (std::size_t subMeshIndex = 0; subMeshIndex < data.subMeshes.size(); ++subMeshIndex)
+    {
+        SubMesh& subMesh = data.subMeshes[ subMeshIndex ];
+        const SubMeshUpload& upload = uploads[ subMeshIndex ];
+
+        if (upload.vertexFormat == 0)
+        {
+            subMesh.vertexBuffer.Generate( subMesh.indices.data(), static_cast< int >( subMesh.indices.size() ), subMesh.verticesPTNTC.data(), static_cast< int >( subMesh.verticesPTNTC.size() ) );
+        }
+        else if (upload.vertexFormat == 1)
+        {
+            subMesh.vertexBuffer.Generate( subMesh.indices.data(), static_cast< int >( subMesh.indices.size() ), subMesh.verticesPTN.data(), static_cast< int >( subMesh.verticesPTN.size() ) );
+        }
+        else if (upload.vertexFormat == 2)
+        {
+            subMesh.vertexBuffer.Generate( subMesh.indices.data(), static_cast< int >( subMesh.indices.size() ), subMesh.verticesPTNTC_Skinned.data(), static_cast< int >( subMesh.verticesPTNTC_Skinned.size() ) );
+        }
+        else if (upload.vertexFormat == 3 || upload.vertexFormat == 4)
+        {
+            const Vec3 positionOffset( subMesh.positionDequantization.x, subMesh.positionDequantization.y, subMesh.positionDequantization.z );
+
+            if (upload.vertexFormat == 3)
+            {
+                subMesh.vertexBuffer.Generate( subMesh.indices.data(), static_cast< int >( subMesh.indices.size() ), subMesh.verticesPTNTC_Compact.data(),
+                                               static_cast< int >( subMesh.verticesPTNTC_Compact.size() ), positionOffset, subMesh.positionDequantization.w );
+            }
+            else
+            {
+                subMesh.vertexBuffer.Generate( subMesh.indices.data(), static_cast< int >( subMesh.indices.size() ), subMesh.verticesPTNTC_Compact_Skinned.data(),
+                                               static_cast< int >( subMesh.verticesPTNTC_Compact_Skinned.size() ), positionOffset, subMesh.positionDequantization.w );
+            }
+        }
+        else
+        {
+            ae3d::System::Assert( false, "unhandled vertex format" );
+        }
+
+        if (!upload.depthPositions.empty())
+        {
+            subMesh.vertexBuffer.GenerateDepthStreams( upload.depthPositions.data(), upload.depthPositionsNormals.data(), static_cast< int >( subMesh.GetVertexCount() ) );
+        }
+        else if (!upload.depthPositionsCompact.empty())
+        {
+            subMesh.vertexBuffer.GenerateDepthStreams( upload.depthPositionsCompact.data(), upload.depthPositionsNormalsCompact.data(), static_cast< int >( subMesh.GetVertexCount() ) );
+        }
+
+        if (!keepCpuData)
+        {
+            ReleaseCpuData( subMesh );
+        }
+
+        SetSubMeshDebugName( subMesh, data.path );
+    }
+}
+
+ae3d::Mesh::LoadResult ae3d::Mesh::Load( const FileSystem::FileContentsData& meshData )
+{
+    RemovePendingLoad( this );
+
+    if (LoadFromCache( meshData.path ))
+    {
+        return LoadResult::Success;
+    }
+
+    if (!meshData.isLoaded)
+    {
+        m().data = GetDefaultMeshData();
+        return LoadResult::FileNotFound;
+    }
+    
+    if (meshData.data.size() >= 2 && meshData.data[ 0 ] == 'c' && meshData.data[ 1 ] == '0')
+    {
+        return LoadPacked( meshData.data.data(), meshData.data.size(), meshData.path );
+    }
+
+    std::shared_ptr< MeshData > data = std::make_shared< MeshData >();
+    std::vector< SubMeshUpload > uploads;
+    const LoadResult result = ParseMesh( meshData, *data, uploads );
+
+    if (result != LoadResult::Success)
+    {
+        return result;
+    }
+
+    UploadMeshData( *data, uploads, m().keepCpuData );
+    m().data = data;
+    FinishLoad( meshData.path );
+    
+    return LoadResult::Success;
+}
+
+ae3d::Mesh::LoadResult ae3d::Mesh::LoadPacked( const unsigned char* data, std::size_t size, const std::string& path )
+{
+    PackedMeshHeader header;
+
+    if (size < sizeof( header ))
+    {
+        System::Print( "%s is corrupted: file is too small!\n", path.c_str() );
+        return LoadResult::Corrupted;
+    }
+
+    std::memcpy( &header, data, sizeof( header ) );
+    // The mesh stays unchanged if the file is corrupted.
+    std::shared_ptr< MeshData > meshData = std::make_shared< MeshData >();
+
+    if (header.fileSize != size || sizeof( header ) + header.subMeshCount * sizeof( PackedSubMesh ) > size)
+    {
+        System::Print( "%s is corrupted: wrong size!\n", path.c_str() );
+        return LoadResult::Corrupted;
+    }
+
+    meshData->aabbMin = Vec3( header.aabbMin[ 0 ], header.aabbMin[ 1 ], header.aabbMin[ 2 ] );
+    meshData->aabbMax = Vec3( header.aabbMax[ 0 ], header.aabbMax[ 1 ], header.aabbMax[ 2 ] );
+
+    if (meshData->aabbMin.x > meshData->aabbMax.x || meshData->aabbMin.y > meshData->aabbMax.y || meshData->aabbMin.z > meshData->aabbMax.z)
+    {
+        return LoadResult::Corrupted;
+    }
+
+    auto isInFile = [size]( uint32_t offset, uint64_t blobSize ) { return (uint64_t)offset + blobSize <= size; };
+    auto isAligned = []( uint32_t offset ) { return (offset % 16) == 0; };
+
+    const VertexBuffer::VertexFormat vertexFormats[ 5 ] = { VertexBuffer::VertexFormat::PTNTC, VertexBuffer::VertexFormat::PTN, VertexBuffer::VertexFormat::PTNTC_Skinned,
+                                                             VertexBuffer::VertexFormat::PTNTC_Compact, VertexBuffer::VertexFormat::PTNTC_Compact_Skinned };
+
+    meshData->subMeshes.resize( header.subMeshCount );
+
+    for (std::size_t i = 0; i < meshData->subMeshes.size(); ++i)
+    {
+        PackedSubMesh entry;
+        std::memcpy( &entry, data + sizeof( header ) + i * sizeof( entry ), sizeof( entry ) );
+
+        SubMesh& subMesh = meshData->subMeshes[ i ];
+        subMesh.aabbMin = Vec3( entry.aabbMin[ 0 ], entry.aabbMin[ 1 ], entry.aabbMin[ 2 ] );
+        subMesh.aabbMax = Vec3( entry.aabbMax[ 0 ], entry.aabbMax[ 1 ], entry.aabbMax[ 2 ] );
+        subMesh.positionDequantization = Vec4( entry.positionDequantization[ 0 ], entry.positionDequantization[ 1 ], entry.positionDequantization[ 2 ], entry.positionDequantization[ 3 ] );
+
+        if (!isInFile( entry.nameOffset, entry.nameLength ))
+        {
+            return LoadResult::Corrupted;
+        }
+
+        subMesh.name = std::string( (const char*)data + entry.nameOffset, entry.nameLength );
+
+        if (entry.vertexFormat > 4)
+        {
+            System::Print( "Mesh %s submesh %s has invalid vertex format %d. Only 0-4 are valid!\n", path.c_str(), subMesh.name.c_str(), entry.vertexFormat );
+            return LoadResult::Corrupted;
+        }
+
+        const VertexBuffer::VertexFormat vertexFormat = vertexFormats[ entry.vertexFormat ];
+        const bool isCompact = vertexFormat == VertexBuffer::VertexFormat::PTNTC_Compact || vertexFormat == VertexBuffer::VertexFormat::PTNTC_Compact_Skinned;
+        const bool isSkinned = vertexFormat == VertexBuffer::VertexFormat::PTNTC_Skinned || vertexFormat == VertexBuffer::VertexFormat::PTNTC_Compact_Skinned;
+        const uint64_t vertexBlobSize = (uint64_t)entry.vertexCount * VertexBuffer::GetVertexSize( vertexFormat );
+        const uint64_t indexBlobSize = (uint64_t)entry.faceCount * 3 * entry.indexSize;
+
+        if ((entry.indexSize != 2 && entry.indexSize != 4) || (entry.indexSize == 2 && entry.vertexCount > 65536))
+        {
+            System::Print( "Mesh %s submesh %s has invalid index size %d!\n", path.c_str(), subMesh.name.c_str(), entry.indexSize );
+            return LoadResult::Corrupted;
+        }
+
+        if (!isAligned( entry.vertexOffset ) || !isAligned( entry.indexOffset ) || !isInFile( entry.vertexOffset, vertexBlobSize ) || !isInFile( entry.indexOffset, indexBlobSize ))
+        {
+            System::Print( "Mesh %s submesh %s has misaligned or truncated data!\n", path.c_str(), subMesh.name.c_str() );
+            return LoadResult::Corrupted;
+        }
+
+        if (isCompact && !(subMesh.positionDequantization.w > 0))
+        {
+            System::Print( "Mesh %s submesh %s has invalid position range!\n", path.c_str(), subMesh.name.c_str() );
+            return LoadResult::Corrupted;
+        }
+
+        const void* vertices = data + entry.vertexOffset;
+        const void* indices = data + entry.indexOffset;
+        const bool needsFaces = m().keepCpuData || vertexFormat == VertexBuffer::VertexFormat::PTN;
+
+        if (needsFaces)
+        {
+            try
+            {
+                subMesh.indices.resize( entry.faceCount );
+
+                if (vertexFormat == VertexBuffer::VertexFormat::PTNTC)
+                {
+                    subMesh.verticesPTNTC.resize( entry.vertexCount );
+                }
+                else if (vertexFormat == VertexBuffer::VertexFormat::PTN)
+                {
+                    subMesh.verticesPTN.resize( entry.vertexCount );
+                }
+                else if (vertexFormat == VertexBuffer::VertexFormat::PTNTC_Skinned)
+                {
+                    subMesh.verticesPTNTC_Skinned.resize( entry.vertexCount );
+                }
+                else if (vertexFormat == VertexBuffer::VertexFormat::PTNTC_Compact)
+                {
+                    subMesh.verticesPTNTC_Compact.resize( entry.vertexCount );
+                }
+                else
+                {
+                    subMesh.verticesPTNTC_Compact_Skinned.resize( entry.vertexCount );
+                }
+            }
+            catch (std::bad_alloc&)
+            {
+                return LoadResult::OutOfMemory;
+            }
+
+            for (uint32_t f = 0; f < entry.faceCount; ++f)
+            {
+                if (entry.indexSize == 4)
+                {
+                    const uint32_t* face = (const uint32_t*)indices + f * 3;
+                    subMesh.indices[ f ] = VertexBuffer::Face( face[ 0 ], face[ 1 ], face[ 2 ] );
+                }
+                else
+                {
+                    const uint16_t* face = (const uint16_t*)indices + f * 3;
+                    subMesh.indices[ f ] = VertexBuffer::Face( face[ 0 ], face[ 1 ], face[ 2 ] );
+                }
+            }
+
+            void* cpuVertices = subMesh.verticesPTNTC.empty() ? nullptr : (void*)subMesh.verticesPTNTC.data();
+            cpuVertices = subMesh.verticesPTN.empty() ? cpuVertices : (void*)subMesh.verticesPTN.data();
+            cpuVertices = subMesh.verticesPTNTC_Skinned.empty() ? cpuVertices : (void*)subMesh.verticesPTNTC_Skinned.data();
+            cpuVertices = subMesh.verticesPTNTC_Compact.empty() ? cpuVertices : (void*)subMesh.verticesPTNTC_Compact.data();
+            cpuVertices = subMesh.verticesPTNTC_Compact_Skinned.empty() ? cpuVertices : (void*)subMesh.verticesPTNTC_Compact_Skinned.data();
+
+            if (cpuVertices != nullptr)
+            {
+                std::memcpy( cpuVertices, vertices, (std::size_t)vertexBlobSize );
+            }
+        }
+
+        if (vertexFormat == VertexBuffer::VertexFormat::PTN)
+        {
+            // PTN is not a GPU layout on every backend, so it goes through the converting path.
+            subMesh.vertexBuffer.Generate( subMesh.indices.data(), static_cast< int >( subMesh.indices.size() ), subMesh.verticesPTN.data(), static_cast< int >( subMesh.verticesPTN.size() ) );
+        }
+        else
+        {
+            subMesh.vertexBuffer.GeneratePacked( indices, entry.indexSize == 4 ? VertexBuffer::IndexType::UInt32 : VertexBuffer::IndexType::UInt16, static_cast< int >( entry.faceCount ),
+                                                 vertices, vertexFormat, static_cast< int >( entry.vertexCount ), subMesh.positionDequantization );
+        }
+
+        if (entry.hasDepthStreams != 0)
+        {
+            if (isSkinned)
+            {
+                System::Print( "Mesh %s submesh %s has depth streams in skinned vertex format %d!\n", path.c_str(), subMesh.name.c_str(), entry.vertexFormat );
+                return LoadResult::Corrupted;
+            }
+
+            const uint64_t positionSize = (uint64_t)entry.vertexCount * (isCompact ? sizeof( VertexBuffer::VertexP_Compact ) : sizeof( Vec3 ));
+            const uint64_t positionNormalSize = (uint64_t)entry.vertexCount * (isCompact ? sizeof( VertexBuffer::VertexPN_Compact ) : sizeof( VertexBuffer::VertexPN ));
+
+            if (!isAligned( entry.positionStreamOffset ) || !isAligned( entry.positionNormalStreamOffset ) ||
+                !isInFile( entry.positionStreamOffset, positionSize ) || !isInFile( entry.positionNormalStreamOffset, positionNormalSize ))
+            {
+                System::Print( "Mesh %s submesh %s has misaligned or truncated depth streams!\n", path.c_str(), subMesh.name.c_str() );
+                return LoadResult::Corrupted;
+            }
+
+            if (isCompact)
+            {
+                subMesh.vertexBuffer.GenerateDepthStreams( (const VertexBuffer::VertexP_Compact*)(data + entry.positionStreamOffset),
+                                                           (const VertexBuffer::VertexPN_Compact*)(data + entry.positionNormalStreamOffset), static_cast< int >( entry.vertexCount ) );
+            }
+            else
+            {
+                subMesh.vertexBuffer.GenerateDepthStreams( (const Vec3*)(data + entry.positionStreamOffset),
+                                                           (const VertexBuffer::VertexPN*)(data + entry.positionNormalStreamOffset), static_cast< int >( entry.vertexCount ) );
+            }
+        }
+
+        if (isSkinned)
+        {
+            if (!isInFile( entry.jointOffset, entry.jointSize ))
+            {
+                return LoadResult::Corrupted;
+            }
+
+            imemstream is( (const char*)data + entry.jointOffset, entry.jointSize );
+
+            if (!ReadJoints( is, subMesh, path ) || !is)
+            {
+                return LoadResult::Corrupted;
+            }
+        }
+
+        if (!m().keepCpuData)
+        {
+            ReleaseCpuData( subMesh );
+        }
+
+        SetSubMeshDebugName( subMesh, path );
+    }
+
+    m().data = meshData;
+    FinishLoad( path );
+
+    return LoadResult::Success;
+}
+
+void ae3d::Mesh::LoadAsync( const char* path )
+{
+    RemovePendingLoad( this );
+
+    if (LoadFromCache( path ))
+    {
+        return;
+    }
+
+    m().data = GetDefaultMeshData();
+
+    std::vector< Mesh* >& waitingMeshes = gPendingMeshLoads[ path ];
+    waitingMeshes.push_back( this );
+
+    if (waitingMeshes.size() > 1)
+    {
+        return;
+    }
+
+    std::shared_ptr< PendingMeshLoad > load = std::make_shared< PendingMeshLoad >();
+    load->path = path;
+
+    AsyncLoad::Enqueue( [load]()
+    {
+        load->fileContents = FileSystem::FileContents( load->path.c_str() );
+        const std::vector< unsigned char >& bytes = load->fileContents.data;
+        load->isPacked = bytes.size() >= 2 && bytes[ 0 ] == 'c' && bytes[ 1 ] == '0';
+
+        if (load->fileContents.isLoaded && !load->isPacked)
+        {
+            load->data = std::make_shared< MeshData >();
+            load->result = ParseMesh( load->fileContents, *load->data, load->uploads );
+        }
+    },
+    [load]()
+    {
+        auto pending = gPendingMeshLoads.find( load->path );
+
+        if (pending == std::end( gPendingMeshLoads ))
+        {
+            return;
+        }
+
+        const std::vector< Mesh* > meshes = pending->second;
+        gPendingMeshLoads.erase( pending );
+
+        if (meshes.empty())
+        {
+            return;
+        }
+
+        Mesh* first = meshes[ 0 ];
+
+        if (!load->fileContents.isLoaded)
+        {
+            System::Print( "Could not load mesh %s\n", load->path.c_str() );
+            return;
+        }
+        else if (load->isPacked)
+        {
+            const std::vector< unsigned char >& bytes = load->fileContents.data;
+
+            if (first->LoadPacked( bytes.data(), bytes.size(), load->fileContents.path ) != LoadResult::Success)
+            {
+                return;
+            }
+        }
+        else if (load->result == LoadResult::Success)
+        {
+            UploadMeshData( *load->data, load->uploads, first->m().keepCpuData );
+            first->m().data = load->data;
+            first->FinishLoad( load->fileContents.path );
+        }
+        else
+        {
+            System::Print( "Mesh %s is corrupted.\n", load->path.c_str() );
+            return;
+        }
+
+        for (std::size_t i = 1; i < meshes.size(); ++i)
+        {
+            if (!meshes[ i ]->LoadFromCache( load->fileContents.path ))
+            {
+                meshes[ i ]->Load( load->path.c_str() );
+            }
+        }
+    } );
+}
+
+bool ae3d::Mesh::IsLoading() const
+{
+    for (const auto& pending : gPendingMeshLoads)
+    {
+        for (const Mesh* mesh : pending.second)
+        {
+            if (mesh == this)
+            {
+                return true;
+            }
+        }
+    }
+
+    return false;
 }
@@ -0,0 +1,434 @@
+// This is an independent project of an individual developer. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++, C#, and Java: http://www.viva64.com
+
+#include "MeshCodec.hpp"
+#include <cstring>
+#if defined( SIMD_SSE3 )
+#include <emmintrin.h>
+#elif defined( __ARM_NEON ) || defined( __ARM_NEON__ )
+#include <arm_neon.h>
+#define MESH_CODEC_NEON 1
+#endif
+
+static const std::size_t BlockVertexCount = 16;
+static const std::size_t MaxVertexSize = 256;
+
+/// \return Size of packed differences of a byte position in bytes.
+static std::size_t GetPackedSize( unsigned mode )
+{
+    static const std::size_t sizes[ 4 ] = { 0, 4, 8, 16 };
+    return sizes[ mode ];
+}
+
+/// \return Size of all packed differences of a block.
+static std::size_t GetBlockDataSize( const unsigned char* header, std::size_t vertexSize )
+{
+    std::size_t size = 0;
+
+    for (std::size_t k = 0; k < vertexSize; ++k)
+    {
+        size += GetPackedSize( (header[ k / 4 ] >> ((k % 4) * 2)) & 3 );
+    }
+
+    return size;
+}
+
+#if defined( SIMD_SSE3 )
+static __m128i UnpackDifferences( const unsigned char*& source, unsigned mode )
+{
+    if (mode == 0)
+    {
+        return _mm_setzero_si128();
+    }
+
+    if (mode == 1)
+    {
+        int bits;
+        std::memcpy( &bits, source, 4 );
+        source += 4;
+
+        const __m128i mask = _mm_set1_epi8( 3 );
+        const __m128i packed = _mm_cvtsi32_si128( bits );
+        const __m128i d0 = _mm_and_si128( packed, mask );
+        const __m128i d1 = _mm_and_si128( _mm_srli_epi16( packed, 2 ), mask );
+        const __m128i d2 = _mm_and_si128( _mm_srli_epi16( packed, 4 ), mask );
+        const __m128i d3 = _mm_and_si128( _mm_srli_epi16( packed, 6 ), mask );
+        return _mm_unpacklo_epi16( _mm_unpacklo_epi8( d0, d1 ), _mm_unpacklo_epi8( d2, d3 ) );
+    }
+
+    if (mode == 2)
+    {
+        const __m128i mask = _mm_set1_epi8( 15 );
+        const __m128i packed = _mm_loadl_epi64( (const __m128i*)source );
+        source += 8;
+
+        return _mm_unpacklo_epi8( _mm_and_si128( packed, mask ), _mm_and_si128( _mm_srli_epi16( packed, 4 ), mask ) );
+    }
+
+    const __m128i differences = _mm_loadu_si128( (const __m128i*)source );
+    source += 16;
+    return differences;
+}
+
+/// Unzigzags differences and adds them to the previous byte value. \return Values of the byte position in 16 vertices.
+static __m128i AccumulateDifferences( __m128i differences, unsigned char& previous )
+{
+    const __m128i sign = _mm_sub_epi8( _mm_setzero_si128(), _mm_and_si128( differences, _mm_set1_epi8( 1 ) ) );
+    __m128i values = _mm_xor_si128( _mm_and_si128( _mm_srli_epi16( differences, 1 ), _mm_set1_epi8( 127 ) ), sign );
+
+    values = _mm_add_epi8( values, _mm_slli_si128( values, 1 ) );
+    values = _mm_add_epi8( values, _mm_slli_si128( values, 2 ) );
+    values = _mm_add_epi8( values, _mm_slli_si128( values, 4 ) );
+    values = _mm_add_epi8( values, _mm_slli_si128( values, 8 ) );
+    values = _mm_add_epi8( values, _mm_set1_epi8( (char)previous ) );
+
+    previous = (unsigned char)(_mm_cvtsi128_si32( _mm_srli_si128( values, 12 ) ) >> 24);
+    return values;
+}
+
+static void StoreWords( unsigned char* destination, std::size_t vertexSize, __m128i words )
+{
+    for (int v = 0; v < 4; ++v)
+    {
+        const int word = _mm_cvtsi128_si32( words );
+        std::memcpy( destination + v * vertexSize, &word, 4 );
+        words = _mm_srli_si128( words, 4 );
+    }
+}
+
+static void DecodeBlock( const unsigned char* header, const unsigned char* data, std::size_t vertexSize, unsigned char* previous, unsigned char* destination )
+{
+    for (std::size_t k = 0; k < vertexSize; k += 4)
+    {
+        const unsigned modes = header[ k / 4 ];
+        const __m128i b0 = AccumulateDifferences( UnpackDifferences( data, modes & 3 ), previous[ k + 0 ] );
+        const __m128i b1 = AccumulateDifferences( UnpackDifferences( data, (modes >> 2) & 3 ), previous[ k + 1 ] );
+        const __m128i b2 = AccumulateDifferences( UnpackDifferences( data, (modes >> 4) & 3 ), previous[ k + 2 ] );
+        const __m128i b3 = AccumulateDifferences( UnpackDifferences( data, (modes >> 6) & 3 ), previous[ k + 3 ] );
+
+        // Transposes byte positions k..k+3 of 16 vertices into 4-byte words of vertices.
+        const __m128i b01lo = _mm_unpacklo_epi8( b0, b1 );
+        const __m128i b01hi = _mm_unpackhi_epi8( b0, b1 );
+        const __m128i b23lo = _mm_unpacklo_epi8( b2, b3 );
+        const __m128i b23hi = _mm_unpackhi_epi8( b2, b3 );
+
+        StoreWords( destination + k, vertexSize, _mm_unpacklo_epi16( b01lo, b23lo ) );
+        StoreWords( destination + k + 4 * vertexSize, vertexSize, _mm_unpackhi_epi16( b01lo, b23lo ) );
+        StoreWords( destination + k + 8 * vertexSize, vertexSize, _mm_unpacklo_epi16( b01hi, b23hi ) );
+        StoreWords( destination + k + 12 * vertexSize, vertexSize, _mm_unpackhi_epi16( b01hi, b23hi ) );
+    }
+}
+#elif defined( MESH_CODEC_NEON )
+static uint8x16_t UnpackDifferences( const unsigned char*& source, unsigned mode )
+{
+    if (mode == 0)
+    {
+        return vdupq_n_u8( 0 );
+    }
+
+    if (mode == 1)
+    {
+        uint32_t bits;
+        std::memcpy( &bits, source, 4 );
+        source += 4;
+
+        const uint8x8_t mask = vdup_n_u8( 3 );
+        const uint8x8_t packed = vreinterpret_u8_u32( vdup_n_u32( bits ) );
+        const uint8x8x2_t d01 = vzip_u8( vand_u8( packed, mask ), vand_u8( vshr_n_u8( packed, 2 ), mask ) );
+        const uint8x8x2_t d23 = vzip_u8( vand_u8( vshr_n_u8( packed, 4 ), mask ), vshr_n_u8( packed, 6 ) );
+        const uint16x4x2_t differences = vzip_u16( vreinterpret_u16_u8( d01.val[ 0 ] ), vreinterpret_u16_u8( d23.val[ 0 ] ) );
+        return vcombine_u8( vreinterpret_u8_u16( differences.val[ 0 ] ), vreinterpret_u8_u16( differences.val[ 1 ] ) );
+    }
+
+    if (mode == 2)
+    {
+        const uint8x8_t packed = vld1_u8( source );
+        source += 8;
+
+        const uint8x8x2_t differences = vzip_u8( vand_u8( packed, vdup_n_u8( 15 ) ), vshr_n_u8( packed, 4 ) );
+        return vcombine_u8( differences.val[ 0 ], differences.val[ 1 ] );
+    }
+
+    const uint8x16_t differences = vld1q_u8( source );
+    source += 16;
+    return differences;
+}
+
+/// Unzigzags differences and adds them to the previous byte value. \return Values of the byte position in 16 vertices.
+static uint8x16_t AccumulateDifferences( uint8x16_t differences, unsigned char& previous )
+{
+    const uint8x16_t zero = vdupq_n_u8( 0 );
+    const uint8x16_t sign = vsubq_u8( zero, vandq_u8( differences, vdupq_n_u8( 1 ) ) );
+    uint8x16_t values = veorq_u8( vshrq_n_u8( differences, 1 ), sign );
+
+    values = vaddq_u8( values, vextq_u8( zero, values, 15 ) );
+    values = vaddq_u8( values, vextq_u8( zero, values, 14 ) );
+    values = vaddq_u8( values, vextq_u8( zero, values, 12 ) );
+    values = vaddq_u8( values, vextq_u8( zero, values, 8 ) );
+    values = vaddq_u8( values, vdupq_n_u8( previous ) );
+
+    previous = vgetq_lane_u8( values, 15 );
+    return values;
+}
+
+static void StoreWords( unsigned char* destination, std::size_t vertexSize, uint8x16_t bytes )
+{
+    const uint32x4_t words = vreinterpretq_u32_u8( bytes );
+    const uint32_t word0 = vgetq_lane_u32( words, 0 );
+    const uint32_t word1 = vgetq_lane_u32( words, 1 );
+    const uint32_t word2 = vgetq_lane_u32( words, 2 );
+    const uint32_t word3 = vgetq_lane_u32( words, 3 );
+    std::memcpy( destination, &word0, 4 );
+    std::memcpy( destination + vertexSize, &word1, 4 );
+    std::memcpy( destination + 2 * vertexSize, &word2, 4 );
+    std::memcpy( destination + 3 * vertexSize, &word3, 4 );
+}
+
+static void DecodeBlock( const unsigned char* header, const unsigned char* data, std::size_t vertexSize, unsigned char* previous, unsigned char* destination )
+{
+    for (std::size_t k = 0; k < vertexSize; k += 4)
+    {
+        const unsigned modes = header[ k / 4 ];
+        const uint8x16_t b0 = AccumulateDifferences( UnpackDifferences( data, modes & 3 ), previous[ k + 0 ] );
+        const uint8x16_t b1 = AccumulateDifferences( UnpackDifferences( data, (modes >> 2) & 3 ), previous[ k + 1 ] );
+        const uint8x16_t b2 = AccumulateDifferences( UnpackDifferences( data, (modes >> 4) & 3 ), previous[ k + 2 ] );
+        const uint8x16_t b3 = AccumulateDifferences( UnpackDifferences( data, (modes >> 6) & 3 ), previous[ k + 3 ] );
+
+        // Transposes byte positions k..k+3 of 16 vertices into 4-byte words of vertices.
+        const uint8x16x2_t b01 = vzipq_u8( b0, b1 );
+        const uint8x16x2_t b23 = vzipq_u8( b2, b3 );
+        const uint16x8x2_t lo = vzipq_u16( vreinterpretq_u16_u8( b01.val[ 0 ] ), vreinterpretq_u16_u8( b23.val[ 0 ] ) );
+        const uint16x8x2_t hi = vzipq_u16( vreinterpretq_u16_u8( b01.val[ 1 ] ), vreinterpretq_u16_u8( b23.val[ 1 ] ) );
+
+        StoreWords( destination + k, vertexSize, vreinterpretq_u8_u16( lo.val[ 0 ] ) );
+        StoreWords( destination + k + 4 * vertexSize, vertexSize, vreinterpretq_u8_u16( lo.val[ 1 ] ) );
+        StoreWords( destination + k + 8 * vertexSize, vertexSize, vreinterpretq_u8_u16( hi.val[ 0 ] ) );
+        StoreWords( destination + k + 12 * vertexSize, vertexSize, vreinterpretq_u8_u16( hi.val[ 1 ] ) );
+    }
+}
+#else
+static void DecodeBlock( const unsigned char* header, const unsigned char* data, std::size_t vertexSize, unsigned char* previous, unsigned char* destination )
+{
+    for (std::size_t k = 0; k < vertexSize; ++k)
+    {
+        const unsigned mode = (header[ k / 4 ] >> ((k % 4) * 2)) & 3;
+        const unsigned bits = mode == 3 ? 8 : mode * 2;
+        const unsigned mask = (1u << bits) - 1;
+        unsigned char value = previous[ k ];
+
+        for (std::size_t i = 0; i < BlockVertexCount; ++i)
+        {
+            const unsigned difference = mode == 0 ? 0 : (data[ i * bits / 8 ] >> ((i * bits) % 8)) & mask;
+            value += (unsigned char)((difference >> 1) ^ (0u - (difference & 1)));
+            destination[ i * vertexSize + k ] = value;
+        }
+
+        previous[ k ] = value;
+        data += GetPackedSize( mode );
+    }
+}
+#endif
+
+bool MeshCodec::DecodeVertexBuffer( void* destination, std::size_t vertexCount, std::size_t vertexSize, const unsigned char* source, std::size_t sourceSize )
+{
+    if (vertexSize == 0 || vertexSize % 4 != 0 || vertexSize > MaxVertexSize)
+    {
+        return false;
+    }
+
+    const unsigned char* end = source + sourceSize;
+    unsigned char* vertices = (unsigned char*)destination;
+    unsigned char previous[ MaxVertexSize ] = {};
+    unsigned char lastBlock[ BlockVertexCount * MaxVertexSize ];
+
+    for (std::size_t first = 0; first < vertexCount; first += BlockVertexCount)
+    {
+        const std::size_t headerSize = vertexSize / 4;
+
+        if (std::size_t( end - source ) < headerSize)
+        {
+            return false;
+        }
+
+        const std::size_t dataSize = GetBlockDataSize( source, vertexSize );
+
+        if (std::size_t( end - source ) - headerSize < dataSize)
+        {
+            return false;
+        }
+
+        const std::size_t blockVertexCount = vertexCount - first < BlockVertexCount ? vertexCount - first : BlockVertexCount;
+
+        // The padded last block is decoded into a temporary, because the destination has no room for padding.
+        unsigned char* blockDestination = blockVertexCount == BlockVertexCount ? vertices + first * vertexSize : lastBlock;
+        DecodeBlock( source, source + headerSize, vertexSize, previous, blockDestination );
+
+        if (blockDestination == lastBlock)
+        {
+            std::memcpy( vertices + first * vertexSize, lastBlock, blockVertexCount * vertexSize );
+        }
+
+        source += headerSize + dataSize;
+    }
+
+    return source == end;
+}
+
+/// Reads a LEB128 varint. \return false if the stream ends.
+static bool ReadVarint( const unsigned char*& source, const unsigned char* end, std::uint64_t& outValue )
+{
+    outValue = 0;
+
+    for (unsigned shift = 0; shift < 64; shift += 7)
+    {
+        if (source == end)
+        {
+            return false;
+        }
+
+        const unsigned char byte = *source++;
+        outValue |= std::uint64_t( byte & 127 ) << shift;
+
+        if ((byte & 128) == 0)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static std::uint32_t Unzigzag( std::uint64_t value )
+{
+    return std::uint32_t( (value >> 1) ^ (0 - (value & 1)) );
+}
+
+bool MeshCodec::DecodeIndexBuffer( std::uint32_t* destination, std::size_t indexCount, std::size_t vertexCount, const unsigned char* source, std::size_t sourceSize )
+{
+    if (indexCount % 3 != 0)
+    {
+        return false;
+    }
+
+    const unsigned char* end = source + sourceSize;
+    std::uint32_t edgeFifo[ 16 ][ 2 ] = {};
+    std::uint32_t vertexFifo[ 16 ] = {};
+    unsigned edgeHead = 0;
+    unsigned vertexHead = 0;
+    std::uint32_t next = 0;
+    std::uint32_t last = 0;
+
+    auto pushEdge = [&]( std::uint32_t a, std::uint32_t b )
+    {
+        edgeFifo[ edgeHead & 15 ][ 0 ] = a;
+        edgeFifo[ edgeHead & 15 ][ 1 ] = b;
+        ++edgeHead;
+    };
+
+    auto pushVertex = [&]( std::uint32_t v )
+    {
+        vertexFifo[ vertexHead & 15 ] = v;
+        ++vertexHead;
+    };
+
+    // Decodes a vertex reference of a triangle that doesn't start with a FIFO edge.
+    auto readVertex = [&]( std::uint32_t& outVertex ) -> bool
+    {
+        std::uint64_t value;
+
+        if (!ReadVarint( source, end, value ))
+        {
+            return false;
+        }
+
+        if (value == 0)
+        {
+            outVertex = next++;
+            pushVertex( outVertex );
+        }
+        else if (value <= 16)
+        {
+            outVertex = vertexFifo[ (vertexHead - unsigned( value )) & 15 ];
+        }
+        else
+        {
+            outVertex = last + Unzigzag( value - 17 );
+            pushVertex( outVertex );
+        }
+
+        last = outVertex;
+        return outVertex < vertexCount;
+    };
+
+    for (std::size_t i = 0; i < indexCount; i += 3)
+    {
+        if (source == end)
+        {
+            return false;
+        }
+
+        const unsigned code = *source++;
+        std::uint32_t a, b, c;
+
+        if ((code >> 4) < 15)
+        {
+            const unsigned edge = (edgeHead - 1 - (code >> 4)) & 15;
+            a = edgeFifo[ edge ][ 1 ];
+            b = edgeFifo[ edge ][ 0 ];
+            const unsigned vertexCode = code & 15;
+
+            if (vertexCode == 0)
+            {
+                c = next++;
+                pushVertex( c );
+            }
+            else if (vertexCode < 15)
+            {
+                c = vertexFifo[ (vertexHead - vertexCode) & 15 ];
+            }
+            else
+            {
+                std::uint64_t value;
+
+                if (!ReadVarint( source, end, value ))
+                {
+                    return false;
+                }
+
+                c = last + Unzigzag( value );
+                pushVertex( c );
+            }
+
+            last = c;
+
+            if (c >= vertexCount || a >= vertexCount || b >= vertexCount)
+            {
+                return false;
+            }
+
+            pushEdge( b, c );
+            pushEdge( c, a );
+        }
+        else if (code == 0xF0)
+        {
+            if (!readVertex( a ) || !readVertex( b ) || !readVertex( c ))
+            {
+                return false;
+            }
+
+            pushEdge( a, b );
+            pushEdge( b, c );
+            pushEdge( c, a );
+        }
+        else
+        {
+            return false;
+        }
+
+        destination[ i + 0 ] = a;
+        destination[ i + 1 ] = b;
+        destination[ i + 2 ] = c;
+    }
+
+    return source == end;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ Decoders for the compressed vertex and index streams of .ae3d version b2. The encoders are in Tools/common.hpp.
+
+ Vertex stream: Vertices are coded in blocks of 16, the last block is padded by repeating the last vertex.
+ Each byte of a vertex is coded as the zigzag-coded difference to the same byte of the previous vertex,
+ the first vertex is compared against zeros. The 16 differences of a byte position are stored together.
+ Block layout:
+   vertexSize / 4 header bytes, 2 bits per byte position in ascending order, LSB first:
+     0: all differences are 0, no data
+     1: 2 bits per difference, 4 bytes
+     2: 4 bits per difference, 8 bytes
+     3: 8 bits per difference, 16 bytes
+   packed differences of each byte position. Difference i is in bits starting from ( i * bits ) % 8 of byte ( i * bits ) / 8.
+
+ Index stream: One code byte per triangle, followed by LEB128 varints. The decoder keeps a FIFO of the 16 latest edges
+ and a FIFO of the 16 latest vertices that were not found in the vertex FIFO, index 0 being the latest.
+ The next vertex counter starts at 0 and the last vertex at 0.
+   code >> 4 < 15:  The triangle starts with edge FIFO entry code >> 4 reversed. Its third vertex is
+                    the next vertex if code & 15 is 0, vertex FIFO entry ( code & 15 ) - 1 if code & 15 is 1-14,
+                    and last vertex + unzigzag( varint ) if code & 15 is 15.
+                    Pushes the edges second-third and third-first.
+   code == 0xF0:    Three varints follow, one per vertex: 0 is the next vertex, 1-16 vertex FIFO entry varint - 1,
+                    otherwise last vertex + unzigzag( varint - 17 ). Pushes the edges first-second, second-third and third-first.
+ Each decoded vertex becomes the last vertex. Using the next vertex increments it.
+ Triangles keep their winding, but the encoder can rotate their vertices.
+ */
+namespace MeshCodec
+{
+    /// Decodes a vertex stream.
+    /// \param destination Decoded vertices, vertexCount * vertexSize bytes.
+    /// \param vertexCount Vertex count.
+    /// \param vertexSize Vertex size in bytes. Must be a multiple of 4 and at most 256.
+    /// \param source Encoded stream.
+    /// \param sourceSize Encoded stream size in bytes.
+    /// \return false if the stream is corrupted.
+    bool DecodeVertexBuffer( void* destination, std::size_t vertexCount, std::size_t vertexSize, const unsigned char* source, std::size_t sourceSize );
+
+    /// Decodes an index stream.
+    /// \param destination Decoded indices, 3 per triangle.
+    /// \param indexCount Index count. Must be a multiple of 3.
+    /// \param vertexCount Vertex count. Indices that are not smaller are treated as corruption.
+    /// \param source Encoded stream.
+    /// \param sourceSize Encoded stream size in bytes.
+    /// \return false if the stream is corrupted.
+    bool DecodeIndexBuffer( std::uint32_t* destination, std::size_t indexCount, std::size_t vertexCount, const unsigned char* source, std::size_t sourceSize );
+}
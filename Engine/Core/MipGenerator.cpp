@@ -0,0 +1,352 @@
+// This is an independent project of an individual developer. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++, C#, and Java: http://www.viva64.com
+
+#include "MipGenerator.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include "Jobs.hpp"
+#include "TextureBase.hpp"
+#if defined( SIMD_SSE3 )
+#include <emmintrin.h>
+#elif defined( __ARM_NEON ) || defined( __ARM_NEON__ )
+#include <arm_neon.h>
+#define MIP_GENERATOR_NEON 1
+#endif
+
+namespace MathUtil
+{
+    int Max( int a, int b );
+    int GetMipmapCount( int width, int height );
+}
+
+/// Mips with fewer rows are filtered on the calling thread.
+static const int minRowsPerJob = 16;
+
+/// Conversions of 8-bit values to floats and of linear floats to 8-bit sRGB.
+struct MipTables
+{
+    static const int fromLinearCount = 16384;
+
+    MipTables()
+    {
+        for (int i = 0; i < 256; ++i)
+        {
+            const float value = i / 255.0f;
+            toUnorm[ i ] = value;
+            toLinear[ i ] = value <= 0.04045f ? value / 12.92f : std::pow( (value + 0.055f) / 1.055f, 2.4f );
+        }
+
+        for (int i = 0; i < fromLinearCount; ++i)
+        {
+            const float value = i / static_cast< float >( fromLinearCount - 1 );
+            const float srgb = value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow( value, 1.0f / 2.4f ) - 0.055f;
+            fromLinear[ i ] = static_cast< std::uint8_t >( srgb * 255.0f + 0.5f );
+        }
+    }
+
+    float toUnorm[ 256 ];
+    float toLinear[ 256 ];
+    std::uint8_t fromLinear[ fromLinearCount ];
+};
+
+/// \return Tables. Can be called on loader threads.
+static const MipTables& GetMipTables()
+{
+    static const MipTables tables;
+    return tables;
+}
+
+/// Weights of source texels along one axis. Destination texel i is the weighted sum of tapCount source texels
+/// starting at firstSources[ i ], whose weights start at weights[ i * tapCount ].
+struct MipAxisFilter
+{
+    int tapCount = 0;
+    std::vector< int > firstSources;
+    std::vector< float > weights;
+};
+
+/// \return Modified Bessel function of the first kind of order 0.
+static float BesselI0( float x )
+{
+    float sum = 1;
+    float term = 1;
+
+    for (int k = 1; k < 16; ++k)
+    {
+        const float factor = x / (2.0f * k);
+        term *= factor * factor;
+        sum += term;
+    }
+
+    return sum;
+}
+
+/// Sinc windowed by Kaiser (alpha 4) that reaches kaiserRadius destination texels from the destination texel's center.
+static const float kaiserRadius = 3;
+
+/// \param x Distance between source and destination texel centers in destination texels.
+/// \return Unnormalized weight.
+static float GetKaiserWeight( float x )
+{
+    const float alpha = 4;
+    const float pi = 3.14159265f;
+
+    if (std::fabs( x ) >= kaiserRadius)
+    {
+        return 0;
+    }
+
+    const float window = x / kaiserRadius;
+    const float sinc = std::fabs( x ) < 0.0001f ? 1.0f : std::sin( pi * x ) / (pi * x);
+    return sinc * BesselI0( alpha * std::sqrt( 1 - window * window ) ) / BesselI0( alpha );
+}
+
+/// \return Filter that halves sourceSize texels into size texels, or copies a single texel.
+static MipAxisFilter GetMipAxisFilter( ae3d::MipmapFilter filter, int sourceSize, int size )
+{
+    MipAxisFilter axis;
+    axis.firstSources.resize( size );
+
+    // A dimension of 1 texel is not halved, so its only texel is copied.
+    if (sourceSize == 1)
+    {
+        axis.tapCount = 1;
+        axis.weights.assign( 1, 1.0f );
+        return axis;
+    }
+
+    if (filter == ae3d::MipmapFilter::Box)
+    {
+        // A destination texel of an odd size covers 2.5 or more source texels, so its outer texels are weighted by their coverage.
+        const bool isOdd = (sourceSize & 1) != 0;
+        axis.tapCount = isOdd ? 3 : 2;
+        axis.weights.resize( size * axis.tapCount );
+
+        for (int i = 0; i < size; ++i)
+        {
+            axis.firstSources[ i ] = 2 * i;
+            float* weights = &axis.weights[ i * axis.tapCount ];
+
+            if (isOdd)
+            {
+                weights[ 0 ] = (size - i) / static_cast< float >( sourceSize );
+                weights[ 1 ] = size / static_cast< float >( sourceSize );
+                weights[ 2 ] = (i + 1) / static_cast< float >( sourceSize );
+            }
+            else
+            {
+                weights[ 0 ] = 0.5f;
+                weights[ 1 ] = 0.5f;
+            }
+        }
+
+        return axis;
+    }
+
+    // An open interval of 2 * reach source texels contains at most ceil( 2 * reach ) texel centers.
+    const float scale = sourceSize / static_cast< float >( size );
+    const float reach = kaiserRadius * scale;
+    axis.tapCount = static_cast< int >( std::ceil( 2 * reach ) );
+    axis.weights.resize( size * axis.tapCount );
+
+    for (int i = 0; i < size; ++i)
+    {
+        const float center = (i + 0.5f) * scale - 0.5f;
+        axis.firstSources[ i ] = static_cast< int >( std::floor( center - reach ) ) + 1;
+        float* weights = &axis.weights[ i * axis.tapCount ];
+        float sum = 0;
+
+        for (int tap = 0; tap < axis.tapCount; ++tap)
+        {
+            weights[ tap ] = GetKaiserWeight( (axis.firstSources[ i ] + tap - center) / scale );
+            sum += weights[ tap ];
+        }
+
+        for (int tap = 0; tap < axis.tapCount; ++tap)
+        {
+            weights[ tap ] /= sum;
+        }
+    }
+
+    return axis;
+}
+
+#if defined( SIMD_SSE3 )
+typedef __m128 MipTexel;
+
+static MipTexel ZeroTexel() { return _mm_setzero_ps(); }
+static MipTexel LoadTexel( const float* rgba ) { return _mm_loadu_ps( rgba ); }
+static void StoreTexel( float* rgba, MipTexel texel ) { _mm_storeu_ps( rgba, texel ); }
+static MipTexel AddWeighted( MipTexel sum, MipTexel texel, float weight ) { return _mm_add_ps( sum, _mm_mul_ps( texel, _mm_set1_ps( weight ) ) ); }
+#elif defined( MIP_GENERATOR_NEON )
+typedef float32x4_t MipTexel;
+
+static MipTexel ZeroTexel() { return vdupq_n_f32( 0.0f ); }
+static MipTexel LoadTexel( const float* rgba ) { return vld1q_f32( rgba ); }
+static void StoreTexel( float* rgba, MipTexel texel ) { vst1q_f32( rgba, texel ); }
+static MipTexel AddWeighted( MipTexel sum, MipTexel texel, float weight ) { return vmlaq_n_f32( sum, texel, weight ); }
+#else
+struct MipTexel
+{
+    float rgba[ 4 ];
+};
+
+static MipTexel ZeroTexel()
+{
+    MipTexel texel = { { 0, 0, 0, 0 } };
+    return texel;
+}
+
+static MipTexel LoadTexel( const float* rgba )
+{
+    MipTexel texel = { { rgba[ 0 ], rgba[ 1 ], rgba[ 2 ], rgba[ 3 ] } };
+    return texel;
+}
+
+static void StoreTexel( float* rgba, MipTexel texel )
+{
+    for (int c = 0; c < 4; ++c)
+    {
+        rgba[ c ] = texel.rgba[ c ];
+    }
+}
+
+static MipTexel AddWeighted( MipTexel sum, MipTexel texel, float weight )
+{
+    for (int c = 0; c < 4; ++c)
+    {
+        sum.rgba[ c ] += texel.rgba[ c ] * weight;
+    }
+
+    return sum;
+}
+#endif
+
+/// \return Texel index that is wrapped or clamped to [0, size).
+static int AddressMipTexel( int index, int size, bool isRepeat )
+{
+    if (isRepeat)
+    {
+        index %= size;
+        return index < 0 ? index + size : index;
+    }
+
+    return index < 0 ? 0 : (index < size ? index : size - 1);
+}
+
+/// Filters rows [rowBegin, rowEnd) of an RGBA8 mip from the previous mip. Color of sRGB textures is filtered in linear space, alpha is always linear.
+static void FilterMipRows( const std::uint8_t* source, int sourceWidth, int sourceHeight, std::uint8_t* destination, int width,
+                           const MipAxisFilter& filterX, const MipAxisFilter& filterY, bool isSrgb, bool isRepeat, int rowBegin, int rowEnd )
+{
+    const MipTables& tables = GetMipTables();
+    const float* toFloat = isSrgb ? tables.toLinear : tables.toUnorm;
+    const bool isWidthHalved = sourceWidth > 1;
+    const bool isHeightHalved = sourceHeight > 1;
+
+    std::vector< float > sourceRow( sourceWidth * 4 );
+    std::vector< float > filteredRows( filterY.tapCount * width * 4 );
+
+    for (int y = rowBegin; y < rowEnd; ++y)
+    {
+        const float* weightsY = isHeightHalved ? &filterY.weights[ y * filterY.tapCount ] : &filterY.weights[ 0 ];
+
+        for (int tapY = 0; tapY < filterY.tapCount; ++tapY)
+        {
+            const int sourceY = AddressMipTexel( filterY.firstSources[ y ] + tapY, sourceHeight, isRepeat );
+            const std::uint8_t* sourceTexels = source + sourceY * sourceWidth * 4;
+
+            for (int i = 0; i < sourceWidth * 4; i += 4)
+            {
+                sourceRow[ i + 0 ] = toFloat[ sourceTexels[ i + 0 ] ];
+                sourceRow[ i + 1 ] = toFloat[ sourceTexels[ i + 1 ] ];
+                sourceRow[ i + 2 ] = toFloat[ sourceTexels[ i + 2 ] ];
+                sourceRow[ i + 3 ] = tables.toUnorm[ sourceTexels[ i + 3 ] ];
+            }
+
+            float* filteredRow = &filteredRows[ tapY * width * 4 ];
+
+            for (int x = 0; x < width; ++x)
+            {
+                const float* weightsX = isWidthHalved ? &filterX.weights[ x * filterX.tapCount ] : &filterX.weights[ 0 ];
+                MipTexel sum = ZeroTexel();
+
+                for (int tapX = 0; tapX < filterX.tapCount; ++tapX)
+                {
+                    const int sourceX = AddressMipTexel( filterX.firstSources[ x ] + tapX, sourceWidth, isRepeat );
+                    sum = AddWeighted( sum, LoadTexel( &sourceRow[ sourceX * 4 ] ), weightsX[ tapX ] );
+                }
+
+                StoreTexel( &filteredRow[ x * 4 ], sum );
+            }
+        }
+
+        std::uint8_t* destinationTexels = destination + y * width * 4;
+
+        for (int x = 0; x < width; ++x)
+        {
+            MipTexel sum = ZeroTexel();
+
+            for (int tapY = 0; tapY < filterY.tapCount; ++tapY)
+            {
+                sum = AddWeighted( sum, LoadTexel( &filteredRows[ (tapY * width + x) * 4 ] ), weightsY[ tapY ] );
+            }
+
+            float rgba[ 4 ];
+            StoreTexel( rgba, sum );
+
+            // Kaiser's negative lobes can overshoot.
+            for (int c = 0; c < 4; ++c)
+            {
+                const float value = std::min( std::max( rgba[ c ], 0.0f ), 1.0f );
+                destinationTexels[ x * 4 + c ] = (isSrgb && c < 3) ? tables.fromLinear[ static_cast< int >( value * (MipTables::fromLinearCount - 1) + 0.5f ) ]
+                                                                    : static_cast< std::uint8_t >( value * 255.0f + 0.5f );
+            }
+        }
+    }
+}
+
+void MipGenerator::GenerateMips( const unsigned char* pixels, int width, int height, bool isSrgb, bool isRepeat, ae3d::MipmapFilter filter,
+                                 bool useJobs, std::vector< unsigned char >& outMips )
+{
+    const int mipCount = MathUtil::GetMipmapCount( width, height );
+    std::size_t mipChainSize = 0;
+
+    for (int mip = 1; mip < mipCount; ++mip)
+    {
+        mipChainSize += MathUtil::Max( width >> mip, 1 ) * MathUtil::Max( height >> mip, 1 ) * 4;
+    }
+
+    outMips.resize( mipChainSize );
+
+    const std::uint8_t* source = pixels;
+    std::size_t offset = 0;
+
+    for (int mip = 1; mip < mipCount; ++mip)
+    {
+        const int sourceWidth = MathUtil::Max( width >> (mip - 1), 1 );
+        const int sourceHeight = MathUtil::Max( height >> (mip - 1), 1 );
+        const int mipWidth = MathUtil::Max( width >> mip, 1 );
+        const int mipHeight = MathUtil::Max( height >> mip, 1 );
+        const MipAxisFilter filterX = GetMipAxisFilter( filter, sourceWidth, mipWidth );
+        const MipAxisFilter filterY = GetMipAxisFilter( filter, sourceHeight, mipHeight );
+        std::uint8_t* destination = &outMips[ offset ];
+
+        const auto filterRows = [&]( int rowBegin, int rowEnd )
+        {
+            FilterMipRows( source, sourceWidth, sourceHeight, destination, mipWidth, filterX, filterY, isSrgb, isRepeat, rowBegin, rowEnd );
+        };
+
+        if (useJobs)
+        {
+            Jobs::ParallelFor( mipHeight, minRowsPerJob, filterRows );
+        }
+        else
+        {
+            filterRows( 0, mipHeight );
+        }
+
+        source = destination;
+        offset += mipWidth * mipHeight * 4;
+    }
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <vector>
+
+namespace ae3d
+{
+    enum class MipmapFilter;
+}
+
+/// Generates mipmaps of RGBA8 images on the CPU.
+namespace MipGenerator
+{
+    /// Generates mips 1 and smaller of an RGBA8 image. Every mip is filtered from the previous one. Color of sRGB images is filtered
+    /// in linear space, alpha is always linear. Odd dimensions are filtered with all their texels, for example a box filter averages 3 texels into 1.
+    /// \param pixels Mip 0.
+    /// \param width Width of mip 0.
+    /// \param height Height of mip 0.
+    /// \param isSrgb Color is sRGB.
+    /// \param isRepeat Filters that reach over edges wrap instead of clamping.
+    /// \param filter Filter.
+    /// \param useJobs Filters rows on job threads. Must be false on other threads than the main thread.
+    /// \param outMips Mips one after another. Mip i is max(width >> i, 1) by max(height >> i, 1) texels.
+    void GenerateMips( const unsigned char* pixels, int width, int height, bool isSrgb, bool isRepeat, ae3d::MipmapFilter filter,
+                       bool useJobs, std::vector< unsigned char >& outMips );
+}
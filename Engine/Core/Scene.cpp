@@ -3,9 +3,12 @@
 #include "Scene.hpp"
 #include <algorithm>
 #include <chrono>
+#include <cmath>
+#include <functional>
 #include <locale>
 #include <string>
 #include <sstream>
+#include <tuple>
 #include <vector>
 #include "AudioSourceComponent.hpp"
 #include "AudioSystem.hpp"
@@ -28,6 +31,7 @@
 #include "SpriteRendererComponent.hpp"
 #include "SpotLightComponent.hpp"
 #include "Statistics.hpp"
+#include "SubMesh.hpp"
 #include "System.hpp"
 #include "TextRendererComponent.hpp"
 #include "TransformComponent.hpp"
@@ -60,7 +64,7 @@ std::string GetSerialized( ae3d::TransformComponent* component );
 
 namespace GfxDeviceGlobal
 {
-    extern PerObjectUboStruct perObjectUboStruct;
+    extern thread_local PerObjectUboStruct perObjectUboStruct;
     extern ae3d::LightTiler lightTiler;
 }
 
@@ -90,6 +94,16 @@ namespace SceneGlobal
 
 bool someLightCastsShadow = false;
 
+// Calls recordRange( begin, end ) for draws [0, drawCount), split between recording threads if the renderer supports it.
+static void RecordDraws( int drawCount, const std::function< void( int, int ) >& recordRange )
+{
+#if RENDERER_VULKAN
+    GfxDevice::RecordDrawsInParallel( drawCount, recordRange );
+#else
+    recordRange( 0, drawCount );
+#endif
+}
+
 void SetupCameraForSpotShadowCasting( const Vec3& lightPosition, const Vec3& lightDirection, float coneAngleDegrees, ae3d::CameraComponent& outCamera,
                                      ae3d::TransformComponent& outCameraTransform )
 {
@@ -512,6 +526,25 @@ void ae3d::Scene::Render()
 #endif
     Statistics::ResetFrameStatistics();
     TransformComponent::UpdateLocalMatrices();
+    Texture2D::UpdateStreaming();
+
+    // Poses are evaluated once here and reused by every pass and submesh.
+    Statistics::BeginSkinningProfiling();
+    std::vector< MeshRendererComponent* > meshRenderers;
+    meshRenderers.reserve( gameObjects.size() );
+
+    for (auto gameObject : gameObjects)
+    {
+        MeshRendererComponent* meshRenderer = (gameObject && gameObject->IsEnabled()) ? gameObject->GetComponent< MeshRendererComponent >() : nullptr;
+
+        if (meshRenderer && meshRenderer->IsEnabled())
+        {
+            meshRenderers.push_back( meshRenderer );
+        }
+    }
+
+    MeshRendererComponent::UpdateSkinPalettes( meshRenderers.data(), (int)meshRenderers.size() );
+    Statistics::EndSkinningProfiling();
 
     GfxDeviceGlobal::perObjectUboStruct.particleCount = 1000;//65535 * 2;
     GfxDeviceGlobal::perObjectUboStruct.timeStamp = System::SecondsSinceStartup();
@@ -784,46 +817,74 @@ void ae3d::Scene::RenderWithCamera( GameObject* cameraGo, int cubeMapFace, const
         }
     }
 
-    auto meshSorterByMesh = [&](unsigned j, unsigned k)
+    // Groups draws by shader and material so that consecutive draws can reuse the bound pipeline.
+    // Renderers are sorted by the material of their first submesh only, so submeshes with other materials are not grouped.
+    auto meshSorterByMaterial = [&](unsigned j, unsigned k)
     {
-        return gameObjects[ j ]->GetComponent< MeshRendererComponent >()->GetMesh() <
-               gameObjects[ k ]->GetComponent< MeshRendererComponent >()->GetMesh();
+        MeshRendererComponent* meshRendererJ = gameObjects[ j ]->GetComponent< MeshRendererComponent >();
+        MeshRendererComponent* meshRendererK = gameObjects[ k ]->GetComponent< MeshRendererComponent >();
+        Material* materialJ = meshRendererJ->GetMaterial( 0 );
+        Material* materialK = meshRendererK->GetMaterial( 0 );
+        Shader* shaderJ = materialJ ? materialJ->GetShader() : nullptr;
+        Shader* shaderK = materialK ? materialK->GetShader() : nullptr;
+
+        if (shaderJ != shaderK)
+        {
+            return shaderJ < shaderK;
+        }
+
+        if (materialJ != materialK)
+        {
+            return materialJ < materialK;
+        }
+
+        return meshRendererJ->GetMesh() < meshRendererK->GetMesh();
     };
 
-    std::sort( std::begin( gameObjectsWithMeshRenderer ), std::end( gameObjectsWithMeshRenderer ), meshSorterByMesh );
+    std::sort( std::begin( gameObjectsWithMeshRenderer ), std::end( gameObjectsWithMeshRenderer ), meshSorterByMaterial );
     
     Array< Matrix44 > localToViews( (int)gameObjectsWithMeshRenderer.size() );
     Array< Matrix44 > localToClips( (int)gameObjectsWithMeshRenderer.size() );
     
-    int i = 0;
-    
-    for (auto j : gameObjectsWithMeshRenderer)
+    RecordDraws( (int)gameObjectsWithMeshRenderer.size(), [ & ]( int begin, int end )
     {
-        auto transform = gameObjects[ j ]->GetComponent< TransformComponent >();
-        auto meshLocalToWorld = transform ? transform->GetLocalToWorldMatrix() : Matrix44::identity;
+        for (int i = begin; i < end; ++i)
+        {
+            const unsigned j = gameObjectsWithMeshRenderer[ i ];
+            auto transform = gameObjects[ j ]->GetComponent< TransformComponent >();
+            auto meshLocalToWorld = transform ? transform->GetLocalToWorldMatrix() : Matrix44::identity;
 
-        Matrix44::Multiply( meshLocalToWorld, view, localToViews[ i ] );
-        Matrix44::Multiply( localToViews[ i ], camera->GetProjection(), localToClips[ i ] );
+            Matrix44::Multiply( meshLocalToWorld, view, localToViews[ i ] );
+            Matrix44::Multiply( localToViews[ i ], camera->GetProjection(), localToClips[ i ] );
 
-        auto* meshRenderer = gameObjects[ j ]->GetComponent< MeshRendererComponent >();
-        meshRenderer->Cull( frustum, meshLocalToWorld );
-        meshRenderer->Render( localToViews[ i ], localToClips[ i ], meshLocalToWorld, SceneGlobal::shadowCameraViewMatrix, SceneGlobal::shadowCameraProjectionMatrix, nullptr, nullptr, MeshRendererComponent::RenderType::Opaque );
-        
-        ++i;
-    }
+            auto* meshRenderer = gameObjects[ j ]->GetComponent< MeshRendererComponent >();
+            meshRenderer->Cull( frustum, meshLocalToWorld );
+            meshRenderer->Render( localToViews[ i ], localToClips[ i ], meshLocalToWorld, SceneGlobal::shadowCameraViewMatrix, SceneGlobal::shadowCameraProjectionMatrix, nullptr, nullptr, MeshRendererComponent::RenderType::Opaque );
+        }
+    } );
 
-    i = 0;
-    
-    for (auto j : gameObjectsWithMeshRenderer)
+    // Texture streaming state and line buffers are not thread-safe, so mips are requested and bounding boxes are drawn after recording.
+    const bool isPerspective = camera->GetProjectionType() == CameraComponent::ProjectionType::Perspective;
+
+    for (std::size_t i = 0; i < gameObjectsWithMeshRenderer.size(); ++i)
     {
-        auto transform = gameObjects[ j ]->GetComponent< TransformComponent >();
-        auto meshLocalToWorld = transform ? transform->GetLocalToWorldMatrix() : Matrix44::identity;
-        
-        gameObjects[ j ]->GetComponent< MeshRendererComponent >()->Render( localToViews[ i ], localToClips[ i ], meshLocalToWorld, SceneGlobal::shadowCameraViewMatrix, SceneGlobal::shadowCameraProjectionMatrix, nullptr, nullptr, MeshRendererComponent::RenderType::Transparent );
-        
-        ++i;
+        auto* meshRenderer = gameObjects[ gameObjectsWithMeshRenderer[ i ] ]->GetComponent< MeshRendererComponent >();
+        meshRenderer->RequestStreamedMips( localToViews[ (int)i ], camera->GetProjection(), isPerspective, (float)camera->GetViewport()[ 3 ] );
+        meshRenderer->RenderBoundingBox( localToViews[ (int)i ], localToClips[ (int)i ] );
     }
 
+    RecordDraws( (int)gameObjectsWithMeshRenderer.size(), [ & ]( int begin, int end )
+    {
+        for (int i = begin; i < end; ++i)
+        {
+            const unsigned j = gameObjectsWithMeshRenderer[ i ];
+            auto transform = gameObjects[ j ]->GetComponent< TransformComponent >();
+            auto meshLocalToWorld = transform ? transform->GetLocalToWorldMatrix() : Matrix44::identity;
+
+            gameObjects[ j ]->GetComponent< MeshRendererComponent >()->Render( localToViews[ i ], localToClips[ i ], meshLocalToWorld, SceneGlobal::shadowCameraViewMatrix, SceneGlobal::shadowCameraProjectionMatrix, nullptr, nullptr, MeshRendererComponent::RenderType::Transparent );
+        }
+    } );
+
     GfxDevice::PopGroupMarker();
 
 #if RENDERER_METAL
@@ -884,23 +945,27 @@ void ae3d::Scene::RenderDepthAndNormals( CameraComponent* camera, const Matrix44
 
     GfxDeviceGlobal::perObjectUboStruct.cameraParams = Vec4( camera->GetFovDegrees() * 3.14159265f / 180.0f, camera->GetAspect(), camera->GetNear(), camera->GetFar() );
 
-    for (auto j : gameObjectsWithMeshRenderer)
+    RecordDraws( (int)gameObjectsWithMeshRenderer.size(), [ & ]( int begin, int end )
     {
-        auto transform = gameObjects[ j ]->GetComponent< TransformComponent >();
-        auto meshLocalToWorld = transform ? transform->GetLocalToWorldMatrix() : Matrix44::identity;
-        
-        Matrix44 localToView;
-        Matrix44 localToClip;
-        Matrix44::Multiply( meshLocalToWorld, worldToView, localToView );
-        Matrix44::Multiply( localToView, camera->GetProjection(), localToClip );
-        
-        auto meshRenderer = gameObjects[ j ]->GetComponent< MeshRendererComponent >();
+        for (int i = begin; i < end; ++i)
+        {
+            const unsigned j = gameObjectsWithMeshRenderer[ i ];
+            auto transform = gameObjects[ j ]->GetComponent< TransformComponent >();
+            auto meshLocalToWorld = transform ? transform->GetLocalToWorldMatrix() : Matrix44::identity;
 
-        meshRenderer->Cull( frustum, meshLocalToWorld );
-        meshRenderer->Render( localToView, localToClip, meshLocalToWorld, SceneGlobal::shadowCameraViewMatrix, SceneGlobal::shadowCameraProjectionMatrix, &renderer.builtinShaders.depthNormalsShader, &renderer.builtinShaders.depthNormalsSkinShader, MeshRendererComponent::RenderType::Opaque );
-        meshRenderer->Render( localToView, localToClip, meshLocalToWorld, SceneGlobal::shadowCameraViewMatrix, SceneGlobal::shadowCameraProjectionMatrix, &renderer.builtinShaders.depthNormalsShader,
-                             &renderer.builtinShaders.depthNormalsSkinShader, MeshRendererComponent::RenderType::Transparent );
-    }
+            Matrix44 localToView;
+            Matrix44 localToClip;
+            Matrix44::Multiply( meshLocalToWorld, worldToView, localToView );
+            Matrix44::Multiply( localToView, camera->GetProjection(), localToClip );
+
+            auto meshRenderer = gameObjects[ j ]->GetComponent< MeshRendererComponent >();
+
+            meshRenderer->Cull( frustum, meshLocalToWorld );
+            meshRenderer->Render( localToView, localToClip, meshLocalToWorld, SceneGlobal::shadowCameraViewMatrix, SceneGlobal::shadowCameraProjectionMatrix, &renderer.builtinShaders.depthNormalsShader, &renderer.builtinShaders.depthNormalsSkinShader, MeshRendererComponent::RenderType::Opaque );
+            meshRenderer->Render( localToView, localToClip, meshLocalToWorld, SceneGlobal::shadowCameraViewMatrix, SceneGlobal::shadowCameraProjectionMatrix, &renderer.builtinShaders.depthNormalsShader,
+                                 &renderer.builtinShaders.depthNormalsSkinShader, MeshRendererComponent::RenderType::Transparent );
+        }
+    } );
 
     GfxDevice::PopGroupMarker();
     
@@ -995,22 +1060,26 @@ void ae3d::Scene::RenderShadowsWithCamera( GameObject* cameraGo, int cubeMapFace
     };
     std::sort( std::begin( gameObjectsWithMeshRenderer ), std::end( gameObjectsWithMeshRenderer ), meshSorterByMesh );
     
-    for (auto j : gameObjectsWithMeshRenderer)
+    RecordDraws( (int)gameObjectsWithMeshRenderer.size(), [ & ]( int begin, int end )
     {
-        auto transform = gameObjects[ j ]->GetComponent< TransformComponent >();
-        auto meshLocalToWorld = transform ? transform->GetLocalToWorldMatrix() : Matrix44::identity;
-        
-        Matrix44 localToView;
-        Matrix44 localToClip;
-        Matrix44::Multiply( meshLocalToWorld, view, localToView );
-        Matrix44::Multiply( localToView, camera->GetProjection(), localToClip );
+        for (int i = begin; i < end; ++i)
+        {
+            const unsigned j = gameObjectsWithMeshRenderer[ i ];
+            auto transform = gameObjects[ j ]->GetComponent< TransformComponent >();
+            auto meshLocalToWorld = transform ? transform->GetLocalToWorldMatrix() : Matrix44::identity;
 
-        auto* meshRenderer = gameObjects[ j ]->GetComponent< MeshRendererComponent >();
-        
-        meshRenderer->Cull( frustum, meshLocalToWorld );
-        meshRenderer->Render( localToView, localToClip, meshLocalToWorld, SceneGlobal::shadowCameraViewMatrix, SceneGlobal::shadowCameraProjectionMatrix, &renderer.builtinShaders.momentsShader,
-                             &renderer.builtinShaders.momentsSkinShader, MeshRendererComponent::RenderType::Opaque );
-    }
+            Matrix44 localToView;
+            Matrix44 localToClip;
+            Matrix44::Multiply( meshLocalToWorld, view, localToView );
+            Matrix44::Multiply( localToView, camera->GetProjection(), localToClip );
+
+            auto* meshRenderer = gameObjects[ j ]->GetComponent< MeshRendererComponent >();
+
+            meshRenderer->Cull( frustum, meshLocalToWorld );
+            meshRenderer->Render( localToView, localToClip, meshLocalToWorld, SceneGlobal::shadowCameraViewMatrix, SceneGlobal::shadowCameraProjectionMatrix, &renderer.builtinShaders.momentsShader,
+                                 &renderer.builtinShaders.momentsSkinShader, MeshRendererComponent::RenderType::Opaque );
+        }
+    } );
 
     GfxDevice::PopGroupMarker();
 
@@ -1022,6 +1091,216 @@ void ae3d::Scene::RenderShadowsWithCamera( GameObject* cameraGo, int cubeMapFace
 #endif
 }
 
+void ae3d::Scene::CreatePipelineStates( std::vector< GameObject >& newGameObjects )
+{
+    std::vector< CameraComponent* > cameras;
+    std::vector< RenderTexture* > shadowMaps;
+
+    auto collectPasses = [ & ]( GameObject& go )
+    {
+        CameraComponent* camera = go.GetComponent< CameraComponent >();
+        DirectionalLightComponent* dirLight = go.GetComponent< DirectionalLightComponent >();
+        SpotLightComponent* spotLight = go.GetComponent< SpotLightComponent >();
+        PointLightComponent* pointLight = go.GetComponent< PointLightComponent >();
+
+        if (camera)
+        {
+            cameras.push_back( camera );
+        }
+
+        if (dirLight && dirLight->CastsShadow() && dirLight->shadowMap.IsCreated())
+        {
+            shadowMaps.push_back( &dirLight->shadowMap );
+        }
+        else if (spotLight && spotLight->CastsShadow())
+        {
+            shadowMaps.push_back( &spotLight->shadowMap );
+        }
+        else if (pointLight && pointLight->CastsShadow())
+        {
+            shadowMaps.push_back( &pointLight->shadowMap );
+        }
+    };
+
+    for (auto gameObject : gameObjects)
+    {
+        if (gameObject)
+        {
+            collectPasses( *gameObject );
+        }
+    }
+
+    for (auto& gameObject : newGameObjects)
+    {
+        collectPasses( gameObject );
+    }
+
+    for (auto& gameObject : newGameObjects)
+    {
+        MeshRendererComponent* meshRenderer = gameObject.GetComponent< MeshRendererComponent >();
+
+        if (!meshRenderer)
+        {
+            continue;
+        }
+
+        for (auto camera : cameras)
+        {
+            meshRenderer->CreatePSOs( camera->GetTargetTexture(), nullptr, nullptr );
+
+            if (camera->GetDepthNormalsTexture().GetID() != 0)
+            {
+                meshRenderer->CreatePSOs( &camera->GetDepthNormalsTexture(), &renderer.builtinShaders.depthNormalsShader, &renderer.builtinShaders.depthNormalsSkinShader );
+            }
+        }
+
+        if (meshRenderer->CastsShadow())
+        {
+            for (auto shadowMap : shadowMaps)
+            {
+                meshRenderer->CreatePSOs( shadowMap, &renderer.builtinShaders.momentsShader, &renderer.builtinShaders.momentsSkinShader );
+            }
+        }
+    }
+}
+
+int ae3d::Scene::CreateStaticBatches( std::vector< GameObject >& newGameObjects, float chunkSize, std::vector< GameObject >& outBatches, Array< Mesh* >& outMeshes )
+{
+    // Chunks stay addressable with 16-bit indices.
+    const std::size_t MaxChunkVertices = 65536;
+
+    struct BatchSource
+    {
+        Mesh* mesh;
+        unsigned subMeshIndex;
+        // Copied, because adding the batches' components can reallocate the transform pool.
+        Matrix44 localToWorld;
+        std::size_t vertexCount;
+    };
+
+    // Material, layer, casts shadow, wireframe.
+    typedef std::tuple< Material*, unsigned, bool, bool > BatchKey;
+    typedef std::tuple< int, int, int > ChunkCell;
+    std::map< BatchKey, std::map< ChunkCell, std::vector< BatchSource > > > batches;
+    std::vector< GameObject* > batchedGameObjects;
+    int batchedSubMeshCount = 0;
+
+    TransformComponent::UpdateLocalMatrices();
+
+    for (auto& go : newGameObjects)
+    {
+        MeshRendererComponent* meshRenderer = go.GetComponent< MeshRendererComponent >();
+        TransformComponent* transform = go.GetComponent< TransformComponent >();
+
+        if (!go.IsStatic() || !go.IsEnabled() || !meshRenderer || !meshRenderer->IsEnabled() || !meshRenderer->GetMesh() || !transform)
+        {
+            continue;
+        }
+
+        int subMeshCount = 0;
+        SubMesh* subMeshes = meshRenderer->GetMesh()->GetSubMeshes( subMeshCount );
+        bool isBatchable = subMeshCount > 0;
+
+        for (int i = 0; i < subMeshCount; ++i)
+        {
+            const Material* material = meshRenderer->GetMaterial( i );
+            isBatchable = isBatchable && material && material->IsValidShader() && material->GetBlendingMode() == Material::BlendingMode::Off &&
+                          subMeshes[ i ].joints.empty() && subMeshes[ i ].verticesPTNTC_Compact_Skinned.empty() &&
+                          subMeshes[ i ].GetVertexCount() > 0 && subMeshes[ i ].GetVertexCount() <= MaxChunkVertices;
+        }
+
+        if (!isBatchable)
+        {
+            continue;
+        }
+
+        const Matrix44& localToWorld = transform->GetLocalToWorldMatrix();
+
+        for (int i = 0; i < subMeshCount; ++i)
+        {
+            Vec3 center = (subMeshes[ i ].aabbMin + subMeshes[ i ].aabbMax) * 0.5f;
+            Matrix44::TransformPoint( center, localToWorld, &center );
+
+            ChunkCell cell( 0, 0, 0 );
+
+            if (chunkSize > 0)
+            {
+                cell = ChunkCell( (int)std::floor( center.x / chunkSize ), (int)std::floor( center.y / chunkSize ), (int)std::floor( center.z / chunkSize ) );
+            }
+
+            const BatchKey key( meshRenderer->GetMaterial( i ), go.GetLayer(), meshRenderer->CastsShadow(), meshRenderer->IsWireframe() );
+            batches[ key ][ cell ].push_back( { meshRenderer->GetMesh(), (unsigned)i, localToWorld, subMeshes[ i ].GetVertexCount() } );
+            ++batchedSubMeshCount;
+        }
+
+        batchedGameObjects.push_back( &go );
+    }
+
+    // Disabled before the batches are created, because their components can reallocate the mesh renderer pool.
+    for (auto go : batchedGameObjects)
+    {
+        go->GetComponent< MeshRendererComponent >()->SetEnabled( false );
+    }
+
+    outBatches.clear();
+    outBatches.reserve( batches.size() );
+    int chunkCount = 0;
+
+    for (const auto& batch : batches)
+    {
+        Mesh* mesh = new Mesh();
+        outMeshes.Add( mesh );
+
+        unsigned chunkIndex = 0;
+
+        for (const auto& cell : batch.second)
+        {
+            std::size_t chunkVertexCount = 0;
+
+            for (const auto& source : cell.second)
+            {
+                if (chunkVertexCount + source.vertexCount > MaxChunkVertices)
+                {
+                    ++chunkIndex;
+                    chunkVertexCount = 0;
+                }
+
+                mesh->AppendToStaticBatch( chunkIndex, *source.mesh, source.subMeshIndex, source.localToWorld );
+                chunkVertexCount += source.vertexCount;
+            }
+
+            ++chunkIndex;
+        }
+
+        const std::string name = std::string( "static batch " ) + std::to_string( outBatches.size() );
+        mesh->FinishStaticBatch( name.c_str() );
+        chunkCount += (int)chunkIndex;
+
+        outBatches.push_back( GameObject() );
+        GameObject& batchGo = outBatches.back();
+        batchGo.SetName( name.c_str() );
+        batchGo.SetLayer( std::get< 1 >( batch.first ) );
+        batchGo.SetStatic( true );
+        batchGo.AddComponent< TransformComponent >();
+        batchGo.AddComponent< MeshRendererComponent >();
+
+        MeshRendererComponent* meshRenderer = batchGo.GetComponent< MeshRendererComponent >();
+        meshRenderer->SetMesh( mesh );
+        meshRenderer->SetCastShadow( std::get< 2 >( batch.first ) );
+        meshRenderer->EnableWireframe( std::get< 3 >( batch.first ) );
+
+        for (unsigned i = 0; i < chunkIndex; ++i)
+        {
+            meshRenderer->SetMaterial( std::get< 0 >( batch.first ), i );
+        }
+    }
+
+    const int savedDrawCount = batchedSubMeshCount - chunkCount;
+    System::Print( "Static batching: %d batches with %d chunks from %d submeshes, %d draws saved.\n", (int)outBatches.size(), chunkCount, batchedSubMeshCount, savedDrawCount );
+
+    return savedDrawCount;
+}
+
 void ae3d::Scene::SetSkybox( TextureCube* skyTexture )
 {
     skybox = skyTexture;
@@ -1168,6 +1447,18 @@ ae3d::Scene::DeserializeResult ae3d::Scene::Deserialize( const FileSystem::FileC
             lineStream >> enabled;
             outGameObjects.back().SetEnabled( enabled != 0 );
         }
+        else if (token == "static")
+        {
+            if (outGameObjects.empty())
+            {
+                System::Print( "Failed to parse %s at line %d: found \"static\" but there are no game objects defined before this line.\n", serialized.path.c_str(), lineNo );
+                return DeserializeResult::ParseError;
+            }
+
+            int isStatic;
+            lineStream >> isStatic;
+            outGameObjects.back().SetStatic( isStatic != 0 );
+        }
         else if (token == "meshrenderer_enabled")
         {
             if (outGameObjects.empty())
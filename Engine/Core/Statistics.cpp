@@ -1,19 +1,23 @@
 #include "Statistics.hpp"
 #include "GfxDevice.hpp"
+#include <atomic>
 #include <chrono>
 
 namespace Statistics
 {
-    int drawCalls = 0;
+    // Atomic counters are also updated by command recording threads.
+    std::atomic< int > drawCalls( 0 );
     int barrierCalls = 0;
     int fenceCalls = 0;
     int shaderBinds = 0;
+    // Pipeline, texture, sampler and other binds that were skipped because the state was already bound.
+    std::atomic< int > avoidedBinds( 0 );
     int renderTargetBinds = 0;
     int createConstantBufferCalls = 0;
     int allocCalls = 0;
     int totalAllocCalls = 0;
-    int triangleCount = 0;
-    int psoBindCount = 0;
+    std::atomic< int > triangleCount( 0 );
+    std::atomic< int > psoBindCount( 0 );
     int queueSubmitCalls = 0;
     float depthNormalsTimeMS = 0;
     float depthNormalsTimeGpuMS = 0;
@@ -27,10 +31,18 @@ namespace Statistics
     float bloomCpuTimeMs = 0;
     float bloomGpuTimeMs = 0;
     float queueWaitTimeMs = 0;
-    float frustumCullTimeMS = 0;
+    std::atomic< float > frustumCullTimeMS( 0 );
     float waitForPreviousFrameTimeMS = 0;
     float lightUpdateTimeMS = 0;
     float acquireNextImageTimeMS = 0;
+    float skinningTimeMS = 0;
+    // Updated by job threads.
+    std::atomic< int > skinPaletteUpdates( 0 );
+    std::size_t textureUploadBytes = 0;
+    float textureUploadMBPerSecond = 0;
+    // Totals since start.
+    int textureCacheHits = 0;
+    int textureCacheMisses = 0;
     
     std::chrono::time_point< std::chrono::steady_clock > startAcquireNextImageTimePoint;
     std::chrono::time_point< std::chrono::steady_clock > startLightUpdateTimePoint;
@@ -41,6 +53,8 @@ namespace Statistics
     std::chrono::time_point< std::chrono::steady_clock > startPresentTimePoint;
     std::chrono::time_point< std::chrono::steady_clock > startSceneAABBPoint;
     std::chrono::time_point< std::chrono::steady_clock > startWaitForPreviousFrameTimePoint;
+    std::chrono::time_point< std::chrono::steady_clock > startSkinningTimePoint;
+    std::chrono::time_point< std::chrono::steady_clock > startTextureUploadTimePoint = std::chrono::steady_clock::now();
 }
 
 void Statistics::BeginLightUpdateProfiling()
@@ -162,7 +176,11 @@ void Statistics::EndPresentTimeProfiling()
 
 void Statistics::IncFrustumCullTime( float ms )
 {
-    frustumCullTimeMS += ms;
+    float oldTimeMS = frustumCullTimeMS;
+
+    while (!frustumCullTimeMS.compare_exchange_weak( oldTimeMS, oldTimeMS + ms ))
+    {
+    }
 }
 
 void Statistics::BeginLightCullerProfiling()
@@ -348,6 +366,16 @@ int Statistics::GetShaderBinds()
     return Statistics::shaderBinds;
 }
 
+void Statistics::IncAvoidedBinds()
+{
+    ++Statistics::avoidedBinds;
+}
+
+int Statistics::GetAvoidedBinds()
+{
+    return Statistics::avoidedBinds;
+}
+
 void Statistics::IncBarrierCalls()
 {
     ++Statistics::barrierCalls;
@@ -359,6 +387,7 @@ void Statistics::ResetFrameStatistics()
     barrierCalls = 0;
     fenceCalls = 0;
     shaderBinds = 0;
+    avoidedBinds = 0;
     renderTargetBinds = 0;
     createConstantBufferCalls = 0;
     allocCalls = 0;
@@ -369,8 +398,49 @@ void Statistics::ResetFrameStatistics()
     frustumCullTimeMS = 0;
     waitForPreviousFrameTimeMS = 0;
     lightUpdateTimeMS = 0;
+    skinningTimeMS = 0;
+    skinPaletteUpdates = 0;
 
     startFrameTimePoint = std::chrono::steady_clock::now();
+
+    const double uploadSeconds = std::chrono::duration< double >( startFrameTimePoint - startTextureUploadTimePoint ).count();
+
+    if (uploadSeconds >= 1)
+    {
+        textureUploadMBPerSecond = static_cast< float >( textureUploadBytes / (1024.0 * 1024.0) / uploadSeconds );
+        textureUploadBytes = 0;
+        startTextureUploadTimePoint = startFrameTimePoint;
+    }
+}
+
+void Statistics::IncTextureUploadBytes( std::size_t bytes )
+{
+    textureUploadBytes += bytes;
+}
+
+float Statistics::GetTextureUploadMBPerSecond()
+{
+    return textureUploadMBPerSecond;
+}
+
+void Statistics::IncTextureCacheHits()
+{
+    ++textureCacheHits;
+}
+
+int Statistics::GetTextureCacheHits()
+{
+    return textureCacheHits;
+}
+
+void Statistics::IncTextureCacheMisses()
+{
+    ++textureCacheMisses;
+}
+
+int Statistics::GetTextureCacheMisses()
+{
+    return textureCacheMisses;
 }
 
 float Statistics::GetLightCullerTimeGpuMS()
@@ -400,6 +470,33 @@ void Statistics::EndSceneAABB()
     Statistics::sceneAABBTimeMS = static_cast< float >(tDiff);
 }
 
+void Statistics::BeginSkinningProfiling()
+{
+    Statistics::startSkinningTimePoint = std::chrono::steady_clock::now();
+}
+
+void Statistics::EndSkinningProfiling()
+{
+    auto tEnd = std::chrono::steady_clock::now();
+    auto tDiff = std::chrono::duration< double, std::milli >( tEnd - Statistics::startSkinningTimePoint ).count();
+    Statistics::skinningTimeMS = static_cast< float >( tDiff );
+}
+
+float Statistics::GetSkinningTimeMS()
+{
+    return skinningTimeMS;
+}
+
+void Statistics::IncSkinPaletteUpdates()
+{
+    ++skinPaletteUpdates;
+}
+
+int Statistics::GetSkinPaletteUpdates()
+{
+    return skinPaletteUpdates;
+}
+
 void UpdateFrameTiming()
 {
     Statistics::EndFrameTimeProfiling();
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstddef>
+
 namespace Statistics
 {
     void BeginLightCullerProfiling();
@@ -36,6 +38,19 @@ namespace Statistics
 
     void BeginSceneAABB();
     void EndSceneAABB();
+
+    void BeginSkinningProfiling();
+    void EndSkinningProfiling();
+    float GetSkinningTimeMS();
+    void IncSkinPaletteUpdates();
+    int GetSkinPaletteUpdates();
+    void IncTextureUploadBytes( std::size_t bytes );
+    /// \return Texture data uploaded per second, averaged over about a second.
+    float GetTextureUploadMBPerSecond();
+    void IncTextureCacheHits();
+    int GetTextureCacheHits();
+    void IncTextureCacheMisses();
+    int GetTextureCacheMisses();
     
     void BeginPresentTimeProfiling();
     void EndPresentTimeProfiling();
@@ -61,6 +76,8 @@ namespace Statistics
     void ResetFrameStatistics();
     void IncShaderBinds();
     int GetShaderBinds();
+    void IncAvoidedBinds();
+    int GetAvoidedBinds();
     void IncBarrierCalls();
     int GetBarrierCalls();
     void IncFenceCalls();
@@ -2,6 +2,7 @@
 
 #include <string>
 #include <vector>
+#include "Animation.hpp"
 #include "VertexBuffer.hpp"
 #include "Vec3.hpp"
 
@@ -10,7 +11,7 @@ namespace ae3d
     struct Joint
     {
         Matrix44 globalBindposeInverse;
-        std::vector< Matrix44 > animTransforms;
+        JointAnimation animation;
         int parentIndex = -1;
         char name[ 128 ];
     };
@@ -24,7 +25,17 @@ namespace ae3d
         std::vector< VertexBuffer::VertexPTNTC > verticesPTNTC;
         std::vector< VertexBuffer::VertexPTNTC_Skinned > verticesPTNTC_Skinned;
         std::vector< VertexBuffer::VertexPTN > verticesPTN;
+        std::vector< VertexBuffer::VertexPTNTC_Compact > verticesPTNTC_Compact;
+        std::vector< VertexBuffer::VertexPTNTC_Compact_Skinned > verticesPTNTC_Compact_Skinned;
+        /// Compact vertex position range: local position = xyz + quantized position (0-1) * w.
+        Vec4 positionDequantization = Vec4( 0, 0, 0, 1 );
         std::vector< VertexBuffer::Face > indices;
         std::vector< Joint > joints;
+
+        /// \return Vertex count of the CPU-side vertex array in use.
+        std::size_t GetVertexCount() const
+        {
+            return verticesPTNTC.size() + verticesPTNTC_Skinned.size() + verticesPTN.size() + verticesPTNTC_Compact.size() + verticesPTNTC_Compact_Skinned.size();
+        }
     };
 }
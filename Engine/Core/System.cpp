@@ -10,10 +10,20 @@
 #endif
 #include <stdarg.h>
 #include <assert.h>
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "AsyncLoad.hpp"
 #include "AudioSystem.hpp"
 #include "GfxDevice.hpp"
+#include "GfxCapture.hpp"
 #include "FileWatcher.hpp"
+#include "Jobs.hpp"
 #include "Matrix.hpp"
 #include "Renderer.hpp"
 #include "Shader.hpp"
@@ -26,11 +36,247 @@ extern ae3d::FileWatcher fileWatcher;
 
 namespace GfxDeviceGlobal
 {
-    extern PerObjectUboStruct perObjectUboStruct;
+    extern thread_local PerObjectUboStruct perObjectUboStruct;
+}
+
+namespace AsyncLoadGlobal
+{
+    struct Job
+    {
+        std::function< void() > work;
+        std::function< void() > finish;
+    };
+
+    const int threadCount = 2;
+    std::vector< std::thread > threads;
+    std::deque< Job > queuedJobs;
+    std::deque< Job > finishedJobs;
+    std::mutex mutex;
+    std::condition_variable workAvailable;
+    int pendingCount = 0;
+    bool isQuitting = false;
+}
+
+static void LoaderThreadMain()
+{
+    while (true)
+    {
+        AsyncLoadGlobal::Job job;
+
+        {
+            std::unique_lock< std::mutex > lock( AsyncLoadGlobal::mutex );
+            AsyncLoadGlobal::workAvailable.wait( lock, [] { return AsyncLoadGlobal::isQuitting || !AsyncLoadGlobal::queuedJobs.empty(); } );
+
+            if (AsyncLoadGlobal::isQuitting)
+            {
+                return;
+            }
+
+            job = AsyncLoadGlobal::queuedJobs.front();
+            AsyncLoadGlobal::queuedJobs.pop_front();
+        }
+
+        job.work();
+
+        std::lock_guard< std::mutex > lock( AsyncLoadGlobal::mutex );
+        AsyncLoadGlobal::finishedJobs.push_back( job );
+    }
+}
+
+void AsyncLoad::Enqueue( const std::function< void() >& work, const std::function< void() >& finish )
+{
+    if (AsyncLoadGlobal::threads.empty())
+    {
+        AsyncLoadGlobal::isQuitting = false;
+
+        for (int threadIndex = 0; threadIndex < AsyncLoadGlobal::threadCount; ++threadIndex)
+        {
+            AsyncLoadGlobal::threads.push_back( std::thread( LoaderThreadMain ) );
+        }
+    }
+
+    std::lock_guard< std::mutex > lock( AsyncLoadGlobal::mutex );
+    AsyncLoadGlobal::Job job;
+    job.work = work;
+    job.finish = finish;
+    AsyncLoadGlobal::queuedJobs.push_back( job );
+    ++AsyncLoadGlobal::pendingCount;
+    AsyncLoadGlobal::workAvailable.notify_one();
+}
+
+void AsyncLoad::ProcessFinished( float budgetMs )
+{
+    const auto begin = std::chrono::steady_clock::now();
+
+    while (true)
+    {
+        AsyncLoadGlobal::Job job;
+
+        {
+            std::lock_guard< std::mutex > lock( AsyncLoadGlobal::mutex );
+
+            if (AsyncLoadGlobal::finishedJobs.empty())
+            {
+                return;
+            }
+
+            job = AsyncLoadGlobal::finishedJobs.front();
+            AsyncLoadGlobal::finishedJobs.pop_front();
+            --AsyncLoadGlobal::pendingCount;
+        }
+
+        job.finish();
+
+        if (std::chrono::duration< float, std::milli >( std::chrono::steady_clock::now() - begin ).count() >= budgetMs)
+        {
+            return;
+        }
+    }
+}
+
+int AsyncLoad::GetPendingCount()
+{
+    std::lock_guard< std::mutex > lock( AsyncLoadGlobal::mutex );
+    return AsyncLoadGlobal::pendingCount;
+}
+
+void AsyncLoad::Deinit()
+{
+    {
+        std::lock_guard< std::mutex > lock( AsyncLoadGlobal::mutex );
+        AsyncLoadGlobal::isQuitting = true;
+    }
+
+    AsyncLoadGlobal::workAvailable.notify_all();
+
+    for (auto& thread : AsyncLoadGlobal::threads)
+    {
+        thread.join();
+    }
+
+    AsyncLoadGlobal::threads.clear();
+    AsyncLoadGlobal::queuedJobs.clear();
+    AsyncLoadGlobal::finishedJobs.clear();
+    AsyncLoadGlobal::pendingCount = 0;
+}
+
+namespace JobsGlobal
+{
+    const unsigned maxThreadCount = 7;
+    std::vector< std::thread > threads;
+    std::mutex mutex;
+    std::condition_variable workStarted;
+    std::condition_variable workFinished;
+    const std::function< void( int, int ) >* work = nullptr;
+    std::atomic< int > nextItem( 0 );
+    int itemCount = 0;
+    int itemsPerRange = 1;
+    unsigned generation = 0;
+    int busyThreadCount = 0;
+    bool isQuitting = false;
+}
+
+static void RunJobRanges()
+{
+    for (int begin = JobsGlobal::nextItem.fetch_add( JobsGlobal::itemsPerRange ); begin < JobsGlobal::itemCount;
+         begin = JobsGlobal::nextItem.fetch_add( JobsGlobal::itemsPerRange ))
+    {
+        (*JobsGlobal::work)( begin, std::min( JobsGlobal::itemCount, begin + JobsGlobal::itemsPerRange ) );
+    }
+}
+
+static void JobThreadMain()
+{
+    unsigned generation = 0;
+
+    while (true)
+    {
+        {
+            std::unique_lock< std::mutex > lock( JobsGlobal::mutex );
+            JobsGlobal::workStarted.wait( lock, [ &generation ]() { return JobsGlobal::isQuitting || JobsGlobal::generation != generation; } );
+
+            if (JobsGlobal::isQuitting)
+            {
+                return;
+            }
+
+            generation = JobsGlobal::generation;
+        }
+
+        RunJobRanges();
+
+        {
+            std::lock_guard< std::mutex > lock( JobsGlobal::mutex );
+            --JobsGlobal::busyThreadCount;
+        }
+
+        JobsGlobal::workFinished.notify_one();
+    }
+}
+
+void Jobs::ParallelFor( int count, int minItemsPerJob, const std::function< void( int, int ) >& work )
+{
+    if (count < 2 * minItemsPerJob)
+    {
+        work( 0, count );
+        return;
+    }
+
+    if (JobsGlobal::threads.empty())
+    {
+        JobsGlobal::isQuitting = false;
+        const unsigned threadCount = std::min( JobsGlobal::maxThreadCount, std::max( 1u, std::thread::hardware_concurrency() ) - 1 );
+
+        for (unsigned threadIndex = 0; threadIndex < threadCount; ++threadIndex)
+        {
+            JobsGlobal::threads.push_back( std::thread( JobThreadMain ) );
+        }
+    }
+
+    if (JobsGlobal::threads.empty())
+    {
+        work( 0, count );
+        return;
+    }
+
+    {
+        std::lock_guard< std::mutex > lock( JobsGlobal::mutex );
+        // A few ranges per thread balance uneven items.
+        JobsGlobal::itemsPerRange = std::max( minItemsPerJob, count / ((int)JobsGlobal::threads.size() * 4 + 4) );
+        JobsGlobal::itemCount = count;
+        JobsGlobal::nextItem = 0;
+        JobsGlobal::work = &work;
+        JobsGlobal::busyThreadCount = (int)JobsGlobal::threads.size();
+        ++JobsGlobal::generation;
+    }
+
+    JobsGlobal::workStarted.notify_all();
+    RunJobRanges();
+
+    std::unique_lock< std::mutex > lock( JobsGlobal::mutex );
+    JobsGlobal::workFinished.wait( lock, []() { return JobsGlobal::busyThreadCount == 0; } );
+    JobsGlobal::work = nullptr;
+}
+
+void Jobs::Deinit()
+{
+    {
+        std::lock_guard< std::mutex > lock( JobsGlobal::mutex );
+        JobsGlobal::isQuitting = true;
+    }
+
+    JobsGlobal::workStarted.notify_all();
+
+    for (auto& thread : JobsGlobal::threads)
+    {
+        thread.join();
+    }
+
+    JobsGlobal::threads.clear();
 }
 
 void PlatformInitGamePad();
-std::chrono::time_point<std::chrono::steady_clock> tStart;
+thread_local std::chrono::time_point<std::chrono::steady_clock> tStart;
 long double startTimeStamp;
 
 using namespace ae3d;
@@ -94,6 +340,8 @@ float ae3d::System::SecondsSinceStartup()
 
 void ae3d::System::Deinit()
 {
+    AsyncLoad::Deinit();
+    Jobs::Deinit();
     GfxDevice::ReleaseGPUObjects();
     AudioSystem::Deinit();
 }
@@ -164,12 +412,52 @@ void ae3d::System::LoadBuiltinAssets()
     startTimeStamp = (long double)std::chrono::duration_cast< std::chrono::milliseconds >( std::chrono::system_clock::now().time_since_epoch() ).count();
 }
 
+void ae3d::System::SetCommandRecordingThreadCount( int threadCount )
+{
+#if RENDERER_VULKAN
+    GfxDevice::SetRecordingThreadCount( threadCount );
+#else
+    (void)threadCount;
+#endif
+}
+
+void ae3d::System::BeginGfxCapture( const char* path, int frameCount )
+{
+#if RENDERER_VULKAN
+    GfxCapture::Begin( path, frameCount );
+#else
+    (void)path;
+    (void)frameCount;
+    Print( "GfxDevice capture is only supported on Vulkan\n" );
+#endif
+}
+
+int ae3d::System::LoadGfxCapture( const char* path )
+{
+#if RENDERER_VULKAN
+    return GfxCapture::Load( path );
+#else
+    (void)path;
+    Print( "GfxDevice capture is only supported on Vulkan\n" );
+    return 0;
+#endif
+}
+
+void ae3d::System::ReplayGfxCaptureFrame( int frameIndex )
+{
+#if RENDERER_VULKAN
+    GfxCapture::ReplayFrame( frameIndex );
+#else
+    (void)frameIndex;
+#endif
+}
+
 void ae3d::System::Print( const char* format, ... )
 {
     va_list ap;
     va_start(ap, format);
 
-    static char msg[ 2048 ];
+    static thread_local char msg[ 2048 ];
 #if _MSC_VER
     vsnprintf_s( msg, sizeof(msg), format, ap );
 #else
@@ -292,6 +580,16 @@ void ae3d::System::ReloadChangedAssets()
     fileWatcher.Poll();
 }
 
+void ae3d::System::ProcessAsyncLoads( float budgetMs )
+{
+    AsyncLoad::ProcessFinished( budgetMs );
+}
+
+int ae3d::System::GetPendingAsyncLoadCount()
+{
+    return AsyncLoad::GetPendingCount();
+}
+
 void ae3d::System::Statistics::SetBloomTime( float cpuMs, float gpuMs )
 {
     ::Statistics::SetBloomTime( cpuMs, gpuMs );
@@ -312,6 +610,11 @@ int ae3d::System::Statistics::GetShaderBindCount()
     return ::Statistics::GetShaderBinds();
 }
 
+int ae3d::System::Statistics::GetAvoidedBindCount()
+{
+    return ::Statistics::GetAvoidedBinds();
+}
+
 void ae3d::System::Statistics::GetGpuMemoryUsage( unsigned& outUsedMBytes, unsigned& outBudgetMBytes )
 {
     GfxDevice::GetGpuMemoryUsage( outUsedMBytes, outBudgetMBytes );
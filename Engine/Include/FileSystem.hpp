@@ -23,6 +23,21 @@ namespace ae3d
             bool isLoaded = false;
         };
 
+        /// Read-only view of file contents. Memory-mapped where supported, so pages are read on first access.
+        struct MappedFile
+        {
+            /// File content bytes, or null if the file could not be opened.
+            const unsigned char* data = nullptr;
+            /// Content size in bytes.
+            std::size_t size = 0;
+            /// File path.
+            std::string path;
+            /// Contents of files that could not be mapped, for example ones inside .pak files.
+            std::vector< unsigned char > readContents;
+            /// Platform mapping handle.
+            void* handle = nullptr;
+        };
+
         /**
         Reads file contents.
 
@@ -30,6 +45,14 @@ namespace ae3d
         */
         FileContentsData FileContents( const char* path );
 
+        /// Maps file contents into memory. Falls back to reading the file when it's inside a .pak file or mapping is not supported.
+        /// \param path Path.
+        /// \param outFile Mapped file. outFile.data is null if the file could not be opened. Must be released with UnmapFile().
+        void MapFile( const char* path, MappedFile& outFile );
+
+        /// \param file File mapped with MapFile(). Its data is invalid after this call.
+        void UnmapFile( MappedFile& file );
+
         /// \param path .pak file path. After this call FileContents() searches first in all loaded .pak files and if the file is not found, it's loaded without .pak file.
         void LoadPakFile( const char* path );
 
@@ -83,6 +83,12 @@ namespace ae3d
         /// \return Layer.
         unsigned GetLayer() const { return layer; }
 
+        /// \param aIsStatic True if the game object never moves, so its mesh can be merged by Scene::CreateStaticBatches().
+        void SetStatic( bool aIsStatic ) { isStatic = aIsStatic; }
+
+        /// \return True if the game object never moves.
+        bool IsStatic() const { return isStatic; }
+
         /// \return Game Object's contents excluding components
         std::string GetSerialized() const;
 
@@ -101,5 +107,6 @@ namespace ae3d
         std::string name;
         unsigned layer = 1;
         bool isEnabled = true;
+        bool isStatic = false;
     };
 }
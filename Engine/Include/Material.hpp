@@ -63,6 +63,10 @@ namespace ae3d
         /// \param renderTexture Render texture.
         /// \param slot Slot in the shader.
         void SetRenderTexture( RenderTexture* renderTexture, int slot );
+
+        /// Requests streamed mips of the material's textures. Called internally for visible meshes.
+        /// \param screenSize Size of the mesh on screen in pixels.
+        void RequestStreamedMips( float screenSize );
         
   private:
         static RenderTexture* sTexRT;
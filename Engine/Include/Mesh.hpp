@@ -1,5 +1,6 @@
 #pragma once
 
+#include <string>
 #include <type_traits>
 #include "Array.hpp"
 
@@ -12,6 +13,7 @@ namespace ae3d
 
     struct SubMesh;
     struct Vec3;
+    struct Matrix44;
     
     /// Contains a mesh. Can contain submeshes.
     class Mesh
@@ -38,6 +40,33 @@ namespace ae3d
         /// \param meshData Data from .ae3d mesh file.
         /// \return Load result.
         LoadResult Load( const FileSystem::FileContentsData& meshData );
+
+        /// Loads a .ae3d mesh file by memory-mapping it. Version c0 files are uploaded directly from the mapping.
+        /// \param path Path to .ae3d mesh file.
+        /// \return Load result.
+        LoadResult Load( const char* path );
+
+        /// Starts loading a .ae3d mesh file on a loader thread. The mesh is a default cube until System::ProcessAsyncLoads() uploads it.
+        /// Meshes that load the same path at the same time share one read. Version a9-b2 files are also parsed and decompressed on the loader thread.
+        /// \param path Path to .ae3d mesh file.
+        void LoadAsync( const char* path );
+
+        /// \return True between LoadAsync() and the upload of the loaded mesh.
+        bool IsLoading() const;
+
+        /// Selects whether vertices and indices are kept in CPU memory after upload. Defaults to true.
+        /// Must be called before Load(). Picking with GetSubMeshFlattenedTriangles() and static batching need CPU data.
+        /// \param keep True to keep CPU data.
+        void SetKeepCpuData( bool keep );
+
+        /// Meshes loaded from the same path share their data through a cache. Data that is no longer referenced by any Mesh
+        /// stays cached for later loads until more than unusedMeshCount such meshes exist, then least recently used ones are evicted.
+        /// \param unusedMeshCount Maximum count of cached meshes not referenced by any Mesh. Defaults to 64.
+        static void SetCacheCapacity( unsigned unusedMeshCount );
+
+        /// Removes a mesh from the cache. Meshes that reference it keep their data and the next Load() reads the file again.
+        /// \param path Path the mesh was loaded from.
+        static void EvictFromCache( const char* path );
         
         /// \return Axis-aligned bounding box minimum in local coordinates.
         const Vec3& GetAABBMin() const;
@@ -67,6 +96,7 @@ namespace ae3d
         
       private:
         friend class MeshRendererComponent;
+        friend class Scene;
         
         struct Impl;
         Impl& m() { return reinterpret_cast<Impl&>(_storage); }
@@ -78,5 +108,22 @@ namespace ae3d
         std::aligned_storage<StorageSize, StorageAlign>::type _storage = {};
         
         SubMesh* GetSubMeshes( int& outCount );
+
+        /// \return True if path was found in the mesh cache and this mesh was set up from it.
+        bool LoadFromCache( const std::string& path );
+
+        /// Loads a version c0 file whose vertices and indices are stored in their GPU layout.
+        LoadResult LoadPacked( const unsigned char* data, std::size_t size, const std::string& path );
+
+        /// Adds this mesh into the cache and watches path for reloading.
+        void FinishLoad( const std::string& path );
+
+        /// Appends a submesh of source transformed by localToWorld into submesh batchIndex of this mesh, creating it if needed. Used by static batching.
+        /// \return False if the source submesh is skinned or has no CPU-side vertices, and was not appended.
+        bool AppendToStaticBatch( unsigned batchIndex, const Mesh& source, unsigned sourceSubMeshIndex, const Matrix44& localToWorld );
+
+        /// Generates vertex buffers and AABBs of submeshes created by AppendToStaticBatch().
+        /// \param name Name used as the mesh path and in debug names.
+        void FinishStaticBatch( const char* name );
     };
 }
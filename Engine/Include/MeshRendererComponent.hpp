@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Array.hpp"
+#include "Matrix.hpp"
 
 namespace ae3d
 {
@@ -44,7 +45,10 @@ namespace ae3d
         void EnableBoundingBoxDrawing( bool enable );
         
         /// \param frame Animation frame. If too high or low, repeats from the beginning using modulo.
-        void SetAnimationFrame( int frame ) { animFrame = frame; }
+        void SetAnimationFrame( int frame ) { animFrame = (float)frame; }
+
+        /// \param seconds Animation time. Poses are interpolated between frames. If too high or low, repeats from the beginning.
+        void SetAnimationTime( float seconds );
         
         /// \return True, if the mesh will be rendered as a wireframe.
         bool IsWireframe() const { return isWireframe; }
@@ -67,13 +71,37 @@ namespace ae3d
         /// \return Component at index or null if index is invalid.
         static MeshRendererComponent* Get( unsigned index );
         
-        /// Applies skin
+        /// Points the draw's bone offset at the submesh's joints in the bone palette buffer.
         /// \param subMeshIndex Submesh index
         void ApplySkin( unsigned subMeshIndex );
+
+        /// Evaluates the pose of the current animation frame into the skin palette, unless it's already evaluated.
+        /// Can run on a job thread.
+        void UpdateSkinPalette();
+
+        /// Evaluates skin palettes on job threads and uploads them into the bone palette buffer. Renderers whose mesh
+        /// and animation frame are the same share one palette. Called once per frame before rendering, so all passes
+        /// and submeshes reuse the palettes.
+        /// \param renderers Enabled renderers.
+        /// \param count Renderer count.
+        static void UpdateSkinPalettes( MeshRendererComponent** renderers, int count );
         
+        /// Creates pipeline states for drawing submeshes into target. Does nothing on backends that create them lazily without stalling.
+        /// \param target Render target, or null for backbuffer.
+        /// \param overrideShader Override shader. Used for shadow and depth-normals passes.
+        /// \param overrideSkinShader Override shader for skinned meshes.
+        void CreatePSOs( class RenderTexture* target, class Shader* overrideShader, Shader* overrideSkinShader );
+
         /// \param cameraFrustum cameraFrustum
         /// \param localToWorld Local-to-World matrix
         void Cull( const class Frustum& cameraFrustum, const struct Matrix44& localToWorld );
+
+        /// Requests streamed mips of visible submeshes' textures. Must be called after Cull().
+        /// \param localToView Model-view matrix.
+        /// \param viewToClip Projection matrix.
+        /// \param isPerspective True if the projection is perspective.
+        /// \param viewportHeight Viewport height in pixels.
+        void RequestStreamedMips( const Matrix44& localToView, const Matrix44& viewToClip, bool isPerspective, float viewportHeight );
         
         /// \param localToView Model-view matrix.
         /// \param localToClip Model-view-projection matrix.
@@ -87,11 +115,28 @@ namespace ae3d
                      const Matrix44& shadowView, const Matrix44& shadowProjection, class Shader* overrideShader,
                      Shader* overrideSkinShader, RenderType renderType );
 
+        /// Draws the bounding box if it's enabled and the renderer is visible. Line buffers are shared by all renderers,
+        /// so this is called on the main thread after Render() calls that can run on command recording threads.
+        /// \param localToView Model-view matrix.
+        /// \param localToClip Model-view-projection matrix.
+        void RenderBoundingBox( const Matrix44& localToView, const Matrix44& localToClip );
+
         Mesh* mesh = nullptr;
         Array< Material* > materials;
         Array< bool > isSubMeshCulled;
         GameObject* gameObject = nullptr;
-        int animFrame = 0;
+        /// Bone matrices of all submeshes' joints. Joints of submesh i start at skinPaletteOffsets[ i ].
+        Array< Matrix44 > skinPalette;
+        Array< unsigned > skinPaletteOffsets;
+        /// Submeshes whose joints are in the palette.
+        const struct SubMesh* skinPaletteSubMeshes = nullptr;
+        /// Renderer whose palette is used this frame because it has the same pose, or null.
+        const MeshRendererComponent* skinPaletteSource = nullptr;
+        /// Index of the palette's first joint in the bone palette buffer.
+        unsigned skinPaletteGpuOffset = 0;
+        float animFrame = 0;
+        float skinPaletteFrame = 0;
+        bool isSkinPaletteValid = false;
         bool isCulled = false;
         bool isWireframe = false;
         bool isEnabled = true;
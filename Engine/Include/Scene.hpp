@@ -52,6 +52,22 @@ namespace ae3d
                                        std::map< std::string, class Texture2D* >& outTexture2Ds,
                                        std::map< std::string, class Material* >& outMaterials,
                                        Array< class Mesh* >& outMeshes ) const;
+
+        /// Creates pipeline states that meshes in newGameObjects need when rendered by this scene's and newGameObjects' cameras and shadow casting lights,
+        /// so that their first frame doesn't stall on pipeline creation. Call after adding the cameras and lights, for example with Deserialize() output.
+        /// \param newGameObjects Game objects whose mesh renderers are prepared. Currently only affects Vulkan.
+        void CreatePipelineStates( std::vector< GameObject >& newGameObjects );
+
+        /// Merges mesh renderers of static game objects (GameObject::SetStatic()) that share a material, layer and shadow/wireframe settings
+        /// into combined world-space meshes, and disables the merged mesh renderers. Each combined mesh is split into chunks, one submesh each,
+        /// so frustum culling works at chunk granularity. Objects that are skinned, use alpha blending or lack materials are not merged.
+        /// Combined meshes exist only at runtime, so don't serialize the scene after batching.
+        /// \param newGameObjects Game objects to merge, for example from Deserialize().
+        /// \param chunkSize Chunk grid cell size in world units. Objects are assigned to cells by their AABB center. 0 disables spatial chunking.
+        /// \param outBatches Returns game objects that render the combined meshes. Add them into the scene after the call; the vector must not reallocate after that.
+        /// \param outMeshes Returns meshes that were created. Caller is responsible for freeing the memory.
+        /// \return Number of draws saved per pass when nothing is culled.
+        int CreateStaticBatches( std::vector< GameObject >& newGameObjects, float chunkSize, std::vector< GameObject >& outBatches, Array< class Mesh* >& outMeshes );
         
     private:
         void RenderWithCamera( GameObject* cameraGo, int cubeMapFace, const char* debugGroupName );
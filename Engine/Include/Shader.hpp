@@ -23,6 +23,9 @@ namespace ae3d
     class Shader
     {
     public:
+        /// Vertex attributes read by the vertex shader.
+        enum class VertexInput { All, Position, PositionNormal };
+
         /// Loads a HLSL shader from source code. For portability it's better to call the other
         /// load method that can take all shaders as input.
         /// \param vertexSource Vertex shader source.
@@ -70,6 +73,16 @@ namespace ae3d
         /// \return Vertex shader path.
         const std::string& GetVertexShaderPath() const { return vertexPath; }
 
+        /// \return Fragment shader path.
+        const std::string& GetFragmentShaderPath() const { return fragmentPath; }
+
+        /// Declares that the vertex shader reads only positions or positions and normals, so draws can bind a vertex buffer's matching depth stream.
+        /// \param input Attributes read by the vertex shader.
+        void SetVertexInput( VertexInput input ) { vertexInput = input; }
+
+        /// \return Attributes read by the vertex shader.
+        VertexInput GetVertexInput() const { return vertexInput; }
+
 #if RENDERER_D3D12
         bool IsValid() const { return blobShaderVertex != nullptr; }
         ID3DBlob* blobShaderVertex = nullptr;
@@ -101,6 +114,7 @@ namespace ae3d
         Array< UniformLocation > uniformLocations;
         std::string vertexPath;
         std::string fragmentPath;
+        VertexInput vertexInput = VertexInput::All;
 
 #if RENDERER_D3D12
         void ReflectVariables();
@@ -81,6 +81,11 @@
    CombineFiles creates .pak files that contain contents of multiple files. You run it with command <code>CombineFiles inputFile outputFile</code> where
    inputFile is just a text file containing a list of file paths, each on their own line.
 
+   \subsection AssetBuilder
+
+   AssetBuilder runs the tools for all files listed in a manifest file. It only rebuilds files whose inputs, arguments or tool changed and
+   runs conversions in parallel. CombineFiles lines run last to create .pak files. Run it with <code>AssetBuilder manifest.txt</code>.
+
    \subsection SDF_Generator
 
    Generates a signed-distance field from a texture, useful for high-quality font rendering.
@@ -187,6 +192,24 @@ namespace ae3d
 
         /// Loads built-in assets and shaders.
         void LoadBuiltinAssets();
+
+        /// Sets how many worker threads record draws of large render passes. 0 (default) records everything on the calling thread.
+        /// Only used by the Vulkan renderer. Call after the window has been created and outside Scene::Render().
+        void SetCommandRecordingThreadCount( int threadCount );
+
+        /// Records the GfxDevice calls of the next frameCount frames into a file. Only used by the Vulkan renderer.
+        /// \param path Capture file path.
+        /// \param frameCount Number of frames to capture.
+        void BeginGfxCapture( const char* path, int frameCount );
+
+        /// Loads a capture written by BeginGfxCapture. Call after the window has been created and builtin assets loaded.
+        /// \param path Capture file path.
+        /// \return Captured frame count, or 0 if the capture could not be loaded.
+        int LoadGfxCapture( const char* path );
+
+        /// Replays a frame of a capture loaded by LoadGfxCapture, including presenting it.
+        /// \param frameIndex Frame index.
+        void ReplayGfxCaptureFrame( int frameIndex );
         
 #if RENDERER_METAL
         void InitMetal( id< MTLDevice > metalDevice, MTKView* view, int sampleCount, int uiVBSize, int uiIBSize );
@@ -215,6 +238,14 @@ namespace ae3d
         /// Reloads assets that have been changed on disk. Relatively slow operation, so avoid calling too often.
         void ReloadChangedAssets();
 
+        /// Uploads meshes and textures whose Mesh::LoadAsync() or Texture2D::LoadAsync() background work has completed.
+        /// Call once per frame on the render thread, outside Scene::Render().
+        /// \param budgetMs Time budget in milliseconds. At least one completed load is uploaded per call.
+        void ProcessAsyncLoads( float budgetMs );
+
+        /// \return Count of async loads that have not been uploaded yet.
+        int GetPendingAsyncLoadCount();
+
         /// Tests internal functionality.
         void RunUnitTests();
 
@@ -224,6 +255,8 @@ namespace ae3d
             void GetStatistics( char* outStr );
             int GetDrawCallCount();
             int GetShaderBindCount();
+            /// \return Count of binds that were skipped this frame because the same state was already bound.
+            int GetAvoidedBindCount();
             int GetRenderTargetBindCount();
             int GetBarrierCallCount();
             int GetFenceCallCount();
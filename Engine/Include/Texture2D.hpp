@@ -29,6 +29,9 @@ namespace ae3d
         /// \param layouts Target layouts.
         /// \param count Count. Must be equal or less than textures and layouts array item count.
         static void SetLayouts( Texture2D* textures[], TextureLayout layouts[], int count );
+
+        /// Stops the texture cache and mip streaming from updating the texture. Graphics API objects are shared by the cache and not released.
+        ~Texture2D();
         
         /// \param layout Layout.
         void SetLayout( TextureLayout layout );
@@ -48,6 +51,19 @@ namespace ae3d
         /// \param anisotropy Anisotropy. Value range is 1-16 depending on support. On Metal the value is bucketed into 1, 2, 4, 8 and 16.
         void Load( const FileSystem::FileContentsData& textureData, TextureWrap wrap, TextureFilter filter, Mipmaps mipmaps, ColorSpace colorSpace, Anisotropy anisotropy );
         
+        /// Starts reading and decoding a texture file on a loader thread. The texture is the default texture until System::ProcessAsyncLoads() uploads it.
+        /// Destroying the texture or calling Load() or LoadAsync() again cancels the pending load.
+        /// \param path Path to a dds, png, tga, jpg or bmp file.
+        /// \param wrap Wrap mode.
+        /// \param filter Filter mode.
+        /// \param mipmaps Mipmaps.
+        /// \param colorSpace Color space.
+        /// \param anisotropy Anisotropy.
+        void LoadAsync( const char* path, TextureWrap wrap, TextureFilter filter, Mipmaps mipmaps, ColorSpace colorSpace, Anisotropy anisotropy );
+
+        /// \return True between LoadAsync() and the upload of the loaded texture.
+        bool IsLoading() const;
+
         /// \param atlasTextureData Atlas texture image data. File format must be dds, png, tga, jpg or bmp.
         /// \param atlasMetaData Atlas metadata. Format is Ogre/CEGUI. Example atlas tool: Texture Packer.
         /// \param textureName Name of the texture in atlas.
@@ -72,9 +88,43 @@ namespace ae3d
         /// Destroys all textures. Called internally at exit.
         static void DestroyTextures();
 
+        /// Enables mip streaming of .dds textures with mipmaps that are loaded after this call. They are loaded with mips up to 64x64
+        /// and more detailed mips are read on loader threads when visible meshes need them. Streamed textures must stay alive and must not be copied.
+        /// \param budgetBytes Memory budget of streamed textures' mips. Mips up to 64x64 are always resident. 0 disables streaming, which is the default.
+        static void SetStreamingBudget( std::size_t budgetBytes );
+
+        /// \return Memory used by resident mips of streamed textures in bytes.
+        static std::size_t GetStreamingMemoryUsage();
+
+        /// \return Memory used by textures that were loaded from files in bytes. A file that is loaded many times with the same settings is counted once.
+        static std::size_t GetCacheMemoryUsage();
+
+        /// Sets the filter of mipmaps that are generated for .png, .jpg, .tga, .bmp and .gif textures loaded after this call. Box is the default, Kaiser is sharper.
+        static void SetMipmapFilter( MipmapFilter filter );
+
+        /// Loads and evicts streamed mips based on requests since the previous call. Called internally once per frame.
+        static void UpdateStreaming();
+
+        /// Requests mips for drawing the texture. Does nothing if the texture is not streamed. Called internally for visible meshes' textures.
+        /// \param screenSize Size of the texture on screen in pixels.
+        void RequestStreamedMips( float screenSize );
+
     private:
-        /// \param path Path.
-        void LoadDDS( const char* path );
+        /// Registers the texture for mip streaming if it's enabled and the texture has mipmaps.
+        /// \param ddsOutput Loaded .dds file.
+        /// \param mipCount Mip count of the texture with all mips resident.
+        /// \return Most detailed mip to create.
+        int BeginStreaming( const DDSLoader::Output& ddsOutput, int mipCount );
+
+        /// Creates graphics API objects from a .dds file's mips firstMip and smaller, replacing previous ones.
+        /// Width and height stay at the size of mip 0 and mipLevelCount is the count of created mips.
+        /// \param ddsOutput Loaded .dds file.
+        /// \param firstMip Most detailed mip to create.
+        /// \param releasePrevious True if the previous objects were created by this method and are released after the frame.
+        void CreateFromDDSMips( const DDSLoader::Output& ddsOutput, int firstMip, bool releasePrevious );
+
+        /// \param fileContents Contents of a .dds file.
+        void LoadDDS( const FileSystem::FileContentsData& fileContents );
         
         /**
           Loads texture from stb_image.c supported formats.
@@ -87,12 +137,14 @@ namespace ae3d
         void LoadPVRv3( const char* path );
 #endif
 #if RENDERER_VULKAN
-        void CreateVulkanObjects( const DDSLoader::Output& mipChain, VkFormat format );
+        void CreateVulkanObjects( const DDSLoader::Output& mipChain, VkFormat format, int firstMip );
         void CreateVulkanObjects( void* data, int bytesPerPixel, VkFormat format, VkImageUsageFlags usageFlags );
         VkImage image = VK_NULL_HANDLE;
         VkImageView view = VK_NULL_HANDLE;
         VkDeviceMemory deviceMemory = VK_NULL_HANDLE;
         VkImageLayout layout = VK_IMAGE_LAYOUT_GENERAL;
 #endif
+        /// Index in streamed textures or -1 if the texture is not streamed.
+        int streamingIndex = -1;
     };
 }
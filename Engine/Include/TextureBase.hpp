@@ -61,6 +61,13 @@ namespace ae3d
         k8
     };
 
+    /// Filter of mipmaps that are generated on the CPU.
+    enum class MipmapFilter
+    {
+        Box,
+        Kaiser
+    };
+
     /// Data type.
     enum class DataType
     {
@@ -71,8 +78,6 @@ namespace ae3d
         R32F
     };
 
-    std::string GetCacheHash( const std::string& path, ae3d::TextureWrap wrap, ae3d::TextureFilter filter, ae3d::Mipmaps mipmaps, ae3d::ColorSpace colorSpace, ae3d::Anisotropy anisotropy );
-
     enum class TextureLayout
     {
         General, ShaderRead, ShaderReadWrite, UAVBarrier
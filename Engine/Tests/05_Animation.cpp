@@ -0,0 +1,146 @@
+#include <iostream>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include "Animation.hpp"
+#include "Matrix.hpp"
+#include "SubMesh.hpp"
+#include "Vec3.hpp"
+
+using namespace ae3d;
+
+bool IsAlmost( const Matrix44& m1, const Matrix44& m2, float tolerance )
+{
+    for (int i = 0; i < 16; ++i)
+    {
+        if (std::abs( m1.m[ i ] - m2.m[ i ] ) > tolerance)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Root joint moves and turns, its child swings around the root.
+void MakeJointTransforms( int frameCount, std::vector< Matrix44 > outGlobalTransforms[ 2 ] )
+{
+    for (int f = 0; f < frameCount; ++f)
+    {
+        Matrix44 root;
+        root.MakeRotationXYZ( 0, f * 6.0f, 0 );
+        root.SetTranslation( Vec3( f * 0.1f, 0, 2 ) );
+
+        Matrix44 childLocal;
+        childLocal.MakeRotationXYZ( std::sin( f * 0.3f ) * 45.0f, 0, 0 );
+        childLocal.SetTranslation( Vec3( 0, 1, 0 ) );
+
+        Matrix44 child;
+        Matrix44::Multiply( childLocal, root, child );
+
+        outGlobalTransforms[ 0 ].push_back( root );
+        outGlobalTransforms[ 1 ].push_back( child );
+    }
+}
+
+bool TestAnimationRoundTrip()
+{
+    const int frameCount = 40;
+    std::vector< Matrix44 > globalTransforms[ 2 ];
+    MakeJointTransforms( frameCount, globalTransforms );
+
+    Joint joints[ 2 ];
+    std::strcpy( joints[ 0 ].name, "root" );
+    std::strcpy( joints[ 1 ].name, "child" );
+    joints[ 1 ].parentIndex = 0;
+
+    Animation::Compress( globalTransforms, joints, 2 );
+
+    if (Animation::GetFrameCount( joints[ 0 ].animation ) != frameCount || Animation::GetFrameCount( joints[ 1 ].animation ) != frameCount)
+    {
+        std::cerr << "Animation Compress frame count failed!" << std::endl;
+        return false;
+    }
+
+    if (!joints[ 1 ].animation.isRelativeToParent)
+    {
+        std::cerr << "Animation Compress parent space failed!" << std::endl;
+        return false;
+    }
+
+    for (int f = 0; f < frameCount; ++f)
+    {
+        Matrix44 sampled[ 2 ];
+        Animation::Sample( joints, 2, (float)f, sampled );
+
+        for (int j = 0; j < 2; ++j)
+        {
+            if (!IsAlmost( sampled[ j ], globalTransforms[ j ][ f ], 0.01f ))
+            {
+                std::cerr << "Animation Sample failed for joint " << j << " at frame " << f << "!" << std::endl;
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+bool TestAnimationLoop()
+{
+    const int frameCount = 40;
+    std::vector< Matrix44 > globalTransforms[ 2 ];
+    MakeJointTransforms( frameCount, globalTransforms );
+
+    Joint joints[ 2 ];
+    joints[ 1 ].parentIndex = 0;
+    Animation::Compress( globalTransforms, joints, 2 );
+
+    Matrix44 sampled[ 2 ];
+    Matrix44 looped[ 2 ];
+    Animation::Sample( joints, 2, 3.0f, sampled );
+    Animation::Sample( joints, 2, 3.0f + frameCount, looped );
+
+    if (!IsAlmost( sampled[ 1 ], looped[ 1 ], 0.0001f ))
+    {
+        std::cerr << "Animation Sample looping failed!" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+bool TestStaticJoint()
+{
+    std::vector< Matrix44 > globalTransforms[ 1 ];
+
+    Joint joints[ 1 ];
+    Animation::Compress( globalTransforms, joints, 1 );
+
+    Matrix44 sampled[ 1 ];
+    sampled[ 0 ].SetTranslation( Vec3( 1, 2, 3 ) );
+    const Matrix44 untouched = sampled[ 0 ];
+    Animation::Sample( joints, 1, 5.0f, sampled );
+
+    if (Animation::GetFrameCount( joints[ 0 ].animation ) != 0 || !IsAlmost( sampled[ 0 ], untouched, 0 ))
+    {
+        std::cerr << "Animation of a static joint failed!" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+int main()
+{
+    bool result = true;
+
+    result &= TestAnimationRoundTrip();
+    result &= TestAnimationLoop();
+    result &= TestStaticJoint();
+
+    assert( result && "Animation tests failed!" );
+
+    return result ? 0 : 1;
+}
@@ -0,0 +1,252 @@
+#include <algorithm>
+#include <iostream>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "MeshCodec.hpp"
+#include "../../Tools/common.hpp"
+
+// Deterministic pseudo-random numbers, so failures can be reproduced.
+static unsigned Random( unsigned& state )
+{
+    state = state * 1664525u + 1013904223u;
+    return state >> 8;
+}
+
+// Smooth positions and normals like in real meshes, followed by bytes that change randomly.
+static std::vector< unsigned char > MakeVertices( std::size_t vertexCount, std::size_t vertexSize )
+{
+    std::vector< unsigned char > vertices( vertexCount * vertexSize );
+    unsigned state = 1;
+
+    for (std::size_t v = 0; v < vertexCount; ++v)
+    {
+        const float position[ 3 ] = { v * 0.25f, (v % 7) * 0.5f, 1.0f };
+        const std::size_t positionSize = std::min( sizeof( position ), vertexSize );
+        std::memcpy( &vertices[ v * vertexSize ], position, positionSize );
+
+        for (std::size_t k = positionSize; k < vertexSize; ++k)
+        {
+            vertices[ v * vertexSize + k ] = (unsigned char)(k < vertexSize / 2 ? v : Random( state ));
+        }
+    }
+
+    return vertices;
+}
+
+// A grid whose triangles share edges, followed by triangles that reference distant vertices.
+static std::vector< VertexInd > MakeFaces( unsigned gridSize, unsigned& outVertexCount )
+{
+    std::vector< VertexInd > faces;
+
+    for (unsigned y = 0; y < gridSize; ++y)
+    {
+        for (unsigned x = 0; x < gridSize; ++x)
+        {
+            const unsigned v = y * (gridSize + 1) + x;
+            faces.push_back( { v, v + 1, v + gridSize + 1 } );
+            faces.push_back( { v + 1, v + gridSize + 2, v + gridSize + 1 } );
+        }
+    }
+
+    outVertexCount = (gridSize + 1) * (gridSize + 1);
+    unsigned state = 2;
+
+    for (int f = 0; f < 50; ++f)
+    {
+        faces.push_back( { Random( state ) % outVertexCount, Random( state ) % outVertexCount, Random( state ) % outVertexCount } );
+    }
+
+    return faces;
+}
+
+// The encoder can rotate triangles but keeps their winding.
+static bool IsSameTriangle( const VertexInd& face, const std::uint32_t* indices )
+{
+    for (int r = 0; r < 3; ++r)
+    {
+        if (indices[ r ] == face.a && indices[ (r + 1) % 3 ] == face.b && indices[ (r + 2) % 3 ] == face.c)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool TestVertexRoundTrip()
+{
+    const std::size_t vertexSizes[] = { 4, 12, 32, 256 };
+    const std::size_t vertexCounts[] = { 1, 16, 37 };
+
+    for (std::size_t vertexSize : vertexSizes)
+    {
+        for (std::size_t vertexCount : vertexCounts)
+        {
+            const std::vector< unsigned char > vertices = MakeVertices( vertexCount, vertexSize );
+            const std::vector< unsigned char > encoded = EncodeVertexBuffer( vertices.data(), vertexCount, vertexSize );
+            std::vector< unsigned char > decoded( vertices.size() );
+
+            if (!MeshCodec::DecodeVertexBuffer( decoded.data(), vertexCount, vertexSize, encoded.data(), encoded.size() ) || decoded != vertices)
+            {
+                std::cerr << "Vertex stream round trip failed for " << vertexCount << " vertices of " << vertexSize << " bytes!" << std::endl;
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+bool TestIndexRoundTrip()
+{
+    unsigned vertexCount = 0;
+    const std::vector< VertexInd > faces = MakeFaces( 20, vertexCount );
+    const std::vector< unsigned char > encoded = EncodeIndexBuffer( faces );
+    std::vector< std::uint32_t > decoded( faces.size() * 3 );
+
+    if (!MeshCodec::DecodeIndexBuffer( decoded.data(), decoded.size(), vertexCount, encoded.data(), encoded.size() ))
+    {
+        std::cerr << "Index stream decoding failed!" << std::endl;
+        return false;
+    }
+
+    for (std::size_t f = 0; f < faces.size(); ++f)
+    {
+        if (!IsSameTriangle( faces[ f ], &decoded[ f * 3 ] ))
+        {
+            std::cerr << "Index stream round trip failed at face " << f << "!" << std::endl;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool TestTruncatedStreams()
+{
+    const std::size_t vertexCount = 37;
+    const std::size_t vertexSize = 32;
+    const std::vector< unsigned char > vertices = MakeVertices( vertexCount, vertexSize );
+    const std::vector< unsigned char > encodedVertices = EncodeVertexBuffer( vertices.data(), vertexCount, vertexSize );
+    std::vector< unsigned char > decodedVertices( vertices.size() );
+
+    unsigned faceVertexCount = 0;
+    const std::vector< VertexInd > faces = MakeFaces( 6, faceVertexCount );
+    const std::vector< unsigned char > encodedIndices = EncodeIndexBuffer( faces );
+    std::vector< std::uint32_t > decodedIndices( faces.size() * 3 );
+
+    // Copies make the sanitizer catch reads past the truncated end.
+    for (std::size_t size = 0; size < encodedVertices.size(); ++size)
+    {
+        const std::vector< unsigned char > truncated( encodedVertices.begin(), encodedVertices.begin() + size );
+
+        if (MeshCodec::DecodeVertexBuffer( decodedVertices.data(), vertexCount, vertexSize, truncated.data(), truncated.size() ))
+        {
+            std::cerr << "Truncated vertex stream of " << size << " bytes was accepted!" << std::endl;
+            return false;
+        }
+    }
+
+    for (std::size_t size = 0; size < encodedIndices.size(); ++size)
+    {
+        const std::vector< unsigned char > truncated( encodedIndices.begin(), encodedIndices.begin() + size );
+
+        if (MeshCodec::DecodeIndexBuffer( decodedIndices.data(), decodedIndices.size(), faceVertexCount, truncated.data(), truncated.size() ))
+        {
+            std::cerr << "Truncated index stream of " << size << " bytes was accepted!" << std::endl;
+            return false;
+        }
+    }
+
+    std::vector< unsigned char > padded = encodedIndices;
+    padded.push_back( 0 );
+
+    if (MeshCodec::DecodeIndexBuffer( decodedIndices.data(), decodedIndices.size(), faceVertexCount, padded.data(), padded.size() ))
+    {
+        std::cerr << "Index stream with trailing data was accepted!" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+bool TestCorruptedStreams()
+{
+    const std::size_t vertexCount = 37;
+    const std::size_t vertexSize = 32;
+    const std::vector< unsigned char > vertices = MakeVertices( vertexCount, vertexSize );
+    const std::vector< unsigned char > encodedVertices = EncodeVertexBuffer( vertices.data(), vertexCount, vertexSize );
+    std::vector< unsigned char > decodedVertices( vertices.size() );
+
+    unsigned faceVertexCount = 0;
+    const std::vector< VertexInd > faces = MakeFaces( 6, faceVertexCount );
+    const std::vector< unsigned char > encodedIndices = EncodeIndexBuffer( faces );
+    std::vector< std::uint32_t > decodedIndices( faces.size() * 3 );
+    unsigned state = 3;
+
+    // Corrupted streams must either be rejected or decode into valid data, without reading or writing out of bounds.
+    for (int i = 0; i < 2000; ++i)
+    {
+        std::vector< unsigned char > corrupted = encodedVertices;
+        corrupted[ Random( state ) % corrupted.size() ] ^= (unsigned char)(1 + Random( state ) % 255);
+        MeshCodec::DecodeVertexBuffer( decodedVertices.data(), vertexCount, vertexSize, corrupted.data(), corrupted.size() );
+
+        corrupted = encodedIndices;
+        corrupted[ Random( state ) % corrupted.size() ] ^= (unsigned char)(1 + Random( state ) % 255);
+
+        if (MeshCodec::DecodeIndexBuffer( decodedIndices.data(), decodedIndices.size(), faceVertexCount, corrupted.data(), corrupted.size() ))
+        {
+            for (std::uint32_t index : decodedIndices)
+            {
+                if (index >= faceVertexCount)
+                {
+                    std::cerr << "Corrupted index stream decoded an index out of range!" << std::endl;
+                    return false;
+                }
+            }
+        }
+    }
+
+    // Random bytes.
+    for (int i = 0; i < 500; ++i)
+    {
+        std::vector< unsigned char > garbage( Random( state ) % 300 );
+
+        for (unsigned char& byte : garbage)
+        {
+            byte = (unsigned char)Random( state );
+        }
+
+        MeshCodec::DecodeVertexBuffer( decodedVertices.data(), vertexCount, vertexSize, garbage.data(), garbage.size() );
+
+        if (MeshCodec::DecodeIndexBuffer( decodedIndices.data(), decodedIndices.size(), faceVertexCount, garbage.data(), garbage.size() ))
+        {
+            for (std::uint32_t index : decodedIndices)
+            {
+                if (index >= faceVertexCount)
+                {
+                    std::cerr << "Random index stream decoded an index out of range!" << std::endl;
+                    return false;
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
+int main()
+{
+    bool result = true;
+
+    result &= TestVertexRoundTrip();
+    result &= TestIndexRoundTrip();
+    result &= TestTruncatedStreams();
+    result &= TestCorruptedStreams();
+
+    assert( result && "Mesh codec tests failed!" );
+
+    return result ? 0 : 1;
+}
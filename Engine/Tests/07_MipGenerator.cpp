@@ -0,0 +1,151 @@
+#include <iostream>
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+#include "MipGenerator.hpp"
+#include "TextureBase.hpp"
+
+using namespace ae3d;
+
+static float SrgbToLinear( int value )
+{
+    const float f = value / 255.0f;
+    return f <= 0.04045f ? f / 12.92f : std::pow( (f + 0.055f) / 1.055f, 2.4f );
+}
+
+static int LinearToSrgb( float value )
+{
+    const float srgb = value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow( value, 1.0f / 2.4f ) - 0.055f;
+    return (int)(srgb * 255.0f + 0.5f);
+}
+
+static bool IsAlmost( int value, int expected )
+{
+    return std::abs( value - expected ) <= 1;
+}
+
+bool TestSrgbGradient()
+{
+    // 8x1 gradient whose neighbors are averaged by mip 1.
+    const int width = 8;
+    std::vector< unsigned char > pixels( width * 4 );
+
+    for (int x = 0; x < width; ++x)
+    {
+        const unsigned char value = (unsigned char)(x * 255 / (width - 1));
+        pixels[ x * 4 + 0 ] = value;
+        pixels[ x * 4 + 1 ] = value;
+        pixels[ x * 4 + 2 ] = value;
+        pixels[ x * 4 + 3 ] = value;
+    }
+
+    std::vector< unsigned char > mips;
+    MipGenerator::GenerateMips( pixels.data(), width, 1, true, false, MipmapFilter::Box, false, mips );
+
+    if (mips.size() != (4 + 2 + 1) * 4)
+    {
+        std::cerr << "Mip chain size failed!" << std::endl;
+        return false;
+    }
+
+    for (int x = 0; x < width / 2; ++x)
+    {
+        const int a = pixels[ (x * 2) * 4 ];
+        const int b = pixels[ (x * 2 + 1) * 4 ];
+        const int expectedColor = LinearToSrgb( (SrgbToLinear( a ) + SrgbToLinear( b )) * 0.5f );
+        const int expectedAlpha = (a + b + 1) / 2;
+
+        if (!IsAlmost( mips[ x * 4 + 0 ], expectedColor ) || !IsAlmost( mips[ x * 4 + 2 ], expectedColor ))
+        {
+            std::cerr << "sRGB color was not filtered in linear space at texel " << x << "!" << std::endl;
+            return false;
+        }
+
+        if (!IsAlmost( mips[ x * 4 + 3 ], expectedAlpha ))
+        {
+            std::cerr << "sRGB alpha was not filtered linearly at texel " << x << "!" << std::endl;
+            return false;
+        }
+    }
+
+    // Black and white average to linear 0.5, which is much brighter than sRGB 128.
+    const unsigned char blackWhite[ 8 ] = { 0, 0, 0, 255, 255, 255, 255, 255 };
+    MipGenerator::GenerateMips( blackWhite, 2, 1, true, false, MipmapFilter::Box, false, mips );
+
+    if (!IsAlmost( mips[ 0 ], 188 ))
+    {
+        std::cerr << "sRGB black and white average failed!" << std::endl;
+        return false;
+    }
+
+    MipGenerator::GenerateMips( blackWhite, 2, 1, false, false, MipmapFilter::Box, false, mips );
+
+    if (!IsAlmost( mips[ 0 ], 128 ))
+    {
+        std::cerr << "Linear black and white average failed!" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+bool TestOddSizes()
+{
+    // 3x1 is filtered into 1 texel that covers all 3 texels.
+    const unsigned char row[ 12 ] = { 0, 0, 0, 0, 0, 0, 0, 0, 255, 255, 255, 255 };
+    std::vector< unsigned char > mips;
+    MipGenerator::GenerateMips( row, 3, 1, false, false, MipmapFilter::Box, false, mips );
+
+    if (mips.size() != 4 || !IsAlmost( mips[ 0 ], 85 ) || !IsAlmost( mips[ 3 ], 85 ))
+    {
+        std::cerr << "Box filter of an odd width failed!" << std::endl;
+        return false;
+    }
+
+    // 1x5 column of texels 0 and 255 alternating. Mip 1 is 1x2 and both texels cover 2.5 source texels.
+    const unsigned char column[ 20 ] = { 0, 0, 0, 0, 255, 255, 255, 255, 0, 0, 0, 0, 255, 255, 255, 255, 0, 0, 0, 0 };
+    MipGenerator::GenerateMips( column, 1, 5, false, false, MipmapFilter::Box, false, mips );
+
+    if (mips.size() != (2 + 1) * 4 || !IsAlmost( mips[ 0 ], 102 ) || !IsAlmost( mips[ 4 ], 102 ))
+    {
+        std::cerr << "Box filter of an odd height failed!" << std::endl;
+        return false;
+    }
+
+    // Constant images stay constant with every filter and size.
+    const MipmapFilter filters[] = { MipmapFilter::Box, MipmapFilter::Kaiser };
+    const int sizes[ 3 ][ 2 ] = { { 7, 5 }, { 16, 9 }, { 33, 1 } };
+
+    for (MipmapFilter filter : filters)
+    {
+        for (int s = 0; s < 3; ++s)
+        {
+            std::vector< unsigned char > pixels( sizes[ s ][ 0 ] * sizes[ s ][ 1 ] * 4, 77 );
+            MipGenerator::GenerateMips( pixels.data(), sizes[ s ][ 0 ], sizes[ s ][ 1 ], true, s == 1, filter, false, mips );
+
+            for (unsigned char value : mips)
+            {
+                if (!IsAlmost( value, 77 ))
+                {
+                    std::cerr << "Constant image changed when filtered!" << std::endl;
+                    return false;
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
+int main()
+{
+    bool result = true;
+
+    result &= TestSrgbGradient();
+    result &= TestOddSizes();
+
+    assert( result && "Mip generator tests failed!" );
+
+    return result ? 0 : 1;
+}
@@ -23,7 +23,8 @@ namespace GfxDeviceGlobal
     extern ID3D12RootSignature* rootSignatureCompute;
     extern ID3D12DescriptorHeap* computeCbvSrvUavHeaps[ 8 ];
     extern ID3D12PipelineState* cachedPSO;
-	extern PerObjectUboStruct perObjectUboStruct;
+    extern bool areDrawHeapsSet;
+	extern thread_local PerObjectUboStruct perObjectUboStruct;
 }
 
 namespace Global
@@ -133,6 +134,7 @@ void ae3d::ComputeShader::Dispatch( unsigned groupCountX, unsigned groupCountY,
     Statistics::IncPSOBindCalls();
     GfxDeviceGlobal::graphicsCommandList->SetPipelineState( pso );
     GfxDeviceGlobal::graphicsCommandList->SetDescriptorHeaps( 1, &GfxDeviceGlobal::computeCbvSrvUavHeaps[ heapIndex ] );
+    GfxDeviceGlobal::areDrawHeapsSet = false;
     GfxDeviceGlobal::graphicsCommandList->SetComputeRootSignature( GfxDeviceGlobal::rootSignatureCompute );
     GfxDeviceGlobal::graphicsCommandList->SetComputeRootDescriptorTable( 0, GfxDeviceGlobal::computeCbvSrvUavHeaps[ heapIndex ]->GetGPUDescriptorHandleForHeapStart() );
     GfxDeviceGlobal::graphicsCommandList->Dispatch( groupCountX, groupCountY, groupCountZ );
@@ -32,7 +32,7 @@
 #include "TextureCube.hpp"
 #include "VertexBuffer.hpp"
 
-int AE3D_CB_SIZE = 256 * 3 + 80 * 64 + 128 * 16;
+int AE3D_CB_SIZE = 256 * 3 + 128 * 16;
 
 void DestroyShaders(); // Defined in ShaderD3D12.cpp
 void DestroyComputeShaders(); // Defined in ComputeShaderD3D12.cpp
@@ -67,6 +67,10 @@ namespace ae3d
                 stm << "light culler time GPU: " << ::Statistics::GetLightCullerTimeGpuMS() << "ms\n";
                 stm << "light update time CPU: " << ::Statistics::GetLightUpdateTimeMS() << "ms\n";
                 stm << "bloom time CPU: " << ::Statistics::GetBloomCpuTimeMS() << "ms\n";
+                stm << "skinning time CPU: " << ::Statistics::GetSkinningTimeMS() << "ms (" << ::Statistics::GetSkinPaletteUpdates() << " palettes)\n";
+                stm << "texture upload: " << ::Statistics::GetTextureUploadMBPerSecond() << " MB/s\n";
+                stm << "texture cache: " << ::Statistics::GetTextureCacheHits() << " hits, " << ::Statistics::GetTextureCacheMisses() << " misses, "
+                    << Texture2D::GetCacheMemoryUsage() / (1024 * 1024) << " MiB\n";
                 stm << "draw calls: " << ::Statistics::GetDrawCalls() << "\n";
                 stm << "barrier calls: " << ::Statistics::GetBarrierCalls() << "\n";
                 stm << "triangles: " << ::Statistics::GetTriangleCount() << "\n";
@@ -207,6 +211,13 @@ namespace GfxDeviceGlobal
     std::vector< ID3D12Resource* > constantBuffers;
     std::vector< void* > mappedConstantBuffers;
     int currentConstantBufferIndex = 0;
+    ID3D12Resource* bonePaletteBuffer = nullptr;
+    ae3d::Matrix44* mappedBonePalette = nullptr;
+    unsigned bonePaletteCapacity = 0;
+    // Matrices uploaded this frame.
+    unsigned bonePaletteCount = 0;
+    // Replaced resources that recorded draws can reference. Released after the frame.
+    std::vector< ID3D12Resource* > pendingFreeResources;
     unsigned frameIndex = 0;
     ae3d::LightTiler lightTiler;
 
@@ -222,11 +233,18 @@ namespace GfxDeviceGlobal
     D3D12_CPU_DESCRIPTOR_HANDLE msaaDepthHandle = {};
     ID3D12DescriptorHeap* computeCbvSrvUavHeaps[ ae3d::GfxDevice::computeHeapCount ] = {};
     TimerQuery timerQuery;
-    PerObjectUboStruct perObjectUboStruct;
+    thread_local PerObjectUboStruct perObjectUboStruct;
     ae3d::VertexBuffer uiVertexBuffer;
-    std::vector< ae3d::VertexBuffer::VertexPTC > uiVertices( 512 * 1024 );
-    std::vector< ae3d::VertexBuffer::Face > uiFaces( 512 * 1024 );
+    // UI indices are 16-bit, so more vertices could not be addressed.
+    std::vector< ae3d::VertexBuffer::VertexPTC > uiVertices( 64 * 1024 );
+    std::vector< unsigned short > uiIndices( 512 * 1024 * 3 );
+    std::vector< ae3d::VertexBuffer::VertexPTNTC > uiVerticesPTNTC( 64 * 1024 );
     ID3D12PipelineState* cachedPSO = nullptr;
+    // Set by Draw() and cleared when the command list is reset or a compute dispatch sets its own heaps.
+    bool areDrawHeapsSet = false;
+    // Root arguments set by Draw(). They stay bound until the command list is reset or the descriptor heaps change.
+    D3D12_GPU_DESCRIPTOR_HANDLE boundSamplerTable = {};
+    D3D12_GPU_VIRTUAL_ADDRESS boundBonePalette = 0;
     ID3D12Resource* particleBuffer;
     ID3D12Resource* particleTileBuffer;
 }
@@ -570,16 +588,18 @@ void CreateRootSignature()
         CD3DX12_DESCRIPTOR_RANGE descRange2[ 1 ];
         descRange2[ 0 ].Init( D3D12_DESCRIPTOR_RANGE_TYPE_SAMPLER, 2, 0 );
 
-        CD3DX12_ROOT_PARAMETER rootParam[ 2 ];
+        // Bone palette is a root SRV after the table's SRVs, so compute shaders' table layout is unchanged.
+        CD3DX12_ROOT_PARAMETER rootParam[ 3 ];
         rootParam[ 0 ].InitAsDescriptorTable( 3, descRange1, D3D12_SHADER_VISIBILITY_ALL );
         rootParam[ 1 ].InitAsDescriptorTable( 1, descRange2, D3D12_SHADER_VISIBILITY_PIXEL );
+        rootParam[ 2 ].InitAsShaderResourceView( 10, 0, D3D12_SHADER_VISIBILITY_VERTEX );
 
         const D3D12_ROOT_SIGNATURE_FLAGS flags = D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT | D3D12_ROOT_SIGNATURE_FLAG_DENY_HULL_SHADER_ROOT_ACCESS |
                                                  D3D12_ROOT_SIGNATURE_FLAG_DENY_DOMAIN_SHADER_ROOT_ACCESS | D3D12_ROOT_SIGNATURE_FLAG_DENY_GEOMETRY_SHADER_ROOT_ACCESS;
 
         D3D12_ROOT_SIGNATURE_DESC descRootSignature;
         descRootSignature.Flags = flags;
-        descRootSignature.NumParameters = 2;
+        descRootSignature.NumParameters = 3;
         descRootSignature.NumStaticSamplers = 0;
         descRootSignature.pParameters = rootParam;
         descRootSignature.pStaticSamplers = nullptr;
@@ -751,6 +771,18 @@ void CreatePSO( ae3d::VertexBuffer::VertexFormat vertexFormat, ae3d::Shader& sha
         { "BONES", 0, DXGI_FORMAT_R32G32B32A32_UINT, 0, 80, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 }
     };
 
+    // Normalized formats are expanded to floats by the input assembler, so shaders are shared with PTNTC.
+    D3D12_INPUT_ELEMENT_DESC layoutPTNTC_Compact_Skinned[] =
+    {
+        { "POSITION", 0, DXGI_FORMAT_R16G16B16A16_UNORM, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+        { "TEXCOORD", 0, DXGI_FORMAT_R16G16_FLOAT, 0, 8, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+        { "NORMAL", 0, DXGI_FORMAT_R8G8B8A8_SNORM, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+        { "TANGENT", 0, DXGI_FORMAT_R8G8B8A8_SNORM, 0, 16, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+        { "COLOR", 0, DXGI_FORMAT_R8G8B8A8_UNORM, 0, 20, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+        { "WEIGHTS", 0, DXGI_FORMAT_R8G8B8A8_UNORM, 0, 24, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+        { "BONES", 0, DXGI_FORMAT_R8G8B8A8_UINT, 0, 28, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 }
+    };
+
     UINT numElements = 0;
     D3D12_INPUT_ELEMENT_DESC* layout = nullptr;
     if (vertexFormat == ae3d::VertexBuffer::VertexFormat::PTC)
@@ -773,6 +805,17 @@ void CreatePSO( ae3d::VertexBuffer::VertexFormat vertexFormat, ae3d::Shader& sha
         layout = layoutPTNTC_Skinned;
         numElements = 7;
     }
+    else if (vertexFormat == ae3d::VertexBuffer::VertexFormat::PTNTC_Compact)
+    {
+        // Uses the first 5 elements of the skinned layout.
+        layout = layoutPTNTC_Compact_Skinned;
+        numElements = 5;
+    }
+    else if (vertexFormat == ae3d::VertexBuffer::VertexFormat::PTNTC_Compact_Skinned)
+    {
+        layout = layoutPTNTC_Compact_Skinned;
+        numElements = 7;
+    }
     else
     {
         ae3d::System::Assert( false, "unhandled vertex format" );
@@ -965,6 +1008,40 @@ void CreateParticleBuffer()
     GfxDeviceGlobal::uav3Desc.ViewDimension = D3D12_UAV_DIMENSION_BUFFER;
 }
 
+void CreateBonePaletteBuffer( unsigned capacity )
+{
+    D3D12_HEAP_PROPERTIES prop = {};
+    prop.Type = D3D12_HEAP_TYPE_UPLOAD;
+    prop.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
+    prop.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
+    prop.CreationNodeMask = 1;
+    prop.VisibleNodeMask = 1;
+
+    D3D12_RESOURCE_DESC buf = {};
+    buf.Alignment = 0;
+    buf.DepthOrArraySize = 1;
+    buf.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+    buf.Flags = D3D12_RESOURCE_FLAG_NONE;
+    buf.Format = DXGI_FORMAT_UNKNOWN;
+    buf.Height = 1;
+    buf.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+    buf.MipLevels = 1;
+    buf.SampleDesc.Count = 1;
+    buf.SampleDesc.Quality = 0;
+    buf.Width = capacity * sizeof( ae3d::Matrix44 );
+
+    HRESULT hr = GfxDeviceGlobal::device->CreateCommittedResource( &prop, D3D12_HEAP_FLAG_NONE, &buf, D3D12_RESOURCE_STATE_GENERIC_READ,
+                                                                   nullptr, IID_PPV_ARGS( &GfxDeviceGlobal::bonePaletteBuffer ) );
+    AE3D_CHECK_D3D( hr, "Unable to create bone palette buffer" );
+    GfxDeviceGlobal::bonePaletteBuffer->SetName( L"Bone Palette" );
+
+    D3D12_RANGE emptyRange{};
+    hr = GfxDeviceGlobal::bonePaletteBuffer->Map( 0, &emptyRange, reinterpret_cast<void**>( &GfxDeviceGlobal::mappedBonePalette ) );
+    AE3D_CHECK_D3D( hr, "Unable to map bone palette buffer" );
+
+    GfxDeviceGlobal::bonePaletteCapacity = capacity;
+}
+
 void CreateConstantBuffers()
 {
     GfxDeviceGlobal::constantBuffers.resize( 20000 );
@@ -1020,6 +1097,8 @@ void CreateConstantBuffers()
             ae3d::System::Print( "Unable to map shader constant buffer!" );
         }
     }
+
+    CreateBonePaletteBuffer( 1024 );
 }
 
 void ae3d::CreateRenderer( int samples, bool apiValidation )
@@ -1181,12 +1260,24 @@ void ae3d::GfxDevice::DrawUI( int scX, int scY, int scWidth, int scHeight, int e
 void ae3d::GfxDevice::MapUIVertexBuffer( int /*vertexSize*/, int /*indexSize*/, void** outMappedVertices, void** outMappedIndices )
 {
     *outMappedVertices = GfxDeviceGlobal::uiVertices.data();
-    *outMappedIndices = GfxDeviceGlobal::uiFaces.data();
+    *outMappedIndices = GfxDeviceGlobal::uiIndices.data();
 }
 
 void ae3d::GfxDevice::UnmapUIVertexBuffer()
 {
-    GfxDeviceGlobal::uiVertexBuffer.Generate( GfxDeviceGlobal::uiFaces.data(), int( GfxDeviceGlobal::uiFaces.size() ), GfxDeviceGlobal::uiVertices.data(), int( GfxDeviceGlobal::uiVertices.size() ), VertexBuffer::Storage::CPU );
+    for (std::size_t v = 0; v < GfxDeviceGlobal::uiVertices.size(); ++v)
+    {
+        GfxDeviceGlobal::uiVerticesPTNTC[ v ].position = GfxDeviceGlobal::uiVertices[ v ].position;
+        GfxDeviceGlobal::uiVerticesPTNTC[ v ].u = GfxDeviceGlobal::uiVertices[ v ].u;
+        GfxDeviceGlobal::uiVerticesPTNTC[ v ].v = GfxDeviceGlobal::uiVertices[ v ].v;
+        GfxDeviceGlobal::uiVerticesPTNTC[ v ].normal = Vec3( 0, 0, 1 );
+        GfxDeviceGlobal::uiVerticesPTNTC[ v ].tangent = Vec4( 1, 0, 0, 0 );
+        GfxDeviceGlobal::uiVerticesPTNTC[ v ].color = GfxDeviceGlobal::uiVertices[ v ].color;
+    }
+
+    // UI indices are 16-bit, so they are uploaded as-is instead of being widened to Faces.
+    GfxDeviceGlobal::uiVertexBuffer.GeneratePacked( GfxDeviceGlobal::uiIndices.data(), VertexBuffer::IndexType::UInt16, int( GfxDeviceGlobal::uiIndices.size() / 3 ),
+                                                    GfxDeviceGlobal::uiVerticesPTNTC.data(), VertexBuffer::VertexFormat::PTNTC, int( GfxDeviceGlobal::uiVerticesPTNTC.size() ), Vec4( 0, 0, 0, 1 ) );
 }
 
 void ae3d::GfxDevice::BeginDepthNormalsGpuQuery()
@@ -1241,6 +1332,22 @@ void ae3d::GfxDevice::GetNewUniformBuffer()
     GfxDeviceGlobal::currentConstantBufferIndex = (GfxDeviceGlobal::currentConstantBufferIndex + 1) % GfxDeviceGlobal::mappedConstantBuffers.size();
 }
 
+unsigned ae3d::GfxDevice::UploadBonePalette( const Matrix44* matrices, unsigned matrixCount )
+{
+    const unsigned firstIndex = GfxDeviceGlobal::bonePaletteCount;
+
+    if (firstIndex + matrixCount > GfxDeviceGlobal::bonePaletteCapacity)
+    {
+        // Recorded draws reference the old buffer, so it's released after the frame.
+        GfxDeviceGlobal::pendingFreeResources.push_back( GfxDeviceGlobal::bonePaletteBuffer );
+        CreateBonePaletteBuffer( (firstIndex + matrixCount) * 2 );
+    }
+
+    memcpy_s( GfxDeviceGlobal::mappedBonePalette + firstIndex, (GfxDeviceGlobal::bonePaletteCapacity - firstIndex) * sizeof( Matrix44 ), matrices, matrixCount * sizeof( Matrix44 ) );
+    GfxDeviceGlobal::bonePaletteCount += matrixCount;
+    return firstIndex;
+}
+
 void* ae3d::GfxDevice::GetCurrentMappedConstantBuffer()
 {
     return GfxDeviceGlobal::mappedConstantBuffers[ GfxDeviceGlobal::currentConstantBufferIndex ];
@@ -1386,10 +1493,43 @@ void ae3d::GfxDevice::Draw( VertexBuffer& vertexBuffer, int startFace, int endFa
     samplerHandle.ptr += GfxDeviceGlobal::device->GetDescriptorHandleIncrementSize( D3D12_DESCRIPTOR_HEAP_TYPE_SAMPLER );
     samplerHandle = GetSampler( GfxDeviceGlobal::texture0->GetMipmaps(), GfxDeviceGlobal::texture0->GetWrap(), GfxDeviceGlobal::texture0->GetFilter(), GfxDeviceGlobal::texture0->GetAnisotropy() );
 
-    ID3D12DescriptorHeap* descHeaps[] = { DescriptorHeapManager::GetCbvSrvUavHeap(), DescriptorHeapManager::GetSamplerHeap() };
-    GfxDeviceGlobal::graphicsCommandList->SetDescriptorHeaps( 2, &descHeaps[ 0 ] );
+    // Setting descriptor heaps can flush the GPU pipeline, so they are set only when another heap has replaced them.
+    if (!GfxDeviceGlobal::areDrawHeapsSet)
+    {
+        ID3D12DescriptorHeap* descHeaps[] = { DescriptorHeapManager::GetCbvSrvUavHeap(), DescriptorHeapManager::GetSamplerHeap() };
+        GfxDeviceGlobal::graphicsCommandList->SetDescriptorHeaps( 2, &descHeaps[ 0 ] );
+        GfxDeviceGlobal::areDrawHeapsSet = true;
+        GfxDeviceGlobal::boundSamplerTable.ptr = 0;
+    }
+    else
+    {
+        Statistics::IncAvoidedBinds();
+    }
+
+    // Every draw has its own constant buffer in the table.
     GfxDeviceGlobal::graphicsCommandList->SetGraphicsRootDescriptorTable( 0, DescriptorHeapManager::GetCbvSrvUavGpuHandle( index ) );
-    GfxDeviceGlobal::graphicsCommandList->SetGraphicsRootDescriptorTable( 1, samplerHandle );
+
+    if (GfxDeviceGlobal::boundSamplerTable.ptr != samplerHandle.ptr)
+    {
+        GfxDeviceGlobal::graphicsCommandList->SetGraphicsRootDescriptorTable( 1, samplerHandle );
+        GfxDeviceGlobal::boundSamplerTable = samplerHandle;
+    }
+    else
+    {
+        Statistics::IncAvoidedBinds();
+    }
+
+    const D3D12_GPU_VIRTUAL_ADDRESS bonePalette = GfxDeviceGlobal::bonePaletteBuffer->GetGPUVirtualAddress();
+
+    if (GfxDeviceGlobal::boundBonePalette != bonePalette)
+    {
+        GfxDeviceGlobal::graphicsCommandList->SetGraphicsRootShaderResourceView( 2, bonePalette );
+        GfxDeviceGlobal::boundBonePalette = bonePalette;
+    }
+    else
+    {
+        Statistics::IncAvoidedBinds();
+    }
 
     ID3D12PipelineState* pso = GfxDeviceGlobal::psoCache[ hashIndex ].pso;
 
@@ -1399,6 +1539,10 @@ void ae3d::GfxDevice::Draw( VertexBuffer& vertexBuffer, int startFace, int endFa
         GfxDeviceGlobal::cachedPSO = pso;
         Statistics::IncPSOBindCalls();
     }
+    else
+    {
+        Statistics::IncAvoidedBinds();
+    }
 
     GfxDeviceGlobal::graphicsCommandList->IASetVertexBuffers( 0, 1, vertexBuffer.GetView() );
     GfxDeviceGlobal::graphicsCommandList->IASetIndexBuffer( topology == PrimitiveTopology::Lines ? nullptr : vertexBuffer.GetIndexView() );
@@ -1448,6 +1592,9 @@ void ae3d::GfxDevice::ResetCommandList()
     GfxDeviceGlobal::graphicsCommandList->SetGraphicsRootSignature( GfxDeviceGlobal::rootSignatureGraphics );
 
     GfxDeviceGlobal::cachedPSO = nullptr;
+    GfxDeviceGlobal::areDrawHeapsSet = false;
+    GfxDeviceGlobal::boundSamplerTable.ptr = 0;
+    GfxDeviceGlobal::boundBonePalette = 0;
     GfxDeviceGlobal::texture0 = Texture2D::GetDefaultTexture();
     GfxDeviceGlobal::texture1 = Texture2D::GetDefaultTexture();
     GfxDeviceGlobal::textureCube = TextureCube::GetDefaultTexture();
@@ -1508,6 +1655,8 @@ void ae3d::GfxDevice::ReleaseGPUObjects()
         AE3D_SAFE_RELEASE( GfxDeviceGlobal::constantBuffers[ cbInd ] );
     }
 
+    AE3D_SAFE_RELEASE( GfxDeviceGlobal::bonePaletteBuffer );
+
     /*ID3D12DebugDevice* d3dDebug = nullptr;
     GfxDeviceGlobal::device->QueryInterface( IID_PPV_ARGS( &d3dDebug ) );
     AE3D_SAFE_RELEASE( GfxDeviceGlobal::device );
@@ -1647,6 +1796,14 @@ void ae3d::GfxDevice::Present()
 
     WaitForPreviousFrame();
 
+    for (std::size_t i = 0; i < GfxDeviceGlobal::pendingFreeResources.size(); ++i)
+    {
+        AE3D_SAFE_RELEASE( GfxDeviceGlobal::pendingFreeResources[ i ] );
+    }
+
+    GfxDeviceGlobal::pendingFreeResources.clear();
+    GfxDeviceGlobal::bonePaletteCount = 0;
+
     hr = GfxDeviceGlobal::commandListAllocator->Reset();
     AE3D_CHECK_D3D( hr, "commandListAllocator Reset" );
 
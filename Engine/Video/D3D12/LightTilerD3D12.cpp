@@ -23,7 +23,7 @@ namespace GfxDeviceGlobal
     extern ID3D12Resource* uav1;
     extern D3D12_UNORDERED_ACCESS_VIEW_DESC uav0Desc;
     extern D3D12_UNORDERED_ACCESS_VIEW_DESC uav1Desc;
-    extern PerObjectUboStruct perObjectUboStruct;
+    extern thread_local PerObjectUboStruct perObjectUboStruct;
 }
 
 void ae3d::LightTiler::DestroyBuffers()
@@ -25,7 +25,7 @@ namespace GfxDeviceGlobal
     extern ae3d::TextureBase* texture1;
     extern ae3d::TextureBase* texture3;
     extern ae3d::TextureBase* textureCube;
-	extern PerObjectUboStruct perObjectUboStruct;
+	extern thread_local PerObjectUboStruct perObjectUboStruct;
     extern ae3d::RenderTexture* currentRenderTarget;
 }
 
@@ -19,17 +19,16 @@
 
 extern ae3d::FileWatcher fileWatcher;
 bool HasStbExtension( const std::string& path ); // Defined in TextureCommon.cpp
+unsigned char* LoadStbImage( const ae3d::FileSystem::FileContentsData& fileContents, int& outWidth, int& outHeight, int& outComponents ); // Defined in TextureCommon.cpp
+void GetStbMips( const std::string& path, const unsigned char* pixels, int width, int height, ae3d::ColorSpace colorSpace, ae3d::TextureWrap wrap,
+                 std::vector< unsigned char >& outMips ); // Defined in TextureCommon.cpp
 void TexReload( const std::string& path ); // Defined in TextureCommon.cpp
+bool LoadCachedTexture( ae3d::Texture2D& texture ); // Defined in TextureCommon.cpp
+void CacheTexture( ae3d::Texture2D& texture, std::size_t sizeInBytes ); // Defined in TextureCommon.cpp
+void RemovePendingTextureLoad( const ae3d::Texture2D* texture ); // Defined in TextureCommon.cpp
 float GetFloatAnisotropy( ae3d::Anisotropy anisotropy );
 void TransitionResource( GpuResource& gpuResource, D3D12_RESOURCE_STATES newState );
 
-struct Textures
-{
-    std::vector< ae3d::Texture2D* > pointers;
-};
-
-std::map< std::string, Textures > textures;
-
 namespace MathUtil
 {
     int GetMipmapCount( int width, int height );
@@ -42,6 +41,7 @@ namespace GfxDeviceGlobal
     extern ID3D12CommandAllocator* commandListAllocator;
     extern ID3D12GraphicsCommandList* graphicsCommandList;
     extern ID3D12CommandQueue* commandQueue;
+    extern std::vector< ID3D12Resource* > pendingFreeResources;
 }
 
 namespace Texture2DGlobal
@@ -51,7 +51,6 @@ namespace Texture2DGlobal
     ae3d::Texture2D defaultTexture;
     int tex2dMemoryUsage = 0;
 
-    std::map< std::string, ae3d::Texture2D > hashToCachedTexture;
 #if DEBUG
     std::map< std::string, std::size_t > pathToCachedTextureSizeInBytes;
     
@@ -111,6 +110,7 @@ void InitializeTexture( GpuResource& gpuResource, D3D12_SUBRESOURCE_DATA* subRes
         if (subResources->pData)
         {
             UpdateSubresources( GfxDeviceGlobal::graphicsCommandList, gpuResource.resource, uploadBuffer, 0, 0, subResourceCount, subResources );
+            Statistics::IncTextureUploadBytes( static_cast< std::size_t >( uploadBufferSize ) );
         }
 
         TransitionResource( gpuResource, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE );
@@ -431,6 +431,10 @@ int GetTextureMemoryUsageBytes( int width, int height, DXGI_FORMAT format, bool
     {
         bytesPerPixel = 4;
     }
+    else if (format == DXGI_FORMAT_BC7_UNORM || format == DXGI_FORMAT_BC7_UNORM_SRGB)
+    {
+        bytesPerPixel = 4;
+    }
     else if (format == DXGI_FORMAT_R32G32_FLOAT)
     {
         bytesPerPixel = 4 * 2; // TODO: verify
@@ -445,6 +449,9 @@ int GetTextureMemoryUsageBytes( int width, int height, DXGI_FORMAT format, bool
 
 void ae3d::Texture2D::Load( const FileSystem::FileContentsData& fileContents, TextureWrap aWrap, TextureFilter aFilter, Mipmaps aMipmaps, ColorSpace aColorSpace, Anisotropy aAnisotropy )
 {
+    // A newer load replaces a pending LoadAsync().
+    RemovePendingTextureLoad( this );
+
     filter = aFilter;
     wrap = aWrap;
     mipmaps = aMipmaps;
@@ -458,13 +465,8 @@ void ae3d::Texture2D::Load( const FileSystem::FileContentsData& fileContents, Te
         return;
     }
     
-    const std::string cacheHash = GetCacheHash( fileContents.path, aWrap, aFilter, aMipmaps, aColorSpace, aAnisotropy );
-    const bool isCached = Texture2DGlobal::hashToCachedTexture.find( cacheHash ) != Texture2DGlobal::hashToCachedTexture.end();
-
-    if (isCached && handle == 0)
+    if (LoadCachedTexture( *this ))
     {
-        *this = Texture2DGlobal::hashToCachedTexture[ cacheHash ];
-        textures[ cacheHash ].pointers.push_back( this );
         return;
     }
     
@@ -482,7 +484,7 @@ void ae3d::Texture2D::Load( const FileSystem::FileContentsData& fileContents, Te
     }
     else if (isDDS)
     {
-        LoadDDS( fileContents.path.c_str() );
+        LoadDDS( fileContents );
     }
     else
     {
@@ -497,26 +499,12 @@ void ae3d::Texture2D::Load( const FileSystem::FileContentsData& fileContents, Te
     srvDesc.Texture2D.PlaneSlice = 0;
     srvDesc.Texture2D.ResourceMinLODClamp = 0.0f;
     
-    const int oldHandle = handle;
-
     srv = DescriptorHeapManager::AllocateDescriptor( D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV );
     handle = static_cast< unsigned >( srv.ptr );
     
     GfxDeviceGlobal::device->CreateShaderResourceView( gpuResource.resource, &srvDesc, srv );
 
-    Texture2DGlobal::hashToCachedTexture[ cacheHash ] = *this;
-
-    if (oldHandle != 0)
-    {
-        for (std::size_t i = 0; i < textures[ cacheHash ].pointers.size(); ++i)
-        {
-            *textures[ cacheHash ].pointers[ i ] = *this;
-        }
-    }
-    else
-    {
-        textures[ cacheHash ].pointers.push_back( this );
-    }
+    CacheTexture( *this, (std::size_t)GetTextureMemoryUsageBytes( width, height, dxgiFormat, mipLevelCount > 1 ) );
 
 #if DEBUG
     Texture2DGlobal::pathToCachedTextureSizeInBytes[ fileContents.path ] = (size_t)GetTextureMemoryUsageBytes( width, height, dxgiFormat, mipLevelCount > 1 );
@@ -524,19 +512,40 @@ void ae3d::Texture2D::Load( const FileSystem::FileContentsData& fileContents, Te
 #endif
 }
 
-void ae3d::Texture2D::LoadDDS( const char* aPath )
+void ae3d::Texture2D::LoadDDS( const FileSystem::FileContentsData& fileContents )
 {
     DDSLoader::Output ddsOutput;
-    auto fileContents = FileSystem::FileContents( aPath );
     const DDSLoader::LoadResult loadResult = DDSLoader::Load( fileContents, width, height, opaque, ddsOutput );
 
     if (loadResult != DDSLoader::LoadResult::Success)
     {
-        ae3d::System::Print( "DDS Loader could not load %s", aPath );
+        ae3d::System::Print( "DDS Loader could not load %s", fileContents.path.c_str() );
         return;
     }
 
-	mipLevelCount = ddsOutput.dataOffsets.count;
+    CreateFromDDSMips( ddsOutput, BeginStreaming( ddsOutput, ddsOutput.dataOffsets.count ), false );
+}
+
+void ae3d::Texture2D::CreateFromDDSMips( const DDSLoader::Output& ddsOutput, int firstMip, bool releasePrevious )
+{
+    if (releasePrevious)
+    {
+        // Recorded draws can reference the previous resource, so it's released after the frame.
+        for (std::size_t i = 0; i < Texture2DGlobal::textures.size(); ++i)
+        {
+            if (Texture2DGlobal::textures[ i ] == gpuResource.resource)
+            {
+                Texture2DGlobal::textures.erase( std::begin( Texture2DGlobal::textures ) + i );
+                break;
+            }
+        }
+
+        const D3D12_RESOURCE_DESC previousDesc = gpuResource.resource->GetDesc();
+        Texture2DGlobal::tex2dMemoryUsage -= (int)GfxDeviceGlobal::device->GetResourceAllocationInfo( 0, 1, &previousDesc ).SizeInBytes;
+        GfxDeviceGlobal::pendingFreeResources.push_back( gpuResource.resource );
+    }
+
+    mipLevelCount = ddsOutput.dataOffsets.count - firstMip;
     int bytesPerPixel = 2;
 
     if (ddsOutput.format == DDSLoader::Format::BC1)
@@ -573,6 +582,11 @@ void ae3d::Texture2D::LoadDDS( const char* aPath )
         dxgiFormat = DXGI_FORMAT_BC5_UNORM;
         bytesPerPixel = 4;
     }
+    else if (ddsOutput.format == DDSLoader::Format::BC7)
+    {
+        dxgiFormat = (colorSpace == ColorSpace::Linear) ? DXGI_FORMAT_BC7_UNORM : DXGI_FORMAT_BC7_UNORM_SRGB;
+        bytesPerPixel = 4;
+    }
     else
     {
         System::Assert( false, "Unhandled DDS format!" );
@@ -580,8 +594,8 @@ void ae3d::Texture2D::LoadDDS( const char* aPath )
 
     D3D12_RESOURCE_DESC descTex = {};
     descTex.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
-    descTex.Width = width;
-    descTex.Height = static_cast< UINT >(height);
+    descTex.Width = MathUtil::Max( width >> firstMip, 1 );
+    descTex.Height = static_cast< UINT >( MathUtil::Max( height >> firstMip, 1 ) );
     descTex.DepthOrArraySize = 1;
     descTex.MipLevels = static_cast< UINT16 >( mipLevelCount );
     descTex.Format = dxgiFormat;
@@ -604,36 +618,49 @@ void ae3d::Texture2D::LoadDDS( const char* aPath )
     Texture2DGlobal::tex2dMemoryUsage += (int)info.SizeInBytes;
 
 	wchar_t wstr[ 128 ] = {};
-    std::mbstowcs( wstr, aPath, 128 );
+    std::mbstowcs( wstr, path.c_str(), 128 );
     gpuResource.resource->SetName( wstr );
     gpuResource.usageState = D3D12_RESOURCE_STATE_COPY_DEST;
     Texture2DGlobal::textures.push_back( gpuResource.resource );
 
     std::vector< D3D12_SUBRESOURCE_DATA > texResources( mipLevelCount );
-    texResources[ 0 ].pData = &ddsOutput.imageData[ ddsOutput.dataOffsets[ 0 ] ];
-    texResources[ 0 ].RowPitch = width * bytesPerPixel;
-    texResources[ 0 ].SlicePitch = texResources[ 0 ].RowPitch * height;
-
-    unsigned mipWidth = width;
-    unsigned mipHeight = height;
+    unsigned mipWidth = static_cast< unsigned >( descTex.Width );
+    unsigned mipHeight = descTex.Height;
 
-    for (int i = 1; i < mipLevelCount; ++i)
+    for (int i = 0; i < mipLevelCount; ++i)
     {
-        mipWidth = (mipWidth + 1) >> 1;
-        mipHeight = (mipHeight + 1) >> 1;
-
-        texResources[ i ].pData = &ddsOutput.imageData[ ddsOutput.dataOffsets[ i ] ];
+        texResources[ i ].pData = &ddsOutput.imageData[ ddsOutput.dataOffsets[ firstMip + i ] ];
         texResources[ i ].RowPitch = mipWidth * bytesPerPixel;
         texResources[ i ].SlicePitch = texResources[ i ].RowPitch * mipHeight;
+
+        mipWidth = (mipWidth + 1) >> 1;
+        mipHeight = (mipHeight + 1) >> 1;
     }
 
+    const std::size_t uploadBufferCount = Texture2DGlobal::uploadBuffers.size();
     InitializeTexture( gpuResource, texResources.data(), mipLevelCount );
+
+    if (releasePrevious)
+    {
+        // Streaming would otherwise keep an upload buffer per update until exit.
+        if (Texture2DGlobal::uploadBuffers.size() > uploadBufferCount)
+        {
+            GfxDeviceGlobal::pendingFreeResources.push_back( Texture2DGlobal::uploadBuffers.back() );
+            Texture2DGlobal::uploadBuffers.pop_back();
+        }
+
+        srvDesc.Texture2D.MipLevels = mipLevelCount;
+        GfxDeviceGlobal::device->CreateShaderResourceView( gpuResource.resource, &srvDesc, srv );
+
+        // Cached copies are updated like in a reload.
+        CacheTexture( *this, (std::size_t)GetTextureMemoryUsageBytes( width, height, dxgiFormat, mipLevelCount > 1 ) );
+    }
 }
 
 void ae3d::Texture2D::LoadSTB( const FileSystem::FileContentsData& fileContents )
 {
     int components;
-    unsigned char* data = stbi_load_from_memory( fileContents.data.data(), static_cast<int>(fileContents.data.size()), &width, &height, &components, 4 );
+    unsigned char* data = LoadStbImage( fileContents, width, height, components );
     System::Assert( width > 0 && height > 0, "Invalid texture dimension" );
 
     if (data == nullptr)
@@ -695,41 +722,19 @@ void ae3d::Texture2D::LoadSTB( const FileSystem::FileContentsData& fileContents
         texResources[ 0 ].RowPitch = width * bytesPerPixel;
         texResources[ 0 ].SlicePitch = texResources[ 0 ].RowPitch * height;
 
-        std::vector< std::vector< std::uint8_t > > mipLevels( mipLevelCount - 1 );
-        for (std::size_t i = 1; i < mipLevelCount; ++i)
-        {
-            const std::int32_t mipWidth = MathUtil::Max( width >> i, 1 );
-            const std::int32_t mipHeight = MathUtil::Max( height >> i, 1 );
-            mipLevels[ i-1 ].resize( mipWidth * mipHeight * 4 );
-        }
+        std::vector< unsigned char > mips;
+        GetStbMips( fileContents.path, data, width, height, colorSpace, wrap, mips );
+        std::size_t offset = 0;
 
         for (std::size_t i = 1; i < mipLevelCount; ++i)
         {
             const std::int32_t mipWidth = MathUtil::Max( width >> i, 1 );
             const std::int32_t mipHeight = MathUtil::Max( height >> i, 1 );
 
-            for (int mipY = 0; mipY < mipHeight; ++mipY)
-            {
-                for (int mipX = 0; mipX < mipWidth; ++mipX)
-                {
-                    const int yInBase = mipY << i;
-                    const int xInBase = mipX << i;
-
-                    const std::uint8_t red = data[ (yInBase * width + xInBase) * 4 + 0 ];
-                    const std::uint8_t green = data[ (yInBase * width + xInBase) * 4 + 1 ];
-                    const std::uint8_t blue = data[ (yInBase * width + xInBase) * 4 + 2 ];
-                    const std::uint8_t alpha = data[ (yInBase * width + xInBase) * 4 + 3 ];
-
-                    mipLevels[ i - 1 ][ (mipY * mipWidth + mipX) * 4 + 0 ] = red;
-                    mipLevels[ i - 1 ][ (mipY * mipWidth + mipX) * 4 + 1 ] = green;
-                    mipLevels[ i - 1 ][ (mipY * mipWidth + mipX) * 4 + 2 ] = blue;
-                    mipLevels[ i - 1 ][ (mipY * mipWidth + mipX) * 4 + 3 ] = alpha;
-                }
-            }
-
-            texResources[ i ].pData = mipLevels[ i - 1 ].data();
+            texResources[ i ].pData = &mips[ offset ];
             texResources[ i ].RowPitch = mipWidth * bytesPerPixel;
             texResources[ i ].SlicePitch = texResources[ i ].RowPitch * mipHeight;
+            offset += mipWidth * mipHeight * bytesPerPixel;
         }
 
         InitializeTexture( gpuResource, texResources.data(), mipLevelCount );
@@ -147,6 +147,11 @@ void ae3d::TextureCube::Load( const FileSystem::FileContentsData& negX, const Fi
                 dxgiFormat = DXGI_FORMAT_BC5_UNORM;
                 bytesPerPixel = 4;
             }
+            else if (ddsOutput.format == DDSLoader::Format::BC7)
+            {
+                dxgiFormat = (colorSpace == ColorSpace::Linear) ? DXGI_FORMAT_BC7_UNORM : DXGI_FORMAT_BC7_UNORM_SRGB;
+                bytesPerPixel = 4;
+            }
             else
             {
                 System::Assert( false, "Unhandled DDS format!" );
@@ -1,6 +1,7 @@
 // This is an independent project of an individual developer. Dear PVS-Studio, please check it.
 // PVS-Studio Static Code Analyzer for C, C++, C#, and Java: http://www.viva64.com
 #include "VertexBuffer.hpp"
+#include <algorithm>
 #include <vector>
 #include <d3d12.h>
 #include "GfxDevice.hpp"
@@ -15,6 +16,7 @@ namespace GfxDeviceGlobal
     extern ID3D12GraphicsCommandList* commandList;
     extern ID3D12CommandAllocator* commandListAllocator;
     extern ID3D12CommandQueue* commandQueue;
+    extern std::vector< ID3D12Resource* > pendingFreeResources;
 }
 
 namespace Global
@@ -33,7 +35,7 @@ void ae3d::VertexBuffer::DestroyBuffers()
 
 unsigned ae3d::VertexBuffer::GetIBSize() const
 {
-    return elementCount * 2;
+    return elementCount * GetIndexSize();
 }
 
 unsigned ae3d::VertexBuffer::GetStride() const
@@ -54,6 +56,14 @@ unsigned ae3d::VertexBuffer::GetStride() const
     {
         return sizeof( VertexPTNTC_Skinned );
     }
+    else if (vertexFormat == VertexFormat::PTNTC_Compact)
+    {
+        return sizeof( VertexPTNTC_Compact );
+    }
+    else if (vertexFormat == VertexFormat::PTNTC_Compact_Skinned)
+    {
+        return sizeof( VertexPTNTC_Compact_Skinned );
+    }
     else
     {
         System::Assert( false, "unhandled vertex format!" );
@@ -71,6 +81,26 @@ void ae3d::VertexBuffer::SetDebugName( const char* name )
     }
 }
 
+void ae3d::VertexBuffer::Release()
+{
+    if (vbUpload != nullptr)
+    {
+        // Buffers that are not in vbs have already been released by DestroyBuffers().
+        auto vb = std::find( std::begin( Global::vbs ), std::end( Global::vbs ), vbUpload );
+
+        if (vb != std::end( Global::vbs ))
+        {
+            Global::vbs.erase( vb );
+            GfxDeviceGlobal::pendingFreeResources.push_back( vbUpload );
+            Global::totalBufferMemoryUsageBytes -= sizeBytes;
+        }
+    }
+
+    vbUpload = nullptr;
+    mappedDynamic = nullptr;
+    elementCount = 0;
+}
+
 void ae3d::VertexBuffer::UploadVB( void* faces, void* vertices, unsigned ibSize )
 {
     D3D12_HEAP_PROPERTIES uploadProp = {};
@@ -131,15 +161,16 @@ void ae3d::VertexBuffer::UploadVB( void* faces, void* vertices, unsigned ibSize
 
     indexBufferView.BufferLocation = vbUpload->GetGPUVirtualAddress() + GetIBOffset();
     indexBufferView.SizeInBytes = GetIBSize();
-    indexBufferView.Format = DXGI_FORMAT_R16_UINT;
+    indexBufferView.Format = indexType == IndexType::UInt32 ? DXGI_FORMAT_R32_UINT : DXGI_FORMAT_R16_UINT;
 }
 
 void ae3d::VertexBuffer::GenerateDynamic( int faceCount, int vertexCount )
 {
     vertexFormat = VertexFormat::PTNTC;
     elementCount = faceCount * 3;
+    indexType = vertexCount > 65536 ? IndexType::UInt32 : IndexType::UInt16;
 
-    const int ibSize = elementCount * 2;
+    const int ibSize = elementCount * GetIndexSize();
     ibOffset = sizeof( VertexPTNTC ) * vertexCount;
 
     D3D12_HEAP_PROPERTIES uploadProp = {};
@@ -196,7 +227,7 @@ void ae3d::VertexBuffer::GenerateDynamic( int faceCount, int vertexCount )
 
     indexBufferView.BufferLocation = vbUpload->GetGPUVirtualAddress() + GetIBOffset();
     indexBufferView.SizeInBytes = GetIBSize();
-    indexBufferView.Format = DXGI_FORMAT_R16_UINT;
+    indexBufferView.Format = indexType == IndexType::UInt32 ? DXGI_FORMAT_R32_UINT : DXGI_FORMAT_R16_UINT;
 }
 
 void ae3d::VertexBuffer::UpdateDynamic( const Face* faces, int /*faceCount*/, const VertexPTC* vertices, int vertexCount )
@@ -215,9 +246,24 @@ void ae3d::VertexBuffer::UpdateDynamic( const Face* faces, int /*faceCount*/, co
         verticesPTNTC[ vertexInd ].color = vertices[ vertexInd ].color;
     }
 
-    const int ibSize = elementCount * 2;
     std::memcpy( mappedDynamic, verticesPTNTC.data(), vertexCount * sizeof( VertexPTNTC ) );
-    memcpy_s( mappedDynamic + ibOffset, ibSize, faces, ibSize );
+
+    if (indexType == IndexType::UInt32)
+    {
+        const int ibSize = elementCount * 4;
+        memcpy_s( mappedDynamic + ibOffset, ibSize, faces, ibSize );
+    }
+    else
+    {
+        unsigned short* indices = reinterpret_cast< unsigned short* >( mappedDynamic + ibOffset );
+
+        for (int f = 0; f < elementCount / 3; ++f)
+        {
+            indices[ f * 3 + 0 ] = (unsigned short)faces[ f ].a;
+            indices[ f * 3 + 1 ] = (unsigned short)faces[ f ].b;
+            indices[ f * 3 + 2 ] = (unsigned short)faces[ f ].c;
+        }
+    }
 }
 
 void ae3d::VertexBuffer::Generate( const Face* faces, int faceCount, const VertexPTC* vertices, int vertexCount, Storage /*storage*/ )
@@ -225,7 +271,9 @@ void ae3d::VertexBuffer::Generate( const Face* faces, int faceCount, const Verte
     vertexFormat = VertexFormat::PTNTC;
     elementCount = faceCount * 3;
 
-    const int ibSize = elementCount * 2;
+    Array< unsigned short > indices16;
+    const void* indices = PackIndices( faces, faceCount, vertexCount, indices16 );
+    const int ibSize = elementCount * GetIndexSize();
     ibOffset = sizeof( VertexPTNTC ) * vertexCount;
 
     std::vector< VertexPTNTC > verticesPTNTC( vertexCount );
@@ -240,7 +288,7 @@ void ae3d::VertexBuffer::Generate( const Face* faces, int faceCount, const Verte
         verticesPTNTC[ vertexInd ].color = vertices[ vertexInd ].color;
     }
 
-    UploadVB( (void*)faces, verticesPTNTC.data(), ibSize );
+    UploadVB( (void*)indices, verticesPTNTC.data(), ibSize );
 }
 
 void ae3d::VertexBuffer::Generate( const Face* faces, int faceCount, const VertexPTN* vertices, int vertexCount )
@@ -248,7 +296,9 @@ void ae3d::VertexBuffer::Generate( const Face* faces, int faceCount, const Verte
     vertexFormat = VertexFormat::PTNTC;
     elementCount = faceCount * 3;
 
-    const int ibSize = elementCount * 2;
+    Array< unsigned short > indices16;
+    const void* indices = PackIndices( faces, faceCount, vertexCount, indices16 );
+    const int ibSize = elementCount * GetIndexSize();
     ibOffset = sizeof( VertexPTNTC ) * vertexCount;
 
     std::vector< VertexPTNTC > verticesPTNTC( vertexCount );
@@ -263,7 +313,7 @@ void ae3d::VertexBuffer::Generate( const Face* faces, int faceCount, const Verte
         verticesPTNTC[ vertexInd ].color = Vec4( 1, 1, 1, 1 );
     }
 
-    UploadVB( (void*)faces, verticesPTNTC.data(), ibSize );
+    UploadVB( (void*)indices, verticesPTNTC.data(), ibSize );
 }
 
 void ae3d::VertexBuffer::Generate( const Face* faces, int faceCount, const VertexPTNTC* vertices, int vertexCount )
@@ -271,10 +321,12 @@ void ae3d::VertexBuffer::Generate( const Face* faces, int faceCount, const Verte
     vertexFormat = VertexFormat::PTNTC;
     elementCount = faceCount * 3;
 
-    const int ibSize = elementCount * 2;
+    Array< unsigned short > indices16;
+    const void* indices = PackIndices( faces, faceCount, vertexCount, indices16 );
+    const int ibSize = elementCount * GetIndexSize();
     ibOffset = sizeof( VertexPTNTC ) * vertexCount;
 
-    UploadVB( (void*)faces, (void*)vertices, ibSize );
+    UploadVB( (void*)indices, (void*)vertices, ibSize );
 }
 
 void ae3d::VertexBuffer::Generate( const Face* faces, int faceCount, const VertexPTNTC_Skinned* vertices, int vertexCount )
@@ -282,10 +334,68 @@ void ae3d::VertexBuffer::Generate( const Face* faces, int faceCount, const Verte
     vertexFormat = VertexFormat::PTNTC_Skinned;
     elementCount = faceCount * 3;
 
-    const int ibSize = elementCount * 2;
+    Array< unsigned short > indices16;
+    const void* indices = PackIndices( faces, faceCount, vertexCount, indices16 );
+    const int ibSize = elementCount * GetIndexSize();
     ibOffset = sizeof( VertexPTNTC_Skinned ) * vertexCount;
 
-    UploadVB( (void*)faces, (void*)vertices, ibSize );
+    UploadVB( (void*)indices, (void*)vertices, ibSize );
+}
+
+void ae3d::VertexBuffer::Generate( const Face* faces, int faceCount, const VertexPTNTC_Compact* vertices, int vertexCount, const Vec3& positionOffset, float positionScale )
+{
+    vertexFormat = VertexFormat::PTNTC_Compact;
+    elementCount = faceCount * 3;
+    positionDequantization = Vec4( positionOffset, positionScale );
+
+    Array< unsigned short > indices16;
+    const void* indices = PackIndices( faces, faceCount, vertexCount, indices16 );
+    const int ibSize = elementCount * GetIndexSize();
+    ibOffset = sizeof( VertexPTNTC_Compact ) * vertexCount;
+
+    UploadVB( (void*)indices, (void*)vertices, ibSize );
+}
+
+void ae3d::VertexBuffer::Generate( const Face* faces, int faceCount, const VertexPTNTC_Compact_Skinned* vertices, int vertexCount, const Vec3& positionOffset, float positionScale )
+{
+    vertexFormat = VertexFormat::PTNTC_Compact_Skinned;
+    elementCount = faceCount * 3;
+    positionDequantization = Vec4( positionOffset, positionScale );
+
+    Array< unsigned short > indices16;
+    const void* indices = PackIndices( faces, faceCount, vertexCount, indices16 );
+    const int ibSize = elementCount * GetIndexSize();
+    ibOffset = sizeof( VertexPTNTC_Compact_Skinned ) * vertexCount;
+
+    UploadVB( (void*)indices, (void*)vertices, ibSize );
+}
+
+void ae3d::VertexBuffer::GeneratePacked( const void* indices, IndexType aIndexType, int faceCount, const void* vertices, VertexFormat aVertexFormat, int vertexCount,
+                                         const Vec4& aPositionDequantization )
+{
+    System::Assert( aVertexFormat == VertexFormat::PTNTC || aVertexFormat == VertexFormat::PTNTC_Skinned ||
+                    aVertexFormat == VertexFormat::PTNTC_Compact || aVertexFormat == VertexFormat::PTNTC_Compact_Skinned, "GeneratePacked: unsupported vertex format" );
+    System::Assert( aIndexType == IndexType::UInt32 || vertexCount <= 65536, "GeneratePacked: too many vertices for 16-bit indices" );
+
+    vertexFormat = aVertexFormat;
+    indexType = aIndexType;
+    elementCount = faceCount * 3;
+    positionDequantization = aPositionDequantization;
+
+    const int ibSize = elementCount * GetIndexSize();
+    ibOffset = GetVertexSize( vertexFormat ) * vertexCount;
+
+    UploadVB( (void*)indices, (void*)vertices, ibSize );
+}
+
+void ae3d::VertexBuffer::GenerateDepthStreams( const Vec3* /*positions*/, const VertexPN* /*positionsNormals*/, int /*vertexCount*/ )
+{
+    // Depth-only passes bind the full vertex buffer on this backend.
+}
+
+void ae3d::VertexBuffer::GenerateDepthStreams( const VertexP_Compact* /*positions*/, const VertexPN_Compact* /*positionsNormals*/, int /*vertexCount*/ )
+{
+    // Depth-only passes bind the full vertex buffer on this backend.
 }
 
 void ae3d::VertexBuffer::Bind() const
@@ -87,6 +87,22 @@
 ((pf.dwFlags & DDPF_FOURCC) && \
 (pf.dwFourCC == MAKEFOURCC('A', 'T', 'I', '2') ))
 
+#define DDS_DX10_HEADER_SIZE 20 ///< DDS_HEADER_DXT10 follows the header when FourCC is DX10.
+
+// DXGI_FORMAT values in DDS_HEADER_DXT10
+#define DDS_DXGI_BC1_UNORM 71
+#define DDS_DXGI_BC1_UNORM_SRGB 72
+#define DDS_DXGI_BC2_UNORM 74
+#define DDS_DXGI_BC2_UNORM_SRGB 75
+#define DDS_DXGI_BC3_UNORM 77
+#define DDS_DXGI_BC3_UNORM_SRGB 78
+#define DDS_DXGI_BC4_UNORM 80
+#define DDS_DXGI_BC4_SNORM 81
+#define DDS_DXGI_BC5_UNORM 83
+#define DDS_DXGI_BC5_SNORM 84
+#define DDS_DXGI_BC7_UNORM 98
+#define DDS_DXGI_BC7_UNORM_SRGB 99
+
 unsigned MyMax( unsigned a, unsigned b )
 {
     return (a > b ? a : b);
@@ -154,6 +170,7 @@ DDSInfo loadInfoDXT5 = { 4, 16 };
 DDSInfo loadInfoBC4 = { 4, 16 };
 DDSInfo loadInfoBC5 = { 4, 16 };
 DDSInfo loadInfoBC5_ATI2 = { 4, 16 };
+DDSInfo loadInfoBC7 = { 4, 16 };
 
 DDSLoader::LoadResult DDSLoader::Load( const ae3d::FileSystem::FileContentsData& fileContents, int& outWidth, int& outHeight, bool& outOpaque, Output& output )
 {
@@ -204,6 +221,7 @@ DDSLoader::LoadResult DDSLoader::Load( const ae3d::FileSystem::FileContentsData&
     outWidth  = xSize;
     outHeight = ySize;
     DDSInfo* li = nullptr;
+    std::size_t dx10HeaderSize = 0;
 
     if (PF_IS_DXT1( header.sHeader.sPixelFormat ))
     {
@@ -259,13 +277,52 @@ DDSLoader::LoadResult DDSLoader::Load( const ae3d::FileSystem::FileContentsData&
         outOpaque = true;
         output.format = DDSLoader::Format::BC5U;
     }
-    else if (PF_IS_DX10( header.sHeader.sPixelFormat ))
+    else if (PF_IS_DX10( header.sHeader.sPixelFormat ) && fileContents.data.size() >= sizeof( header ) + DDS_DX10_HEADER_SIZE)
     {
-        li = &loadInfoDXT5;
-        outOpaque = true;
-        output.format = DDSLoader::Format::BC5U;
+        uint32_t dxgiFormat = 0;
+        memcpy( &dxgiFormat, fileContents.data.data() + sizeof( header ), sizeof( dxgiFormat ) );
+        dx10HeaderSize = DDS_DX10_HEADER_SIZE;
+
+        if (dxgiFormat == DDS_DXGI_BC1_UNORM || dxgiFormat == DDS_DXGI_BC1_UNORM_SRGB)
+        {
+            li = &loadInfoDXT1;
+            outOpaque = true;
+            output.format = DDSLoader::Format::BC1;
+        }
+        else if (dxgiFormat == DDS_DXGI_BC2_UNORM || dxgiFormat == DDS_DXGI_BC2_UNORM_SRGB)
+        {
+            li = &loadInfoDXT3;
+            outOpaque = false;
+            output.format = DDSLoader::Format::BC2;
+        }
+        else if (dxgiFormat == DDS_DXGI_BC3_UNORM || dxgiFormat == DDS_DXGI_BC3_UNORM_SRGB)
+        {
+            li = &loadInfoDXT5;
+            outOpaque = false;
+            output.format = DDSLoader::Format::BC3;
+        }
+        else if (dxgiFormat == DDS_DXGI_BC4_UNORM || dxgiFormat == DDS_DXGI_BC4_SNORM)
+        {
+            li = &loadInfoBC4;
+            outOpaque = true;
+            output.format = dxgiFormat == DDS_DXGI_BC4_UNORM ? DDSLoader::Format::BC4U : DDSLoader::Format::BC4S;
+        }
+        else if (dxgiFormat == DDS_DXGI_BC5_UNORM || dxgiFormat == DDS_DXGI_BC5_SNORM)
+        {
+            li = &loadInfoBC5;
+            outOpaque = true;
+            output.format = dxgiFormat == DDS_DXGI_BC5_UNORM ? DDSLoader::Format::BC5U : DDSLoader::Format::BC5S;
+        }
+        else if (dxgiFormat == DDS_DXGI_BC7_UNORM || dxgiFormat == DDS_DXGI_BC7_UNORM_SRGB)
+        {
+            li = &loadInfoBC7;
+            // BC7 blocks can contain alpha.
+            outOpaque = false;
+            output.format = DDSLoader::Format::BC7;
+        }
     }
-    else
+
+    if (li == nullptr)
     {
         // (pf.dwFlags & DDPF_FOURCC) && pf.dwFourCC
         ae3d::System::Print("DDS loader error: Texture %s has unknown pixelformat. Has FourCC: %d, FourCC: %d\n", fileContents.path.c_str(),
@@ -280,7 +337,7 @@ DDSLoader::LoadResult DDSLoader::Load( const ae3d::FileSystem::FileContentsData&
     unsigned y = ySize;
     mipMapCount = (header.sHeader.dwFlags & DDSD_MIPMAPCOUNT) ? header.sHeader.dwMipMapCount : 1;
 
-    std::size_t fileOffset = sizeof( header );
+    std::size_t fileOffset = sizeof( header ) + dx10HeaderSize;
 
     std::size_t size = MyMax( li->divSize, x ) / li->divSize * MyMax( li->divSize, y ) / li->divSize * li->blockBytes;
     // FIXME: A texture loaded from https://online-converting.com/image/convert2dds/ has dwPitchOrLinearSize set to 0, but otherwise seems to load correctly.
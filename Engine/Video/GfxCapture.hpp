@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+#include "GfxDevice.hpp"
+
+namespace ae3d
+{
+    /// Records GfxDevice calls of whole frames into a compact binary file and replays them.
+    /// Replaying measures backend submission cost without scene traversal and gives identical input across engine versions.
+    /// Geometry and texture contents are not captured: replay uses placeholders of the same vertex format, index count and binding pattern.
+    namespace GfxCapture
+    {
+        enum class Command : std::uint8_t
+        {
+            BeginFrame,
+            Present,
+            BeginRenderPassAndCommandBuffer,
+            EndRenderPassAndCommandBuffer,
+            BeginRenderPass,
+            EndRenderPass,
+            BeginOffscreen,
+            EndOffscreen,
+            SetRenderTarget,
+            SetViewport,
+            SetScissor,
+            ClearScreen,
+            Draw,
+            DefineShader,
+            DefineVertexBuffer,
+            DefineRenderTexture
+        };
+
+        /// Texture slots whose bindings are captured.
+        static const int TextureSlotCount = 4;
+
+        /// Starts capturing on the next BeginFrame. The file is written after frameCount frames have been presented.
+        void Begin( const char* path, int frameCount );
+
+        /// \return True between the first captured BeginFrame and the last captured Present.
+        bool IsCapturing();
+
+        /// Called at the start of GfxDevice::BeginFrame. Starts a pending capture and records the frame start.
+        void BeginFrame();
+
+        /// Called at the end of GfxDevice::Present. Records the frame end and writes the file after the last captured frame.
+        void Present();
+
+        /// Records a command without arguments.
+        void Record( Command command );
+        void RecordSetRenderTarget( RenderTexture* target, unsigned cubeMapFace );
+        void RecordRect( Command command, const int rect[ 4 ] );
+        void RecordClearScreen( unsigned clearFlags );
+        void RecordEndOffscreen( int profilerIndex, RenderTexture* target );
+        /// \param textures Bound texture handles for the first TextureSlotCount slots.
+        void RecordDraw( VertexBuffer& vertexBuffer, int startIndex, int endIndex, Shader& shader, GfxDevice::BlendMode blendMode, GfxDevice::DepthFunc depthFunc,
+                         GfxDevice::CullMode cullMode, GfxDevice::FillMode fillMode, GfxDevice::PrimitiveTopology topology,
+                         const PerObjectUboStruct& ubo, const std::uint64_t textures[ TextureSlotCount ] );
+
+        /// Loads a capture and creates its placeholder resources.
+        /// \return Captured frame count, or 0 if the file could not be loaded.
+        int Load( const char* path );
+
+        /// Re-issues captured GfxDevice calls of a frame loaded with Load(), including BeginFrame and Present.
+        void ReplayFrame( int frameIndex );
+    }
+}
@@ -1,6 +1,9 @@
 #pragma once
 
 #include <cstdint>
+#if RENDERER_VULKAN
+#include <functional>
+#endif
 #if RENDERER_METAL
 #import <MetalKit/MetalKit.h>
 #endif
@@ -30,7 +33,8 @@ struct PerObjectUboStruct
     float f0 = 0.8f;
     ae3d::Vec4 tex0scaleOffset = ae3d::Vec4( 1, 1, 0, 0 );
     ae3d::Vec4 tilesXY = ae3d::Vec4( 0, 0, 0, 0 );
-    ae3d::Matrix44 boneMatrices[ 80 ];
+    unsigned boneOffset = 0; // Index of the draw's first joint in the bone palette buffer.
+    unsigned bonePadding[ 3 ];
     int isVR = 0;
     int kernelSize;
     float bloomThreshold = 0.8f;
@@ -99,6 +103,10 @@ namespace ae3d
         int CreateLineBuffer( const Vec3* lines, int lineCount, const Vec3& color );
         void UpdateLineBuffer( int lineHandle, const Vec3* lines, int lineCount, const Vec3& color );
         void GetNewUniformBuffer();
+        /// Appends matrices to this frame's bone palette buffer, which grows if needed. Skinned draws read their joints
+        /// starting at PerObjectUboStruct::boneOffset.
+        /// \return Index of the first matrix in the buffer.
+        unsigned UploadBonePalette( const Matrix44* matrices, unsigned matrixCount );
 #if RENDERER_D3D12
         void ResetCommandList();
         void* GetCurrentMappedConstantBuffer();
@@ -119,6 +127,8 @@ namespace ae3d
         void EndBackBufferEncoding();
 #endif
 #if RENDERER_VULKAN
+        /// Creates a pipeline state for drawing into target (null for backbuffer) unless it's already cached, so the first Draw() with it doesn't stall.
+        void CreatePSOIfMissing( VertexBuffer& vertexBuffer, Shader& shader, BlendMode blendMode, DepthFunc depthFunc, CullMode cullMode, FillMode fillMode, PrimitiveTopology topology, RenderTexture* target );
         void ResetPSOCache();
         void CreateUniformBuffers();
         std::uint8_t* GetCurrentUbo();
@@ -128,6 +138,10 @@ namespace ae3d
         void EndRenderPass();
         void EndCommandBuffer();
         void BeginFrame();
+        void SetRecordingThreadCount( int threadCount );
+        /// Calls recordRange( begin, end ) for draws [0, drawCount). Inside a pass, large ranges are split between recording threads
+        /// that record into secondary command buffers. recordRange must only touch state owned by its range.
+        void RecordDrawsInParallel( int drawCount, const std::function< void( int, int ) >& recordRange );
 #endif
         void ClearScreen( unsigned clearFlags );
         void Draw( VertexBuffer& vertexBuffer, int startIndex, int endIndex, Shader& shader, BlendMode blendMode, DepthFunc depthFunc, CullMode cullMode, FillMode fillMode, PrimitiveTopology topology );
@@ -10,7 +10,7 @@ ae3d::RenderTexture* ae3d::Material::sTexRT;
 
 namespace GfxDeviceGlobal
 {
-    extern PerObjectUboStruct perObjectUboStruct;
+    extern thread_local PerObjectUboStruct perObjectUboStruct;
 }
 
 bool ae3d::Material::IsValidShader() const
@@ -25,15 +25,16 @@ void ae3d::Material::Apply()
         return;
     }
 
+    // Use() must be called for every draw because it advances the per-draw uniform buffer.
     shader->Use();
     
     for (int slot = 0; slot < TEXTURE_SLOT_COUNT; ++slot)
     {
-        shader->SetTexture( tex2dSlots[ slot ], slot );
-    }
+        if (tex2dSlots[ slot ])
+        {
+            shader->SetTexture( tex2dSlots[ slot ], slot );
+        }
 
-    for (int slot = 0; slot < TEXTURE_SLOT_COUNT; ++slot)
-    {
         if (texCubeSlots[ slot ])
         {
             shader->SetTexture( texCubeSlots[ slot ], slot );
@@ -100,6 +101,17 @@ void ae3d::Material::SetTexture( Texture2D* texture, int slot )
     }
 }
 
+void ae3d::Material::RequestStreamedMips( float screenSize )
+{
+    for (int slot = 0; slot < TEXTURE_SLOT_COUNT; ++slot)
+    {
+        if (tex2dSlots[ slot ] != nullptr)
+        {
+            tex2dSlots[ slot ]->RequestStreamedMips( screenSize );
+        }
+    }
+}
+
 void ae3d::Material::SetTexture( TextureCube* texture )
 {
     texCubeSlots[ 4 ] = texture;
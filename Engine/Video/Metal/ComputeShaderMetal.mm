@@ -11,7 +11,7 @@ extern id <MTLCommandQueue> commandQueue;
 
 namespace GfxDeviceGlobal
 {
-    extern PerObjectUboStruct perObjectUboStruct;
+    extern thread_local PerObjectUboStruct perObjectUboStruct;
 }
 
 void ae3d::ComputeShader::Load( const char* source )
@@ -101,6 +101,11 @@ namespace GfxDeviceGlobal
     id<MTLSamplerState> samplerStates[ 13 ];
     id<MTLBuffer> uniformBuffers[ UboCount ];
     int currentUboIndex;
+    // There's no frame synchronization, so frames in flight have their own bone palettes.
+    const unsigned BonePaletteBufferCount = 3;
+    id<MTLBuffer> bonePaletteBuffers[ BonePaletteBufferCount ];
+    // Matrices uploaded this frame.
+    unsigned bonePaletteCount = 0;
     ae3d::DataType currentRenderTargetDataType = ae3d::DataType::UByte;
     ae3d::LightTiler lightTiler;
     std::vector< ae3d::VertexBuffer > lineBuffers;
@@ -109,8 +114,14 @@ namespace GfxDeviceGlobal
     unsigned frameIndex = 0;
     ae3d::VertexBuffer uiBuffer;
     ae3d::VertexBuffer uiBuffer2;
-    PerObjectUboStruct perObjectUboStruct;
+    thread_local PerObjectUboStruct perObjectUboStruct;
     id <MTLRenderPipelineState> cachedPSO;
+    // State bound to renderEncoder by Draw(). Reset when a new encoder is created.
+    id<MTLTexture> boundTextures[ 5 ];
+    id<MTLSamplerState> boundSamplerStates[ 5 ];
+    id<MTLDepthStencilState> boundDepthStencilState;
+    ae3d::GfxDevice::CullMode boundCullMode = ae3d::GfxDevice::CullMode::Off;
+    ae3d::GfxDevice::FillMode boundFillMode = ae3d::GfxDevice::FillMode::Solid;
     
     struct Samplers
     {
@@ -237,6 +248,11 @@ namespace ae3d
                 str += std::to_string( ::Statistics::GetSceneAABBTimeMS() );
                 str += "\nfrustum cull: ";
                 str += std::to_string( ::Statistics::GetFrustumCullTimeMS() );
+                str += "\nskinning: ";
+                str += std::to_string( ::Statistics::GetSkinningTimeMS() );
+                str += "\ntexture upload: ";
+                str += std::to_string( ::Statistics::GetTextureUploadMBPerSecond() );
+                str += " MB/s";
                 str += "\nmemory: ";
                 str += std::to_string([device currentAllocatedSize] / (1024 * 1024));
                 str += " MiB";
@@ -261,6 +277,36 @@ void ae3d::GfxDevice::GetNewUniformBuffer()
     GfxDeviceGlobal::currentUboIndex = (GfxDeviceGlobal::currentUboIndex + 1) % UboCount;
 }
 
+static id<MTLBuffer> CreateBonePaletteBuffer( unsigned capacity )
+{
+#if !TARGET_OS_IPHONE
+    id<MTLBuffer> buffer = [ae3d::GfxDevice::GetMetalDevice() newBufferWithLength:capacity * sizeof( ae3d::Matrix44 ) options:MTLResourceStorageModeManaged];
+#else
+    id<MTLBuffer> buffer = [ae3d::GfxDevice::GetMetalDevice() newBufferWithLength:capacity * sizeof( ae3d::Matrix44 ) options:MTLResourceCPUCacheModeDefaultCache];
+#endif
+    buffer.label = @"bone palette";
+    return buffer;
+}
+
+unsigned ae3d::GfxDevice::UploadBonePalette( const Matrix44* matrices, unsigned matrixCount )
+{
+    id<MTLBuffer>& buffer = GfxDeviceGlobal::bonePaletteBuffers[ GfxDeviceGlobal::frameIndex % GfxDeviceGlobal::BonePaletteBufferCount ];
+    const unsigned firstIndex = GfxDeviceGlobal::bonePaletteCount;
+
+    // Command buffers retain the old buffer, so recorded draws still read it.
+    if ((firstIndex + matrixCount) * sizeof( Matrix44 ) > buffer.length)
+    {
+        buffer = CreateBonePaletteBuffer( (firstIndex + matrixCount) * 2 );
+    }
+
+    memcpy( (Matrix44*)[buffer contents] + firstIndex, matrices, matrixCount * sizeof( Matrix44 ) );
+#if !TARGET_OS_IPHONE
+    [buffer didModifyRange:NSMakeRange( firstIndex * sizeof( Matrix44 ), matrixCount * sizeof( Matrix44 ) )];
+#endif
+    GfxDeviceGlobal::bonePaletteCount += matrixCount;
+    return firstIndex;
+}
+
 id <MTLBuffer> ae3d::GfxDevice::GetCurrentUniformBuffer()
 {
     return GfxDeviceGlobal::uniformBuffers[ GfxDeviceGlobal::currentUboIndex ];
@@ -394,6 +440,11 @@ void ae3d::GfxDevice::InitMetal( id <MTLDevice> metalDevice, MTKView* aView, int
 #endif
         GfxDeviceGlobal::uniformBuffers[ uboIndex ].label = @"uniform buffer";
     }
+
+    for (unsigned bufferIndex = 0; bufferIndex < GfxDeviceGlobal::BonePaletteBufferCount; ++bufferIndex)
+    {
+        GfxDeviceGlobal::bonePaletteBuffers[ bufferIndex ] = CreateBonePaletteBuffer( 1024 );
+    }
     
     MTLDepthStencilDescriptor *depthStateDesc = [[MTLDepthStencilDescriptor alloc] init];
     depthStateDesc.depthCompareFunction = MTLCompareFunctionLessEqual;
@@ -414,7 +465,8 @@ void ae3d::GfxDevice::InitMetal( id <MTLDevice> metalDevice, MTKView* aView, int
     GfxDeviceGlobal::CreateSamplers();
     GfxDeviceGlobal::lightTiler.Init();
 
-    Array< VertexBuffer::VertexPTC > vertices( uiVBSize );
+    // UI indices are 16-bit, so more vertices could not be addressed.
+    Array< VertexBuffer::VertexPTC > vertices( uiVBSize < 65536 ? uiVBSize : 65536 );
     Array< VertexBuffer::Face > faces( uiIBSize );
     GfxDeviceGlobal::uiBuffer.Generate( faces.elements, int( faces.count ), vertices.elements, int( vertices.count ), VertexBuffer::Storage::CPU );
     GfxDeviceGlobal::uiBuffer2.Generate( faces.elements, int( faces.count ), vertices.elements, int( vertices.count ), VertexBuffer::Storage::CPU );
@@ -691,6 +743,55 @@ id <MTLRenderPipelineState> GetPSO( ae3d::Shader& shader, ae3d::GfxDevice::Blend
     return GfxDeviceGlobal::psoCache[ psoHash ];
 }
 
+/// Finds slots 0-4 that differ from the bound ones and marks the range as bound. Slots outside the range don't need a bind.
+/// \return Range of slots from the first to the last changed one, with zero length if none changed.
+template< typename T > static NSRange GetChangedRange( T const* slots, T* bound )
+{
+    NSRange range = { 0, 0 };
+
+    for (NSUInteger slot = 0; slot < 5; ++slot)
+    {
+        if (bound[ slot ] != slots[ slot ])
+        {
+            if (range.length == 0)
+            {
+                range.location = slot;
+            }
+
+            range.length = slot - range.location + 1;
+        }
+    }
+
+    for (NSUInteger slot = 0; slot < 5; ++slot)
+    {
+        if (slot >= range.location && slot < range.location + range.length)
+        {
+            bound[ slot ] = slots[ slot ];
+        }
+        else
+        {
+            Statistics::IncAvoidedBinds();
+        }
+    }
+
+    return range;
+}
+
+/// Forgets state bound to the previous render encoder.
+static void ResetBoundState()
+{
+    GfxDeviceGlobal::cachedPSO = nil;
+    GfxDeviceGlobal::boundDepthStencilState = nil;
+    GfxDeviceGlobal::boundCullMode = ae3d::GfxDevice::CullMode::Off;
+    GfxDeviceGlobal::boundFillMode = ae3d::GfxDevice::FillMode::Solid;
+
+    for (int slot = 0; slot < 5; ++slot)
+    {
+        GfxDeviceGlobal::boundTextures[ slot ] = nil;
+        GfxDeviceGlobal::boundSamplerStates[ slot ] = nil;
+    }
+}
+
 void ae3d::GfxDevice::DrawLines( int handle, Shader& shader )
 {
     if (handle < 0 || handle >= int( GfxDeviceGlobal::lineBuffers.size() ))
@@ -732,9 +833,14 @@ void ae3d::GfxDevice::Draw( VertexBuffer& vertexBuffer, int startIndex, int endI
         GfxDeviceGlobal::cachedPSO = pso;
         [renderEncoder setRenderPipelineState:GfxDeviceGlobal::cachedPSO];
     }
+    else
+    {
+        Statistics::IncAvoidedBinds();
+    }
     
     [renderEncoder setVertexBuffer:vertexBuffer.GetVertexBuffer() offset:0 atIndex:0];
     [renderEncoder setVertexBuffer:GetCurrentUniformBuffer() offset:0 atIndex:5];
+    [renderEncoder setVertexBuffer:GfxDeviceGlobal::bonePaletteBuffers[ GfxDeviceGlobal::frameIndex % GfxDeviceGlobal::BonePaletteBufferCount ] offset:0 atIndex:6];
     
     MTLViewport viewport;
     viewport.originX = GfxDeviceGlobal::viewport[ 0 ];
@@ -763,52 +869,57 @@ void ae3d::GfxDevice::Draw( VertexBuffer& vertexBuffer, int startIndex, int endI
         [renderEncoder setFragmentBuffer:GetCurrentUniformBuffer() offset:0 atIndex:5];
     }
     
-    static CullMode cachedCullMode = CullMode::Off;
-    if (cullMode != cachedCullMode)
+    if (cullMode != GfxDeviceGlobal::boundCullMode)
     {
-        cachedCullMode = cullMode;
+        GfxDeviceGlobal::boundCullMode = cullMode;
         [renderEncoder setCullMode:(cullMode == CullMode::Back) ? MTLCullModeBack : MTLCullModeNone];
     }
     
-    static FillMode cachedTriangleFillMode = FillMode::Solid;
-    if (fillMode != cachedTriangleFillMode)
+    if (fillMode != GfxDeviceGlobal::boundFillMode)
     {
-        cachedTriangleFillMode = fillMode;
+        GfxDeviceGlobal::boundFillMode = fillMode;
         [renderEncoder setTriangleFillMode:(fillMode == FillMode::Solid ? MTLTriangleFillMode::MTLTriangleFillModeFill : MTLTriangleFillMode::MTLTriangleFillModeLines)];
     }
     
-    if (isStandard)
+    // Shaders other than standard don't read slots 2 and 3, so binding them too is harmless.
+    NSRange textureRange = GetChangedRange( textures, GfxDeviceGlobal::boundTextures );
+
+    if (textureRange.length > 0)
     {
-        NSRange range = { 0, 5 };
-        [renderEncoder setFragmentTextures:textures withRange:range ];
+        [renderEncoder setFragmentTextures:&textures[ textureRange.location ] withRange:textureRange ];
     }
-    else
+
+    id<MTLDepthStencilState> depthStencilState = depthStateLessEqualWriteOn;
+
+    if (depthFunc == DepthFunc::LessOrEqualWriteOff)
     {
-        [renderEncoder setFragmentTexture:textures[ 0 ] atIndex:0];
-        [renderEncoder setFragmentTexture:textures[ 1 ] atIndex:1];
-        [renderEncoder setFragmentTexture:textures[ 4 ] atIndex:4];
+        depthStencilState = depthStateLessEqualWriteOff;
     }
-    
-    if (depthFunc == DepthFunc::LessOrEqualWriteOff)
+    else if (depthFunc == DepthFunc::NoneWriteOff)
     {
-        [renderEncoder setDepthStencilState:depthStateLessEqualWriteOff];
+        depthStencilState = depthStateNoneWriteOff;
     }
-    else if (depthFunc == DepthFunc::LessOrEqualWriteOn)
+    else if (depthFunc != DepthFunc::LessOrEqualWriteOn)
     {
-        [renderEncoder setDepthStencilState:depthStateLessEqualWriteOn];
+        System::Assert( false, "unhandled depth function" );
     }
-    else if (depthFunc == DepthFunc::NoneWriteOff)
+
+    if (GfxDeviceGlobal::boundDepthStencilState != depthStencilState)
     {
-        [renderEncoder setDepthStencilState:depthStateNoneWriteOff];
+        GfxDeviceGlobal::boundDepthStencilState = depthStencilState;
+        [renderEncoder setDepthStencilState:depthStencilState];
     }
     else
     {
-        System::Assert( false, "unhandled depth function" );
-        [renderEncoder setDepthStencilState:depthStateLessEqualWriteOn];
+        Statistics::IncAvoidedBinds();
+    }
+
+    NSRange samplerRange = GetChangedRange( GfxDeviceGlobal::samplerStates, GfxDeviceGlobal::boundSamplerStates );
+
+    if (samplerRange.length > 0)
+    {
+        [renderEncoder setFragmentSamplerStates:&GfxDeviceGlobal::samplerStates[ samplerRange.location ] withRange:samplerRange ];
     }
-    
-    NSRange range = { 0, 5 };
-    [renderEncoder setFragmentSamplerStates:GfxDeviceGlobal::samplerStates withRange:range ];
     
     if (vertexBuffer.GetVertexFormat() == VertexBuffer::VertexFormat::PTNTC)
     {
@@ -839,9 +950,9 @@ void ae3d::GfxDevice::Draw( VertexBuffer& vertexBuffer, int startIndex, int endI
     {
         [renderEncoder drawIndexedPrimitives:MTLPrimitiveTypeTriangle
                                   indexCount:(endIndex - startIndex) * 3
-                               indexType:MTLIndexTypeUInt16
+                               indexType:vertexBuffer.GetIndexType() == VertexBuffer::IndexType::UInt32 ? MTLIndexTypeUInt32 : MTLIndexTypeUInt16
                              indexBuffer:vertexBuffer.GetIndexBuffer()
-                       indexBufferOffset:startIndex * 2 * 3];
+                       indexBufferOffset:startIndex * vertexBuffer.GetIndexSize() * 3];
     }
     else // MTLPrimitiveTypeLine
     {
@@ -881,6 +992,7 @@ void ae3d::GfxDevice::PresentDrawable()
     }
     
     ++GfxDeviceGlobal::frameIndex;
+    GfxDeviceGlobal::bonePaletteCount = 0;
 }
 
 void ae3d::GfxDevice::SetClearColor( float red, float green, float blue )
@@ -906,6 +1018,7 @@ void ae3d::GfxDevice::BeginBackBufferEncoding()
         renderEncoder = [commandBuffer renderCommandEncoderWithDescriptor:renderPassDescriptor];
         renderEncoder.label = @"BackBufferRenderEncoder";
         [renderEncoder setFrontFacingWinding:MTLWindingCounterClockwise];
+        ResetBoundState();
     }
     else
     {
@@ -971,6 +1084,6 @@ void ae3d::GfxDevice::SetRenderTarget( ae3d::RenderTexture* renderTexture, unsig
     [renderEncoder setFrontFacingWinding:MTLWindingCounterClockwise];
 
     GfxDeviceGlobal::currentRenderTargetDataType = renderTexture->GetDataType();
-    GfxDeviceGlobal::cachedPSO = nil;
+    ResetBoundState();
 }
 
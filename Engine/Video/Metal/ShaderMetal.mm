@@ -12,7 +12,7 @@ extern id<MTLTexture> textures[ 13 ];
 namespace GfxDeviceGlobal
 {
     void SetSampler( int textureUnit, ae3d::TextureFilter filter, ae3d::TextureWrap wrap, ae3d::Anisotropy anisotropy );
-    extern PerObjectUboStruct perObjectUboStruct;
+    extern thread_local PerObjectUboStruct perObjectUboStruct;
 }
 
 int ae3d::Shader::GetUniformLocation( const char* name )
@@ -1,5 +1,6 @@
 #include "Texture2D.hpp"
 #include <string>
+#include <vector>
 #include <stdint.h>
 #define STB_IMAGE_IMPLEMENTATION
 #if TARGET_OS_IPHONE
@@ -9,18 +10,24 @@
 #include "DDSLoader.hpp"
 #include "FileSystem.hpp"
 #include "GfxDevice.hpp"
+#include "Statistics.hpp"
 #include "System.hpp"
 
 #define MYMAX(x, y) ((x) > (y) ? (x) : (y))
 
 extern id <MTLCommandQueue> commandQueue;
 bool HasStbExtension( const std::string& path ); // Defined in TextureCommon.cpp
+unsigned char* LoadStbImage( const ae3d::FileSystem::FileContentsData& fileContents, int& outWidth, int& outHeight, int& outComponents ); // Defined in TextureCommon.cpp
+void GetStbMips( const std::string& path, const unsigned char* pixels, int width, int height, ae3d::ColorSpace colorSpace, ae3d::TextureWrap wrap,
+                 std::vector< unsigned char >& outMips ); // Defined in TextureCommon.cpp
+void RemovePendingTextureLoad( const ae3d::Texture2D* texture ); // Defined in TextureCommon.cpp
 int tex2dMemoryUsage = 0;
 
 namespace MathUtil
 {
     int Min( int a, int b );
     int Max( int a, int b );
+    int GetMipmapCount( int width, int height );
 }
 
 namespace PVRType
@@ -462,8 +469,127 @@ void ae3d::Texture2D::SetLayout( TextureLayout aLayout )
     // Not needed on Metal.
 }
 
+void ae3d::Texture2D::CreateFromDDSMips( const DDSLoader::Output& output, int firstMip, bool /*releasePrevious*/ )
+{
+#if !TARGET_OS_IPHONE
+    // Command buffers retain the previous texture while they use it.
+    mipLevelCount = (mipmaps == Mipmaps::Generate ? output.dataOffsets.count : 1) - firstMip;
+
+    int multiplier = 2;
+    
+    MTLPixelFormat pixelFormat = MTLPixelFormatRGBA8Unorm;
+    
+    if (output.format == DDSLoader::Format::BC1)
+    {
+        pixelFormat = colorSpace == ColorSpace::Linear ? MTLPixelFormatBC1_RGBA : MTLPixelFormatBC1_RGBA_sRGB;
+    }
+    else if (output.format == DDSLoader::Format::BC2)
+    {
+        pixelFormat = colorSpace == ColorSpace::Linear ? MTLPixelFormatBC2_RGBA : MTLPixelFormatBC2_RGBA_sRGB;
+        multiplier = 4;
+    }
+    else if (output.format == DDSLoader::Format::BC3)
+    {
+        pixelFormat = colorSpace == ColorSpace::Linear ? MTLPixelFormatBC3_RGBA : MTLPixelFormatBC3_RGBA_sRGB;
+        multiplier = 4;
+    }
+    else if (output.format == DDSLoader::Format::BC4U)
+    {
+        pixelFormat = MTLPixelFormatBC4_RUnorm;
+        multiplier = 2;
+    }
+    else if (output.format == DDSLoader::Format::BC4S)
+    {
+        pixelFormat = MTLPixelFormatBC4_RSnorm;
+        multiplier = 2;
+    }
+    else if (output.format == DDSLoader::Format::BC5U)
+    {
+        pixelFormat = MTLPixelFormatBC5_RGUnorm;
+        multiplier = 4;
+    }
+    else if (output.format == DDSLoader::Format::BC5S)
+    {
+        pixelFormat = MTLPixelFormatBC5_RGSnorm;
+        multiplier = 4;
+    }
+    else if (output.format == DDSLoader::Format::BC7)
+    {
+        pixelFormat = colorSpace == ColorSpace::Linear ? MTLPixelFormatBC7_RGBAUnorm : MTLPixelFormatBC7_RGBAUnorm_sRGB;
+        multiplier = 4;
+    }
+
+    MTLTextureDescriptor* textureDescriptor =
+    [MTLTextureDescriptor texture2DDescriptorWithPixelFormat:pixelFormat
+                                                       width:MathUtil::Max( width >> firstMip, 1 )
+                                                      height:MathUtil::Max( height >> firstMip, 1 )
+                                                   mipmapped:(mipmaps == Mipmaps::None ? NO : YES)];
+    textureDescriptor.mipmapLevelCount = mipLevelCount;
+    textureDescriptor.usage = MTLTextureUsageShaderRead;
+    id< MTLTexture > stagingTexture = [GfxDevice::GetMetalDevice() newTextureWithDescriptor:textureDescriptor];
+    
+    const std::size_t pos = path.find_last_of( "/" );
+    if (pos != std::string::npos)
+    {
+        std::string fileName = path.substr( pos );
+        stagingTexture.label = [NSString stringWithUTF8String:fileName.c_str()];
+    }
+    else
+    {
+        stagingTexture.label = [NSString stringWithUTF8String:path.c_str()];
+    }
+
+    for (int mipIndex = 0; mipIndex < mipLevelCount; ++mipIndex)
+    {
+        const int mipWidth = MathUtil::Max( width >> (firstMip + mipIndex), 1 );
+        const int mipHeight = MathUtil::Max( height >> (firstMip + mipIndex), 1 );
+        const int mipBytesPerRow = mipWidth <= 2 ? 8 : mipWidth * multiplier;
+        
+        MTLRegion region = MTLRegionMake2D( 0, 0, mipWidth, mipHeight );
+        [stagingTexture replaceRegion:region mipmapLevel:mipIndex withBytes:&output.imageData[ output.dataOffsets[ firstMip + mipIndex ] ] bytesPerRow:mipBytesPerRow];
+        Statistics::IncTextureUploadBytes( mipBytesPerRow * MathUtil::Max( mipHeight / 4, 1 ) );
+    }
+    
+    MTLTextureDescriptor* textureDescriptor2 =
+    [MTLTextureDescriptor texture2DDescriptorWithPixelFormat:pixelFormat
+                                                       width:textureDescriptor.width
+                                                      height:textureDescriptor.height
+                                                   mipmapped:(mipmaps == Mipmaps::None ? NO : YES)];
+    textureDescriptor2.mipmapLevelCount = mipLevelCount;
+    textureDescriptor2.usage = MTLTextureUsageShaderRead;
+    textureDescriptor2.storageMode = MTLStorageModePrivate;
+    metalTexture = [GfxDevice::GetMetalDevice() newTextureWithDescriptor:textureDescriptor2];
+    metalTexture.label = stagingTexture.label;
+    
+    for (int mipIndex = 0; mipIndex < mipLevelCount; ++mipIndex)
+    {
+        const int mipWidth = MathUtil::Max( width >> (firstMip + mipIndex), 1 );
+        const int mipHeight = MathUtil::Max( height >> (firstMip + mipIndex), 1 );
+
+        id <MTLCommandBuffer> cmd_buffer =     [commandQueue commandBuffer];
+        cmd_buffer.label = @"BlitCommandBuffer";
+        id <MTLBlitCommandEncoder> blit_encoder = [cmd_buffer blitCommandEncoder];
+        [blit_encoder copyFromTexture:stagingTexture
+                          sourceSlice:0
+                          sourceLevel:mipIndex
+                         sourceOrigin:MTLOriginMake( 0, 0, 0 )
+                           sourceSize:MTLSizeMake( mipWidth, mipHeight, 1 )
+                            toTexture:metalTexture
+                     destinationSlice:0
+                     destinationLevel:mipIndex
+                    destinationOrigin:MTLOriginMake( 0, 0, 0 ) ];
+        [blit_encoder endEncoding];
+        [cmd_buffer commit];
+        [cmd_buffer waitUntilCompleted];
+    }
+#endif
+}
+
 void ae3d::Texture2D::Load( const FileSystem::FileContentsData& fileContents, TextureWrap aWrap, TextureFilter aFilter, Mipmaps aMipmaps, ColorSpace aColorSpace, Anisotropy aAnisotropy )
 {
+    // A newer load replaces a pending LoadAsync().
+    RemovePendingTextureLoad( this );
+
     if (!fileContents.isLoaded)
     {
         return;
@@ -513,108 +639,9 @@ void ae3d::Texture2D::Load( const FileSystem::FileContentsData& fileContents, Te
             ae3d::System::Print( "Could not load %s\n", fileContents.path.c_str() );
             return;
         }
-        
-        int multiplier = 2;
-        
-        MTLPixelFormat pixelFormat = MTLPixelFormatRGBA8Unorm;
-        
-        if (output.format == DDSLoader::Format::BC1)
-        {
-            pixelFormat = colorSpace == ColorSpace::Linear ? MTLPixelFormatBC1_RGBA : MTLPixelFormatBC1_RGBA_sRGB;
-        }
-        else if (output.format == DDSLoader::Format::BC2)
-        {
-            pixelFormat = colorSpace == ColorSpace::Linear ? MTLPixelFormatBC2_RGBA : MTLPixelFormatBC2_RGBA_sRGB;
-            multiplier = 4;
-        }
-        else if (output.format == DDSLoader::Format::BC3)
-        {
-            pixelFormat = colorSpace == ColorSpace::Linear ? MTLPixelFormatBC3_RGBA : MTLPixelFormatBC3_RGBA_sRGB;
-            multiplier = 4;
-        }
-        else if (output.format == DDSLoader::Format::BC4U)
-        {
-            pixelFormat = MTLPixelFormatBC4_RUnorm;
-            multiplier = 2;
-        }
-        else if (output.format == DDSLoader::Format::BC4S)
-        {
-            pixelFormat = MTLPixelFormatBC4_RSnorm;
-            multiplier = 2;
-        }
-        else if (output.format == DDSLoader::Format::BC5U)
-        {
-            pixelFormat = MTLPixelFormatBC5_RGUnorm;
-            multiplier = 4;
-        }
-        else if (output.format == DDSLoader::Format::BC5S)
-        {
-            pixelFormat = MTLPixelFormatBC5_RGSnorm;
-            multiplier = 4;
-        }
-
-        MTLTextureDescriptor* textureDescriptor =
-        [MTLTextureDescriptor texture2DDescriptorWithPixelFormat:pixelFormat
-                                                           width:width
-                                                          height:height
-                                                       mipmapped:(mipmaps == Mipmaps::None ? NO : YES)];
-        textureDescriptor.usage = MTLTextureUsageShaderRead;
-        id< MTLTexture > stagingTexture = [GfxDevice::GetMetalDevice() newTextureWithDescriptor:textureDescriptor];
-        
-        const std::size_t pos = fileContents.path.find_last_of( "/" );
-        if (pos != std::string::npos)
-        {
-            std::string fileName = fileContents.path.substr( pos );
-            stagingTexture.label = [NSString stringWithUTF8String:fileName.c_str()];
-        }
-        else
-        {
-            stagingTexture.label = [NSString stringWithUTF8String:fileContents.path.c_str()];
-        }
 
-        mipLevelCount = mipmaps == Mipmaps::Generate ? output.dataOffsets.count : 1;
-
-        for (int mipIndex = 0; mipIndex < mipLevelCount; ++mipIndex)
-        {
-            const int mipWidth = MathUtil::Max( width >> mipIndex, 1 );
-            const int mipHeight = MathUtil::Max( height >> mipIndex, 1 );
-            const int mipBytesPerRow = mipWidth <= 2 ? 8 : mipWidth * multiplier;
-            
-            MTLRegion region = MTLRegionMake2D( 0, 0, mipWidth, mipHeight );
-            [stagingTexture replaceRegion:region mipmapLevel:mipIndex withBytes:&output.imageData[ output.dataOffsets[ mipIndex ] ] bytesPerRow:mipBytesPerRow];
-        }
-        
-        MTLTextureDescriptor* textureDescriptor2 =
-        [MTLTextureDescriptor texture2DDescriptorWithPixelFormat:pixelFormat
-                                                           width:width
-                                                          height:height
-                                                       mipmapped:(mipmaps == Mipmaps::None ? NO : YES)];
-        textureDescriptor2.usage = MTLTextureUsageShaderRead;
-        textureDescriptor2.storageMode = MTLStorageModePrivate;
-        metalTexture = [GfxDevice::GetMetalDevice() newTextureWithDescriptor:textureDescriptor2];
-        metalTexture.label = stagingTexture.label;
-        
-        for (int mipIndex = 0; mipIndex < mipLevelCount; ++mipIndex)
-        {
-            const int mipWidth = MathUtil::Max( width >> mipIndex, 1 );
-            const int mipHeight = MathUtil::Max( height >> mipIndex, 1 );
-
-            id <MTLCommandBuffer> cmd_buffer =     [commandQueue commandBuffer];
-            cmd_buffer.label = @"BlitCommandBuffer";
-            id <MTLBlitCommandEncoder> blit_encoder = [cmd_buffer blitCommandEncoder];
-            [blit_encoder copyFromTexture:stagingTexture
-                              sourceSlice:0
-                              sourceLevel:mipIndex
-                             sourceOrigin:MTLOriginMake( 0, 0, 0 )
-                               sourceSize:MTLSizeMake( mipWidth, mipHeight, 1 )
-                                toTexture:metalTexture
-                         destinationSlice:0
-                         destinationLevel:mipIndex
-                        destinationOrigin:MTLOriginMake( 0, 0, 0 ) ];
-            [blit_encoder endEncoding];
-            [cmd_buffer commit];
-            [cmd_buffer waitUntilCompleted];
-        }
+        const int mipCount = mipmaps == Mipmaps::Generate ? output.dataOffsets.count : 1;
+        CreateFromDDSMips( output, BeginStreaming( output, mipCount ), false );
 #else
         ae3d::System::Print( ".dds loading not supported on iOS. Tried to load %s\n", fileContents.path.c_str() );
 #endif
@@ -686,7 +713,7 @@ void ae3d::Texture2D::Load( const FileSystem::FileContentsData& fileContents, Te
 void ae3d::Texture2D::LoadSTB( const FileSystem::FileContentsData& fileContents )
 {
     int components;
-    unsigned char* data = stbi_load_from_memory( &fileContents.data[ 0 ], static_cast<int>(fileContents.data.size()), &width, &height, &components, 4 );
+    unsigned char* data = LoadStbImage( fileContents, width, height, components );
     
     if (data == nullptr)
     {
@@ -696,6 +723,7 @@ void ae3d::Texture2D::LoadSTB( const FileSystem::FileContentsData& fileContents
     }
 
     opaque = (components == 3 || components == 1);
+    mipLevelCount = mipmaps == Mipmaps::Generate ? MathUtil::GetMipmapCount( width, height ) : 1;
 
     MTLTextureDescriptor* textureDescriptor =
     [MTLTextureDescriptor texture2DDescriptorWithPixelFormat:colorSpace == ColorSpace::Linear ? MTLPixelFormatRGBA8Unorm : MTLPixelFormatRGBA8Unorm_sRGB
@@ -719,7 +747,23 @@ void ae3d::Texture2D::LoadSTB( const FileSystem::FileContentsData& fileContents
 
     MTLRegion region = MTLRegionMake2D( 0, 0, width, height );
     [stagingTexture replaceRegion:region mipmapLevel:0 withBytes:data bytesPerRow:bytesPerRow];
-    
+
+    if (mipmaps == Mipmaps::Generate)
+    {
+        // Mips are generated on the CPU and copied with the base level instead of generating them in another blit pass.
+        std::vector< unsigned char > mips;
+        GetStbMips( fileContents.path, data, width, height, colorSpace, wrap, mips );
+        std::size_t offset = 0;
+
+        for (int mip = 1; mip < mipLevelCount; ++mip)
+        {
+            const int mipWidth = MathUtil::Max( width >> mip, 1 );
+            const int mipHeight = MathUtil::Max( height >> mip, 1 );
+            [stagingTexture replaceRegion:MTLRegionMake2D( 0, 0, mipWidth, mipHeight ) mipmapLevel:mip withBytes:&mips[ offset ] bytesPerRow:mipWidth * 4];
+            offset += mipWidth * mipHeight * 4;
+        }
+    }
+
     MTLTextureDescriptor* textureDescriptor2 =
     [MTLTextureDescriptor texture2DDescriptorWithPixelFormat:colorSpace == ColorSpace::Linear ? MTLPixelFormatRGBA8Unorm : MTLPixelFormatRGBA8Unorm_sRGB
                                                        width:width
@@ -733,29 +777,24 @@ void ae3d::Texture2D::LoadSTB( const FileSystem::FileContentsData& fileContents
     id <MTLCommandBuffer> cmd_buffer =     [commandQueue commandBuffer];
     cmd_buffer.label = @"BlitCommandBuffer";
     id <MTLBlitCommandEncoder> blit_encoder = [cmd_buffer blitCommandEncoder];
-    [blit_encoder copyFromTexture:stagingTexture
-                    sourceSlice:0
-                      sourceLevel:0
-                     sourceOrigin:MTLOriginMake( 0, 0, 0 )
-                       sourceSize:MTLSizeMake( width, height, 1 )
-                        toTexture:metalTexture
-               destinationSlice:0
-                 destinationLevel:0
-                destinationOrigin:MTLOriginMake( 0, 0, 0 ) ];
-    [blit_encoder endEncoding];
-    [cmd_buffer commit];
-    [cmd_buffer waitUntilCompleted];
 
-    if (mipmaps == Mipmaps::Generate)
+    for (int mip = 0; mip < mipLevelCount; ++mip)
     {
-        id<MTLCommandBuffer> commandBuffer = [commandQueue commandBuffer];
-        id<MTLBlitCommandEncoder> commandEncoder = [commandBuffer blitCommandEncoder];
-        [commandEncoder generateMipmapsForTexture:metalTexture];
-        [commandEncoder endEncoding];
-        [commandBuffer commit];
-        [commandBuffer waitUntilCompleted];
+        [blit_encoder copyFromTexture:stagingTexture
+                        sourceSlice:0
+                          sourceLevel:mip
+                         sourceOrigin:MTLOriginMake( 0, 0, 0 )
+                           sourceSize:MTLSizeMake( MathUtil::Max( width >> mip, 1 ), MathUtil::Max( height >> mip, 1 ), 1 )
+                            toTexture:metalTexture
+                   destinationSlice:0
+                     destinationLevel:mip
+                    destinationOrigin:MTLOriginMake( 0, 0, 0 ) ];
     }
 
+    [blit_encoder endEncoding];
+    [cmd_buffer commit];
+    [cmd_buffer waitUntilCompleted];
+
     stbi_image_free( data );
 }
 
@@ -106,6 +106,11 @@ void ae3d::TextureCube::Load( const FileSystem::FileContentsData& negX, const Fi
             pixelFormat = MTLPixelFormatBC5_RGSnorm;
             bytesPerRow = width * 4;
         }
+        else if (output.format == DDSLoader::Format::BC7)
+        {
+            pixelFormat = colorSpace == ColorSpace::Linear ? MTLPixelFormatBC7_RGBAUnorm : MTLPixelFormatBC7_RGBAUnorm_sRGB;
+            bytesPerRow = width * 4;
+        }
         else
         {
             System::Assert( false, "Unhandled DDS compression" );
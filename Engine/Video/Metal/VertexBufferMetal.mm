@@ -6,6 +6,23 @@
 extern id <MTLCommandQueue> commandQueue;
 static int vertexBufferMemoryUsage = 0;
 
+namespace MathUtil
+{
+    float HalfToFloat( unsigned short half );
+}
+
+// Metal shaders are shared with PTNTC and read separate float streams, so compact vertices are expanded on load.
+template< typename T >
+static void DecodeCompactVertex( const T& in, const ae3d::Vec3& positionOffset, float positionScale, ae3d::VertexBuffer::VertexPTNTC& out )
+{
+    out.position = positionOffset + ae3d::Vec3( in.position[ 0 ], in.position[ 1 ], in.position[ 2 ] ) * (positionScale / 65535.0f);
+    out.u = MathUtil::HalfToFloat( in.uv[ 0 ] );
+    out.v = MathUtil::HalfToFloat( in.uv[ 1 ] );
+    out.normal = ae3d::Vec3( in.normal[ 0 ], in.normal[ 1 ], in.normal[ 2 ] ) * (1.0f / 127.0f);
+    out.tangent = ae3d::Vec4( in.tangent[ 0 ], in.tangent[ 1 ], in.tangent[ 2 ], in.tangent[ 3 ] ) * (1.0f / 127.0f);
+    out.color = ae3d::Vec4( in.color[ 0 ], in.color[ 1 ], in.color[ 2 ], in.color[ 3 ] ) * (1.0f / 255.0f);
+}
+
 void ae3d::VertexBuffer::Bind() const
 {
 }
@@ -15,6 +32,21 @@ void ae3d::VertexBuffer::SetDebugName( const char* name )
     vertexBuffer.label = [NSString stringWithUTF8String:name];
 }
 
+void ae3d::VertexBuffer::Release()
+{
+    // Command buffers retain the buffers they use until they have completed.
+    vertexBuffer = nil;
+    indexBuffer = nil;
+    positionBuffer = nil;
+    texcoordBuffer = nil;
+    colorBuffer = nil;
+    normalBuffer = nil;
+    tangentBuffer = nil;
+    boneBuffer = nil;
+    weightBuffer = nil;
+    elementCount = 0;
+}
+
 void ae3d::VertexBuffer::Generate( const Face* faces, int faceCount, const VertexPTC* vertices, int vertexCount, Storage storage )
 {
     if (faceCount == 0)
@@ -23,6 +55,9 @@ void ae3d::VertexBuffer::Generate( const Face* faces, int faceCount, const Verte
     }
     
     vertexFormat = VertexFormat::PTC;
+    const IndexType oldIndexType = indexType;
+    Array< unsigned short > indices16;
+    const void* indices = PackIndices( faces, faceCount, vertexCount, indices16 );
     
     if (storage == Storage::GPU)
     {
@@ -190,16 +225,16 @@ void ae3d::VertexBuffer::Generate( const Face* faces, int faceCount, const Verte
         memcpy( [weightBuffer contents], weights.data(), 4 * 4 * vertexCount );
     }
     
-    if (triangleCount != (unsigned)faceCount)
+    if (triangleCount != (unsigned)faceCount || indexType != oldIndexType)
     {
-        indexBuffer = [GfxDevice::GetMetalDevice() newBufferWithBytes:faces
-                      length:sizeof( Face ) * faceCount
+        indexBuffer = [GfxDevice::GetMetalDevice() newBufferWithBytes:indices
+                      length:GetIndexSize() * 3 * faceCount
                      options:MTLResourceCPUCacheModeDefaultCache];
         indexBuffer.label = @"Index buffer";
     }
     else
     {
-        memcpy( [indexBuffer contents], faces, sizeof( Face ) * faceCount );
+        memcpy( [indexBuffer contents], indices, GetIndexSize() * 3 * faceCount );
     }
     
     elementCount = faceCount * 3;
@@ -224,6 +259,8 @@ void ae3d::VertexBuffer::Generate( const Face* faces, int faceCount, const Verte
     }
     
     vertexFormat = VertexFormat::PTN;
+    Array< unsigned short > indices16;
+    const void* indices = PackIndices( faces, faceCount, vertexCount, indices16 );
     vertexBuffer = [GfxDevice::GetMetalDevice() newBufferWithBytes:vertices
                        length:sizeof( VertexPTN ) * vertexCount
                       options:MTLResourceCPUCacheModeDefaultCache];
@@ -302,8 +339,8 @@ void ae3d::VertexBuffer::Generate( const Face* faces, int faceCount, const Verte
                       options:MTLResourceCPUCacheModeDefaultCache];
     weightBuffer.label = @"Weight buffer";
     
-    indexBuffer = [GfxDevice::GetMetalDevice() newBufferWithBytes:faces
-                      length:sizeof( Face ) * faceCount
+    indexBuffer = [GfxDevice::GetMetalDevice() newBufferWithBytes:indices
+                      length:GetIndexSize() * 3 * faceCount
                      options:MTLResourceCPUCacheModeDefaultCache];
     indexBuffer.label = @"Index buffer";
     
@@ -327,6 +364,8 @@ void ae3d::VertexBuffer::Generate( const Face* faces, int faceCount, const Verte
     }
 
     vertexFormat = VertexFormat::PTNTC;
+    Array< unsigned short > indices16;
+    const void* indices = PackIndices( faces, faceCount, vertexCount, indices16 );
     vertexBuffer = [GfxDevice::GetMetalDevice() newBufferWithLength:sizeof( VertexPTNTC ) * vertexCount
                       options:MTLResourceStorageModePrivate];
     vertexBuffer.label = @"Vertex buffer PTNTC";
@@ -433,8 +472,8 @@ void ae3d::VertexBuffer::Generate( const Face* faces, int faceCount, const Verte
                       options:MTLResourceCPUCacheModeDefaultCache];
     weightBuffer.label = @"Weight buffer";
     
-    indexBuffer = [GfxDevice::GetMetalDevice() newBufferWithBytes:faces
-                      length:sizeof( Face ) * faceCount
+    indexBuffer = [GfxDevice::GetMetalDevice() newBufferWithBytes:indices
+                      length:GetIndexSize() * 3 * faceCount
                      options:MTLResourceCPUCacheModeDefaultCache];
     indexBuffer.label = @"Index buffer";
     
@@ -458,6 +497,8 @@ void ae3d::VertexBuffer::Generate( const Face* faces, int faceCount, const Verte
     }
 
     vertexFormat = VertexFormat::PTNTC_Skinned;
+    Array< unsigned short > indices16;
+    const void* indices = PackIndices( faces, faceCount, vertexCount, indices16 );
     vertexBuffer = [GfxDevice::GetMetalDevice() newBufferWithLength:sizeof( VertexPTNTC_Skinned ) * vertexCount
                       options:MTLResourceStorageModePrivate];
     vertexBuffer.label = @"Vertex buffer PTNTC_Skinned";
@@ -580,8 +621,8 @@ void ae3d::VertexBuffer::Generate( const Face* faces, int faceCount, const Verte
                     options:MTLResourceCPUCacheModeDefaultCache];
     boneBuffer.label = @"Bone buffer";
     
-    indexBuffer = [GfxDevice::GetMetalDevice() newBufferWithBytes:faces
-                      length:sizeof( Face ) * faceCount
+    indexBuffer = [GfxDevice::GetMetalDevice() newBufferWithBytes:indices
+                      length:GetIndexSize() * 3 * faceCount
                      options:MTLResourceCPUCacheModeDefaultCache];
     indexBuffer.label = @"Index buffer";
     
@@ -601,12 +642,13 @@ void ae3d::VertexBuffer::GenerateDynamic( int faceCount, int vertexCount )
 {
     vertexFormat = VertexFormat::PTC;
     elementCount = faceCount * 3;
+    indexType = vertexCount > 65536 ? IndexType::UInt32 : IndexType::UInt16;
 
     vertexBuffer = [GfxDevice::GetMetalDevice() newBufferWithLength:sizeof( VertexPTC ) * vertexCount
                               options:MTLResourceCPUCacheModeDefaultCache];
     vertexBuffer.label = @"Dynamic Vertex buffer";
     
-    indexBuffer = [GfxDevice::GetMetalDevice() newBufferWithLength:sizeof( Face ) * faceCount
+    indexBuffer = [GfxDevice::GetMetalDevice() newBufferWithLength:GetIndexSize() * 3 * faceCount
                  options:MTLResourceCPUCacheModeDefaultCache];
     indexBuffer.label = @"Dynamic Index buffer";
 
@@ -625,5 +667,110 @@ void ae3d::VertexBuffer::GenerateDynamic( int faceCount, int vertexCount )
 void ae3d::VertexBuffer::UpdateDynamic( const Face* faces, int faceCount, const VertexPTC* vertices, int vertexCount )
 {
     memcpy( [vertexBuffer contents], vertices, sizeof( VertexPTC ) * vertexCount );
-    memcpy( [indexBuffer contents], faces, sizeof( Face ) * faceCount );
+
+    if (indexType == IndexType::UInt32)
+    {
+        memcpy( [indexBuffer contents], faces, sizeof( Face ) * faceCount );
+        return;
+    }
+
+    unsigned short* indices = (unsigned short*)[indexBuffer contents];
+
+    for (int f = 0; f < faceCount; ++f)
+    {
+        indices[ f * 3 + 0 ] = (unsigned short)faces[ f ].a;
+        indices[ f * 3 + 1 ] = (unsigned short)faces[ f ].b;
+        indices[ f * 3 + 2 ] = (unsigned short)faces[ f ].c;
+    }
+}
+
+void ae3d::VertexBuffer::Generate( const Face* faces, int faceCount, const VertexPTNTC_Compact* vertices, int vertexCount, const Vec3& positionOffset, float positionScale )
+{
+    std::vector< VertexPTNTC > decoded( vertexCount );
+
+    for (int v = 0; v < vertexCount; ++v)
+    {
+        DecodeCompactVertex( vertices[ v ], positionOffset, positionScale, decoded[ v ] );
+    }
+
+    Generate( faces, faceCount, decoded.data(), vertexCount );
+}
+
+void ae3d::VertexBuffer::Generate( const Face* faces, int faceCount, const VertexPTNTC_Compact_Skinned* vertices, int vertexCount, const Vec3& positionOffset, float positionScale )
+{
+    std::vector< VertexPTNTC_Skinned > decoded( vertexCount );
+
+    for (int v = 0; v < vertexCount; ++v)
+    {
+        VertexPTNTC vertex;
+        DecodeCompactVertex( vertices[ v ], positionOffset, positionScale, vertex );
+
+        decoded[ v ].position = vertex.position;
+        decoded[ v ].u = vertex.u;
+        decoded[ v ].v = vertex.v;
+        decoded[ v ].normal = vertex.normal;
+        decoded[ v ].tangent = vertex.tangent;
+        decoded[ v ].color = vertex.color;
+        decoded[ v ].weights = Vec4( vertices[ v ].weights[ 0 ], vertices[ v ].weights[ 1 ], vertices[ v ].weights[ 2 ], vertices[ v ].weights[ 3 ] ) * (1.0f / 255.0f);
+
+        for (int b = 0; b < 4; ++b)
+        {
+            decoded[ v ].bones[ b ] = vertices[ v ].bones[ b ];
+        }
+    }
+
+    Generate( faces, faceCount, decoded.data(), vertexCount );
+}
+
+void ae3d::VertexBuffer::GeneratePacked( const void* indices, IndexType aIndexType, int faceCount, const void* vertices, VertexFormat aVertexFormat, int vertexCount,
+                                         const Vec4& aPositionDequantization )
+{
+    // Metal buffers are split into attribute streams, so packed data goes through the typed paths.
+    std::vector< Face > faces( faceCount );
+
+    for (int f = 0; f < faceCount; ++f)
+    {
+        if (aIndexType == IndexType::UInt16)
+        {
+            const unsigned short* indices16 = static_cast< const unsigned short* >( indices ) + f * 3;
+            faces[ f ] = Face( indices16[ 0 ], indices16[ 1 ], indices16[ 2 ] );
+        }
+        else
+        {
+            faces[ f ] = static_cast< const Face* >( indices )[ f ];
+        }
+    }
+
+    const Vec3 positionOffset( aPositionDequantization.x, aPositionDequantization.y, aPositionDequantization.z );
+
+    if (aVertexFormat == VertexFormat::PTNTC)
+    {
+        Generate( faces.data(), faceCount, static_cast< const VertexPTNTC* >( vertices ), vertexCount );
+    }
+    else if (aVertexFormat == VertexFormat::PTNTC_Skinned)
+    {
+        Generate( faces.data(), faceCount, static_cast< const VertexPTNTC_Skinned* >( vertices ), vertexCount );
+    }
+    else if (aVertexFormat == VertexFormat::PTNTC_Compact)
+    {
+        Generate( faces.data(), faceCount, static_cast< const VertexPTNTC_Compact* >( vertices ), vertexCount, positionOffset, aPositionDequantization.w );
+    }
+    else if (aVertexFormat == VertexFormat::PTNTC_Compact_Skinned)
+    {
+        Generate( faces.data(), faceCount, static_cast< const VertexPTNTC_Compact_Skinned* >( vertices ), vertexCount, positionOffset, aPositionDequantization.w );
+    }
+    else
+    {
+        System::Assert( false, "GeneratePacked: unsupported vertex format" );
+    }
+}
+
+void ae3d::VertexBuffer::GenerateDepthStreams( const Vec3* /*positions*/, const VertexPN* /*positionsNormals*/, int /*vertexCount*/ )
+{
+    // Depth-only passes bind the full vertex buffer on this backend.
+}
+
+void ae3d::VertexBuffer::GenerateDepthStreams( const VertexP_Compact* /*positions*/, const VertexPN_Compact* /*positionsNormals*/, int /*vertexCount*/ )
+{
+    // Depth-only passes bind the full vertex buffer on this backend.
 }
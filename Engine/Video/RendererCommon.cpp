@@ -15,7 +15,7 @@
 
 namespace GfxDeviceGlobal
 {
-    extern PerObjectUboStruct perObjectUboStruct;
+    extern thread_local PerObjectUboStruct perObjectUboStruct;
     extern std::vector< ae3d::VertexBuffer > lineBuffers;
 }
 
@@ -160,7 +160,7 @@ int ae3d::GfxDevice::CreateLineBuffer( const Vec3* lines, int lineCount, const V
     }
 
     // Not used, but needs to be set to something.
-    for (unsigned short faceIndex = 0; faceIndex < (unsigned short)(faces.count / 2); ++faceIndex)
+    for (unsigned faceIndex = 0; faceIndex < faces.count / 2; ++faceIndex)
     {
         faces[ faceIndex * 2 + 0 ].a = faceIndex;
         faces[ faceIndex * 2 + 1 ].b = faceIndex + 1;
@@ -191,7 +191,7 @@ void ae3d::GfxDevice::UpdateLineBuffer( int lineHandle, const Vec3* lines, int l
     }
 
     // Not used, but needs to be set to something.
-    for (unsigned short faceIndex = 0; faceIndex < (unsigned short)(faces.count / 2); ++faceIndex)
+    for (unsigned faceIndex = 0; faceIndex < faces.count / 2; ++faceIndex)
     {
         faces[ faceIndex * 2 + 0 ].a = faceIndex;
         faces[ faceIndex * 2 + 1 ].b = faceIndex + 1;
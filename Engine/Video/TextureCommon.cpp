@@ -1,19 +1,20 @@
 // This is an independent project of an individual developer. Dear PVS-Studio, please check it.
 // PVS-Studio Static Code Analyzer for C, C++, C#, and Java: http://www.viva64.com
+#include <algorithm>
+#include <limits>
 #include <string>
-#include <map>
+#include <memory>
+#include <unordered_map>
 #include <vector>
 #include <sstream>
+#include "stb_image.c"
+#include "AsyncLoad.hpp"
+#include "DDSLoader.hpp"
 #include "Texture2D.hpp"
 #include "System.hpp"
 #include "FileSystem.hpp"
-
-#if defined( RENDERER_METAL ) || defined( RENDERER_VULKAN )
-namespace Texture2DGlobal
-{
-    std::map< std::string, ae3d::Texture2D > hashToCachedTexture;
-}
-#endif
+#include "Statistics.hpp"
+#include "MipGenerator.hpp"
 
 // Checks for uncompressed formats in texture's file name.
 static const std::string extensions[] =
@@ -22,6 +23,125 @@ static const std::string extensions[] =
     ".bmp", ".BMP", ".gif", ".GIF"
 };
 
+/// Image decoded on a loader thread.
+struct DecodedImage
+{
+    std::string path;
+    unsigned char* pixels = nullptr;
+    int width = 0;
+    int height = 0;
+    int components = 0;
+    /// Mips 1 and smaller if the texture generates mipmaps.
+    std::vector< unsigned char > mips;
+    bool isSrgb = false;
+    bool isRepeat = false;
+};
+
+/// Set while an async load calls Texture2D::Load(), so LoadStbImage() can use the image decoded on the loader thread.
+static DecodedImage* gDecodedImage = nullptr;
+
+/// Texture between Texture2D::LoadAsync() and its upload.
+struct PendingTexture
+{
+    ae3d::Texture2D* texture;
+    /// Only the latest load of a texture is applied.
+    unsigned generation;
+};
+
+static std::vector< PendingTexture > gPendingTextures;
+static unsigned gPendingTextureGeneration = 0;
+
+void RemovePendingTextureLoad( const ae3d::Texture2D* texture )
+{
+    for (std::size_t i = 0; i < gPendingTextures.size(); ++i)
+    {
+        if (gPendingTextures[ i ].texture == texture)
+        {
+            gPendingTextures.erase( std::begin( gPendingTextures ) + i );
+            return;
+        }
+    }
+}
+
+namespace MathUtil
+{
+    int Max( int a, int b );
+    int GetMipmapCount( int width, int height );
+}
+
+/// Mip residency of a streamed .dds texture.
+struct StreamedTexture
+{
+    /// Null if the slot is free.
+    ae3d::Texture2D* texture = nullptr;
+    std::string path;
+    /// Size of every mip in the file in bytes.
+    std::vector< std::size_t > mipSizes;
+    /// Most detailed mip of the mip tail that is always resident.
+    int tailMip = 0;
+    /// Most detailed resident mip.
+    int residentMip = 0;
+    /// Most detailed mip requested since the previous update.
+    int requestedMip = 0;
+    /// Most detailed mip requested by recent updates.
+    int wantedMip = 0;
+    /// Most detailed mip that fits into the budget.
+    int targetMip = 0;
+    unsigned lastRequestFrame = 0;
+    bool isLoading = false;
+};
+
+namespace TextureStreamingGlobal
+{
+    /// Mips up to this size are loaded with the texture.
+    const int mipTailSize = 64;
+    /// Mips of textures that have not been requested for this many updates are evicted.
+    const unsigned evictFrameCount = 60;
+    /// Limits loader thread work so that loads of other assets are not delayed.
+    const int maxLoadCount = 4;
+    const int notRequested = std::numeric_limits< int >::max();
+
+    std::vector< StreamedTexture > textures;
+    std::size_t budgetBytes = 0;
+    unsigned frame = 0;
+    int loadCount = 0;
+
+    std::size_t GetResidentBytes( const StreamedTexture& texture, int firstMip )
+    {
+        std::size_t bytes = 0;
+
+        for (std::size_t mip = firstMip; mip < texture.mipSizes.size(); ++mip)
+        {
+            bytes += texture.mipSizes[ mip ];
+        }
+
+        return bytes;
+    }
+}
+
+namespace MipGeneratorGlobal
+{
+    ae3d::MipmapFilter filter = ae3d::MipmapFilter::Box;
+}
+
+/// Gets mips 1 and smaller of an image returned by LoadStbImage(). Texture2D::LoadAsync() generates them on a loader thread.
+/// \param outMips Mips one after another. Mip i is max(width >> i, 1) by max(height >> i, 1) texels.
+void GetStbMips( const std::string& path, const unsigned char* pixels, int width, int height, ae3d::ColorSpace colorSpace, ae3d::TextureWrap wrap,
+                 std::vector< unsigned char >& outMips )
+{
+    const bool isSrgb = colorSpace == ae3d::ColorSpace::SRGB;
+    const bool isRepeat = wrap == ae3d::TextureWrap::Repeat;
+
+    if (gDecodedImage != nullptr && !gDecodedImage->mips.empty() && gDecodedImage->path == path && gDecodedImage->width == width &&
+        gDecodedImage->height == height && gDecodedImage->isSrgb == isSrgb && gDecodedImage->isRepeat == isRepeat)
+    {
+        outMips.swap( gDecodedImage->mips );
+        return;
+    }
+
+    MipGenerator::GenerateMips( pixels, width, height, isSrgb, isRepeat, MipGeneratorGlobal::filter, true, outMips );
+}
+
 bool HasStbExtension( const std::string& path )
 {
     for (const auto& e : extensions)
@@ -35,6 +155,21 @@ bool HasStbExtension( const std::string& path )
     return false;
 }
 
+unsigned char* LoadStbImage( const ae3d::FileSystem::FileContentsData& fileContents, int& outWidth, int& outHeight, int& outComponents )
+{
+    if (gDecodedImage != nullptr && gDecodedImage->pixels != nullptr && gDecodedImage->path == fileContents.path)
+    {
+        unsigned char* pixels = gDecodedImage->pixels;
+        gDecodedImage->pixels = nullptr;
+        outWidth = gDecodedImage->width;
+        outHeight = gDecodedImage->height;
+        outComponents = gDecodedImage->components;
+        return pixels;
+    }
+
+    return stbi_load_from_memory( fileContents.data.data(), static_cast< int >( fileContents.data.size() ), &outWidth, &outHeight, &outComponents, 4 );
+}
+
 void Tokenize( const std::string& str,
               std::vector< std::string >& tokens,
               const std::string& delimiters = " " )
@@ -78,102 +213,224 @@ float GetFloatAnisotropy( ae3d::Anisotropy anisotropy )
     return 1;
 }
 
-namespace Texture2DGlobal
+/// Texture loaded from a file with a sampler state and color space.
+struct CachedTexture
 {
-    extern std::map< std::string, ae3d::Texture2D > hashToCachedTexture;
-}
+    ae3d::TextureWrap wrap;
+    ae3d::TextureFilter filter;
+    ae3d::Mipmaps mipmaps;
+    ae3d::ColorSpace colorSpace;
+    ae3d::Anisotropy anisotropy;
+    ae3d::Texture2D texture;
+    /// Textures that were loaded as this one. They are updated when it's reloaded or streamed.
+    std::vector< ae3d::Texture2D* > users;
+    std::size_t sizeInBytes = 0;
+};
 
-namespace ae3d
+namespace TextureCacheGlobal
 {
-    std::string GetCacheHash( const std::string& path, ae3d::TextureWrap wrap, ae3d::TextureFilter filter, ae3d::Mipmaps mipmaps, ae3d::ColorSpace colorSpace, ae3d::Anisotropy anisotropy )
+    /// Paths are interned to ids that index cached textures, so a reload finds all of a path's textures with one lookup.
+    std::unordered_map< std::string, unsigned > pathToId;
+    /// Indexed by path id. Cached textures are never removed, so their indices stay valid.
+    std::vector< std::vector< CachedTexture > > idToTextures;
+    /// Cached texture of every user as a path id and an index into idToTextures. Texture2D's destructor removes the user.
+    std::unordered_map< const ae3d::Texture2D*, std::pair< unsigned, unsigned > > userToCached;
+    std::size_t sizeInBytes = 0;
+    /// Set while TexReload() calls Texture2D::Load(), so the load bypasses the cache and updates the cached texture.
+    bool isReloading = false;
+
+    /// Cleared after static destruction has reached this file, so textures destroyed after the cache don't touch it.
+    bool isAlive = false;
+
+    struct Lifetime
     {
-        return path + std::to_string( static_cast<int>(wrap) ) + std::to_string( static_cast<int>(filter) ) +
-            std::to_string( static_cast<int>(mipmaps) ) + std::to_string( static_cast<int>(colorSpace) ) + std::to_string( static_cast< int >(anisotropy) );
-    }
-}
+        Lifetime() { isAlive = true; }
+        ~Lifetime() { isAlive = false; }
+    } lifetime;
 
-void ClearPSOCache();
+    /// \return True if the path and sampler state of texture are cached.
+    bool Find( const ae3d::Texture2D& texture, unsigned& outId, unsigned& outIndex )
+    {
+        const auto id = pathToId.find( texture.GetPath() );
 
-void TexReload( const std::string& path )
-{
-    std::string cacheHash = GetCacheHash( path, ae3d::TextureWrap::Clamp, ae3d::TextureFilter::Nearest, ae3d::Mipmaps::None, ae3d::ColorSpace::SRGB, ae3d::Anisotropy::k1 );
-    ae3d::System::Print("reloading texture %s\n", path.c_str());
+        if (id == std::end( pathToId ))
+        {
+            return false;
+        }
 
-    if (Texture2DGlobal::hashToCachedTexture.find( cacheHash ) != std::end( Texture2DGlobal::hashToCachedTexture ))
-    {
-        auto& tex = Texture2DGlobal::hashToCachedTexture[ cacheHash ];
-        tex.Load( ae3d::FileSystem::FileContents( path.c_str() ), tex.GetWrap(), tex.GetFilter(), tex.GetMipmaps(), tex.GetColorSpace(), tex.GetAnisotropy() );
+        for (std::size_t i = 0; i < idToTextures[ id->second ].size(); ++i)
+        {
+            const CachedTexture& cached = idToTextures[ id->second ][ i ];
+
+            if (cached.wrap == texture.GetWrap() && cached.filter == texture.GetFilter() && cached.mipmaps == texture.GetMipmaps() &&
+                cached.colorSpace == texture.GetColorSpace() && cached.anisotropy == texture.GetAnisotropy())
+            {
+                outId = id->second;
+                outIndex = (unsigned)i;
+                return true;
+            }
+        }
+
+        return false;
     }
 
-    cacheHash = GetCacheHash( path, ae3d::TextureWrap::Repeat, ae3d::TextureFilter::Nearest, ae3d::Mipmaps::Generate, ae3d::ColorSpace::Linear, ae3d::Anisotropy::k1 );
+    void RemoveUser( const ae3d::Texture2D* texture )
+    {
+        const auto user = userToCached.find( texture );
 
-    if (Texture2DGlobal::hashToCachedTexture.find( cacheHash ) != std::end( Texture2DGlobal::hashToCachedTexture ))
+        if (user == std::end( userToCached ))
+        {
+            return;
+        }
+
+        std::vector< ae3d::Texture2D* >& users = idToTextures[ user->second.first ][ user->second.second ].users;
+        users.erase( std::find( std::begin( users ), std::end( users ), texture ) );
+        userToCached.erase( user );
+    }
+
+    /// A texture that is loaded again with another path or sampler state stops being a user of its previous cached texture.
+    void AddUser( ae3d::Texture2D* texture, unsigned id, unsigned index )
     {
-        auto& tex = Texture2DGlobal::hashToCachedTexture[ cacheHash ];
-        tex.Load( ae3d::FileSystem::FileContents( path.c_str() ), tex.GetWrap(), tex.GetFilter(), tex.GetMipmaps(), tex.GetColorSpace(), tex.GetAnisotropy() );
+        const auto user = userToCached.find( texture );
+
+        if (user != std::end( userToCached ) && user->second == std::make_pair( id, index ))
+        {
+            return;
+        }
+
+        RemoveUser( texture );
+        idToTextures[ id ][ index ].users.push_back( texture );
+        userToCached[ texture ] = std::make_pair( id, index );
     }
+}
 
-    cacheHash = GetCacheHash( path, ae3d::TextureWrap::Repeat, ae3d::TextureFilter::Nearest, ae3d::Mipmaps::None, ae3d::ColorSpace::SRGB, ae3d::Anisotropy::k1 );
+bool LoadCachedTexture( ae3d::Texture2D& texture )
+{
+    unsigned id = 0;
+    unsigned index = 0;
 
-    if (Texture2DGlobal::hashToCachedTexture.find( cacheHash ) != std::end( Texture2DGlobal::hashToCachedTexture ))
+    if (TextureCacheGlobal::isReloading || !TextureCacheGlobal::Find( texture, id, index ))
     {
-        auto& tex = Texture2DGlobal::hashToCachedTexture[ cacheHash ];
-        tex.Load( ae3d::FileSystem::FileContents( path.c_str() ), tex.GetWrap(), tex.GetFilter(), tex.GetMipmaps(), tex.GetColorSpace(), tex.GetAnisotropy() );
+        Statistics::IncTextureCacheMisses();
+        return false;
     }
 
-    cacheHash = GetCacheHash( path, ae3d::TextureWrap::Clamp, ae3d::TextureFilter::Linear, ae3d::Mipmaps::None, ae3d::ColorSpace::SRGB, ae3d::Anisotropy::k1 );
+    // Loading a texture again reloads it.
+    const auto user = TextureCacheGlobal::userToCached.find( &texture );
 
-    if (Texture2DGlobal::hashToCachedTexture.find( cacheHash ) != std::end( Texture2DGlobal::hashToCachedTexture ))
+    if (user != std::end( TextureCacheGlobal::userToCached ) && user->second == std::make_pair( id, index ))
     {
-        auto& tex = Texture2DGlobal::hashToCachedTexture[ cacheHash ];
-        tex.Load( ae3d::FileSystem::FileContents( path.c_str() ), tex.GetWrap(), tex.GetFilter(), tex.GetMipmaps(), tex.GetColorSpace(), tex.GetAnisotropy() );
+        Statistics::IncTextureCacheMisses();
+        return false;
     }
 
-    cacheHash = GetCacheHash( path, ae3d::TextureWrap::Repeat, ae3d::TextureFilter::Linear, ae3d::Mipmaps::None, ae3d::ColorSpace::SRGB, ae3d::Anisotropy::k1 );
+    texture = TextureCacheGlobal::idToTextures[ id ][ index ].texture;
+    TextureCacheGlobal::AddUser( &texture, id, index );
+    Statistics::IncTextureCacheHits();
+    return true;
+}
+
+void CacheTexture( ae3d::Texture2D& texture, std::size_t sizeInBytes )
+{
+    unsigned id = 0;
+    unsigned index = 0;
 
-    if (Texture2DGlobal::hashToCachedTexture.find( cacheHash ) != std::end( Texture2DGlobal::hashToCachedTexture ))
+    if (!TextureCacheGlobal::Find( texture, id, index ))
     {
-        auto& tex = Texture2DGlobal::hashToCachedTexture[ cacheHash ];
-        tex.Load( ae3d::FileSystem::FileContents( path.c_str() ), tex.GetWrap(), tex.GetFilter(), tex.GetMipmaps(), tex.GetColorSpace(), tex.GetAnisotropy() );
+        const auto pathId = TextureCacheGlobal::pathToId.insert( std::make_pair( texture.GetPath(), (unsigned)TextureCacheGlobal::idToTextures.size() ) );
+
+        if (pathId.second)
+        {
+            TextureCacheGlobal::idToTextures.push_back( std::vector< CachedTexture >() );
+        }
+
+        id = pathId.first->second;
+        std::vector< CachedTexture >& pathTextures = TextureCacheGlobal::idToTextures[ id ];
+        index = (unsigned)pathTextures.size();
+        pathTextures.push_back( CachedTexture() );
+        CachedTexture& created = pathTextures.back();
+        created.wrap = texture.GetWrap();
+        created.filter = texture.GetFilter();
+        created.mipmaps = texture.GetMipmaps();
+        created.colorSpace = texture.GetColorSpace();
+        created.anisotropy = texture.GetAnisotropy();
     }
 
-    cacheHash = GetCacheHash( path, ae3d::TextureWrap::Clamp, ae3d::TextureFilter::Linear, ae3d::Mipmaps::Generate, ae3d::ColorSpace::SRGB, ae3d::Anisotropy::k1 );
+    CachedTexture& cached = TextureCacheGlobal::idToTextures[ id ][ index ];
+    TextureCacheGlobal::sizeInBytes -= cached.sizeInBytes;
+    TextureCacheGlobal::sizeInBytes += sizeInBytes;
+    cached.sizeInBytes = sizeInBytes;
+    cached.texture = texture;
 
-    if (Texture2DGlobal::hashToCachedTexture.find( cacheHash ) != std::end( Texture2DGlobal::hashToCachedTexture ))
+    for (ae3d::Texture2D* user : cached.users)
     {
-        auto& tex = Texture2DGlobal::hashToCachedTexture[ cacheHash ];
-        tex.Load( ae3d::FileSystem::FileContents( path.c_str() ), tex.GetWrap(), tex.GetFilter(), tex.GetMipmaps(), tex.GetColorSpace(), tex.GetAnisotropy() );
+        if (user != &texture)
+        {
+            *user = texture;
+        }
     }
 
-    cacheHash = GetCacheHash( path, ae3d::TextureWrap::Repeat, ae3d::TextureFilter::Linear, ae3d::Mipmaps::Generate, ae3d::ColorSpace::SRGB, ae3d::Anisotropy::k1 );
-
-    if (Texture2DGlobal::hashToCachedTexture.find( cacheHash ) != std::end( Texture2DGlobal::hashToCachedTexture ))
+    if (!TextureCacheGlobal::isReloading)
     {
-        auto& tex = Texture2DGlobal::hashToCachedTexture[ cacheHash ];
-        tex.Load( ae3d::FileSystem::FileContents( path.c_str() ), tex.GetWrap(), tex.GetFilter(), tex.GetMipmaps(), tex.GetColorSpace(), tex.GetAnisotropy() );
+        TextureCacheGlobal::AddUser( &texture, id, index );
     }
+}
+
+void ClearPSOCache();
 
-    cacheHash = GetCacheHash( path, ae3d::TextureWrap::Repeat, ae3d::TextureFilter::Nearest, ae3d::Mipmaps::Generate, ae3d::ColorSpace::SRGB, ae3d::Anisotropy::k1 );
+void TexReload( const std::string& path )
+{
+    const auto id = TextureCacheGlobal::pathToId.find( path );
 
-    if (Texture2DGlobal::hashToCachedTexture.find( cacheHash ) != std::end( Texture2DGlobal::hashToCachedTexture ))
+    if (id == std::end( TextureCacheGlobal::pathToId ))
     {
-        auto& tex = Texture2DGlobal::hashToCachedTexture[ cacheHash ];
-        tex.Load( ae3d::FileSystem::FileContents( path.c_str() ), tex.GetWrap(), tex.GetFilter(), tex.GetMipmaps(), tex.GetColorSpace(), tex.GetAnisotropy() );
+        return;
     }
 
-    cacheHash = GetCacheHash( path, ae3d::TextureWrap::Clamp, ae3d::TextureFilter::Nearest, ae3d::Mipmaps::Generate, ae3d::ColorSpace::SRGB, ae3d::Anisotropy::k1 );
+    ae3d::System::Print( "reloading texture %s\n", path.c_str() );
+    const ae3d::FileSystem::FileContentsData fileContents = ae3d::FileSystem::FileContents( path.c_str() );
+    TextureCacheGlobal::isReloading = true;
 
-    if (Texture2DGlobal::hashToCachedTexture.find( cacheHash ) != std::end( Texture2DGlobal::hashToCachedTexture ))
+    for (std::size_t i = 0; i < TextureCacheGlobal::idToTextures[ id->second ].size(); ++i)
     {
-        auto& tex = Texture2DGlobal::hashToCachedTexture[ cacheHash ];
-        tex.Load( ae3d::FileSystem::FileContents( path.c_str() ), tex.GetWrap(), tex.GetFilter(), tex.GetMipmaps(), tex.GetColorSpace(), tex.GetAnisotropy() );
+        // Load() updates the cached texture and its users from the copy.
+        ae3d::Texture2D tex = TextureCacheGlobal::idToTextures[ id->second ][ i ].texture;
+        tex.Load( fileContents, tex.GetWrap(), tex.GetFilter(), tex.GetMipmaps(), tex.GetColorSpace(), tex.GetAnisotropy() );
     }
 
+    TextureCacheGlobal::isReloading = false;
+
 #if RENDERER_D3D12
     ClearPSOCache();
 #endif
 }
 
+ae3d::Texture2D::~Texture2D()
+{
+    if (!TextureCacheGlobal::isAlive)
+    {
+        return;
+    }
+
+    TextureCacheGlobal::RemoveUser( this );
+    RemovePendingTextureLoad( this );
+
+    if (streamingIndex != -1 && TextureStreamingGlobal::textures[ streamingIndex ].texture == this)
+    {
+        TextureStreamingGlobal::textures[ streamingIndex ].texture = nullptr;
+    }
+}
+
+std::size_t ae3d::Texture2D::GetCacheMemoryUsage()
+{
+    return TextureCacheGlobal::sizeInBytes;
+}
+
+void ae3d::Texture2D::SetMipmapFilter( MipmapFilter filter )
+{
+    MipGeneratorGlobal::filter = filter;
+}
+
 void ae3d::Texture2D::LoadFromAtlas( const FileSystem::FileContentsData& atlasTextureData, const FileSystem::FileContentsData& atlasMetaData, const char* textureName, TextureWrap aWrap, TextureFilter aFilter, ColorSpace aColorSpace, Anisotropy aAnisotropy )
 {
     Load( atlasTextureData, aWrap, aFilter, mipmaps, aColorSpace, aAnisotropy );
@@ -240,3 +497,330 @@ void ae3d::Texture2D::LoadFromAtlas( const FileSystem::FileContentsData& atlasTe
         }
     }
 }
+
+void ae3d::Texture2D::LoadAsync( const char* aPath, TextureWrap aWrap, TextureFilter aFilter, Mipmaps aMipmaps, ColorSpace aColorSpace, Anisotropy aAnisotropy )
+{
+    RemovePendingTextureLoad( this );
+    *this = *GetDefaultTexture();
+
+    const unsigned generation = ++gPendingTextureGeneration;
+    gPendingTextures.push_back( { this, generation } );
+
+    struct PendingTextureLoad
+    {
+        FileSystem::FileContentsData fileContents;
+        DecodedImage image;
+    };
+
+    std::shared_ptr< PendingTextureLoad > load = std::make_shared< PendingTextureLoad >();
+    load->image.path = aPath;
+    load->image.isSrgb = aColorSpace == ColorSpace::SRGB;
+    load->image.isRepeat = aWrap == TextureWrap::Repeat;
+    Texture2D* texture = this;
+    const MipmapFilter mipmapFilter = MipGeneratorGlobal::filter;
+
+    AsyncLoad::Enqueue( [load, aMipmaps, mipmapFilter]()
+    {
+        load->fileContents = FileSystem::FileContents( load->image.path.c_str() );
+
+        if (load->fileContents.isLoaded && HasStbExtension( load->image.path ))
+        {
+            // On failure Load() decodes again and prints the reason.
+            load->image.pixels = stbi_load_from_memory( load->fileContents.data.data(), static_cast< int >( load->fileContents.data.size() ),
+                                                        &load->image.width, &load->image.height, &load->image.components, 4 );
+
+            // Loader threads already load textures in parallel, so rows are not split into jobs.
+            if (load->image.pixels != nullptr && aMipmaps == Mipmaps::Generate)
+            {
+                MipGenerator::GenerateMips( load->image.pixels, load->image.width, load->image.height, load->image.isSrgb, load->image.isRepeat, mipmapFilter,
+                                            false, load->image.mips );
+            }
+        }
+    },
+    [load, texture, generation, aWrap, aFilter, aMipmaps, aColorSpace, aAnisotropy]()
+    {
+        // Not pending if the texture was destroyed or loaded again meanwhile.
+        bool isPending = false;
+
+        for (std::size_t i = 0; i < gPendingTextures.size(); ++i)
+        {
+            if (gPendingTextures[ i ].texture == texture && gPendingTextures[ i ].generation == generation)
+            {
+                gPendingTextures.erase( std::begin( gPendingTextures ) + i );
+                isPending = true;
+                break;
+            }
+        }
+
+        if (isPending && load->fileContents.isLoaded)
+        {
+            gDecodedImage = &load->image;
+            texture->Load( load->fileContents, aWrap, aFilter, aMipmaps, aColorSpace, aAnisotropy );
+            gDecodedImage = nullptr;
+        }
+        else if (isPending)
+        {
+            System::Print( "Could not load texture %s\n", load->image.path.c_str() );
+        }
+
+        // Not consumed if the texture was cached or loading failed.
+        if (load->image.pixels != nullptr)
+        {
+            stbi_image_free( load->image.pixels );
+        }
+    } );
+}
+
+bool ae3d::Texture2D::IsLoading() const
+{
+    for (const PendingTexture& pending : gPendingTextures)
+    {
+        if (pending.texture == this)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void ae3d::Texture2D::SetStreamingBudget( std::size_t budgetBytes )
+{
+    TextureStreamingGlobal::budgetBytes = budgetBytes;
+}
+
+std::size_t ae3d::Texture2D::GetStreamingMemoryUsage()
+{
+    std::size_t bytes = 0;
+
+    for (const StreamedTexture& streamed : TextureStreamingGlobal::textures)
+    {
+        if (streamed.texture != nullptr)
+        {
+            bytes += TextureStreamingGlobal::GetResidentBytes( streamed, streamed.residentMip );
+        }
+    }
+
+    return bytes;
+}
+
+int ae3d::Texture2D::BeginStreaming( const DDSLoader::Output& ddsOutput, int mipCount )
+{
+    const bool isStreamed = streamingIndex != -1 && TextureStreamingGlobal::textures[ streamingIndex ].texture == this;
+
+    if (TextureStreamingGlobal::budgetBytes == 0 || mipCount < 2 || mipCount > static_cast< int >( ddsOutput.dataOffsets.count ))
+    {
+        if (isStreamed)
+        {
+            TextureStreamingGlobal::textures[ streamingIndex ].texture = nullptr;
+        }
+
+        streamingIndex = -1;
+        return 0;
+    }
+
+    if (!isStreamed)
+    {
+        streamingIndex = -1;
+
+        // The texture can have a slot but no index after it has been assigned the default texture.
+        for (std::size_t i = 0; i < TextureStreamingGlobal::textures.size() && streamingIndex == -1; ++i)
+        {
+            if (TextureStreamingGlobal::textures[ i ].texture == nullptr || TextureStreamingGlobal::textures[ i ].texture == this)
+            {
+                streamingIndex = static_cast< int >( i );
+            }
+        }
+
+        if (streamingIndex == -1)
+        {
+            streamingIndex = static_cast< int >( TextureStreamingGlobal::textures.size() );
+            TextureStreamingGlobal::textures.push_back( StreamedTexture() );
+        }
+    }
+
+    StreamedTexture& streamed = TextureStreamingGlobal::textures[ streamingIndex ];
+    streamed.texture = this;
+    streamed.path = path;
+    streamed.mipSizes.resize( mipCount );
+
+    for (int mip = 0; mip < mipCount; ++mip)
+    {
+        const unsigned end = mip + 1 < mipCount ? (unsigned)ddsOutput.dataOffsets[ mip + 1 ] : ddsOutput.imageData.count;
+        streamed.mipSizes[ mip ] = end - ddsOutput.dataOffsets[ mip ];
+    }
+
+    streamed.tailMip = 0;
+
+    while (streamed.tailMip < mipCount - 1 && MathUtil::Max( width >> streamed.tailMip, height >> streamed.tailMip ) > TextureStreamingGlobal::mipTailSize)
+    {
+        ++streamed.tailMip;
+    }
+
+    streamed.residentMip = streamed.tailMip;
+    streamed.requestedMip = TextureStreamingGlobal::notRequested;
+    streamed.wantedMip = streamed.tailMip;
+    streamed.targetMip = streamed.tailMip;
+    streamed.lastRequestFrame = TextureStreamingGlobal::frame;
+
+    return streamed.tailMip;
+}
+
+void ae3d::Texture2D::RequestStreamedMips( float screenSize )
+{
+    if (streamingIndex == -1)
+    {
+        return;
+    }
+
+    StreamedTexture& streamed = TextureStreamingGlobal::textures[ streamingIndex ];
+    const int size = MathUtil::Max( width, height );
+
+    // The least detailed mip that has at least one texel per pixel.
+    int mip = 0;
+
+    while (mip < streamed.tailMip && (size >> (mip + 1)) >= screenSize)
+    {
+        ++mip;
+    }
+
+    streamed.requestedMip = std::min( streamed.requestedMip, mip );
+}
+
+void ae3d::Texture2D::UpdateStreaming()
+{
+    ++TextureStreamingGlobal::frame;
+
+    std::size_t usedBytes = 0;
+    std::vector< int > priorityOrder;
+    priorityOrder.reserve( TextureStreamingGlobal::textures.size() );
+
+    for (std::size_t i = 0; i < TextureStreamingGlobal::textures.size(); ++i)
+    {
+        StreamedTexture& streamed = TextureStreamingGlobal::textures[ i ];
+
+        if (streamed.texture == nullptr)
+        {
+            continue;
+        }
+
+        if (streamed.requestedMip != TextureStreamingGlobal::notRequested)
+        {
+            streamed.wantedMip = streamed.requestedMip;
+            streamed.requestedMip = TextureStreamingGlobal::notRequested;
+            streamed.lastRequestFrame = TextureStreamingGlobal::frame;
+        }
+        else if (TextureStreamingGlobal::frame - streamed.lastRequestFrame > TextureStreamingGlobal::evictFrameCount)
+        {
+            streamed.wantedMip = streamed.tailMip;
+        }
+
+        usedBytes += TextureStreamingGlobal::GetResidentBytes( streamed, streamed.tailMip );
+        priorityOrder.push_back( static_cast< int >( i ) );
+    }
+
+    // Recently requested textures get their mips first, and of them the ones that are drawn biggest.
+    std::sort( std::begin( priorityOrder ), std::end( priorityOrder ), []( int a, int b )
+    {
+        const StreamedTexture& streamedA = TextureStreamingGlobal::textures[ a ];
+        const StreamedTexture& streamedB = TextureStreamingGlobal::textures[ b ];
+
+        if (streamedA.lastRequestFrame != streamedB.lastRequestFrame)
+        {
+            return streamedA.lastRequestFrame > streamedB.lastRequestFrame;
+        }
+
+        return streamedA.wantedMip < streamedB.wantedMip;
+    } );
+
+    for (int i : priorityOrder)
+    {
+        StreamedTexture& streamed = TextureStreamingGlobal::textures[ i ];
+        streamed.targetMip = streamed.tailMip;
+
+        while (streamed.targetMip > streamed.wantedMip && usedBytes + streamed.mipSizes[ streamed.targetMip - 1 ] <= TextureStreamingGlobal::budgetBytes)
+        {
+            --streamed.targetMip;
+            usedBytes += streamed.mipSizes[ streamed.targetMip ];
+        }
+    }
+
+    for (int i : priorityOrder)
+    {
+        StreamedTexture& streamed = TextureStreamingGlobal::textures[ i ];
+
+        if (TextureStreamingGlobal::loadCount == TextureStreamingGlobal::maxLoadCount)
+        {
+            break;
+        }
+
+        if (streamed.isLoading || streamed.targetMip == streamed.residentMip)
+        {
+            continue;
+        }
+
+        struct StreamedMips
+        {
+            std::string path;
+            FileSystem::FileContentsData fileContents;
+            DDSLoader::Output ddsOutput;
+            bool isLoaded = false;
+        };
+
+        std::shared_ptr< StreamedMips > load = std::make_shared< StreamedMips >();
+        load->path = streamed.path;
+        const int firstMip = streamed.targetMip;
+        streamed.isLoading = true;
+        ++TextureStreamingGlobal::loadCount;
+
+        // Evicted mips are also reloaded from the file because only GPU copies of them are kept.
+        AsyncLoad::Enqueue( [load]()
+        {
+            load->fileContents = FileSystem::FileContents( load->path.c_str() );
+            int fileWidth = 0;
+            int fileHeight = 0;
+            bool fileOpaque = true;
+            load->isLoaded = load->fileContents.isLoaded &&
+                DDSLoader::Load( load->fileContents, fileWidth, fileHeight, fileOpaque, load->ddsOutput ) == DDSLoader::LoadResult::Success;
+        },
+        [load, i, firstMip]()
+        {
+            StreamedTexture& loaded = TextureStreamingGlobal::textures[ i ];
+            loaded.isLoading = false;
+            --TextureStreamingGlobal::loadCount;
+
+            Texture2D* texture = loaded.texture;
+
+            // The slot could have been reused for another file.
+            if (texture == nullptr || loaded.path != load->path)
+            {
+                return;
+            }
+
+            // The texture could have been loaded again from another file meanwhile.
+            if (texture->streamingIndex != i || texture->path != loaded.path)
+            {
+                loaded.texture = nullptr;
+
+                if (texture->streamingIndex == i)
+                {
+                    texture->streamingIndex = -1;
+                }
+
+                return;
+            }
+
+            if (!load->isLoaded || load->ddsOutput.dataOffsets.count < loaded.mipSizes.size())
+            {
+                // Keeps the resident mips instead of retrying every frame.
+                System::Print( "Could not stream mips of %s\n", loaded.path.c_str() );
+                loaded.texture = nullptr;
+                texture->streamingIndex = -1;
+                return;
+            }
+
+            texture->CreateFromDDSMips( load->ddsOutput, firstMip, true );
+            loaded.residentMip = firstMip;
+        } );
+    }
+}
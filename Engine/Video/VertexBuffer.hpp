@@ -11,28 +11,30 @@
 #endif
 #include "Vec3.hpp"
 #include "Array.hpp"
+#include "Shader.hpp"
 
 namespace ae3d
 {
-    /// Contains a vertex and index buffer. Indices are 16-bit.
+    /// Contains a vertex and index buffer. Indices are stored as 16-bit when all vertices are addressable with them, otherwise as 32-bit.
     class VertexBuffer
     {
     public:
         enum class Storage { CPU, GPU };
-        enum class VertexFormat { PTC, PTN, PTNTC, PTNTC_Skinned, Empty };
+        enum class VertexFormat { PTC, PTN, PTNTC, PTNTC_Skinned, PTNTC_Compact, PTNTC_Compact_Skinned, Empty };
+        enum class IndexType { UInt16, UInt32 };
 
         /// Triangle of 3 vertices.
         struct Face
         {
             Face() noexcept : a(0), b(0), c(0) {}
             
-            Face( unsigned short fa, unsigned short fb, unsigned short fc )
+            Face( unsigned fa, unsigned fb, unsigned fc )
             : a( fa )
             , b( fb )
             , c( fc )
             {}
             
-            unsigned short a, b, c;
+            unsigned a, b, c;
         };
 
         /// Vertex with position, texture coordinate and color.
@@ -80,6 +82,49 @@ namespace ae3d
             Vec3 normal;
         };
 
+        /// Quantized VertexPTNTC. Position is 16-bit unorm inside the range given to Generate(), texcoord is half float,
+        /// normal and tangent (handedness in .w) are 8-bit snorm and color is 8-bit unorm.
+        struct VertexPTNTC_Compact
+        {
+            unsigned short position[ 4 ];
+            unsigned short uv[ 2 ];
+            signed char normal[ 4 ];
+            signed char tangent[ 4 ];
+            unsigned char color[ 4 ];
+        };
+
+        /// Quantized VertexPTNTC_Skinned. Weights are 8-bit unorm and bone indices 8-bit uint.
+        struct VertexPTNTC_Compact_Skinned
+        {
+            unsigned short position[ 4 ];
+            unsigned short uv[ 2 ];
+            signed char normal[ 4 ];
+            signed char tangent[ 4 ];
+            unsigned char color[ 4 ];
+            unsigned char weights[ 4 ];
+            unsigned char bones[ 4 ];
+        };
+
+        /// Depth stream vertex with position and normal.
+        struct VertexPN
+        {
+            Vec3 position;
+            Vec3 normal;
+        };
+
+        /// Depth stream vertex with a position in the VertexPTNTC_Compact format.
+        struct VertexP_Compact
+        {
+            unsigned short position[ 4 ];
+        };
+
+        /// Depth stream vertex with a position and normal in the VertexPTNTC_Compact format.
+        struct VertexPN_Compact
+        {
+            unsigned short position[ 4 ];
+            signed char normal[ 4 ];
+        };
+
 #if RENDERER_VULKAN
 		VertexBuffer() noexcept : bindingDescriptions(), attributeDescriptions() {}
 #endif
@@ -112,6 +157,18 @@ namespace ae3d
 
         VertexFormat GetVertexFormat() const { return vertexFormat; }
 
+        /// \return True if positions are quantized and must be transformed by GetPositionDequantization() before use.
+        bool HasQuantizedPositions() const { return vertexFormat == VertexFormat::PTNTC_Compact || vertexFormat == VertexFormat::PTNTC_Compact_Skinned; }
+
+        /// \return Quantized position mapping: local position = xyz + quantized position (0-1) * w.
+        const Vec4& GetPositionDequantization() const { return positionDequantization; }
+
+        /// \return Index type of the GPU index buffer.
+        IndexType GetIndexType() const { return indexType; }
+
+        /// \return Index size in bytes.
+        int GetIndexSize() const { return indexType == IndexType::UInt16 ? 2 : 4; }
+
         /// \return True if the buffer contains geometry ready for rendering.
         bool IsGenerated() const { return elementCount != 0; }
 
@@ -135,6 +192,15 @@ namespace ae3d
         /// \param vertexCount Vertex count.
         void UpdateDynamic( const Face* faces, int faceCount, const VertexPTC* vertices, int vertexCount );
 
+#if RENDERER_VULKAN
+        /// Updates the buffer from 16-bit indices, like the ones written by UI libraries. Buffer must have been generated for at most 65536 vertices.
+        /// \param indices Indices, 3 per face.
+        /// \param faceCount Face count.
+        /// \param vertices Vertices.
+        /// \param vertexCount Vertex count.
+        void UpdateDynamic( const unsigned short* indices, int faceCount, const VertexPTC* vertices, int vertexCount );
+#endif
+
         /// Generates the buffer from supplied geometry.
         /// \param faces Faces.
         /// \param faceCount Face count.
@@ -156,10 +222,72 @@ namespace ae3d
         /// \param vertexCount Vertex count.
         void Generate( const Face* faces, int faceCount, const VertexPTNTC_Skinned* vertices, int vertexCount );
 
+        /// Generates the buffer from supplied geometry.
+        /// \param faces Faces.
+        /// \param faceCount Face count.
+        /// \param vertices Vertices.
+        /// \param vertexCount Vertex count.
+        /// \param positionOffset Local position of quantized position 0.
+        /// \param positionScale Local distance of quantized position 1 on every axis.
+        void Generate( const Face* faces, int faceCount, const VertexPTNTC_Compact* vertices, int vertexCount, const Vec3& positionOffset, float positionScale );
+
+        /// Generates the buffer from supplied geometry.
+        /// \param faces Faces.
+        /// \param faceCount Face count.
+        /// \param vertices Vertices.
+        /// \param vertexCount Vertex count.
+        /// \param positionOffset Local position of quantized position 0.
+        /// \param positionScale Local distance of quantized position 1 on every axis.
+        void Generate( const Face* faces, int faceCount, const VertexPTNTC_Compact_Skinned* vertices, int vertexCount, const Vec3& positionOffset, float positionScale );
+
+        /// Generates the buffer from vertices and indices that are already in their GPU layout, for example memory-mapped from a .ae3d file.
+        /// \param indices Indices, 3 per face. 16-bit indices can address at most 65536 vertices.
+        /// \param aIndexType Index type.
+        /// \param faceCount Face count.
+        /// \param vertices Vertices.
+        /// \param aVertexFormat PTNTC, PTNTC_Skinned, PTNTC_Compact or PTNTC_Compact_Skinned.
+        /// \param vertexCount Vertex count.
+        /// \param aPositionDequantization Position range of compact formats, see GetPositionDequantization().
+        void GeneratePacked( const void* indices, IndexType aIndexType, int faceCount, const void* vertices, VertexFormat aVertexFormat, int vertexCount,
+                             const Vec4& aPositionDequantization );
+
+        /// \param format Vertex format.
+        /// \return Size of a vertex in bytes, or 0 for Empty.
+        static int GetVertexSize( VertexFormat format )
+        {
+            switch (format)
+            {
+            case VertexFormat::PTC: return sizeof( VertexPTC );
+            case VertexFormat::PTN: return sizeof( VertexPTN );
+            case VertexFormat::PTNTC: return sizeof( VertexPTNTC );
+            case VertexFormat::PTNTC_Skinned: return sizeof( VertexPTNTC_Skinned );
+            case VertexFormat::PTNTC_Compact: return sizeof( VertexPTNTC_Compact );
+            case VertexFormat::PTNTC_Compact_Skinned: return sizeof( VertexPTNTC_Compact_Skinned );
+            default: return 0;
+            }
+        }
+
+        /// Generates tightly packed streams for shaders that read only positions or positions and normals, see Shader::SetVertexInput().
+        /// Must be called after Generate() with a non-skinned float vertex format. Backends without stream support bind all attributes.
+        /// \param positions Positions.
+        /// \param positionsNormals Positions and normals.
+        /// \param vertexCount Vertex count.
+        void GenerateDepthStreams( const Vec3* positions, const VertexPN* positionsNormals, int vertexCount );
+
+        /// Generates tightly packed streams for shaders that read only positions or positions and normals, see Shader::SetVertexInput().
+        /// Must be called after Generate() with VertexPTNTC_Compact vertices. Backends without stream support bind all attributes.
+        /// \param positions Positions.
+        /// \param positionsNormals Positions and normals.
+        /// \param vertexCount Vertex count.
+        void GenerateDepthStreams( const VertexP_Compact* positions, const VertexPN_Compact* positionsNormals, int vertexCount );
+
         /// Sets a graphics API debug name for the buffer, visible in debugging tools. Must be called after Generate().
         /// \param name Name
         void SetDebugName( const char* name );
 
+        /// Frees graphics API buffers after the current frame has been rendered. The buffer can be generated again.
+        void Release();
+
 #if RENDERER_METAL
         id<MTLBuffer> GetVertexBuffer() const { return vertexBuffer; }
         id<MTLBuffer> GetIndexBuffer() const { return indexBuffer; }
@@ -179,6 +307,13 @@ namespace ae3d
 
         VkPipelineVertexInputStateCreateInfo* GetInputState() { CreateInputState( bindingDescriptions.stride ); return &inputStateCreateInfo; }
         VkBuffer* GetVertexBuffer() { return &vertexBuffer; }
+
+        /// \return Stream that is bound for a shader reading input. Falls back to All if the stream was not generated.
+        Shader::VertexInput GetBoundInput( Shader::VertexInput input ) const { return (input != Shader::VertexInput::All && depthStreams[ (int)input - 1 ] != VK_NULL_HANDLE) ? input : Shader::VertexInput::All; }
+        /// \return Input state for a shader reading input.
+        VkPipelineVertexInputStateCreateInfo* GetInputState( Shader::VertexInput input );
+        /// \return Vertex buffer for a shader reading input.
+        VkBuffer* GetVertexBuffer( Shader::VertexInput input ) { return GetBoundInput( input ) == Shader::VertexInput::All ? &vertexBuffer : &depthStreams[ (int)input - 1 ]; }
         VkBuffer* GetIndexBuffer() { return &indexBuffer; }
 
 #endif
@@ -195,6 +330,33 @@ namespace ae3d
 
     private:
 
+        /// Selects the index type for vertexCount vertices and converts faces into it.
+        /// \param faces Faces.
+        /// \param faceCount Face count.
+        /// \param vertexCount Vertex count.
+        /// \param outIndices16 Storage for converted indices. Not used with 32-bit indices.
+        /// \return Index data in the selected type. Size is faceCount * 3 * GetIndexSize().
+        const void* PackIndices( const Face* faces, int faceCount, int vertexCount, Array< unsigned short >& outIndices16 )
+        {
+            indexType = vertexCount > 65536 ? IndexType::UInt32 : IndexType::UInt16;
+
+            if (indexType == IndexType::UInt32)
+            {
+                return faces;
+            }
+
+            outIndices16.Allocate( faceCount * 3 );
+
+            for (int f = 0; f < faceCount; ++f)
+            {
+                outIndices16[ f * 3 + 0 ] = (unsigned short)faces[ f ].a;
+                outIndices16[ f * 3 + 1 ] = (unsigned short)faces[ f ].b;
+                outIndices16[ f * 3 + 2 ] = (unsigned short)faces[ f ].c;
+            }
+
+            return outIndices16.elements;
+        }
+
 #if RENDERER_D3D12
         void UploadVB( void* faces, void* vertices, unsigned ibSize );
         // Index buffer is stored in the vertex buffer after vertex data.
@@ -207,13 +369,18 @@ namespace ae3d
 #endif
         int elementCount = 0;
         VertexFormat vertexFormat = VertexFormat::PTC;
+        IndexType indexType = IndexType::UInt16;
+        Vec4 positionDequantization = Vec4( 0, 0, 0, 1 );
 #if RENDERER_METAL
         id<MTLBuffer> vertexBuffer;
         id<MTLBuffer> indexBuffer;
 #endif
 #if RENDERER_VULKAN
         void GenerateVertexBuffer( const void* vertexData, int vertexBufferSize, int vertexStride, const void* indexData, int indexBufferSize );
+        void GenerateDepthStreamBuffers( const void* positions, int positionsSize, const void* positionsNormals, int positionsNormalsSize );
+        void UploadBuffer( const void* data, int size, VkBufferUsageFlags usage, VkBuffer& outBuffer, VkDeviceMemory& outMemory, const char* debugName );
         void CreateInputState( int vertexStride );
+        void UpdateDynamicVertices( const VertexPTC* vertices, int vertexCount );
 
         VkBuffer vertexBuffer = VK_NULL_HANDLE;
         VkDeviceMemory vertexMem = VK_NULL_HANDLE;
@@ -224,6 +391,13 @@ namespace ae3d
         VkBuffer indexBuffer = VK_NULL_HANDLE;
         VkDeviceMemory indexMem = VK_NULL_HANDLE;
 
+        // Indexed by Shader::VertexInput - 1.
+        VkBuffer depthStreams[ 2 ] = { VK_NULL_HANDLE, VK_NULL_HANDLE };
+        VkDeviceMemory depthStreamMems[ 2 ] = { VK_NULL_HANDLE, VK_NULL_HANDLE };
+        VkPipelineVertexInputStateCreateInfo depthInputStates[ 2 ] = {};
+        VkVertexInputBindingDescription depthBindingDescriptions[ 2 ] = {};
+        VkVertexInputAttributeDescription depthAttributeDescriptions[ 2 ][ 2 ] = {};
+
         struct Buffer
         {
             int size = 0;
@@ -16,6 +16,7 @@ extern ae3d::FileWatcher fileWatcher;
 
 void BindComputeDescriptorSet();
 void UploadPerObjectUbo();
+void FlushTextureUploads( bool waitForCompletion ); // Defined in Texture2DVulkan.cpp
 
 namespace GfxDeviceGlobal
 {
@@ -24,8 +25,8 @@ namespace GfxDeviceGlobal
     extern VkCommandBuffer computeCmdBuffer;
     extern VkPipelineLayout pipelineLayout;
     extern VkPipelineCache pipelineCache;
-    extern PerObjectUboStruct perObjectUboStruct;
-    extern VkImageView boundViews[ ae3d::ComputeShader::SLOT_COUNT ];
+    extern thread_local PerObjectUboStruct perObjectUboStruct;
+    extern thread_local VkImageView boundViews[ ae3d::ComputeShader::SLOT_COUNT ];
 }
 
 namespace ComputeShaderGlobal
@@ -212,6 +213,8 @@ void ae3d::ComputeShader::End()
     submitInfo.commandBufferCount = 1;
     submitInfo.pCommandBuffers = &GfxDeviceGlobal::computeCmdBuffer;
 
+    // Uploads are on the graphics queue, so they must finish before the compute queue reads the textures.
+    FlushTextureUploads( true );
     VkResult err = vkQueueSubmit( GfxDeviceGlobal::computeQueue, 1, &submitInfo, VK_NULL_HANDLE );
     AE3D_CHECK_VULKAN( err, "vkQueueSubmit compute" );
     Statistics::IncQueueSubmitCalls();
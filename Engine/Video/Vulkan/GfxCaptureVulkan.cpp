@@ -0,0 +1,775 @@
+// This is an independent project of an individual developer. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++, C#, and Java: http://www.viva64.com
+#include "GfxCapture.hpp"
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+#include "Array.hpp"
+#include "FileSystem.hpp"
+#include "RenderTexture.hpp"
+#include "Shader.hpp"
+#include "Statistics.hpp"
+#include "System.hpp"
+#include "Texture2D.hpp"
+#include "VertexBuffer.hpp"
+
+void BeginOffscreen();
+void EndOffscreen( int profilerIndex, ae3d::RenderTexture* target );
+
+using namespace ae3d;
+
+namespace GfxDeviceGlobal
+{
+    extern thread_local PerObjectUboStruct perObjectUboStruct;
+}
+
+// File layout: Header followed by commands. Each command is a Command byte and its arguments.
+// Define* commands precede the first command that references the defined id.
+namespace GfxCaptureGlobal
+{
+    struct Header
+    {
+        char magic[ 4 ] = { 'A', 'E', '3', 'C' };
+        std::uint32_t version = 1;
+        std::uint32_t uboSize = sizeof( PerObjectUboStruct );
+        std::uint32_t frameCount = 0;
+    };
+
+    struct VertexBufferEntry
+    {
+        std::uint32_t id;
+        int faceCount;
+    };
+
+    struct RenderTextureEntry
+    {
+        std::uint32_t id;
+        int width;
+        int height;
+    };
+
+    const std::uint32_t NoId = 0xFFFFFFFF;
+    const unsigned UboBlockSize = 16;
+    const unsigned UboBlockCount = (sizeof( PerObjectUboStruct ) + UboBlockSize - 1) / UboBlockSize;
+
+    std::string pendingPath;
+    int pendingFrameCount = 0;
+    std::string path;
+    int framesLeft = 0;
+    bool isCapturing = false;
+    std::vector< std::uint8_t > stream;
+    std::map< const Shader*, std::uint32_t > shaderIds;
+    std::map< const VertexBuffer*, VertexBufferEntry > vertexBufferIds;
+    std::map< const RenderTexture*, RenderTextureEntry > renderTextureIds;
+    std::map< std::uint64_t, std::uint32_t > textureIds;
+    std::uint32_t nextVertexBufferId = 0;
+    std::uint32_t nextRenderTextureId = 0;
+    // UBO contents are stored as 16-byte blocks that changed since the previous draw of the frame.
+    std::uint8_t previousUbo[ UboBlockCount * UboBlockSize ];
+
+    std::vector< std::uint8_t > replayStream;
+    std::vector< std::size_t > frameOffsets;
+    Array< Shader > shaders;
+    Array< VertexBuffer > vertexBuffers;
+    Array< RenderTexture > renderTextures;
+    Array< Texture2D > textures;
+    unsigned textureCount = 0;
+    std::uint8_t replayUbo[ UboBlockCount * UboBlockSize ];
+}
+
+template< typename T > static void Write( const T& value )
+{
+    const std::uint8_t* bytes = reinterpret_cast< const std::uint8_t* >( &value );
+    GfxCaptureGlobal::stream.insert( GfxCaptureGlobal::stream.end(), bytes, bytes + sizeof( T ) );
+}
+
+static void WriteString( const std::string& str )
+{
+    Write( (std::uint16_t)str.size() );
+    GfxCaptureGlobal::stream.insert( GfxCaptureGlobal::stream.end(), str.begin(), str.end() );
+}
+
+struct Reader
+{
+    explicit Reader( std::size_t aOffset ) : offset( aOffset ) {}
+
+    template< typename T > T Read()
+    {
+        T value = T();
+
+        if (offset + sizeof( T ) <= GfxCaptureGlobal::replayStream.size())
+        {
+            std::memcpy( &value, &GfxCaptureGlobal::replayStream[ offset ], sizeof( T ) );
+        }
+
+        offset += sizeof( T );
+        return value;
+    }
+
+    std::string ReadString()
+    {
+        const std::uint16_t length = Read< std::uint16_t >();
+        const std::size_t begin = offset < GfxCaptureGlobal::replayStream.size() ? offset : GfxCaptureGlobal::replayStream.size();
+        const std::size_t end = begin + length < GfxCaptureGlobal::replayStream.size() ? begin + length : GfxCaptureGlobal::replayStream.size();
+        offset += length;
+        return std::string( GfxCaptureGlobal::replayStream.begin() + begin, GfxCaptureGlobal::replayStream.begin() + end );
+    }
+
+    bool IsAtEnd() const { return offset >= GfxCaptureGlobal::replayStream.size(); }
+
+    std::size_t offset;
+};
+
+static std::uint32_t GetShaderId( const Shader& shader )
+{
+    auto it = GfxCaptureGlobal::shaderIds.find( &shader );
+
+    if (it != GfxCaptureGlobal::shaderIds.end())
+    {
+        return it->second;
+    }
+
+    const std::uint32_t id = (std::uint32_t)GfxCaptureGlobal::shaderIds.size();
+    GfxCaptureGlobal::shaderIds[ &shader ] = id;
+
+    Write( GfxCapture::Command::DefineShader );
+    Write( id );
+    WriteString( shader.GetVertexShaderPath() );
+    WriteString( shader.GetFragmentShaderPath() );
+
+    return id;
+}
+
+static std::uint32_t GetVertexBufferId( const VertexBuffer& vertexBuffer )
+{
+    auto it = GfxCaptureGlobal::vertexBufferIds.find( &vertexBuffer );
+
+    // Dynamic buffers can be regenerated with another size, so they get a new definition.
+    if (it != GfxCaptureGlobal::vertexBufferIds.end() && it->second.faceCount == vertexBuffer.GetFaceCount())
+    {
+        return it->second.id;
+    }
+
+    const std::uint32_t id = GfxCaptureGlobal::nextVertexBufferId++;
+    GfxCaptureGlobal::vertexBufferIds[ &vertexBuffer ] = { id, vertexBuffer.GetFaceCount() };
+
+    Write( GfxCapture::Command::DefineVertexBuffer );
+    Write( id );
+    Write( (std::uint8_t)vertexBuffer.GetVertexFormat() );
+    Write( vertexBuffer.GetFaceCount() / 3 );
+
+    return id;
+}
+
+static std::uint32_t GetRenderTextureId( RenderTexture* renderTexture )
+{
+    if (renderTexture == nullptr)
+    {
+        return GfxCaptureGlobal::NoId;
+    }
+
+    auto it = GfxCaptureGlobal::renderTextureIds.find( renderTexture );
+
+    if (it != GfxCaptureGlobal::renderTextureIds.end() && it->second.width == renderTexture->GetWidth() && it->second.height == renderTexture->GetHeight())
+    {
+        return it->second.id;
+    }
+
+    const std::uint32_t id = GfxCaptureGlobal::nextRenderTextureId++;
+    GfxCaptureGlobal::renderTextureIds[ renderTexture ] = { id, renderTexture->GetWidth(), renderTexture->GetHeight() };
+
+    Write( GfxCapture::Command::DefineRenderTexture );
+    Write( id );
+    Write( renderTexture->GetWidth() );
+    Write( renderTexture->GetHeight() );
+    Write( (std::uint8_t)renderTexture->GetDataType() );
+    Write( (std::uint8_t)(renderTexture->IsCube() ? 1 : 0) );
+    Write( (std::uint8_t)(renderTexture->GetSampleCount() > 1 ? 1 : 0) );
+
+    return id;
+}
+
+static std::uint32_t GetTextureId( std::uint64_t texture )
+{
+    if (texture == 0)
+    {
+        return GfxCaptureGlobal::NoId;
+    }
+
+    auto it = GfxCaptureGlobal::textureIds.find( texture );
+
+    if (it != GfxCaptureGlobal::textureIds.end())
+    {
+        return it->second;
+    }
+
+    const std::uint32_t id = (std::uint32_t)GfxCaptureGlobal::textureIds.size();
+    GfxCaptureGlobal::textureIds[ texture ] = id;
+    return id;
+}
+
+void GfxCapture::Begin( const char* path, int frameCount )
+{
+    GfxCaptureGlobal::pendingPath = path;
+    GfxCaptureGlobal::pendingFrameCount = frameCount;
+}
+
+bool GfxCapture::IsCapturing()
+{
+    return GfxCaptureGlobal::isCapturing;
+}
+
+void GfxCapture::BeginFrame()
+{
+    if (!GfxCaptureGlobal::isCapturing && GfxCaptureGlobal::pendingFrameCount > 0)
+    {
+        GfxCaptureGlobal::path = GfxCaptureGlobal::pendingPath;
+        GfxCaptureGlobal::framesLeft = GfxCaptureGlobal::pendingFrameCount;
+        GfxCaptureGlobal::pendingFrameCount = 0;
+        GfxCaptureGlobal::stream.clear();
+        GfxCaptureGlobal::shaderIds.clear();
+        GfxCaptureGlobal::vertexBufferIds.clear();
+        GfxCaptureGlobal::renderTextureIds.clear();
+        GfxCaptureGlobal::textureIds.clear();
+        GfxCaptureGlobal::nextVertexBufferId = 0;
+        GfxCaptureGlobal::nextRenderTextureId = 0;
+        Write( GfxCaptureGlobal::Header() );
+        GfxCaptureGlobal::isCapturing = true;
+    }
+
+    if (!GfxCaptureGlobal::isCapturing)
+    {
+        return;
+    }
+
+    Write( Command::BeginFrame );
+    std::memset( GfxCaptureGlobal::previousUbo, 0, sizeof( GfxCaptureGlobal::previousUbo ) );
+}
+
+void GfxCapture::Present()
+{
+    if (!GfxCaptureGlobal::isCapturing)
+    {
+        return;
+    }
+
+    Write( Command::Present );
+
+    GfxCaptureGlobal::Header header;
+    std::memcpy( &header, GfxCaptureGlobal::stream.data(), sizeof( header ) );
+    ++header.frameCount;
+    std::memcpy( GfxCaptureGlobal::stream.data(), &header, sizeof( header ) );
+
+    if (--GfxCaptureGlobal::framesLeft > 0)
+    {
+        return;
+    }
+
+    GfxCaptureGlobal::isCapturing = false;
+
+    std::ofstream ofs( GfxCaptureGlobal::path, std::ios::binary );
+
+    if (ofs.write( (const char*)GfxCaptureGlobal::stream.data(), GfxCaptureGlobal::stream.size() ))
+    {
+        System::Print( "Wrote %u frames (%u bytes) into %s\n", header.frameCount, (unsigned)GfxCaptureGlobal::stream.size(), GfxCaptureGlobal::path.c_str() );
+    }
+    else
+    {
+        System::Print( "Could not write capture to %s\n", GfxCaptureGlobal::path.c_str() );
+    }
+
+    GfxCaptureGlobal::stream = std::vector< std::uint8_t >();
+}
+
+void GfxCapture::Record( Command command )
+{
+    if (GfxCaptureGlobal::isCapturing)
+    {
+        Write( command );
+    }
+}
+
+void GfxCapture::RecordSetRenderTarget( RenderTexture* target, unsigned cubeMapFace )
+{
+    if (GfxCaptureGlobal::isCapturing)
+    {
+        const std::uint32_t id = GetRenderTextureId( target );
+        Write( Command::SetRenderTarget );
+        Write( id );
+        Write( (std::uint8_t)cubeMapFace );
+    }
+}
+
+void GfxCapture::RecordRect( Command command, const int rect[ 4 ] )
+{
+    if (GfxCaptureGlobal::isCapturing)
+    {
+        Write( command );
+
+        for (int i = 0; i < 4; ++i)
+        {
+            Write( rect[ i ] );
+        }
+    }
+}
+
+void GfxCapture::RecordClearScreen( unsigned clearFlags )
+{
+    if (GfxCaptureGlobal::isCapturing)
+    {
+        Write( Command::ClearScreen );
+        Write( (std::uint8_t)clearFlags );
+    }
+}
+
+void GfxCapture::RecordEndOffscreen( int profilerIndex, RenderTexture* target )
+{
+    if (GfxCaptureGlobal::isCapturing)
+    {
+        const std::uint32_t id = GetRenderTextureId( target );
+        Write( Command::EndOffscreen );
+        Write( (std::int8_t)profilerIndex );
+        Write( id );
+    }
+}
+
+void GfxCapture::RecordDraw( VertexBuffer& vertexBuffer, int startIndex, int endIndex, Shader& shader, GfxDevice::BlendMode blendMode, GfxDevice::DepthFunc depthFunc,
+                             GfxDevice::CullMode cullMode, GfxDevice::FillMode fillMode, GfxDevice::PrimitiveTopology topology,
+                             const PerObjectUboStruct& ubo, const std::uint64_t textures[ TextureSlotCount ] )
+{
+    if (!GfxCaptureGlobal::isCapturing)
+    {
+        return;
+    }
+
+    const std::uint32_t vertexBufferId = GetVertexBufferId( vertexBuffer );
+    const std::uint32_t shaderId = GetShaderId( shader );
+
+    Write( Command::Draw );
+    Write( vertexBufferId );
+    Write( shaderId );
+    Write( startIndex );
+    Write( endIndex );
+    Write( (std::uint8_t)blendMode );
+    Write( (std::uint8_t)depthFunc );
+    Write( (std::uint8_t)cullMode );
+    Write( (std::uint8_t)fillMode );
+    Write( (std::uint8_t)topology );
+
+    for (int slot = 0; slot < TextureSlotCount; ++slot)
+    {
+        Write( GetTextureId( textures[ slot ] ) );
+    }
+
+    std::uint8_t current[ GfxCaptureGlobal::UboBlockCount * GfxCaptureGlobal::UboBlockSize ] = {};
+    std::memcpy( current, &ubo, sizeof( PerObjectUboStruct ) );
+
+    std::uint16_t changedBlockCount = 0;
+
+    for (unsigned block = 0; block < GfxCaptureGlobal::UboBlockCount; ++block)
+    {
+        if (std::memcmp( &current[ block * GfxCaptureGlobal::UboBlockSize ], &GfxCaptureGlobal::previousUbo[ block * GfxCaptureGlobal::UboBlockSize ], GfxCaptureGlobal::UboBlockSize ) != 0)
+        {
+            ++changedBlockCount;
+        }
+    }
+
+    Write( changedBlockCount );
+
+    for (unsigned block = 0; block < GfxCaptureGlobal::UboBlockCount; ++block)
+    {
+        const std::uint8_t* blockData = &current[ block * GfxCaptureGlobal::UboBlockSize ];
+
+        if (std::memcmp( blockData, &GfxCaptureGlobal::previousUbo[ block * GfxCaptureGlobal::UboBlockSize ], GfxCaptureGlobal::UboBlockSize ) != 0)
+        {
+            Write( (std::uint16_t)block );
+            GfxCaptureGlobal::stream.insert( GfxCaptureGlobal::stream.end(), blockData, blockData + GfxCaptureGlobal::UboBlockSize );
+        }
+    }
+
+    std::memcpy( GfxCaptureGlobal::previousUbo, current, sizeof( current ) );
+}
+
+static void CreatePlaceholderVertexBuffer( VertexBuffer& vertexBuffer, VertexBuffer::VertexFormat format, int faceCount )
+{
+    if (faceCount <= 0)
+    {
+        return;
+    }
+
+    // All faces reference the same three vertices. Submission cost doesn't depend on the contents.
+    Array< VertexBuffer::Face > faces( (unsigned)faceCount );
+
+    for (unsigned i = 0; i < faces.count; ++i)
+    {
+        faces[ i ] = VertexBuffer::Face( 0, 1, 2 );
+    }
+
+    if (format == VertexBuffer::VertexFormat::PTC)
+    {
+        VertexBuffer::VertexPTC vertices[ 3 ];
+        vertexBuffer.Generate( faces.elements, faceCount, vertices, 3, VertexBuffer::Storage::GPU );
+    }
+    else if (format == VertexBuffer::VertexFormat::PTN)
+    {
+        VertexBuffer::VertexPTN vertices[ 3 ] = {};
+        vertexBuffer.Generate( faces.elements, faceCount, vertices, 3 );
+    }
+    else if (format == VertexBuffer::VertexFormat::PTNTC)
+    {
+        VertexBuffer::VertexPTNTC vertices[ 3 ] = {};
+        vertexBuffer.Generate( faces.elements, faceCount, vertices, 3 );
+    }
+    else if (format == VertexBuffer::VertexFormat::PTNTC_Skinned)
+    {
+        VertexBuffer::VertexPTNTC_Skinned vertices[ 3 ] = {};
+        vertexBuffer.Generate( faces.elements, faceCount, vertices, 3 );
+    }
+    else if (format == VertexBuffer::VertexFormat::PTNTC_Compact)
+    {
+        VertexBuffer::VertexPTNTC_Compact vertices[ 3 ] = {};
+        vertexBuffer.Generate( faces.elements, faceCount, vertices, 3, Vec3( 0, 0, 0 ), 1 );
+    }
+    else if (format == VertexBuffer::VertexFormat::PTNTC_Compact_Skinned)
+    {
+        VertexBuffer::VertexPTNTC_Compact_Skinned vertices[ 3 ] = {};
+        vertexBuffer.Generate( faces.elements, faceCount, vertices, 3, Vec3( 0, 0, 0 ), 1 );
+    }
+}
+
+// Reads one command. Load pass creates resources for Define* commands, replay pass executes the others.
+// \return False if the command was Present or the stream ended.
+static bool ProcessCommand( Reader& reader, bool isLoadPass )
+{
+    if (reader.IsAtEnd())
+    {
+        return false;
+    }
+
+    const GfxCapture::Command command = reader.Read< GfxCapture::Command >();
+
+    switch (command)
+    {
+    case GfxCapture::Command::BeginFrame:
+        if (isLoadPass)
+        {
+            GfxCaptureGlobal::frameOffsets.push_back( reader.offset - 1 );
+        }
+        else
+        {
+            GfxDevice::BeginFrame();
+            Statistics::ResetFrameStatistics();
+            std::memset( GfxCaptureGlobal::replayUbo, 0, sizeof( GfxCaptureGlobal::replayUbo ) );
+        }
+        break;
+    case GfxCapture::Command::Present:
+        if (!isLoadPass)
+        {
+            GfxDevice::Present();
+        }
+        return false;
+    case GfxCapture::Command::BeginRenderPassAndCommandBuffer:
+        if (!isLoadPass)
+        {
+            GfxDevice::BeginRenderPassAndCommandBuffer();
+        }
+        break;
+    case GfxCapture::Command::EndRenderPassAndCommandBuffer:
+        if (!isLoadPass)
+        {
+            GfxDevice::EndRenderPassAndCommandBuffer();
+        }
+        break;
+    case GfxCapture::Command::BeginRenderPass:
+        if (!isLoadPass)
+        {
+            GfxDevice::BeginRenderPass();
+        }
+        break;
+    case GfxCapture::Command::EndRenderPass:
+        if (!isLoadPass)
+        {
+            GfxDevice::EndRenderPass();
+        }
+        break;
+    case GfxCapture::Command::BeginOffscreen:
+        if (!isLoadPass)
+        {
+            BeginOffscreen();
+        }
+        break;
+    case GfxCapture::Command::EndOffscreen:
+    {
+        const int profilerIndex = reader.Read< std::int8_t >();
+        const std::uint32_t id = reader.Read< std::uint32_t >();
+
+        if (!isLoadPass)
+        {
+            EndOffscreen( profilerIndex, id < GfxCaptureGlobal::renderTextures.count ? &GfxCaptureGlobal::renderTextures[ id ] : nullptr );
+        }
+        break;
+    }
+    case GfxCapture::Command::SetRenderTarget:
+    {
+        const std::uint32_t id = reader.Read< std::uint32_t >();
+        const unsigned cubeMapFace = reader.Read< std::uint8_t >();
+
+        if (!isLoadPass)
+        {
+            GfxDevice::SetRenderTarget( id < GfxCaptureGlobal::renderTextures.count ? &GfxCaptureGlobal::renderTextures[ id ] : nullptr, cubeMapFace );
+        }
+        break;
+    }
+    case GfxCapture::Command::SetViewport:
+    case GfxCapture::Command::SetScissor:
+    {
+        int rect[ 4 ];
+
+        for (int i = 0; i < 4; ++i)
+        {
+            rect[ i ] = reader.Read< std::int32_t >();
+        }
+
+        if (!isLoadPass && command == GfxCapture::Command::SetViewport)
+        {
+            GfxDevice::SetViewport( rect );
+        }
+        else if (!isLoadPass)
+        {
+            GfxDevice::SetScissor( rect );
+        }
+        break;
+    }
+    case GfxCapture::Command::ClearScreen:
+    {
+        const unsigned clearFlags = reader.Read< std::uint8_t >();
+
+        if (!isLoadPass)
+        {
+            GfxDevice::ClearScreen( clearFlags );
+        }
+        break;
+    }
+    case GfxCapture::Command::Draw:
+    {
+        const std::uint32_t vertexBufferId = reader.Read< std::uint32_t >();
+        const std::uint32_t shaderId = reader.Read< std::uint32_t >();
+        const int startIndex = reader.Read< std::int32_t >();
+        const int endIndex = reader.Read< std::int32_t >();
+        const auto blendMode = (GfxDevice::BlendMode)reader.Read< std::uint8_t >();
+        const auto depthFunc = (GfxDevice::DepthFunc)reader.Read< std::uint8_t >();
+        const auto cullMode = (GfxDevice::CullMode)reader.Read< std::uint8_t >();
+        const auto fillMode = (GfxDevice::FillMode)reader.Read< std::uint8_t >();
+        const auto topology = (GfxDevice::PrimitiveTopology)reader.Read< std::uint8_t >();
+        std::uint32_t textureIds[ GfxCapture::TextureSlotCount ];
+
+        for (int slot = 0; slot < GfxCapture::TextureSlotCount; ++slot)
+        {
+            textureIds[ slot ] = reader.Read< std::uint32_t >();
+
+            if (isLoadPass && textureIds[ slot ] != GfxCaptureGlobal::NoId && textureIds[ slot ] >= GfxCaptureGlobal::textureCount)
+            {
+                GfxCaptureGlobal::textureCount = textureIds[ slot ] + 1;
+            }
+        }
+
+        const std::uint16_t changedBlockCount = reader.Read< std::uint16_t >();
+
+        for (unsigned i = 0; i < changedBlockCount; ++i)
+        {
+            const std::uint16_t block = reader.Read< std::uint16_t >();
+
+            for (unsigned byteIndex = 0; byteIndex < GfxCaptureGlobal::UboBlockSize; ++byteIndex)
+            {
+                const std::uint8_t value = reader.Read< std::uint8_t >();
+
+                if (block < GfxCaptureGlobal::UboBlockCount)
+                {
+                    GfxCaptureGlobal::replayUbo[ block * GfxCaptureGlobal::UboBlockSize + byteIndex ] = value;
+                }
+            }
+        }
+
+        if (isLoadPass || vertexBufferId >= GfxCaptureGlobal::vertexBuffers.count || shaderId >= GfxCaptureGlobal::shaders.count ||
+            !GfxCaptureGlobal::vertexBuffers[ vertexBufferId ].IsGenerated())
+        {
+            break;
+        }
+
+        Shader& shader = GfxCaptureGlobal::shaders[ shaderId ];
+        shader.Use();
+
+        for (int slot = 0; slot < GfxCapture::TextureSlotCount; ++slot)
+        {
+            if (textureIds[ slot ] < GfxCaptureGlobal::textures.count)
+            {
+                shader.SetTexture( &GfxCaptureGlobal::textures[ textureIds[ slot ] ], slot );
+            }
+        }
+
+        std::memcpy( (void*)&GfxDeviceGlobal::perObjectUboStruct, GfxCaptureGlobal::replayUbo, sizeof( PerObjectUboStruct ) );
+        GfxDevice::Draw( GfxCaptureGlobal::vertexBuffers[ vertexBufferId ], startIndex, endIndex, shader, blendMode, depthFunc, cullMode, fillMode, topology );
+        break;
+    }
+    case GfxCapture::Command::DefineShader:
+    {
+        const std::uint32_t id = reader.Read< std::uint32_t >();
+        const std::string vertexPath = reader.ReadString();
+        const std::string fragmentPath = reader.ReadString();
+
+        if (isLoadPass && id < GfxCaptureGlobal::shaders.count)
+        {
+            GfxCaptureGlobal::shaders[ id ].LoadSPIRV( FileSystem::FileContents( vertexPath.c_str() ), FileSystem::FileContents( fragmentPath.c_str() ) );
+        }
+        break;
+    }
+    case GfxCapture::Command::DefineVertexBuffer:
+    {
+        const std::uint32_t id = reader.Read< std::uint32_t >();
+        const auto format = (VertexBuffer::VertexFormat)reader.Read< std::uint8_t >();
+        const int faceCount = reader.Read< std::int32_t >();
+
+        if (isLoadPass && id < GfxCaptureGlobal::vertexBuffers.count)
+        {
+            CreatePlaceholderVertexBuffer( GfxCaptureGlobal::vertexBuffers[ id ], format, faceCount );
+        }
+        break;
+    }
+    case GfxCapture::Command::DefineRenderTexture:
+    {
+        const std::uint32_t id = reader.Read< std::uint32_t >();
+        const int width = reader.Read< std::int32_t >();
+        const int height = reader.Read< std::int32_t >();
+        const auto dataType = (DataType)reader.Read< std::uint8_t >();
+        const bool isCube = reader.Read< std::uint8_t >() != 0;
+        const bool isMultisampled = reader.Read< std::uint8_t >() != 0;
+
+        if (isLoadPass && id < GfxCaptureGlobal::renderTextures.count)
+        {
+            if (isCube)
+            {
+                GfxCaptureGlobal::renderTextures[ id ].CreateCube( width, dataType, TextureWrap::Clamp, TextureFilter::Linear, "capture render texture" );
+            }
+            else
+            {
+                GfxCaptureGlobal::renderTextures[ id ].Create2D( width, height, dataType, TextureWrap::Clamp, TextureFilter::Linear, "capture render texture",
+                                                                 isMultisampled, RenderTexture::UavFlag::Disabled );
+            }
+        }
+        break;
+    }
+    default:
+        System::Print( "Capture has unknown command %d at offset %u\n", (int)command, (unsigned)reader.offset - 1 );
+        reader.offset = GfxCaptureGlobal::replayStream.size();
+        return false;
+    }
+
+    return true;
+}
+
+int GfxCapture::Load( const char* path )
+{
+    const FileSystem::FileContentsData contents = FileSystem::FileContents( path );
+    GfxCaptureGlobal::Header header;
+
+    if (!contents.isLoaded || contents.data.size() < sizeof( header ))
+    {
+        System::Print( "Could not load capture %s\n", path );
+        return 0;
+    }
+
+    std::memcpy( &header, contents.data.data(), sizeof( header ) );
+
+    if (std::memcmp( header.magic, GfxCaptureGlobal::Header().magic, 4 ) != 0 || header.version != GfxCaptureGlobal::Header().version ||
+        header.uboSize != sizeof( PerObjectUboStruct ))
+    {
+        System::Print( "%s is not a capture from this engine version\n", path );
+        return 0;
+    }
+
+    GfxCaptureGlobal::replayStream = contents.data;
+    GfxCaptureGlobal::frameOffsets.clear();
+    GfxCaptureGlobal::shaders.Allocate( 0 );
+    GfxCaptureGlobal::vertexBuffers.Allocate( 0 );
+    GfxCaptureGlobal::renderTextures.Allocate( 0 );
+    GfxCaptureGlobal::textures.Allocate( 0 );
+    GfxCaptureGlobal::textureCount = 0;
+
+    // Resources are allocated once before creating them so that their addresses stay valid.
+    unsigned shaderCount = 0;
+    unsigned vertexBufferCount = 0;
+    unsigned renderTextureCount = 0;
+
+    for (Reader reader( sizeof( header ) ); !reader.IsAtEnd();)
+    {
+        Reader peek = reader;
+        const Command command = peek.Read< Command >();
+        const unsigned id = peek.Read< std::uint32_t >();
+
+        if (command == Command::DefineShader && id + 1 > shaderCount)
+        {
+            shaderCount = id + 1;
+        }
+        else if (command == Command::DefineVertexBuffer && id + 1 > vertexBufferCount)
+        {
+            vertexBufferCount = id + 1;
+        }
+        else if (command == Command::DefineRenderTexture && id + 1 > renderTextureCount)
+        {
+            renderTextureCount = id + 1;
+        }
+
+        // Skips the command's arguments. Resource arrays are still empty so nothing gets created.
+        ProcessCommand( reader, true );
+    }
+
+    GfxCaptureGlobal::frameOffsets.clear();
+
+    GfxCaptureGlobal::shaders.Allocate( shaderCount );
+    GfxCaptureGlobal::vertexBuffers.Allocate( vertexBufferCount );
+    GfxCaptureGlobal::renderTextures.Allocate( renderTextureCount );
+    GfxCaptureGlobal::textures.Allocate( GfxCaptureGlobal::textureCount );
+
+    for (unsigned i = 0; i < GfxCaptureGlobal::textures.count; ++i)
+    {
+        // Distinct colors so that texture changes stay visible in the replay.
+        std::uint8_t pixels[ 4 * 4 * 4 ];
+
+        for (unsigned p = 0; p < 4 * 4; ++p)
+        {
+            pixels[ p * 4 + 0 ] = (std::uint8_t)(i * 67);
+            pixels[ p * 4 + 1 ] = (std::uint8_t)(i * 131);
+            pixels[ p * 4 + 2 ] = (std::uint8_t)(i * 197);
+            pixels[ p * 4 + 3 ] = 255;
+        }
+
+        GfxCaptureGlobal::textures[ i ].LoadFromData( pixels, 4, 4, "capture texture", DataType::UByte );
+    }
+
+    for (Reader reader( sizeof( header ) ); !reader.IsAtEnd();)
+    {
+        ProcessCommand( reader, true );
+    }
+
+    System::Print( "Loaded capture %s: %u frames, %u shaders, %u vertex buffers, %u render textures, %u textures\n", path, header.frameCount,
+                   shaderCount, vertexBufferCount, renderTextureCount, GfxCaptureGlobal::textureCount );
+
+    return (int)GfxCaptureGlobal::frameOffsets.size();
+}
+
+void GfxCapture::ReplayFrame( int frameIndex )
+{
+    if (frameIndex < 0 || frameIndex >= (int)GfxCaptureGlobal::frameOffsets.size())
+    {
+        System::Print( "ReplayFrame: invalid frame index %d\n", frameIndex );
+        return;
+    }
+
+    Reader reader( GfxCaptureGlobal::frameOffsets[ frameIndex ] );
+
+    while (ProcessCommand( reader, false ))
+    {
+    }
+}
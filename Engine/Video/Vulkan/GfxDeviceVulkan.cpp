@@ -1,14 +1,21 @@
 // This is an independent project of an individual developer. Dear PVS-Studio, please check it.
 // PVS-Studio Static Code Analyzer for C, C++, C#, and Java: http://www.viva64.com
 #include "GfxDevice.hpp"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
 #include <cstdint>
-#include <map>
+#include <fstream>
+#include <mutex>
+#include <thread>
 #include <vector>
 #include <cstring>
 #include <string>
 #include <vulkan/vulkan.h>
 #include "Array.hpp"
 #include "FileSystem.hpp"
+#include "FlatHashMap.hpp"
+#include "GfxCapture.hpp"
 #include "LightTiler.hpp"
 #include "Macros.hpp"
 #include "RenderTexture.hpp"
@@ -26,6 +33,7 @@
 #endif
 
 extern ae3d::Renderer renderer;
+void FlushTextureUploads( bool waitForCompletion ); // Defined in Texture2DVulkan.cpp
 #if VK_USE_PLATFORM_ANDROID_KHR
 ANativeWindow* nativeWindow;
 #endif
@@ -40,9 +48,10 @@ PFN_vkAcquireNextImageKHR acquireNextImageKHR = nullptr;
 PFN_vkQueuePresentKHR queuePresentKHR = nullptr;
 PFN_vkGetShaderInfoAMD getShaderInfoAMD;
 
-constexpr unsigned UI_VERTICE_COUNT = 512 * 1024;
+// UI indices are 16-bit, so more vertices could not be addressed.
+constexpr unsigned UI_VERTICE_COUNT = 64 * 1024;
 constexpr unsigned UI_FACE_COUNT = 128 * 1024;
-constexpr std::uint32_t descriptorSlotCount = 17;
+constexpr std::uint32_t descriptorSlotCount = 18;
 
 namespace Texture2DGlobal
 {
@@ -111,13 +120,14 @@ namespace GfxDeviceGlobal
     VkCommandBuffer postPresentCmdBuffer = VK_NULL_HANDLE;
     VkCommandBuffer computeCmdBuffer = VK_NULL_HANDLE;
     VkCommandBuffer offscreenCmdBuffer = VK_NULL_HANDLE;
-    VkCommandBuffer currentCmdBuffer = VK_NULL_HANDLE;
+    thread_local VkCommandBuffer currentCmdBuffer = VK_NULL_HANDLE;
     VkCommandBuffer texCmdBuffer = VK_NULL_HANDLE;
     
     VkSwapchainKHR swapChain = VK_NULL_HANDLE;
     VkSurfaceKHR surface = VK_NULL_HANDLE;
     VkRenderPass renderPass = VK_NULL_HANDLE;
     VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+    const char* pipelineCachePath = "pipeline_cache.bin";
     VkFormat colorFormat;
     VkFormat depthFormat;
     VkColorSpaceKHR colorSpace;
@@ -135,29 +145,79 @@ namespace GfxDeviceGlobal
     float timings[ 3 ];
     VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
     VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
-    std::map< std::uint64_t, VkPipeline > psoCache;
+    FlatHashMap< VkPipeline > psoCache;
+    std::mutex psoCacheMutex;
     VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
     Array< VkDescriptorSet > descriptorSets;
-    unsigned descriptorSetIndex = 0;
+    std::atomic< unsigned > descriptorSetIndex( 0 );
     std::uint32_t queueNodeIndex = UINT32_MAX;
     std::uint32_t currentBuffer = 0;
     ae3d::RenderTexture* renderTexture0 = nullptr;
     VkFramebuffer frameBuffer0 = VK_NULL_HANDLE;
-    VkImageView boundViews[ ae3d::ComputeShader::SLOT_COUNT ];
-    VkSampler boundSamplers[ 2 ];
+    thread_local VkImageView boundViews[ ae3d::ComputeShader::SLOT_COUNT ];
+    thread_local VkSampler boundSamplers[ 2 ];
     VkSampler linearRepeat;
     Array< VkBuffer > pendingFreeVBs;
     Array< VkDeviceMemory > pendingFreeMemory;
+    Array< VkImage > pendingFreeImages;
+    Array< VkImageView > pendingFreeImageViews;
+    Array< VkSampler > pendingFreeSamplers;
     Array< Ubo > ubos;
-    unsigned currentUbo = 0;
+    thread_local unsigned currentUbo = 0;
+    VkBuffer bonePaletteBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory bonePaletteMemory = VK_NULL_HANDLE;
+    ae3d::Matrix44* bonePaletteData = nullptr;
+    unsigned bonePaletteCapacity = 0;
+    // Matrices uploaded this frame.
+    unsigned bonePaletteCount = 0;
+    std::atomic< unsigned > nextUbo( 0 );
     VkSampleCountFlagBits msaaSampleBits = VK_SAMPLE_COUNT_1_BIT;
     ae3d::LightTiler lightTiler;
-    PerObjectUboStruct perObjectUboStruct;
+    thread_local PerObjectUboStruct perObjectUboStruct;
     ae3d::VertexBuffer uiVertexBuffer;
     ae3d::VertexBuffer::VertexPTC uiVertices[ UI_VERTICE_COUNT ];
-    ae3d::VertexBuffer::Face uiFaces[ UI_FACE_COUNT ];
+    // UI libraries write 16-bit indices.
+    unsigned short uiIndices[ UI_FACE_COUNT * 3 ];
     std::vector< ae3d::VertexBuffer > lineBuffers;
-    VkPipeline cachedPSO;
+    thread_local VkPipeline cachedPSO;
+    VkViewport currentViewport;
+    VkRect2D currentScissor;
+
+    // Secondary command buffers of one recording thread. Pool 0 belongs to the main thread.
+    struct SecondaryCmdPool
+    {
+        VkCommandPool pool = VK_NULL_HANDLE;
+        std::vector< VkCommandBuffer > cmdBuffers;
+        unsigned usedCount = 0;
+    };
+
+    struct RecordingJob
+    {
+        const std::function< void( int, int ) >* recordRange = nullptr;
+        VkCommandBuffer cmdBuffer = VK_NULL_HANDLE;
+        int begin = 0;
+        int end = 0;
+    };
+
+    // Render pass whose contents are recorded into secondary command buffers.
+    VkCommandBuffer passCmdBuffer = VK_NULL_HANDLE;
+    VkRenderPass passRenderPass = VK_NULL_HANDLE;
+    VkFramebuffer passFrameBuffer = VK_NULL_HANDLE;
+    VkCommandBuffer passSecondaryCmdBuffer = VK_NULL_HANDLE;
+    std::vector< VkCommandBuffer > passSecondaryCmdBuffers;
+
+    std::vector< SecondaryCmdPool > secondaryCmdPools;
+    std::vector< std::thread > recordingThreads;
+    std::vector< RecordingJob > recordingJobs;
+    std::mutex recordingMutex;
+    std::condition_variable recordingStarted;
+    std::condition_variable recordingFinished;
+    unsigned recordingGeneration = 0;
+    int pendingRecordingJobs = 0;
+    bool quitRecordingThreads = false;
+    PerObjectUboStruct recordingPerObjectUbo;
+    VkImageView recordingViews[ ae3d::ComputeShader::SLOT_COUNT ];
+    VkSampler recordingSamplers[ 2 ];
 }
 
 namespace ae3d
@@ -180,10 +240,15 @@ namespace ae3d
                 //str += "bloom GPU: " + std::to_string( ::Statistics::GetBloomGpuTimeMS() ) + " ms\n";
                 str += "queue wait: " + std::to_string( ::Statistics::GetQueueWaitTimeMS() ) + " ms \n";
                 str += "frustum cull: " + std::to_string( ::Statistics::GetFrustumCullTimeMS() ) + " ms \n";
+                str += "skinning: " + std::to_string( ::Statistics::GetSkinningTimeMS() ) + " ms (" + std::to_string( ::Statistics::GetSkinPaletteUpdates() ) + " palettes)\n";
+                str += "texture upload: " + std::to_string( ::Statistics::GetTextureUploadMBPerSecond() ) + " MB/s\n";
+                str += "texture cache: " + std::to_string( ::Statistics::GetTextureCacheHits() ) + " hits, " + std::to_string( ::Statistics::GetTextureCacheMisses() ) +
+                       " misses, " + std::to_string( Texture2D::GetCacheMemoryUsage() / (1024 * 1024) ) + " MiB\n";
                 str += "draw calls: " + std::to_string( ::Statistics::GetDrawCalls() ) + "\n";
                 str += "barrier calls: " + std::to_string( ::Statistics::GetBarrierCalls() ) + "\n";
 				str += "fence calls: " + std::to_string( ::Statistics::GetFenceCalls() ) + "\n";
 				str += "pso changes: " + std::to_string( ::Statistics::GetPSOBindCalls() ) + "\n";
+                str += "avoided binds: " + std::to_string( ::Statistics::GetAvoidedBinds() ) + "\n";
                 str += "queue submit calls: " + std::to_string( ::Statistics::GetQueueSubmitCalls() ) + "\n";
                 str += "mem alloc calls: " + std::to_string( ::Statistics::GetAllocCalls() ) + " (frame), " + std::to_string( ::Statistics::GetTotalAllocCalls() ) + " (total)\n";
                 str += "triangles: " + std::to_string( ::Statistics::GetTriangleCount() ) + "\n";
@@ -332,7 +397,7 @@ namespace ae3d
     }
 
     void CreatePSO( VertexBuffer& vertexBuffer, ae3d::Shader& shader, ae3d::GfxDevice::BlendMode blendMode, ae3d::GfxDevice::DepthFunc depthFunc,
-                    ae3d::GfxDevice::CullMode cullMode, ae3d::GfxDevice::FillMode fillMode, VkRenderPass renderPass, ae3d::GfxDevice::PrimitiveTopology topology, std::uint64_t hash )
+                    ae3d::GfxDevice::CullMode cullMode, ae3d::GfxDevice::FillMode fillMode, ae3d::RenderTexture* target, ae3d::GfxDevice::PrimitiveTopology topology, std::uint64_t hash )
     {
         VkPipelineInputAssemblyStateCreateInfo inputAssemblyState = {};
         inputAssemblyState.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
@@ -427,7 +492,7 @@ namespace ae3d
         multisampleState.pSampleMask = nullptr;
         multisampleState.rasterizationSamples = GfxDeviceGlobal::msaaSampleBits;
         
-        if (GfxDeviceGlobal::renderTexture0 && GfxDeviceGlobal::renderTexture0->GetSampleCount() == 1)
+        if (target && target->GetSampleCount() == 1)
         {
             multisampleState.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
         }
@@ -443,8 +508,8 @@ namespace ae3d
 
         pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
         pipelineCreateInfo.layout = GfxDeviceGlobal::pipelineLayout;
-        pipelineCreateInfo.renderPass = renderPass != VK_NULL_HANDLE ? renderPass : GfxDeviceGlobal::renderPass;
-        pipelineCreateInfo.pVertexInputState = vertexBuffer.GetInputState();
+        pipelineCreateInfo.renderPass = target ? target->GetRenderPass() : GfxDeviceGlobal::renderPass;
+        pipelineCreateInfo.pVertexInputState = vertexBuffer.GetInputState( shader.GetVertexInput() );
         pipelineCreateInfo.pInputAssemblyState = &inputAssemblyState;
         pipelineCreateInfo.pRasterizationState = &rasterizationState;
         pipelineCreateInfo.pColorBlendState = &colorBlendState;
@@ -462,7 +527,60 @@ namespace ae3d
         AE3D_CHECK_VULKAN( err, "vkCreateGraphicsPipelines" );
         debug::SetObjectName( GfxDeviceGlobal::device, (std::uint64_t)pso, VK_OBJECT_TYPE_PIPELINE, "graphics pipeline" );
 
-        GfxDeviceGlobal::psoCache[ hash ] = pso;
+        GfxDeviceGlobal::psoCache.Insert( hash, pso );
+    }
+
+    void LoadPipelineCache( VkPipelineCacheCreateInfo& outCreateInfo, std::vector< char >& outData )
+    {
+        std::ifstream ifs( GfxDeviceGlobal::pipelineCachePath, std::ios::binary | std::ios::ate );
+
+        if (!ifs)
+        {
+            return;
+        }
+
+        outData.resize( (std::size_t)ifs.tellg() );
+        ifs.seekg( 0 );
+        ifs.read( outData.data(), outData.size() );
+
+        // Header layout is VkPipelineCacheHeaderVersionOne. A cache from another GPU or driver version is discarded.
+        const std::size_t headerSize = 16 + VK_UUID_SIZE;
+        std::uint32_t header[ 4 ] = {};
+
+        if (outData.size() >= headerSize)
+        {
+            std::memcpy( header, outData.data(), sizeof( header ) );
+        }
+
+        if (outData.size() < headerSize || header[ 1 ] != VK_PIPELINE_CACHE_HEADER_VERSION_ONE ||
+            header[ 2 ] != GfxDeviceGlobal::properties.vendorID || header[ 3 ] != GfxDeviceGlobal::properties.deviceID ||
+            std::memcmp( outData.data() + 16, GfxDeviceGlobal::properties.pipelineCacheUUID, VK_UUID_SIZE ) != 0)
+        {
+            System::Print( "Ignoring pipeline cache %s because it was created by another device or driver.\n", GfxDeviceGlobal::pipelineCachePath );
+            outData.clear();
+            return;
+        }
+
+        outCreateInfo.initialDataSize = outData.size();
+        outCreateInfo.pInitialData = outData.data();
+    }
+
+    void SavePipelineCache()
+    {
+        std::size_t dataSize = 0;
+        VkResult err = vkGetPipelineCacheData( GfxDeviceGlobal::device, GfxDeviceGlobal::pipelineCache, &dataSize, nullptr );
+        AE3D_CHECK_VULKAN( err, "vkGetPipelineCacheData" );
+
+        std::vector< char > data( dataSize );
+        err = vkGetPipelineCacheData( GfxDeviceGlobal::device, GfxDeviceGlobal::pipelineCache, &dataSize, data.data() );
+        AE3D_CHECK_VULKAN( err, "vkGetPipelineCacheData" );
+
+        std::ofstream ofs( GfxDeviceGlobal::pipelineCachePath, std::ios::binary );
+
+        if (!ofs.write( data.data(), dataSize ))
+        {
+            System::Print( "Could not write pipeline cache to %s\n", GfxDeviceGlobal::pipelineCachePath );
+        }
     }
 
     void AllocateCommandBuffers()
@@ -1323,7 +1441,7 @@ namespace ae3d
     {
         const int AE3D_DESCRIPTOR_SETS_COUNT = 5550;
 
-        const VkDescriptorPoolSize typeCounts[ descriptorSlotCount ] =
+        const VkDescriptorPoolSize typeCounts[] =
         {
             { VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, AE3D_DESCRIPTOR_SETS_COUNT },
             { VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, AE3D_DESCRIPTOR_SETS_COUNT },
@@ -1340,13 +1458,14 @@ namespace ae3d
             { VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER, AE3D_DESCRIPTOR_SETS_COUNT },
             { VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER, AE3D_DESCRIPTOR_SETS_COUNT },
             { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, AE3D_DESCRIPTOR_SETS_COUNT },
-            { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, AE3D_DESCRIPTOR_SETS_COUNT },
+            // Slots 15 and 17 (bone palette).
+            { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, AE3D_DESCRIPTOR_SETS_COUNT * 2 },
             { VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER, AE3D_DESCRIPTOR_SETS_COUNT }
         };
 
         VkDescriptorPoolCreateInfo descriptorPoolInfo = {};
         descriptorPoolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-        descriptorPoolInfo.poolSizeCount = descriptorSlotCount;
+        descriptorPoolInfo.poolSizeCount = sizeof( typeCounts ) / sizeof( typeCounts[ 0 ] );
         descriptorPoolInfo.pPoolSizes = typeCounts;
         descriptorPoolInfo.maxSets = AE3D_DESCRIPTOR_SETS_COUNT;
         descriptorPoolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
@@ -1371,8 +1490,7 @@ namespace ae3d
 
     VkDescriptorSet AllocateDescriptorSet( const VkDescriptorBufferInfo& uboDesc, const VkImageView& view0, VkSampler sampler0, const VkImageView& view1, VkSampler sampler1, const VkImageView& view2, const VkImageView& view3, const VkImageView& view4, const VkImageView& view14 )
     {
-        VkDescriptorSet outDescriptorSet = GfxDeviceGlobal::descriptorSets[ GfxDeviceGlobal::descriptorSetIndex ];
-        GfxDeviceGlobal::descriptorSetIndex = (GfxDeviceGlobal::descriptorSetIndex + 1) % GfxDeviceGlobal::descriptorSets.count;
+        VkDescriptorSet outDescriptorSet = GfxDeviceGlobal::descriptorSets[ GfxDeviceGlobal::descriptorSetIndex++ % GfxDeviceGlobal::descriptorSets.count ];
 
         VkDescriptorImageInfo sampler0Desc = {};
         sampler0Desc.sampler = sampler0;
@@ -1546,6 +1664,18 @@ namespace ae3d
         sets[ 16 ].pTexelBufferView = &particleTileBufferView;
         sets[ 16 ].dstBinding = 16;
 
+        VkDescriptorBufferInfo bonePaletteDesc = {};
+        bonePaletteDesc.buffer = GfxDeviceGlobal::bonePaletteBuffer;
+        bonePaletteDesc.range = VK_WHOLE_SIZE;
+
+        // Binding 17 : Bone palette.
+        sets[ 17 ].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        sets[ 17 ].dstSet = outDescriptorSet;
+        sets[ 17 ].descriptorCount = 1;
+        sets[ 17 ].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        sets[ 17 ].pBufferInfo = &bonePaletteDesc;
+        sets[ 17 ].dstBinding = 17;
+
         vkUpdateDescriptorSets( GfxDeviceGlobal::device, descriptorSlotCount, sets, 0, nullptr );
 
         return outDescriptorSet;
@@ -1657,6 +1787,12 @@ namespace ae3d
         layoutBindings[ 16 ].descriptorCount = 1;
         layoutBindings[ 16 ].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
 
+        // Binding 17 : Bone palette
+        layoutBindings[ 17 ].binding = 17;
+        layoutBindings[ 17 ].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        layoutBindings[ 17 ].descriptorCount = 1;
+        layoutBindings[ 17 ].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
         VkDescriptorSetLayoutCreateInfo descriptorLayout = {};
         descriptorLayout.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
         descriptorLayout.bindingCount = descriptorSlotCount;
@@ -1732,6 +1868,8 @@ namespace ae3d
 
         VkPipelineCacheCreateInfo pipelineCacheCreateInfo = {};
         pipelineCacheCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+        std::vector< char > pipelineCacheData;
+        LoadPipelineCache( pipelineCacheCreateInfo, pipelineCacheData );
         VkResult err = vkCreatePipelineCache( GfxDeviceGlobal::device, &pipelineCacheCreateInfo, nullptr, &GfxDeviceGlobal::pipelineCache );
         AE3D_CHECK_VULKAN( err, "vkCreatePipelineCache" );
 
@@ -1781,6 +1919,267 @@ void UploadPerObjectUbo()
     std::memcpy( &ae3d::GfxDevice::GetCurrentUbo()[ 0 ], &GfxDeviceGlobal::perObjectUboStruct, sizeof( GfxDeviceGlobal::perObjectUboStruct ) );
 }
 
+static VkCommandBuffer AcquireSecondaryCmdBuffer( unsigned poolIndex )
+{
+    GfxDeviceGlobal::SecondaryCmdPool& cmdPool = GfxDeviceGlobal::secondaryCmdPools[ poolIndex ];
+
+    if (cmdPool.usedCount == cmdPool.cmdBuffers.size())
+    {
+        VkCommandBufferAllocateInfo allocInfo = {};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.commandPool = cmdPool.pool;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+        allocInfo.commandBufferCount = 1;
+
+        VkCommandBuffer cmdBuffer = VK_NULL_HANDLE;
+        VkResult err = vkAllocateCommandBuffers( GfxDeviceGlobal::device, &allocInfo, &cmdBuffer );
+        AE3D_CHECK_VULKAN( err, "vkAllocateCommandBuffers secondary" );
+        debug::SetObjectName( GfxDeviceGlobal::device, (std::uint64_t)cmdBuffer, VK_OBJECT_TYPE_COMMAND_BUFFER, "secondaryCmdBuffer" );
+
+        cmdPool.cmdBuffers.push_back( cmdBuffer );
+    }
+
+    return cmdPool.cmdBuffers[ cmdPool.usedCount++ ];
+}
+
+// Begins a secondary command buffer that continues the current pass and makes it current on the calling thread.
+static void BeginSecondaryCmdBuffer( VkCommandBuffer cmdBuffer )
+{
+    VkCommandBufferInheritanceInfo inheritanceInfo = {};
+    inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    inheritanceInfo.renderPass = GfxDeviceGlobal::passRenderPass;
+    inheritanceInfo.subpass = 0;
+    inheritanceInfo.framebuffer = GfxDeviceGlobal::passFrameBuffer;
+
+    VkCommandBufferBeginInfo cmdBufInfo = {};
+    cmdBufInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    cmdBufInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT | VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    cmdBufInfo.pInheritanceInfo = &inheritanceInfo;
+
+    VkResult err = vkBeginCommandBuffer( cmdBuffer, &cmdBufInfo );
+    AE3D_CHECK_VULKAN( err, "vkBeginCommandBuffer secondary" );
+
+    // Dynamic state is not inherited from the primary command buffer.
+    vkCmdSetViewport( cmdBuffer, 0, 1, &GfxDeviceGlobal::currentViewport );
+    vkCmdSetScissor( cmdBuffer, 0, 1, &GfxDeviceGlobal::currentScissor );
+
+    GfxDeviceGlobal::currentCmdBuffer = cmdBuffer;
+    GfxDeviceGlobal::cachedPSO = VK_NULL_HANDLE;
+}
+
+static VkSubpassContents GetPassContents()
+{
+    return GfxDeviceGlobal::recordingThreads.empty() ? VK_SUBPASS_CONTENTS_INLINE : VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS;
+}
+
+// Must be called after vkCmdBeginRenderPass. When recording threads are enabled, the pass is recorded into secondary command buffers.
+static void BeginPassContents( VkCommandBuffer cmdBuffer, VkRenderPass renderPass, VkFramebuffer frameBuffer, std::uint32_t width, std::uint32_t height )
+{
+    GfxDeviceGlobal::currentViewport = { 0, 0, (float)width, (float)height, 0, 1 };
+    GfxDeviceGlobal::currentScissor = { { 0, 0 }, { width, height } };
+
+    if (GetPassContents() == VK_SUBPASS_CONTENTS_INLINE)
+    {
+        return;
+    }
+
+    ae3d::System::Assert( GfxDeviceGlobal::passCmdBuffer == VK_NULL_HANDLE, "Render passes cannot be nested" );
+
+    GfxDeviceGlobal::passCmdBuffer = cmdBuffer;
+    GfxDeviceGlobal::passRenderPass = renderPass;
+    GfxDeviceGlobal::passFrameBuffer = frameBuffer;
+    GfxDeviceGlobal::passSecondaryCmdBuffers.clear();
+    GfxDeviceGlobal::passSecondaryCmdBuffer = AcquireSecondaryCmdBuffer( 0 );
+    GfxDeviceGlobal::passSecondaryCmdBuffers.push_back( GfxDeviceGlobal::passSecondaryCmdBuffer );
+    BeginSecondaryCmdBuffer( GfxDeviceGlobal::passSecondaryCmdBuffer );
+}
+
+// Must be called before vkCmdEndRenderPass. Executes the pass's secondary command buffers in recording order.
+static void EndPassContents()
+{
+    if (GfxDeviceGlobal::passCmdBuffer == VK_NULL_HANDLE)
+    {
+        return;
+    }
+
+    VkResult err = vkEndCommandBuffer( GfxDeviceGlobal::passSecondaryCmdBuffer );
+    AE3D_CHECK_VULKAN( err, "vkEndCommandBuffer secondary" );
+
+    vkCmdExecuteCommands( GfxDeviceGlobal::passCmdBuffer, (std::uint32_t)GfxDeviceGlobal::passSecondaryCmdBuffers.size(), GfxDeviceGlobal::passSecondaryCmdBuffers.data() );
+
+    if (GfxDeviceGlobal::currentCmdBuffer == GfxDeviceGlobal::passSecondaryCmdBuffer)
+    {
+        GfxDeviceGlobal::currentCmdBuffer = GfxDeviceGlobal::passCmdBuffer;
+    }
+
+    GfxDeviceGlobal::passCmdBuffer = VK_NULL_HANDLE;
+    GfxDeviceGlobal::passSecondaryCmdBuffer = VK_NULL_HANDLE;
+}
+
+static void RecordJob( const GfxDeviceGlobal::RecordingJob& job )
+{
+    GfxDeviceGlobal::perObjectUboStruct = GfxDeviceGlobal::recordingPerObjectUbo;
+    std::memcpy( GfxDeviceGlobal::boundViews, GfxDeviceGlobal::recordingViews, sizeof( GfxDeviceGlobal::boundViews ) );
+    std::memcpy( GfxDeviceGlobal::boundSamplers, GfxDeviceGlobal::recordingSamplers, sizeof( GfxDeviceGlobal::boundSamplers ) );
+
+    BeginSecondaryCmdBuffer( job.cmdBuffer );
+    (*job.recordRange)( job.begin, job.end );
+
+    VkResult err = vkEndCommandBuffer( job.cmdBuffer );
+    AE3D_CHECK_VULKAN( err, "vkEndCommandBuffer secondary" );
+}
+
+static void RecordingThreadMain( unsigned jobIndex )
+{
+    unsigned generation = 0;
+
+    while (true)
+    {
+        {
+            std::unique_lock< std::mutex > lock( GfxDeviceGlobal::recordingMutex );
+            GfxDeviceGlobal::recordingStarted.wait( lock, [ &generation ]() { return GfxDeviceGlobal::quitRecordingThreads || GfxDeviceGlobal::recordingGeneration != generation; } );
+
+            if (GfxDeviceGlobal::quitRecordingThreads)
+            {
+                return;
+            }
+
+            generation = GfxDeviceGlobal::recordingGeneration;
+        }
+
+        if (GfxDeviceGlobal::recordingJobs[ jobIndex ].recordRange)
+        {
+            RecordJob( GfxDeviceGlobal::recordingJobs[ jobIndex ] );
+        }
+
+        {
+            std::lock_guard< std::mutex > lock( GfxDeviceGlobal::recordingMutex );
+            --GfxDeviceGlobal::pendingRecordingJobs;
+        }
+
+        GfxDeviceGlobal::recordingFinished.notify_one();
+    }
+}
+
+static void DestroyRecordingThreads()
+{
+    {
+        std::lock_guard< std::mutex > lock( GfxDeviceGlobal::recordingMutex );
+        GfxDeviceGlobal::quitRecordingThreads = true;
+    }
+
+    GfxDeviceGlobal::recordingStarted.notify_all();
+
+    for (auto& thread : GfxDeviceGlobal::recordingThreads)
+    {
+        thread.join();
+    }
+
+    GfxDeviceGlobal::recordingThreads.clear();
+    GfxDeviceGlobal::recordingJobs.clear();
+    GfxDeviceGlobal::recordingGeneration = 0;
+    GfxDeviceGlobal::quitRecordingThreads = false;
+
+    for (auto& cmdPool : GfxDeviceGlobal::secondaryCmdPools)
+    {
+        vkDestroyCommandPool( GfxDeviceGlobal::device, cmdPool.pool, nullptr );
+    }
+
+    GfxDeviceGlobal::secondaryCmdPools.clear();
+}
+
+void ae3d::GfxDevice::SetRecordingThreadCount( int threadCount )
+{
+    System::Assert( GfxDeviceGlobal::passCmdBuffer == VK_NULL_HANDLE, "Recording thread count cannot be changed inside a render pass" );
+
+    if (!GfxDeviceGlobal::secondaryCmdPools.empty())
+    {
+        VkResult err = vkDeviceWaitIdle( GfxDeviceGlobal::device );
+        AE3D_CHECK_VULKAN( err, "vkDeviceWaitIdle" );
+    }
+
+    DestroyRecordingThreads();
+
+    if (threadCount <= 0)
+    {
+        return;
+    }
+
+    GfxDeviceGlobal::secondaryCmdPools.resize( threadCount + 1 );
+
+    for (auto& cmdPool : GfxDeviceGlobal::secondaryCmdPools)
+    {
+        VkCommandPoolCreateInfo cmdPoolInfo = {};
+        cmdPoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        cmdPoolInfo.queueFamilyIndex = GfxDeviceGlobal::queueNodeIndex;
+        cmdPoolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+        VkResult err = vkCreateCommandPool( GfxDeviceGlobal::device, &cmdPoolInfo, nullptr, &cmdPool.pool );
+        AE3D_CHECK_VULKAN( err, "vkCreateCommandPool secondary" );
+    }
+
+    GfxDeviceGlobal::recordingJobs.resize( threadCount );
+
+    for (int threadIndex = 0; threadIndex < threadCount; ++threadIndex)
+    {
+        GfxDeviceGlobal::recordingThreads.push_back( std::thread( RecordingThreadMain, (unsigned)threadIndex ) );
+    }
+}
+
+void ae3d::GfxDevice::RecordDrawsInParallel( int drawCount, const std::function< void( int, int ) >& recordRange )
+{
+    // Smaller ranges are not worth the cost of an extra secondary command buffer.
+    const int minDrawsPerJob = 64;
+    const int jobCount = std::min( (int)GfxDeviceGlobal::recordingThreads.size() + 1, drawCount / minDrawsPerJob );
+
+    // Capture needs draws in submission order.
+    if (GfxDeviceGlobal::passCmdBuffer == VK_NULL_HANDLE || jobCount < 2 || GfxCapture::IsCapturing())
+    {
+        recordRange( 0, drawCount );
+        return;
+    }
+
+    GfxDeviceGlobal::recordingPerObjectUbo = GfxDeviceGlobal::perObjectUboStruct;
+    std::memcpy( GfxDeviceGlobal::recordingViews, GfxDeviceGlobal::boundViews, sizeof( GfxDeviceGlobal::boundViews ) );
+    std::memcpy( GfxDeviceGlobal::recordingSamplers, GfxDeviceGlobal::boundSamplers, sizeof( GfxDeviceGlobal::boundSamplers ) );
+
+    VkResult err = vkEndCommandBuffer( GfxDeviceGlobal::passSecondaryCmdBuffer );
+    AE3D_CHECK_VULKAN( err, "vkEndCommandBuffer secondary" );
+
+    // Worker threads record the first ranges, this thread records the last one and continues the pass after it.
+    const int drawsPerJob = (drawCount + jobCount - 1) / jobCount;
+
+    for (unsigned jobIndex = 0; jobIndex < GfxDeviceGlobal::recordingJobs.size(); ++jobIndex)
+    {
+        GfxDeviceGlobal::RecordingJob& job = GfxDeviceGlobal::recordingJobs[ jobIndex ];
+        job.recordRange = nullptr;
+
+        if ((int)jobIndex < jobCount - 1)
+        {
+            job.recordRange = &recordRange;
+            job.begin = jobIndex * drawsPerJob;
+            job.end = std::min( drawCount, job.begin + drawsPerJob );
+            job.cmdBuffer = AcquireSecondaryCmdBuffer( jobIndex + 1 );
+            GfxDeviceGlobal::passSecondaryCmdBuffers.push_back( job.cmdBuffer );
+        }
+    }
+
+    {
+        std::lock_guard< std::mutex > lock( GfxDeviceGlobal::recordingMutex );
+        ++GfxDeviceGlobal::recordingGeneration;
+        GfxDeviceGlobal::pendingRecordingJobs = (int)GfxDeviceGlobal::recordingThreads.size();
+    }
+
+    GfxDeviceGlobal::recordingStarted.notify_all();
+
+    GfxDeviceGlobal::passSecondaryCmdBuffer = AcquireSecondaryCmdBuffer( 0 );
+    GfxDeviceGlobal::passSecondaryCmdBuffers.push_back( GfxDeviceGlobal::passSecondaryCmdBuffer );
+    BeginSecondaryCmdBuffer( GfxDeviceGlobal::passSecondaryCmdBuffer );
+    recordRange( std::min( drawCount, (jobCount - 1) * drawsPerJob ), drawCount );
+
+    std::unique_lock< std::mutex > lock( GfxDeviceGlobal::recordingMutex );
+    GfxDeviceGlobal::recordingFinished.wait( lock, []() { return GfxDeviceGlobal::pendingRecordingJobs == 0; } );
+}
+
 void ae3d::GfxDevice::Init( int width, int height )
 {
     GfxDevice::backBufferWidth = width;
@@ -1799,20 +2198,39 @@ void ae3d::GfxDevice::DrawUI( int scX, int scY, int scWidth, int scHeight, int e
     Draw( GfxDeviceGlobal::uiVertexBuffer, offset, offset + elemCount, renderer.builtinShaders.uiShader, BlendMode::AlphaBlend, DepthFunc::NoneWriteOff, CullMode::Off, FillMode::Solid, GfxDevice::PrimitiveTopology::Triangles );
 }
 
+void ae3d::GfxDevice::CreatePSOIfMissing( VertexBuffer& vertexBuffer, Shader& shader, BlendMode blendMode, DepthFunc depthFunc,
+                                          CullMode cullMode, FillMode fillMode, PrimitiveTopology topology, RenderTexture* target )
+{
+    if (shader.GetVertexInfo().module == VK_NULL_HANDLE || shader.GetFragmentInfo().module == VK_NULL_HANDLE)
+    {
+        return;
+    }
+
+    const std::uint64_t psoHash = GetPSOHash( vertexBuffer, shader, blendMode, depthFunc, cullMode, fillMode, target ? target->GetRenderPass() : VK_NULL_HANDLE, topology );
+
+    std::lock_guard< std::mutex > lock( GfxDeviceGlobal::psoCacheMutex );
+
+    if (GfxDeviceGlobal::psoCache.Find( psoHash ) == nullptr)
+    {
+        CreatePSO( vertexBuffer, shader, blendMode, depthFunc, cullMode, fillMode, target, topology, psoHash );
+    }
+}
+
 void ae3d::GfxDevice::ResetPSOCache()
 {
-    GfxDeviceGlobal::psoCache.clear();
+    std::lock_guard< std::mutex > lock( GfxDeviceGlobal::psoCacheMutex );
+    GfxDeviceGlobal::psoCache.Clear();
 }
 
 void ae3d::GfxDevice::MapUIVertexBuffer( int /*vertexSize*/, int /*indexSize*/, void** outMappedVertices, void** outMappedIndices )
 {
     *outMappedVertices = GfxDeviceGlobal::uiVertices;
-    *outMappedIndices = GfxDeviceGlobal::uiFaces;
+    *outMappedIndices = GfxDeviceGlobal::uiIndices;
 }
 
 void ae3d::GfxDevice::UnmapUIVertexBuffer()
 {
-    GfxDeviceGlobal::uiVertexBuffer.UpdateDynamic( GfxDeviceGlobal::uiFaces, UI_FACE_COUNT, GfxDeviceGlobal::uiVertices, UI_VERTICE_COUNT );
+    GfxDeviceGlobal::uiVertexBuffer.UpdateDynamic( GfxDeviceGlobal::uiIndices, UI_FACE_COUNT, GfxDeviceGlobal::uiVertices, UI_VERTICE_COUNT );
 }
 
 void ae3d::GfxDevice::BeginDepthNormalsGpuQuery()
@@ -1855,6 +2273,8 @@ void ae3d::GfxDevice::PopGroupMarker()
 
 void ae3d::GfxDevice::BeginRenderPassAndCommandBuffer()
 {
+    GfxCapture::Record( GfxCapture::Command::BeginRenderPassAndCommandBuffer );
+
     VkClearValue clearValues[ 3 ];
     if (GfxDeviceGlobal::msaaSampleBits != VK_SAMPLE_COUNT_1_BIT)
     {
@@ -1888,7 +2308,8 @@ void ae3d::GfxDevice::BeginRenderPassAndCommandBuffer()
     renderPassBeginInfo.pClearValues = clearValues;
     renderPassBeginInfo.framebuffer = GfxDeviceGlobal::frameBuffers[ GfxDeviceGlobal::currentBuffer ];
 
-    vkCmdBeginRenderPass( GfxDeviceGlobal::currentCmdBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE );
+    vkCmdBeginRenderPass( GfxDeviceGlobal::currentCmdBuffer, &renderPassBeginInfo, GetPassContents() );
+    BeginPassContents( GfxDeviceGlobal::currentCmdBuffer, GfxDeviceGlobal::renderPass, renderPassBeginInfo.framebuffer, width, height );
 
     VkViewport viewport = {};
     viewport.height = (float)height;
@@ -1907,6 +2328,8 @@ void ae3d::GfxDevice::BeginRenderPassAndCommandBuffer()
 
 void ae3d::GfxDevice::BeginRenderPass()
 {
+    GfxCapture::Record( GfxCapture::Command::BeginRenderPass );
+
     const uint32_t width = GfxDeviceGlobal::renderTexture0 ? GfxDeviceGlobal::renderTexture0->GetWidth() : WindowGlobal::windowWidth;
     const uint32_t height = GfxDeviceGlobal::renderTexture0 ? GfxDeviceGlobal::renderTexture0->GetHeight() : WindowGlobal::windowHeight;
 
@@ -1935,11 +2358,14 @@ void ae3d::GfxDevice::BeginRenderPass()
     renderPassBeginInfo.pClearValues = clearValues;
     renderPassBeginInfo.framebuffer = GfxDeviceGlobal::frameBuffers[ GfxDeviceGlobal::currentBuffer ];
 
-    vkCmdBeginRenderPass( GfxDeviceGlobal::currentCmdBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE );
+    vkCmdBeginRenderPass( GfxDeviceGlobal::currentCmdBuffer, &renderPassBeginInfo, GetPassContents() );
+    BeginPassContents( GfxDeviceGlobal::currentCmdBuffer, GfxDeviceGlobal::renderPass, renderPassBeginInfo.framebuffer, width, height );
 }
 
 void ae3d::GfxDevice::EndRenderPass()
 {
+    GfxCapture::Record( GfxCapture::Command::EndRenderPass );
+    EndPassContents();
     vkCmdEndRenderPass( GfxDeviceGlobal::drawCmdBuffers[ GfxDeviceGlobal::currentBuffer ] );
 }
 
@@ -1951,6 +2377,8 @@ void ae3d::GfxDevice::EndCommandBuffer()
 
 void ae3d::GfxDevice::EndRenderPassAndCommandBuffer()
 {
+    GfxCapture::Record( GfxCapture::Command::EndRenderPassAndCommandBuffer );
+    EndPassContents();
     vkCmdEndRenderPass( GfxDeviceGlobal::drawCmdBuffers[ GfxDeviceGlobal::currentBuffer ] );
 
     VkResult err = vkEndCommandBuffer( GfxDeviceGlobal::currentCmdBuffer );
@@ -1972,8 +2400,9 @@ void ae3d::GfxDevice::GetGpuMemoryUsage( unsigned& outUsedMBytes, unsigned& outB
     outBudgetMBytes = 0;
 }
 
-void ae3d::GfxDevice::ClearScreen( unsigned /*clearFlags*/ )
+void ae3d::GfxDevice::ClearScreen( unsigned clearFlags )
 {
+    GfxCapture::RecordClearScreen( clearFlags );
 }
 
 void ae3d::GfxDevice::DrawLines( int handle, Shader& shader )
@@ -1988,6 +2417,8 @@ void ae3d::GfxDevice::DrawLines( int handle, Shader& shader )
 
 void ae3d::GfxDevice::SetViewport( int aViewport[ 4 ] )
 {
+    GfxCapture::RecordRect( GfxCapture::Command::SetViewport, aViewport );
+
     VkViewport viewport = {};
     viewport.x = (float)aViewport[ 0 ];
     viewport.y = (float)aViewport[ 1 ];
@@ -1996,16 +2427,20 @@ void ae3d::GfxDevice::SetViewport( int aViewport[ 4 ] )
     viewport.minDepth = 0.0f;
     viewport.maxDepth = 1.0f;
 
+    GfxDeviceGlobal::currentViewport = viewport;
     vkCmdSetViewport( GfxDeviceGlobal::currentCmdBuffer, 0, 1, &viewport );    
 }
 
 void ae3d::GfxDevice::SetScissor( int aScissor[ 4 ] )
 {
+    GfxCapture::RecordRect( GfxCapture::Command::SetScissor, aScissor );
+
     VkRect2D scissor = {};
     scissor.extent.width = (std::uint32_t)aScissor[ 2 ];
     scissor.extent.height = (std::uint32_t)aScissor[ 3 ];
     scissor.offset.x = (std::uint32_t)aScissor[ 0 ];
     scissor.offset.y = (std::uint32_t)aScissor[ 1 ];
+    GfxDeviceGlobal::currentScissor = scissor;
     vkCmdSetScissor( GfxDeviceGlobal::currentCmdBuffer, 0, 1, &scissor );
 }
 
@@ -2046,11 +2481,25 @@ void ae3d::GfxDevice::Draw( VertexBuffer& vertexBuffer, int startIndex, int endI
         return;
     }
 
+    if (GfxCapture::IsCapturing())
+    {
+        const std::uint64_t textures[ GfxCapture::TextureSlotCount ] = { (std::uint64_t)GfxDeviceGlobal::boundViews[ 0 ], (std::uint64_t)GfxDeviceGlobal::boundViews[ 1 ],
+                                                                         (std::uint64_t)GfxDeviceGlobal::boundViews[ 2 ], (std::uint64_t)GfxDeviceGlobal::boundViews[ 3 ] };
+        GfxCapture::RecordDraw( vertexBuffer, startIndex, endIndex, shader, blendMode, depthFunc, cullMode, fillMode, topology, GfxDeviceGlobal::perObjectUboStruct, textures );
+    }
+
     const std::uint64_t psoHash = GetPSOHash( vertexBuffer, shader, blendMode, depthFunc, cullMode, fillMode, GfxDeviceGlobal::renderTexture0 ? GfxDeviceGlobal::renderTexture0->GetRenderPass() : VK_NULL_HANDLE, topology );
 
-    if (GfxDeviceGlobal::psoCache.find( psoHash ) == std::end( GfxDeviceGlobal::psoCache ))
+    VkPipeline pso = VK_NULL_HANDLE;
     {
-        CreatePSO( vertexBuffer, shader, blendMode, depthFunc, cullMode, fillMode, GfxDeviceGlobal::renderTexture0 ? GfxDeviceGlobal::renderTexture0->GetRenderPass() : VK_NULL_HANDLE, topology, psoHash );
+        std::lock_guard< std::mutex > lock( GfxDeviceGlobal::psoCacheMutex );
+
+        if (GfxDeviceGlobal::psoCache.Find( psoHash ) == nullptr)
+        {
+            CreatePSO( vertexBuffer, shader, blendMode, depthFunc, cullMode, fillMode, GfxDeviceGlobal::renderTexture0, topology, psoHash );
+        }
+
+        pso = *GfxDeviceGlobal::psoCache.Find( psoHash );
     }
 
     const unsigned activePointLights = GfxDeviceGlobal::lightTiler.GetPointLightCount();
@@ -2072,21 +2521,23 @@ void ae3d::GfxDevice::Draw( VertexBuffer& vertexBuffer, int startIndex, int endI
     vkCmdBindDescriptorSets( GfxDeviceGlobal::currentCmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
                              GfxDeviceGlobal::pipelineLayout, 0, 1, &descriptorSet, 0, nullptr );
 
-    VkPipeline pso = GfxDeviceGlobal::psoCache[ psoHash ];
-    
     if (GfxDeviceGlobal::cachedPSO != pso)
     {
         GfxDeviceGlobal::cachedPSO = pso;
         vkCmdBindPipeline( GfxDeviceGlobal::currentCmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pso );
         Statistics::IncPSOBindCalls();
     }
+    else
+    {
+        Statistics::IncAvoidedBinds();
+    }
 
     VkDeviceSize offsets[ 1 ] = { 0 };
-    vkCmdBindVertexBuffers( GfxDeviceGlobal::currentCmdBuffer, VertexBuffer::VERTEX_BUFFER_BIND_ID, 1, vertexBuffer.GetVertexBuffer(), offsets );
+    vkCmdBindVertexBuffers( GfxDeviceGlobal::currentCmdBuffer, VertexBuffer::VERTEX_BUFFER_BIND_ID, 1, vertexBuffer.GetVertexBuffer( shader.GetVertexInput() ), offsets );
 
     if (topology == PrimitiveTopology::Triangles)
     {
-        vkCmdBindIndexBuffer( GfxDeviceGlobal::currentCmdBuffer, *vertexBuffer.GetIndexBuffer(), 0, VK_INDEX_TYPE_UINT16 );
+        vkCmdBindIndexBuffer( GfxDeviceGlobal::currentCmdBuffer, *vertexBuffer.GetIndexBuffer(), 0, vertexBuffer.GetIndexType() == VertexBuffer::IndexType::UInt32 ? VK_INDEX_TYPE_UINT32 : VK_INDEX_TYPE_UINT16 );
         vkCmdDrawIndexed( GfxDeviceGlobal::currentCmdBuffer, (endIndex - startIndex) * 3, 1, startIndex * 3, 0, 0 );
     }
     else if (topology == PrimitiveTopology::Lines)
@@ -2102,7 +2553,56 @@ void ae3d::GfxDevice::Draw( VertexBuffer& vertexBuffer, int startIndex, int endI
 
 void ae3d::GfxDevice::GetNewUniformBuffer()
 {
-    GfxDeviceGlobal::currentUbo = (GfxDeviceGlobal::currentUbo + 1) % GfxDeviceGlobal::ubos.count;
+    GfxDeviceGlobal::currentUbo = GfxDeviceGlobal::nextUbo++ % GfxDeviceGlobal::ubos.count;
+}
+
+static void CreateBonePaletteBuffer( unsigned capacity )
+{
+    VkBufferCreateInfo bufferInfo = {};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = capacity * sizeof( ae3d::Matrix44 );
+    bufferInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+
+    VkResult err = vkCreateBuffer( GfxDeviceGlobal::device, &bufferInfo, nullptr, &GfxDeviceGlobal::bonePaletteBuffer );
+    AE3D_CHECK_VULKAN( err, "vkCreateBuffer bone palette" );
+    debug::SetObjectName( GfxDeviceGlobal::device, (std::uint64_t)GfxDeviceGlobal::bonePaletteBuffer, VK_OBJECT_TYPE_BUFFER, "bone palette" );
+
+    VkMemoryRequirements memReqs;
+    vkGetBufferMemoryRequirements( GfxDeviceGlobal::device, GfxDeviceGlobal::bonePaletteBuffer, &memReqs );
+
+    VkMemoryAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = memReqs.size;
+    allocInfo.memoryTypeIndex = ae3d::GetMemoryType( memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT );
+    err = vkAllocateMemory( GfxDeviceGlobal::device, &allocInfo, nullptr, &GfxDeviceGlobal::bonePaletteMemory );
+    AE3D_CHECK_VULKAN( err, "vkAllocateMemory bone palette" );
+    Statistics::IncTotalAllocCalls();
+    Statistics::IncAllocCalls();
+
+    err = vkBindBufferMemory( GfxDeviceGlobal::device, GfxDeviceGlobal::bonePaletteBuffer, GfxDeviceGlobal::bonePaletteMemory, 0 );
+    AE3D_CHECK_VULKAN( err, "vkBindBufferMemory bone palette" );
+
+    err = vkMapMemory( GfxDeviceGlobal::device, GfxDeviceGlobal::bonePaletteMemory, 0, bufferInfo.size, 0, (void **)&GfxDeviceGlobal::bonePaletteData );
+    AE3D_CHECK_VULKAN( err, "vkMapMemory bone palette" );
+
+    GfxDeviceGlobal::bonePaletteCapacity = capacity;
+}
+
+unsigned ae3d::GfxDevice::UploadBonePalette( const Matrix44* matrices, unsigned matrixCount )
+{
+    const unsigned firstIndex = GfxDeviceGlobal::bonePaletteCount;
+
+    if (firstIndex + matrixCount > GfxDeviceGlobal::bonePaletteCapacity)
+    {
+        // Draws that are already recorded reference the old buffer, so it's freed after the frame.
+        GfxDeviceGlobal::pendingFreeVBs.Add( GfxDeviceGlobal::bonePaletteBuffer );
+        GfxDeviceGlobal::pendingFreeMemory.Add( GfxDeviceGlobal::bonePaletteMemory );
+        CreateBonePaletteBuffer( (firstIndex + matrixCount) * 2 );
+    }
+
+    std::memcpy( GfxDeviceGlobal::bonePaletteData + firstIndex, matrices, matrixCount * sizeof( Matrix44 ) );
+    GfxDeviceGlobal::bonePaletteCount += matrixCount;
+    return firstIndex;
 }
 
 void ae3d::GfxDevice::CreateUniformBuffers()
@@ -2113,7 +2613,7 @@ void ae3d::GfxDevice::CreateUniformBuffers()
     {
         auto& ubo = GfxDeviceGlobal::ubos[ uboIndex ];
 
-        const VkDeviceSize uboSize = 256 * 3 + 80 * 64 + 128 * 16;
+        const VkDeviceSize uboSize = 256 * 3 + 128 * 16;
         static_assert( uboSize >= sizeof( PerObjectUboStruct ), "UBO size must be larger than UBO struct" );
 
         VkBufferCreateInfo bufferInfo = {};
@@ -2147,6 +2647,8 @@ void ae3d::GfxDevice::CreateUniformBuffers()
         err = vkMapMemory( GfxDeviceGlobal::device, ubo.uboMemory, 0, uboSize, 0, (void **)&ubo.uboData );
         AE3D_CHECK_VULKAN( err, "vkMapMemory UBO" );
     }
+
+    CreateBonePaletteBuffer( 1024 );
 }
 
 std::uint8_t* ae3d::GfxDevice::GetCurrentUbo()
@@ -2158,7 +2660,8 @@ void ae3d::GfxDevice::BeginFrame()
 {
     ae3d::System::Assert( acquireNextImageKHR != nullptr, "function pointers not loaded" );
     ae3d::System::Assert( GfxDeviceGlobal::swapChain != VK_NULL_HANDLE, "swap chain not initialized" );
-    
+    GfxCapture::BeginFrame();
+
     VkResult err = acquireNextImageKHR( GfxDeviceGlobal::device, GfxDeviceGlobal::swapChain, UINT64_MAX, GfxDeviceGlobal::presentCompleteSemaphore, (VkFence)nullptr, &GfxDeviceGlobal::currentBuffer );
 
     if (err == VK_TIMEOUT)
@@ -2170,6 +2673,13 @@ void ae3d::GfxDevice::BeginFrame()
 
     GfxDeviceGlobal::currentCmdBuffer = GfxDeviceGlobal::drawCmdBuffers[ GfxDeviceGlobal::currentBuffer ];
     GfxDeviceGlobal::cachedPSO = VK_NULL_HANDLE;
+
+    // The previous frame has finished on the GPU, so its secondary command buffers can be reused.
+    for (auto& cmdPool : GfxDeviceGlobal::secondaryCmdPools)
+    {
+        vkResetCommandPool( GfxDeviceGlobal::device, cmdPool.pool, 0 );
+        cmdPool.usedCount = 0;
+    }
     
     SubmitPostPresentBarrier();
 
@@ -2186,6 +2696,8 @@ void ae3d::GfxDevice::BeginFrame()
 
 void SubmitQueue()
 {
+    FlushTextureUploads( false );
+
     VkPipelineStageFlags pipelineStages = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
 
     VkSubmitInfo submitInfo = {};
@@ -2207,6 +2719,7 @@ void ae3d::GfxDevice::Present()
 {
     Statistics::BeginPresentTimeProfiling();
     VkResult err = VK_SUCCESS;
+    FlushTextureUploads( false );
 
 #if AE3D_OPENVR
     VR::SubmitFrame();
@@ -2260,13 +2773,36 @@ void ae3d::GfxDevice::Present()
 
     GfxDeviceGlobal::pendingFreeVBs.Allocate( 0 );
 
+    for (unsigned i = 0; i < GfxDeviceGlobal::pendingFreeImageViews.count; ++i)
+    {
+        vkDestroyImageView( GfxDeviceGlobal::device, GfxDeviceGlobal::pendingFreeImageViews[ i ], nullptr );
+    }
+
+    GfxDeviceGlobal::pendingFreeImageViews.Allocate( 0 );
+
+    for (unsigned i = 0; i < GfxDeviceGlobal::pendingFreeImages.count; ++i)
+    {
+        vkDestroyImage( GfxDeviceGlobal::device, GfxDeviceGlobal::pendingFreeImages[ i ], nullptr );
+    }
+
+    GfxDeviceGlobal::pendingFreeImages.Allocate( 0 );
+
+    for (unsigned i = 0; i < GfxDeviceGlobal::pendingFreeSamplers.count; ++i)
+    {
+        vkDestroySampler( GfxDeviceGlobal::device, GfxDeviceGlobal::pendingFreeSamplers[ i ], nullptr );
+    }
+
+    GfxDeviceGlobal::pendingFreeSamplers.Allocate( 0 );
+
     for (unsigned i = 0; i < GfxDeviceGlobal::pendingFreeMemory.count; ++i)
     {
         vkFreeMemory( GfxDeviceGlobal::device, GfxDeviceGlobal::pendingFreeMemory[ i ], nullptr );
     }
     
     GfxDeviceGlobal::pendingFreeMemory.Allocate( 0 );
+    GfxDeviceGlobal::bonePaletteCount = 0;
     Statistics::EndPresentTimeProfiling();
+    GfxCapture::Present();
 }
 
 void ae3d::GfxDevice::ReleaseGPUObjects()
@@ -2274,6 +2810,7 @@ void ae3d::GfxDevice::ReleaseGPUObjects()
     VkResult err = vkDeviceWaitIdle( GfxDeviceGlobal::device );
     AE3D_CHECK_VULKAN( err, "vkDeviceWaitIdle" );
 
+    DestroyRecordingThreads();
     debug::Free( GfxDeviceGlobal::instance );
     
     for (unsigned i = 0; i < GfxDeviceGlobal::swapchainBuffers.count; ++i)
@@ -2316,6 +2853,9 @@ void ae3d::GfxDevice::ReleaseGPUObjects()
         vkDestroyBuffer( GfxDeviceGlobal::device, GfxDeviceGlobal::ubos[ i ].ubo, nullptr );
     }
 
+    vkFreeMemory( GfxDeviceGlobal::device, GfxDeviceGlobal::bonePaletteMemory, nullptr );
+    vkDestroyBuffer( GfxDeviceGlobal::device, GfxDeviceGlobal::bonePaletteBuffer, nullptr );
+
     Shader::DestroyShaders();
     ComputeShader::DestroyShaders();
     Texture2D::DestroyTextures();
@@ -2324,14 +2864,12 @@ void ae3d::GfxDevice::ReleaseGPUObjects()
     VertexBuffer::DestroyBuffers();
     GfxDeviceGlobal::lightTiler.DestroyBuffers();
 
-    for (auto pso : GfxDeviceGlobal::psoCache)
-    {
-        vkDestroyPipeline( GfxDeviceGlobal::device, pso.second, nullptr );
-    }
+    GfxDeviceGlobal::psoCache.ForEach( []( std::uint64_t, VkPipeline pso ) { vkDestroyPipeline( GfxDeviceGlobal::device, pso, nullptr ); } );
 
     vkDestroySemaphore( GfxDeviceGlobal::device, GfxDeviceGlobal::renderCompleteSemaphore, nullptr );
     vkDestroySemaphore( GfxDeviceGlobal::device, GfxDeviceGlobal::presentCompleteSemaphore, nullptr );
     vkDestroyPipelineLayout( GfxDeviceGlobal::device, GfxDeviceGlobal::pipelineLayout, nullptr );
+    SavePipelineCache();
     vkDestroyPipelineCache( GfxDeviceGlobal::device, GfxDeviceGlobal::pipelineCache, nullptr );
     vkDestroySwapchainKHR( GfxDeviceGlobal::device, GfxDeviceGlobal::swapChain, nullptr );
     vkDestroySurfaceKHR( GfxDeviceGlobal::instance, GfxDeviceGlobal::surface, nullptr );
@@ -2342,7 +2880,16 @@ void ae3d::GfxDevice::ReleaseGPUObjects()
 
 void ae3d::GfxDevice::SetRenderTarget( RenderTexture* target, unsigned cubeMapFace )
 {
+    GfxCapture::RecordSetRenderTarget( target, cubeMapFace );
+
     GfxDeviceGlobal::currentCmdBuffer = target ? GfxDeviceGlobal::offscreenCmdBuffer : GfxDeviceGlobal::drawCmdBuffers[ GfxDeviceGlobal::currentBuffer ];
+
+    // Draws into an open pass go to its secondary command buffer.
+    if (GfxDeviceGlobal::passCmdBuffer == GfxDeviceGlobal::currentCmdBuffer)
+    {
+        GfxDeviceGlobal::currentCmdBuffer = GfxDeviceGlobal::passSecondaryCmdBuffer;
+    }
+
     GfxDeviceGlobal::cachedPSO = VK_NULL_HANDLE;
     GfxDeviceGlobal::renderTexture0 = target;
 
@@ -2358,6 +2905,7 @@ void ae3d::GfxDevice::SetRenderTarget( RenderTexture* target, unsigned cubeMapFa
 
 void BeginOffscreen()
 {
+    ae3d::GfxCapture::Record( ae3d::GfxCapture::Command::BeginOffscreen );
     ae3d::System::Assert( GfxDeviceGlobal::renderTexture0 != nullptr, "Render texture must be set when beginning offscreen rendering" );
     
     // FIXME: Use fence instead of queue wait.
@@ -2391,15 +2939,19 @@ void BeginOffscreen()
     renderPassBeginInfo.pClearValues = clearValues;
     renderPassBeginInfo.framebuffer = GfxDeviceGlobal::frameBuffer0;
 
-    vkCmdBeginRenderPass( GfxDeviceGlobal::offscreenCmdBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE );
+    vkCmdBeginRenderPass( GfxDeviceGlobal::offscreenCmdBuffer, &renderPassBeginInfo, GetPassContents() );
+    BeginPassContents( GfxDeviceGlobal::offscreenCmdBuffer, renderPassBeginInfo.renderPass, renderPassBeginInfo.framebuffer,
+                       renderPassBeginInfo.renderArea.extent.width, renderPassBeginInfo.renderArea.extent.height );
 }
 
 void EndOffscreen( int profilerIndex, ae3d::RenderTexture* target )
 {
+    ae3d::GfxCapture::RecordEndOffscreen( profilerIndex, target );
+    EndPassContents();
+    vkCmdEndRenderPass( GfxDeviceGlobal::offscreenCmdBuffer );
 #ifndef DISABLE_TIMESTAMPS    
     vkCmdWriteTimestamp( GfxDeviceGlobal::offscreenCmdBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, GfxDeviceGlobal::queryPool, 1 );
 #endif
-    vkCmdEndRenderPass( GfxDeviceGlobal::offscreenCmdBuffer );
     
     VkResult err = vkEndCommandBuffer( GfxDeviceGlobal::offscreenCmdBuffer );
     AE3D_CHECK_VULKAN( err, "vkEndCommandBuffer" );
@@ -2416,6 +2968,7 @@ void EndOffscreen( int profilerIndex, ae3d::RenderTexture* target )
     submitInfo.commandBufferCount = 1;
     submitInfo.pCommandBuffers = &GfxDeviceGlobal::offscreenCmdBuffer;
 
+    FlushTextureUploads( false );
     err = vkQueueSubmit( GfxDeviceGlobal::graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE );
     AE3D_CHECK_VULKAN( err, "vkQueueSubmit" );
     Statistics::IncQueueSubmitCalls();
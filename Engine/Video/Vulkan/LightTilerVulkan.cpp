@@ -22,12 +22,12 @@ namespace MathUtil
 namespace GfxDeviceGlobal
 {
     extern VkDevice device;
-    extern PerObjectUboStruct perObjectUboStruct;
+    extern thread_local PerObjectUboStruct perObjectUboStruct;
     extern VkCommandBuffer computeCmdBuffer;
     extern VkDescriptorSetLayout descriptorSetLayout;
     extern VkQueue computeQueue;
-    extern VkImageView boundViews[ ae3d::ComputeShader::SLOT_COUNT ];
-    extern VkSampler boundSamplers[ 2 ];
+    extern thread_local VkImageView boundViews[ ae3d::ComputeShader::SLOT_COUNT ];
+    extern thread_local VkSampler boundSamplers[ 2 ];
 }
 
 void UploadPerObjectUbo();
@@ -39,7 +39,7 @@ namespace GfxDeviceGlobal
     extern VkInstance instance;
     extern VkQueue graphicsQueue;
     extern std::uint32_t graphicsQueueIndex;
-    extern VkCommandBuffer currentCmdBuffer;
+    extern thread_local VkCommandBuffer currentCmdBuffer;
     extern VkRenderPass renderPass;
 }
 
@@ -21,7 +21,7 @@ namespace GfxDeviceGlobal
     extern VkCommandBuffer setupCmdBuffer;
     extern VkFormat colorFormat;
     extern VkFormat depthFormat;
-    extern VkCommandBuffer currentCmdBuffer;
+    extern thread_local VkCommandBuffer currentCmdBuffer;
     extern VkSampleCountFlagBits msaaSampleBits;
     extern VkQueue graphicsQueue;
     extern VkPhysicalDevice physicalDevice;
@@ -31,6 +31,8 @@ void ae3d::BuiltinShaders::Load()
     momentsSkinShader.LoadSPIRV( FileSystem::FileContents( "shaders/moments_skin_vert.spv" ), FileSystem::FileContents( "shaders/moments_frag.spv" ) );
     depthNormalsShader.LoadSPIRV( FileSystem::FileContents( "shaders/depthnormals_vert.spv" ), FileSystem::FileContents( "shaders/depthnormals_frag.spv" ) );
     depthNormalsSkinShader.LoadSPIRV( FileSystem::FileContents( "shaders/depthnormals_skin_vert.spv" ), FileSystem::FileContents( "shaders/depthnormals_frag.spv" ) );
+    momentsShader.SetVertexInput( Shader::VertexInput::Position );
+    depthNormalsShader.SetVertexInput( Shader::VertexInput::PositionNormal );
     uiShader.LoadSPIRV( FileSystem::FileContents( "shaders/sprite_vert.spv" ), FileSystem::FileContents( "shaders/sprite_frag.spv" ) );
     lightCullShader.LoadSPIRV( FileSystem::FileContents( "shaders/LightCuller.spv" ) );
     particleSimulationShader.LoadSPIRV( FileSystem::FileContents( "shaders/particle_simulate.spv" ) );
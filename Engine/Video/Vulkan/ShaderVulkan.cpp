@@ -22,9 +22,9 @@ constexpr int MaxModuleCount = 600;
 namespace GfxDeviceGlobal
 {
     extern VkDevice device;
-    extern VkImageView boundViews[ 13 ];
-    extern VkSampler boundSamplers[ 2 ];
-	extern PerObjectUboStruct perObjectUboStruct;
+    extern thread_local VkImageView boundViews[ 13 ];
+    extern thread_local VkSampler boundSamplers[ 2 ];
+	extern thread_local PerObjectUboStruct perObjectUboStruct;
     extern VkCommandBuffer texCmdBuffer;
     extern ae3d::RenderTexture* renderTexture0;
 }
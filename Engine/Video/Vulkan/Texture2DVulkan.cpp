@@ -17,7 +17,13 @@
 #include "VulkanUtils.hpp"
 
 bool HasStbExtension( const std::string& path ); // Defined in TextureCommon.cpp
+unsigned char* LoadStbImage( const ae3d::FileSystem::FileContentsData& fileContents, int& outWidth, int& outHeight, int& outComponents ); // Defined in TextureCommon.cpp
+void GetStbMips( const std::string& path, const unsigned char* pixels, int width, int height, ae3d::ColorSpace colorSpace, ae3d::TextureWrap wrap,
+                 std::vector< unsigned char >& outMips ); // Defined in TextureCommon.cpp
 float GetFloatAnisotropy( ae3d::Anisotropy anisotropy );
+bool LoadCachedTexture( ae3d::Texture2D& texture ); // Defined in TextureCommon.cpp
+void CacheTexture( ae3d::Texture2D& texture, std::size_t sizeInBytes ); // Defined in TextureCommon.cpp
+void RemovePendingTextureLoad( const ae3d::Texture2D* texture ); // Defined in TextureCommon.cpp
 
 namespace MathUtil
 {
@@ -32,7 +38,11 @@ namespace GfxDeviceGlobal
     extern VkQueue graphicsQueue;
     extern VkPhysicalDeviceProperties properties;
     extern VkCommandBuffer texCmdBuffer;
+    extern VkCommandPool cmdPool;
     extern VkPhysicalDeviceFeatures deviceFeatures;
+    extern Array< VkDeviceMemory > pendingFreeMemory;
+    extern Array< VkImage > pendingFreeImages;
+    extern Array< VkImageView > pendingFreeImageViews;
 }
 
 namespace Texture2DGlobal
@@ -43,6 +53,218 @@ namespace Texture2DGlobal
     std::vector< VkImage > imagesToReleaseAtExit;
     std::vector< VkImageView > imageViewsToReleaseAtExit;
     std::vector< VkDeviceMemory > memoryToReleaseAtExit;
+
+    template< typename T > void RemoveFromReleaseList( std::vector< T >& list, T object )
+    {
+        for (std::size_t i = 0; i < list.size(); ++i)
+        {
+            if (list[ i ] == object)
+            {
+                list.erase( std::begin( list ) + i );
+                return;
+            }
+        }
+    }
+
+    /// DDS mips are copied into this persistently mapped buffer and their copy commands are recorded into uploadCmdBuffer,
+    /// so textures loaded during a frame are uploaded in one submission. FlushTextureUploads() submits them.
+    VkBuffer stagingBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory stagingMemory = VK_NULL_HANDLE;
+    std::uint8_t* stagingData = nullptr;
+    VkDeviceSize stagingSize = 0;
+    VkDeviceSize stagingOffset = 0;
+    const VkDeviceSize minStagingSize = 32 * 1024 * 1024;
+    VkCommandBuffer uploadCmdBuffer = VK_NULL_HANDLE;
+    VkFence uploadFence = VK_NULL_HANDLE;
+    bool isRecordingUploads = false;
+    bool isUploadInFlight = false;
+
+    /// Samplers are shared by textures with the same state. Indexed by filter, wrap and anisotropy.
+    VkSampler samplers[ 2 ][ 2 ][ 4 ] = {};
+}
+
+/// \return Sampler that is released at exit. Its LOD isn't clamped, so it works with any mip count.
+static VkSampler GetSharedSampler( ae3d::TextureFilter filter, ae3d::TextureWrap wrap, ae3d::Anisotropy anisotropy )
+{
+    VkSampler& sampler = Texture2DGlobal::samplers[ (int)filter ][ (int)wrap ][ (int)anisotropy ];
+
+    if (sampler != VK_NULL_HANDLE)
+    {
+        return sampler;
+    }
+
+    VkSamplerCreateInfo samplerInfo = {};
+    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerInfo.magFilter = filter == ae3d::TextureFilter::Nearest ? VK_FILTER_NEAREST : VK_FILTER_LINEAR;
+    samplerInfo.minFilter = samplerInfo.magFilter;
+    samplerInfo.mipmapMode = filter == ae3d::TextureFilter::Nearest ? VK_SAMPLER_MIPMAP_MODE_NEAREST : VK_SAMPLER_MIPMAP_MODE_LINEAR;
+    samplerInfo.addressModeU = wrap == ae3d::TextureWrap::Repeat ? VK_SAMPLER_ADDRESS_MODE_REPEAT : VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeV = samplerInfo.addressModeU;
+    samplerInfo.addressModeW = samplerInfo.addressModeU;
+    samplerInfo.mipLodBias = 0;
+    samplerInfo.compareOp = VK_COMPARE_OP_NEVER;
+    samplerInfo.minLod = 0;
+    samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+    samplerInfo.maxAnisotropy = GfxDeviceGlobal::deviceFeatures.samplerAnisotropy ? GetFloatAnisotropy( anisotropy ) : 1;
+    samplerInfo.anisotropyEnable = (anisotropy != ae3d::Anisotropy::k1 && GfxDeviceGlobal::deviceFeatures.samplerAnisotropy) ? VK_TRUE : VK_FALSE;
+    samplerInfo.borderColor = VK_BORDER_COLOR_FLOAT_TRANSPARENT_BLACK;
+    VkResult err = vkCreateSampler( GfxDeviceGlobal::device, &samplerInfo, nullptr, &sampler );
+    AE3D_CHECK_VULKAN( err, "vkCreateSampler" );
+    Texture2DGlobal::samplersToReleaseAtExit.push_back( sampler );
+
+    debug::SetObjectName( GfxDeviceGlobal::device, (std::uint64_t)sampler, VK_OBJECT_TYPE_SAMPLER, "sampler" );
+
+    return sampler;
+}
+
+/// Submits recorded texture uploads. Called before submitting work that can sample the textures.
+/// \param waitForCompletion If true, returns after the uploads have finished on the GPU.
+void FlushTextureUploads( bool waitForCompletion )
+{
+    if (Texture2DGlobal::isRecordingUploads)
+    {
+        VkResult err = vkEndCommandBuffer( Texture2DGlobal::uploadCmdBuffer );
+        AE3D_CHECK_VULKAN( err, "vkEndCommandBuffer upload" );
+
+        VkSubmitInfo submitInfo = {};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &Texture2DGlobal::uploadCmdBuffer;
+
+        err = vkQueueSubmit( GfxDeviceGlobal::graphicsQueue, 1, &submitInfo, Texture2DGlobal::uploadFence );
+        AE3D_CHECK_VULKAN( err, "vkQueueSubmit upload" );
+        Statistics::IncQueueSubmitCalls();
+
+        Texture2DGlobal::isRecordingUploads = false;
+        Texture2DGlobal::isUploadInFlight = true;
+    }
+
+    if (waitForCompletion && Texture2DGlobal::isUploadInFlight)
+    {
+        VkResult err = vkWaitForFences( GfxDeviceGlobal::device, 1, &Texture2DGlobal::uploadFence, VK_TRUE, UINT64_MAX );
+        AE3D_CHECK_VULKAN( err, "vkWaitForFences upload" );
+        err = vkResetFences( GfxDeviceGlobal::device, 1, &Texture2DGlobal::uploadFence );
+        AE3D_CHECK_VULKAN( err, "vkResetFences upload" );
+        Statistics::IncFenceCalls();
+
+        Texture2DGlobal::isUploadInFlight = false;
+    }
+}
+
+static void CreateStagingBuffer( VkDeviceSize size )
+{
+    if (Texture2DGlobal::stagingBuffer != VK_NULL_HANDLE)
+    {
+        vkDestroyBuffer( GfxDeviceGlobal::device, Texture2DGlobal::stagingBuffer, nullptr );
+        vkFreeMemory( GfxDeviceGlobal::device, Texture2DGlobal::stagingMemory, nullptr );
+    }
+
+    VkBufferCreateInfo bufferCreateInfo = {};
+    bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferCreateInfo.size = size;
+    bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    VkResult err = vkCreateBuffer( GfxDeviceGlobal::device, &bufferCreateInfo, nullptr, &Texture2DGlobal::stagingBuffer );
+    AE3D_CHECK_VULKAN( err, "vkCreateBuffer staging" );
+    debug::SetObjectName( GfxDeviceGlobal::device, (std::uint64_t)Texture2DGlobal::stagingBuffer, VK_OBJECT_TYPE_BUFFER, "texture upload staging" );
+
+    VkMemoryRequirements memReqs = {};
+    vkGetBufferMemoryRequirements( GfxDeviceGlobal::device, Texture2DGlobal::stagingBuffer, &memReqs );
+
+    VkMemoryAllocateInfo memAllocInfo = {};
+    memAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    memAllocInfo.allocationSize = memReqs.size;
+    memAllocInfo.memoryTypeIndex = ae3d::GetMemoryType( memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT );
+    err = vkAllocateMemory( GfxDeviceGlobal::device, &memAllocInfo, nullptr, &Texture2DGlobal::stagingMemory );
+    AE3D_CHECK_VULKAN( err, "vkAllocateMemory staging" );
+    Statistics::IncAllocCalls();
+    Statistics::IncTotalAllocCalls();
+    debug::SetObjectName( GfxDeviceGlobal::device, (std::uint64_t)Texture2DGlobal::stagingMemory, VK_OBJECT_TYPE_DEVICE_MEMORY, "texture upload staging memory" );
+
+    err = vkBindBufferMemory( GfxDeviceGlobal::device, Texture2DGlobal::stagingBuffer, Texture2DGlobal::stagingMemory, 0 );
+    AE3D_CHECK_VULKAN( err, "vkBindBufferMemory staging" );
+
+    void* mappedData = nullptr;
+    err = vkMapMemory( GfxDeviceGlobal::device, Texture2DGlobal::stagingMemory, 0, VK_WHOLE_SIZE, 0, &mappedData );
+    AE3D_CHECK_VULKAN( err, "vkMapMemory staging" );
+
+    Texture2DGlobal::stagingData = static_cast< std::uint8_t* >( mappedData );
+    Texture2DGlobal::stagingSize = size;
+    Texture2DGlobal::stagingOffset = 0;
+}
+
+/// Starts recording uploads after the previous submission has finished, so the staging buffer can be reused from the start.
+static void BeginUploads()
+{
+    if (Texture2DGlobal::isRecordingUploads)
+    {
+        return;
+    }
+
+    if (Texture2DGlobal::uploadCmdBuffer == VK_NULL_HANDLE)
+    {
+        VkCommandBufferAllocateInfo cmdBufInfo = {};
+        cmdBufInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        cmdBufInfo.commandPool = GfxDeviceGlobal::cmdPool;
+        cmdBufInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        cmdBufInfo.commandBufferCount = 1;
+
+        VkResult err = vkAllocateCommandBuffers( GfxDeviceGlobal::device, &cmdBufInfo, &Texture2DGlobal::uploadCmdBuffer );
+        AE3D_CHECK_VULKAN( err, "vkAllocateCommandBuffers upload" );
+        debug::SetObjectName( GfxDeviceGlobal::device, (std::uint64_t)Texture2DGlobal::uploadCmdBuffer, VK_OBJECT_TYPE_COMMAND_BUFFER, "uploadCmdBuffer" );
+
+        VkFenceCreateInfo fenceInfo = {};
+        fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+        err = vkCreateFence( GfxDeviceGlobal::device, &fenceInfo, nullptr, &Texture2DGlobal::uploadFence );
+        AE3D_CHECK_VULKAN( err, "vkCreateFence upload" );
+    }
+
+    FlushTextureUploads( true );
+    Texture2DGlobal::stagingOffset = 0;
+
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    VkResult err = vkBeginCommandBuffer( Texture2DGlobal::uploadCmdBuffer, &beginInfo );
+    AE3D_CHECK_VULKAN( err, "vkBeginCommandBuffer upload" );
+    Texture2DGlobal::isRecordingUploads = true;
+}
+
+/// Reserves staging memory for an upload and starts recording uploads if needed. Submits the recorded uploads and waits for them
+/// if the staging buffer is full, and grows the buffer if size doesn't fit into it.
+/// \param size Size in bytes.
+/// \return Offset of the reserved memory in the staging buffer.
+static VkDeviceSize AllocateStaging( VkDeviceSize size )
+{
+    if (Texture2DGlobal::stagingBuffer == VK_NULL_HANDLE)
+    {
+        CreateStagingBuffer( size > Texture2DGlobal::minStagingSize ? size : Texture2DGlobal::minStagingSize );
+    }
+
+    BeginUploads();
+
+    // Block-compressed copies need offsets that are multiples of the block size.
+    VkDeviceSize alignment = GfxDeviceGlobal::properties.limits.optimalBufferCopyOffsetAlignment;
+    alignment = alignment < 16 ? 16 : alignment;
+    VkDeviceSize offset = (Texture2DGlobal::stagingOffset + alignment - 1) / alignment * alignment;
+
+    if (offset + size > Texture2DGlobal::stagingSize)
+    {
+        FlushTextureUploads( true );
+
+        if (size > Texture2DGlobal::stagingSize)
+        {
+            CreateStagingBuffer( size );
+        }
+
+        BeginUploads();
+        offset = 0;
+    }
+
+    Texture2DGlobal::stagingOffset = offset + size;
+    Statistics::IncTextureUploadBytes( static_cast< std::size_t >( size ) );
+    return offset;
 }
 
 void ae3d::Texture2D::DestroyTextures()
@@ -66,6 +288,17 @@ void ae3d::Texture2D::DestroyTextures()
     {
         vkFreeMemory( GfxDeviceGlobal::device, Texture2DGlobal::memoryToReleaseAtExit[ memoryIndex ], nullptr );
     }
+
+    if (Texture2DGlobal::stagingBuffer != VK_NULL_HANDLE)
+    {
+        vkDestroyBuffer( GfxDeviceGlobal::device, Texture2DGlobal::stagingBuffer, nullptr );
+        vkFreeMemory( GfxDeviceGlobal::device, Texture2DGlobal::stagingMemory, nullptr );
+    }
+
+    if (Texture2DGlobal::uploadFence != VK_NULL_HANDLE)
+    {
+        vkDestroyFence( GfxDeviceGlobal::device, Texture2DGlobal::uploadFence, nullptr );
+    }
 }
 
 void ae3d::Texture2D::LoadFromData( const void* imageData, int aWidth, int aHeight, const char* debugName, DataType format )
@@ -105,6 +338,9 @@ void ae3d::Texture2D::LoadFromData( const void* imageData, int aWidth, int aHeig
 
 void ae3d::Texture2D::Load( const FileSystem::FileContentsData& fileContents, TextureWrap aWrap, TextureFilter aFilter, Mipmaps aMipmaps, ColorSpace aColorSpace, Anisotropy aAnisotropy )
 {
+    // A newer load replaces a pending LoadAsync().
+    RemovePendingTextureLoad( this );
+
     filter = aFilter;
     wrap = aWrap;
     mipmaps = aMipmaps;
@@ -128,6 +364,11 @@ void ae3d::Texture2D::Load( const FileSystem::FileContentsData& fileContents, Te
         return;
     }
 
+    if (LoadCachedTexture( *this ))
+    {
+        return;
+    }
+
     const bool isDDS = fileContents.path.find( ".dds" ) != std::string::npos || fileContents.path.find( ".DDS" ) != std::string::npos;
 
     if (HasStbExtension( fileContents.path ))
@@ -136,18 +377,26 @@ void ae3d::Texture2D::Load( const FileSystem::FileContentsData& fileContents, Te
     }
     else if (isDDS && GfxDeviceGlobal::deviceFeatures.textureCompressionBC)
     {
-        LoadDDS( fileContents.path.c_str() );
+        LoadDDS( fileContents );
     }
     else
     {
         System::Print( "Unknown/unsupported texture file extension: %s\n", fileContents.path.c_str() );
     }
 
-    debug::SetObjectName( GfxDeviceGlobal::device, (std::uint64_t)view, VK_OBJECT_TYPE_IMAGE_VIEW, fileContents.path.c_str() );
-    debug::SetObjectName( GfxDeviceGlobal::device, (std::uint64_t)image, VK_OBJECT_TYPE_IMAGE, fileContents.path.c_str() );
+    // Failed loads are not cached.
+    if (image != VK_NULL_HANDLE && image != Texture2DGlobal::defaultTexture.image)
+    {
+        debug::SetObjectName( GfxDeviceGlobal::device, (std::uint64_t)view, VK_OBJECT_TYPE_IMAGE_VIEW, fileContents.path.c_str() );
+        debug::SetObjectName( GfxDeviceGlobal::device, (std::uint64_t)image, VK_OBJECT_TYPE_IMAGE, fileContents.path.c_str() );
+
+        VkMemoryRequirements memReqs;
+        vkGetImageMemoryRequirements( GfxDeviceGlobal::device, image, &memReqs );
+        CacheTexture( *this, (std::size_t)memReqs.size );
+    }
 }
 
-void ae3d::Texture2D::CreateVulkanObjects( const DDSLoader::Output& mipChain, VkFormat format )
+void ae3d::Texture2D::CreateVulkanObjects( const DDSLoader::Output& mipChain, VkFormat format, int firstMip )
 {
     VkImageCreateInfo imageCreateInfo = {};
     imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -159,7 +408,7 @@ void ae3d::Texture2D::CreateVulkanObjects( const DDSLoader::Output& mipChain, Vk
     imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
     imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
     imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    imageCreateInfo.extent = { (std::uint32_t)width, (std::uint32_t)height, 1 };
+    imageCreateInfo.extent = { (std::uint32_t)MathUtil::Max( width >> firstMip, 1 ), (std::uint32_t)MathUtil::Max( height >> firstMip, 1 ), 1 };
     imageCreateInfo.usage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
 
     VkResult err = vkCreateImage( GfxDeviceGlobal::device, &imageCreateInfo, nullptr, &image );
@@ -184,63 +433,48 @@ void ae3d::Texture2D::CreateVulkanObjects( const DDSLoader::Output& mipChain, Vk
     err = vkBindImageMemory( GfxDeviceGlobal::device, image, deviceMemory, 0 );
     AE3D_CHECK_VULKAN( err, "vkBindImageMemory" );
 
-    Array< VkBuffer > stagingBuffers( mipLevelCount );
-    Array< VkDeviceMemory > stagingMemory( mipLevelCount );
-    
+    Array< VkDeviceSize > mipOffsets( mipLevelCount );
+    Array< VkDeviceSize > mipSizes( mipLevelCount );
+    VkDeviceSize mipChainSize = 0;
+
     for (int mipIndex = 0; mipIndex < mipLevelCount; ++mipIndex)
     {
-        const std::int32_t mipWidth = MathUtil::Max( width >> mipIndex, 1 );
-        const std::int32_t mipHeight = MathUtil::Max( height >> mipIndex, 1 );
+        const int fileMip = firstMip + mipIndex;
+        const std::int32_t mipWidth = MathUtil::Max( width >> fileMip, 1 );
+        const std::int32_t mipHeight = MathUtil::Max( height >> fileMip, 1 );
 
         const VkDeviceSize bc1BlockSize = opaque ? 8 : 16;
         VkDeviceSize imageSize = (mipWidth / 4) * (mipHeight / 4) * (format == VK_FORMAT_BC5_UNORM_BLOCK ? 16 : bc1BlockSize);
 
+        if (format == VK_FORMAT_R8G8B8A8_UNORM || format == VK_FORMAT_R8G8B8A8_SRGB)
+        {
+            imageSize = mipWidth * mipHeight * 4;
+        }
+
         // FIXME: This is a hack, figure out proper fix.
         if (imageSize == 0)
         {
             imageSize = 16;
         }
-        
-        VkBufferCreateInfo bufferCreateInfo = {};
-        bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-        bufferCreateInfo.size = imageSize;
-        bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-        bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-        err = vkCreateBuffer( GfxDeviceGlobal::device, &bufferCreateInfo, nullptr, &stagingBuffers[ mipIndex ] );
-        AE3D_CHECK_VULKAN( err, "vkCreateBuffer staging" );
-        debug::SetObjectName( GfxDeviceGlobal::device, (std::uint64_t)stagingBuffers[ mipIndex ], VK_OBJECT_TYPE_BUFFER, "stagingBuffer2D" );
-
-        vkGetBufferMemoryRequirements( GfxDeviceGlobal::device, stagingBuffers[ mipIndex ], &memReqs );
-
-        memAllocInfo.allocationSize = (memReqs.size + GfxDeviceGlobal::properties.limits.nonCoherentAtomSize - 1) & ~(GfxDeviceGlobal::properties.limits.nonCoherentAtomSize - 1);;
-        memAllocInfo.memoryTypeIndex = GetMemoryType( memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT );
-
-		err = vkAllocateMemory( GfxDeviceGlobal::device, &memAllocInfo, nullptr, &stagingMemory[ mipIndex ] );
-		AE3D_CHECK_VULKAN( err, "vkAllocateMemory" );
-		debug::SetObjectName( GfxDeviceGlobal::device, ( std::uint64_t )deviceMemory, VK_OBJECT_TYPE_DEVICE_MEMORY, "tex2d memory" );
-
-        err = vkBindBufferMemory( GfxDeviceGlobal::device, stagingBuffers[ mipIndex ], stagingMemory[ mipIndex ], 0 );
-        AE3D_CHECK_VULKAN( err, "vkBindBufferMemory staging" );
-
-        void* stagingData;
-        err = vkMapMemory( GfxDeviceGlobal::device, stagingMemory[ mipIndex ], 0, memAllocInfo.allocationSize, 0, &stagingData );
-        AE3D_CHECK_VULKAN( err, "vkMapMemory in Texture2D" );
-        VkDeviceSize amountToCopy = imageSize;
-        if (mipChain.dataOffsets[ mipIndex ] + imageSize >= (unsigned)mipChain.imageData.count)
+
+        mipOffsets[ mipIndex ] = mipChainSize;
+        mipSizes[ mipIndex ] = imageSize;
+        mipChainSize += (imageSize + 15) & ~VkDeviceSize( 15 );
+    }
+
+    // The whole chain is reserved at once so that a flush can't happen between this texture's copy commands.
+    const VkDeviceSize stagingOffset = AllocateStaging( mipChainSize );
+
+    for (int mipIndex = 0; mipIndex < mipLevelCount; ++mipIndex)
+    {
+        const int fileMip = firstMip + mipIndex;
+        VkDeviceSize amountToCopy = mipSizes[ mipIndex ];
+        if (mipChain.dataOffsets[ fileMip ] + amountToCopy >= (unsigned)mipChain.imageData.count)
         {
-            amountToCopy = mipChain.imageData.count - mipChain.dataOffsets[ mipIndex ];
+            amountToCopy = mipChain.imageData.count - mipChain.dataOffsets[ fileMip ];
         }
-        
-        std::memcpy( stagingData, &mipChain.imageData[ mipChain.dataOffsets[ mipIndex ] ], amountToCopy );
 
-        VkMappedMemoryRange flushRange = {};
-        flushRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-        flushRange.memory = stagingMemory[ mipIndex ];
-        flushRange.offset = 0;
-        flushRange.size = VK_WHOLE_SIZE;
-        vkFlushMappedMemoryRanges( GfxDeviceGlobal::device, 1, &flushRange );
-
-        vkUnmapMemory( GfxDeviceGlobal::device, stagingMemory[ mipIndex ] );
+        std::memcpy( Texture2DGlobal::stagingData + stagingOffset + mipOffsets[ mipIndex ], &mipChain.imageData[ mipChain.dataOffsets[ fileMip ] ], amountToCopy );
     }
 
     VkImageViewCreateInfo viewInfo = {};
@@ -258,13 +492,6 @@ void ae3d::Texture2D::CreateVulkanObjects( const DDSLoader::Output& mipChain, Vk
     AE3D_CHECK_VULKAN( err, "vkCreateImageView in Texture2D" );
     Texture2DGlobal::imageViewsToReleaseAtExit.push_back( view );
 
-    VkCommandBufferBeginInfo cmdBufInfo = {};
-    cmdBufInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    cmdBufInfo.flags = 0;
-
-    err = vkBeginCommandBuffer( GfxDeviceGlobal::texCmdBuffer, &cmdBufInfo );
-    AE3D_CHECK_VULKAN( err, "vkBeginCommandBuffer in Texture2D" );
-
     VkImageSubresourceRange range = {};
     range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
     range.baseMipLevel = 0;
@@ -284,7 +511,7 @@ void ae3d::Texture2D::CreateVulkanObjects( const DDSLoader::Output& mipChain, Vk
     imageMemoryBarrier.subresourceRange = range;
 
     vkCmdPipelineBarrier(
-            GfxDeviceGlobal::texCmdBuffer,
+            Texture2DGlobal::uploadCmdBuffer,
             VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
             VK_PIPELINE_STAGE_TRANSFER_BIT,
             0,
@@ -292,12 +519,15 @@ void ae3d::Texture2D::CreateVulkanObjects( const DDSLoader::Output& mipChain, Vk
             0, nullptr,
             1, &imageMemoryBarrier );
 
+    Array< VkBufferImageCopy > bufferCopyRegions( mipLevelCount );
+
     for (int mipLevel = 0; mipLevel < mipLevelCount; ++mipLevel)
     {
-        const std::int32_t mipWidth = MathUtil::Max( width >> mipLevel, 1 );
-        const std::int32_t mipHeight = MathUtil::Max( height >> mipLevel, 1 );
+        const std::int32_t mipWidth = MathUtil::Max( width >> (firstMip + mipLevel), 1 );
+        const std::int32_t mipHeight = MathUtil::Max( height >> (firstMip + mipLevel), 1 );
 
-        VkBufferImageCopy bufferCopyRegion = {};
+        VkBufferImageCopy& bufferCopyRegion = bufferCopyRegions[ mipLevel ];
+        bufferCopyRegion = {};
         bufferCopyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
         bufferCopyRegion.imageSubresource.mipLevel = mipLevel;
         bufferCopyRegion.imageSubresource.baseArrayLayer = 0;
@@ -305,93 +535,28 @@ void ae3d::Texture2D::CreateVulkanObjects( const DDSLoader::Output& mipChain, Vk
         bufferCopyRegion.imageExtent.width = mipWidth;
         bufferCopyRegion.imageExtent.height = mipHeight;
         bufferCopyRegion.imageExtent.depth = 1;
-        bufferCopyRegion.bufferOffset = 0;
-
-        vkCmdCopyBufferToImage( GfxDeviceGlobal::texCmdBuffer, stagingBuffers[ mipLevel ], image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &bufferCopyRegion );
+        bufferCopyRegion.bufferOffset = stagingOffset + mipOffsets[ mipLevel ];
     }
 
-    vkEndCommandBuffer( GfxDeviceGlobal::texCmdBuffer );
-
-    VkSubmitInfo submitInfo = {};
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &GfxDeviceGlobal::texCmdBuffer;
-
-    err = vkQueueSubmit( GfxDeviceGlobal::graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE );
-    AE3D_CHECK_VULKAN( err, "vkQueueSubmit in Texture2D" );
-
-    vkDeviceWaitIdle( GfxDeviceGlobal::device );
-
-    err = vkBeginCommandBuffer( GfxDeviceGlobal::texCmdBuffer, &cmdBufInfo );
-    AE3D_CHECK_VULKAN( err, "vkBeginCommandBuffer in Texture2D" );
-
-    imageMemoryBarrier = {};
-    imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-    imageMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    imageMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    imageMemoryBarrier.srcAccessMask = 0;
-    imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-    imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-    imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
-    imageMemoryBarrier.image = image;
-    imageMemoryBarrier.subresourceRange = range;
-
-    vkCmdPipelineBarrier(
-        GfxDeviceGlobal::texCmdBuffer,
-        VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
-        VK_PIPELINE_STAGE_TRANSFER_BIT,
-        0,
-        0, nullptr,
-        0, nullptr,
-        1, &imageMemoryBarrier );
+    vkCmdCopyBufferToImage( Texture2DGlobal::uploadCmdBuffer, Texture2DGlobal::stagingBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                            (std::uint32_t)mipLevelCount, &bufferCopyRegions[ 0 ] );
 
     imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
     imageMemoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-    imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+    imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
     imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
     vkCmdPipelineBarrier(
-        GfxDeviceGlobal::texCmdBuffer,
+        Texture2DGlobal::uploadCmdBuffer,
         VK_PIPELINE_STAGE_TRANSFER_BIT,
-        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+        VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
         0,
         0, nullptr,
         0, nullptr,
         1, &imageMemoryBarrier );
+    Statistics::IncBarrierCalls();
 
-    vkEndCommandBuffer( GfxDeviceGlobal::texCmdBuffer );
-
-    err = vkQueueSubmit( GfxDeviceGlobal::graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE );
-    AE3D_CHECK_VULKAN( err, "vkQueueSubmit in Texture2D" );
-
-    vkDeviceWaitIdle( GfxDeviceGlobal::device );
-
-    for (int mipLevel = 0; mipLevel < mipLevelCount; ++mipLevel)
-    {
-        vkDestroyBuffer( GfxDeviceGlobal::device, stagingBuffers[ mipLevel ], nullptr );
-        vkFreeMemory( GfxDeviceGlobal::device, stagingMemory[ mipLevel ], nullptr );
-    }
-    
-    VkSamplerCreateInfo samplerInfo = {};
-    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
-    samplerInfo.magFilter = filter == ae3d::TextureFilter::Nearest ? VK_FILTER_NEAREST : VK_FILTER_LINEAR;
-    samplerInfo.minFilter = samplerInfo.magFilter;
-    samplerInfo.mipmapMode = filter == ae3d::TextureFilter::Nearest ? VK_SAMPLER_MIPMAP_MODE_NEAREST : VK_SAMPLER_MIPMAP_MODE_LINEAR;
-    samplerInfo.addressModeU = wrap == ae3d::TextureWrap::Repeat ? VK_SAMPLER_ADDRESS_MODE_REPEAT : VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
-    samplerInfo.addressModeV = samplerInfo.addressModeU;
-    samplerInfo.addressModeW = samplerInfo.addressModeU;
-    samplerInfo.mipLodBias = 0;
-    samplerInfo.compareOp = VK_COMPARE_OP_NEVER;
-    samplerInfo.minLod = 0;
-    samplerInfo.maxLod = static_cast< float >(mipLevelCount);
-    samplerInfo.maxAnisotropy = GfxDeviceGlobal::deviceFeatures.samplerAnisotropy ? GetFloatAnisotropy( anisotropy ) : 1;
-    samplerInfo.anisotropyEnable = (anisotropy != Anisotropy::k1 && GfxDeviceGlobal::deviceFeatures.samplerAnisotropy) ? VK_TRUE : VK_FALSE;
-    samplerInfo.borderColor = VK_BORDER_COLOR_FLOAT_TRANSPARENT_BLACK;
-    err = vkCreateSampler( GfxDeviceGlobal::device, &samplerInfo, nullptr, &sampler );
-    AE3D_CHECK_VULKAN( err, "vkCreateSampler" );
-    Texture2DGlobal::samplersToReleaseAtExit.push_back( sampler );
-
-    debug::SetObjectName( GfxDeviceGlobal::device, (std::uint64_t)sampler, VK_OBJECT_TYPE_SAMPLER, "sampler" );
+    sampler = GetSharedSampler( filter, wrap, anisotropy );
 }
 
 void ae3d::Texture2D::CreateUAV( int aWidth, int aHeight, const char* debugName, DataType format, const void* imageData )
@@ -545,6 +710,7 @@ void ae3d::Texture2D::CreateVulkanObjects( void* data, int bytesPerPixel, VkForm
     if (data)
     {
         std::memcpy( stagingData, data, imageSize );
+        Statistics::IncTextureUploadBytes( static_cast< std::size_t >( imageSize ) );
     }
 
     VkMappedMemoryRange flushRange = {};
@@ -730,32 +896,12 @@ void ae3d::Texture2D::CreateVulkanObjects( void* data, int bytesPerPixel, VkForm
     vkDestroyBuffer( GfxDeviceGlobal::device, stagingBuffer, nullptr );
     vkFreeMemory( GfxDeviceGlobal::device, stagingMemory, nullptr );
 
-    VkSamplerCreateInfo samplerInfo = {};
-    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
-    samplerInfo.magFilter = filter == ae3d::TextureFilter::Nearest ? VK_FILTER_NEAREST : VK_FILTER_LINEAR;
-    samplerInfo.minFilter = samplerInfo.magFilter;
-    samplerInfo.mipmapMode = filter == ae3d::TextureFilter::Nearest ? VK_SAMPLER_MIPMAP_MODE_NEAREST : VK_SAMPLER_MIPMAP_MODE_LINEAR;
-    samplerInfo.addressModeU = wrap == ae3d::TextureWrap::Repeat ? VK_SAMPLER_ADDRESS_MODE_REPEAT : VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
-    samplerInfo.addressModeV = samplerInfo.addressModeU;
-    samplerInfo.addressModeW = samplerInfo.addressModeU;
-    samplerInfo.mipLodBias = 0;
-    samplerInfo.compareOp = VK_COMPARE_OP_NEVER;
-    samplerInfo.minLod = 0;
-    samplerInfo.maxLod = static_cast< float >(mipLevelCount);
-    samplerInfo.maxAnisotropy = GfxDeviceGlobal::deviceFeatures.samplerAnisotropy ? GetFloatAnisotropy( anisotropy ) : 1;
-    samplerInfo.anisotropyEnable = (anisotropy != Anisotropy::k1 && GfxDeviceGlobal::deviceFeatures.samplerAnisotropy) ? VK_TRUE : VK_FALSE;
-    samplerInfo.borderColor = VK_BORDER_COLOR_FLOAT_TRANSPARENT_BLACK;
-    err = vkCreateSampler( GfxDeviceGlobal::device, &samplerInfo, nullptr, &sampler );
-    AE3D_CHECK_VULKAN( err, "vkCreateSampler" );
-    Texture2DGlobal::samplersToReleaseAtExit.push_back( sampler );
-
-    debug::SetObjectName( GfxDeviceGlobal::device, (std::uint64_t)sampler, VK_OBJECT_TYPE_SAMPLER, "sampler" );
+    sampler = GetSharedSampler( filter, wrap, anisotropy );
 }
 
-void ae3d::Texture2D::LoadDDS( const char* aPath )
+void ae3d::Texture2D::LoadDDS( const FileSystem::FileContentsData& fileContents )
 {
     DDSLoader::Output ddsOutput;
-    auto fileContents = FileSystem::FileContents( aPath );
 #if VK_USE_PLATFORM_ANDROID_KHR
     const DDSLoader::LoadResult loadResult = DDSLoader::LoaddResult::FileNotFound;
 #else
@@ -763,7 +909,7 @@ void ae3d::Texture2D::LoadDDS( const char* aPath )
 #endif
     if (loadResult != DDSLoader::LoadResult::Success)
     {
-        ae3d::System::Print( "DDS Loader could not load %s", aPath );
+        ae3d::System::Print( "DDS Loader could not load %s", fileContents.path.c_str() );
         return;
     }
 
@@ -776,7 +922,26 @@ void ae3d::Texture2D::LoadDDS( const char* aPath )
         height = GfxDeviceGlobal::properties.limits.maxImageDimension2D;
     }
 
-    mipLevelCount = mipmaps == Mipmaps::Generate ? ddsOutput.dataOffsets.count : 1;
+    ae3d::System::Assert( ddsOutput.dataOffsets.count > 0, "DDS reader error: dataoffsets is empty" );
+
+    const int mipCount = mipmaps == Mipmaps::Generate ? ddsOutput.dataOffsets.count : 1;
+    CreateFromDDSMips( ddsOutput, BeginStreaming( ddsOutput, mipCount ), false );
+}
+
+void ae3d::Texture2D::CreateFromDDSMips( const DDSLoader::Output& ddsOutput, int firstMip, bool releasePrevious )
+{
+    if (releasePrevious)
+    {
+        // Recorded draws can reference the previous objects, so they are released after the frame.
+        Texture2DGlobal::RemoveFromReleaseList( Texture2DGlobal::imageViewsToReleaseAtExit, view );
+        Texture2DGlobal::RemoveFromReleaseList( Texture2DGlobal::imagesToReleaseAtExit, image );
+        Texture2DGlobal::RemoveFromReleaseList( Texture2DGlobal::memoryToReleaseAtExit, deviceMemory );
+        GfxDeviceGlobal::pendingFreeImageViews.Add( view );
+        GfxDeviceGlobal::pendingFreeImages.Add( image );
+        GfxDeviceGlobal::pendingFreeMemory.Add( deviceMemory );
+    }
+
+    mipLevelCount = (mipmaps == Mipmaps::Generate ? ddsOutput.dataOffsets.count : 1) - firstMip;
 
     VkFormat format = (colorSpace == ColorSpace::Linear) ? VK_FORMAT_BC1_RGB_UNORM_BLOCK : VK_FORMAT_BC1_RGB_SRGB_BLOCK;
 
@@ -813,15 +978,27 @@ void ae3d::Texture2D::LoadDDS( const char* aPath )
     {
         format = VK_FORMAT_BC5_SNORM_BLOCK;
     }
+    else if (ddsOutput.format == DDSLoader::Format::BC7)
+    {
+        format = (colorSpace == ColorSpace::Linear) ? VK_FORMAT_BC7_UNORM_BLOCK : VK_FORMAT_BC7_SRGB_BLOCK;
+    }
     else
     {
-        ae3d::System::Print( "File: %s\n", aPath  );
+        ae3d::System::Print( "File: %s\n", path.c_str() );
         ae3d::System::Assert( false, "Unhandled compression format!" );
     }
-    
-    ae3d::System::Assert( ddsOutput.dataOffsets.count > 0, "DDS reader error: dataoffsets is empty" );
 
-    CreateVulkanObjects( ddsOutput, format );
+    CreateVulkanObjects( ddsOutput, format, firstMip );
+    debug::SetObjectName( GfxDeviceGlobal::device, (std::uint64_t)view, VK_OBJECT_TYPE_IMAGE_VIEW, path.c_str() );
+    debug::SetObjectName( GfxDeviceGlobal::device, (std::uint64_t)image, VK_OBJECT_TYPE_IMAGE, path.c_str() );
+
+    if (releasePrevious)
+    {
+        // Cached copies are updated like in a reload.
+        VkMemoryRequirements memReqs;
+        vkGetImageMemoryRequirements( GfxDeviceGlobal::device, image, &memReqs );
+        CacheTexture( *this, (std::size_t)memReqs.size );
+    }
 }
 
 void ae3d::Texture2D::LoadSTB( const FileSystem::FileContentsData& fileContents )
@@ -830,7 +1007,7 @@ void ae3d::Texture2D::LoadSTB( const FileSystem::FileContentsData& fileContents
     System::Assert( GfxDeviceGlobal::device != VK_NULL_HANDLE, "device not initialized" );
 
     int components;
-    unsigned char* data = stbi_load_from_memory( fileContents.data.data(), static_cast<int>(fileContents.data.size()), &width, &height, &components, 4 );
+    unsigned char* data = LoadStbImage( fileContents, width, height, components );
 
     if (data == nullptr)
     {
@@ -851,8 +1028,44 @@ void ae3d::Texture2D::LoadSTB( const FileSystem::FileContentsData& fileContents
     }
 
     opaque = (components == 3 || components == 1);
+    const VkFormat format = colorSpace == ColorSpace::Linear ? VK_FORMAT_R8G8B8A8_UNORM : VK_FORMAT_R8G8B8A8_SRGB;
 
-    CreateVulkanObjects( data, 4, colorSpace == ColorSpace::Linear ? VK_FORMAT_R8G8B8A8_UNORM : VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT );
+    if (mipmaps == Mipmaps::Generate)
+    {
+        // Mips are generated on the CPU and the chain is uploaded with other textures' uploads instead of blitting and waiting.
+        std::vector< unsigned char > mips;
+        GetStbMips( fileContents.path, data, width, height, colorSpace, wrap, mips );
+
+        mipLevelCount = MathUtil::GetMipmapCount( width, height );
+        const int baseSize = width * height * 4;
+
+        DDSLoader::Output mipChain;
+        mipChain.imageData.Allocate( baseSize + (unsigned)mips.size() );
+        mipChain.dataOffsets.Allocate( mipLevelCount );
+        std::memcpy( &mipChain.imageData[ 0 ], data, baseSize );
+
+        if (!mips.empty())
+        {
+            std::memcpy( &mipChain.imageData[ baseSize ], mips.data(), mips.size() );
+        }
+
+        int offset = 0;
+
+        for (int mip = 0; mip < mipLevelCount; ++mip)
+        {
+            mipChain.dataOffsets[ mip ] = offset;
+            offset += MathUtil::Max( width >> mip, 1 ) * MathUtil::Max( height >> mip, 1 ) * 4;
+        }
+
+        CreateVulkanObjects( mipChain, format, 0 );
+        layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        debug::SetObjectName( GfxDeviceGlobal::device, (std::uint64_t)view, VK_OBJECT_TYPE_IMAGE_VIEW, fileContents.path.c_str() );
+        debug::SetObjectName( GfxDeviceGlobal::device, (std::uint64_t)image, VK_OBJECT_TYPE_IMAGE, fileContents.path.c_str() );
+    }
+    else
+    {
+        CreateVulkanObjects( data, 4, format, VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT );
+    }
 
     stbi_image_free( data );
 }
@@ -324,6 +324,10 @@ void ae3d::TextureCube::Load( const FileSystem::FileContentsData& negX, const Fi
             {
                 format = VK_FORMAT_BC5_SNORM_BLOCK;
             }
+            else if (ddsOutput[ face ].format == DDSLoader::Format::BC7)
+            {
+                format = (colorSpace == ColorSpace::Linear) ? VK_FORMAT_BC7_UNORM_BLOCK : VK_FORMAT_BC7_SRGB_BLOCK;
+            }
             else
             {
                 ae3d::System::Assert( false, "DDS reader error: Unhandled DDS format!" );
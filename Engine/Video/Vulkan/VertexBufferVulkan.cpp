@@ -2,6 +2,7 @@
 // PVS-Studio Static Code Analyzer for C, C++, C#, and Java: http://www.viva64.com
 #include "VertexBuffer.hpp"
 #include <vector>
+#include <cstddef>
 #include <cstring>
 #include <cstdint>
 #include "Array.hpp"
@@ -159,60 +160,163 @@ void MarkForFreeing( VkBuffer vertexBuffer, VkDeviceMemory vertexMem, VkBuffer i
     GfxDeviceGlobal::pendingFreeVBs.Add( indexBuffer );
 }
 
-void ae3d::VertexBuffer::GenerateVertexBuffer( const void* vertexData, int vertexBufferSize, int vertexStride, const void* indexData, int indexBufferSize )
+void ae3d::VertexBuffer::Release()
 {
-    System::Assert( GfxDeviceGlobal::device != VK_NULL_HANDLE, "device not initialized" );
-    System::Assert( vertexData != nullptr, "vertexData not initialized" );
-    System::Assert( indexData != nullptr, "indexData not initialized" );
-
     if (vertexBuffer != VK_NULL_HANDLE)
     {
         MarkForFreeing( vertexBuffer, vertexMem, indexBuffer, indexMem );
+        vertexBuffer = indexBuffer = VK_NULL_HANDLE;
+        vertexMem = indexMem = VK_NULL_HANDLE;
+    }
+
+    if (depthStreams[ 0 ] != VK_NULL_HANDLE)
+    {
+        MarkForFreeing( depthStreams[ 0 ], depthStreamMems[ 0 ], depthStreams[ 1 ], depthStreamMems[ 1 ] );
+        depthStreams[ 0 ] = depthStreams[ 1 ] = VK_NULL_HANDLE;
+        depthStreamMems[ 0 ] = depthStreamMems[ 1 ] = VK_NULL_HANDLE;
     }
 
-    // Vertex buffer
-    const bool shouldCreateStagingBuffer = globalStagingBuffer.size < vertexBufferSize || globalStagingBuffer.size < indexBufferSize;
+    elementCount = 0;
+}
 
-    if (shouldCreateStagingBuffer)
+void ae3d::VertexBuffer::UploadBuffer( const void* data, int size, VkBufferUsageFlags usage, VkBuffer& outBuffer, VkDeviceMemory& outMemory, const char* debugName )
+{
+    if (globalStagingBuffer.size < size)
     {
-        globalStagingBuffer.size = vertexBufferSize > indexBufferSize ? vertexBufferSize : indexBufferSize;
+        globalStagingBuffer.size = size;
         CreateBuffer( globalStagingBuffer.buffer, globalStagingBuffer.size, globalStagingBuffer.memory, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, "global staging buffer" );
         //VertexBufferGlobal::buffersToReleaseAtExit.push_back( stagingBuffers.vertices.buffer );
         //VertexBufferGlobal::memoryToReleaseAtExit.push_back( stagingBuffers.vertices.memory );
     }
-    
+
     void* bufferData = nullptr;
-    VkResult err = vkMapMemory( GfxDeviceGlobal::device, globalStagingBuffer.memory, 0, vertexBufferSize, 0, &bufferData );
-    AE3D_CHECK_VULKAN( err, "map vertex memory" );
+    VkResult err = vkMapMemory( GfxDeviceGlobal::device, globalStagingBuffer.memory, 0, size, 0, &bufferData );
+    AE3D_CHECK_VULKAN( err, "map staging memory" );
 
-    std::memcpy( bufferData, vertexData, vertexBufferSize );
+    std::memcpy( bufferData, data, size );
     vkUnmapMemory( GfxDeviceGlobal::device, globalStagingBuffer.memory );
 
+    CreateBuffer( outBuffer, size, outMemory, usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, debugName );
+    VertexBufferGlobal::buffersToReleaseAtExit.push_back( outBuffer );
+    VertexBufferGlobal::memoryToReleaseAtExit.push_back( outMemory );
+
+    CopyBuffer( globalStagingBuffer.buffer, outBuffer, size );
+}
+
+void ae3d::VertexBuffer::GenerateVertexBuffer( const void* vertexData, int vertexBufferSize, int vertexStride, const void* indexData, int indexBufferSize )
+{
+    System::Assert( GfxDeviceGlobal::device != VK_NULL_HANDLE, "device not initialized" );
+    System::Assert( vertexData != nullptr, "vertexData not initialized" );
+    System::Assert( indexData != nullptr, "indexData not initialized" );
+
+    if (vertexBuffer != VK_NULL_HANDLE)
     {
-        CreateBuffer( vertexBuffer, vertexBufferSize, vertexMem, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, "vertex buffer" );
-        VertexBufferGlobal::buffersToReleaseAtExit.push_back( vertexBuffer );
-        VertexBufferGlobal::memoryToReleaseAtExit.push_back( vertexMem );
+        MarkForFreeing( vertexBuffer, vertexMem, indexBuffer, indexMem );
     }
-    
-    CopyBuffer( globalStagingBuffer.buffer, vertexBuffer, vertexBufferSize );
-    
-    err = vkMapMemory( GfxDeviceGlobal::device, globalStagingBuffer.memory, 0, indexBufferSize, 0, &bufferData );
-    AE3D_CHECK_VULKAN( err, "map staging index memory" );
-
-    std::memcpy( bufferData, indexData, indexBufferSize );
-    vkUnmapMemory( GfxDeviceGlobal::device, globalStagingBuffer.memory );
 
+    // Depth streams were built from the previous vertices.
+    if (depthStreams[ 0 ] != VK_NULL_HANDLE)
     {
-        CreateBuffer( indexBuffer, indexBufferSize, indexMem, VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, "index buffer" );
-        VertexBufferGlobal::buffersToReleaseAtExit.push_back( indexBuffer );
-        VertexBufferGlobal::memoryToReleaseAtExit.push_back( indexMem );
+        MarkForFreeing( depthStreams[ 0 ], depthStreamMems[ 0 ], depthStreams[ 1 ], depthStreamMems[ 1 ] );
+        depthStreams[ 0 ] = depthStreams[ 1 ] = VK_NULL_HANDLE;
+        depthStreamMems[ 0 ] = depthStreamMems[ 1 ] = VK_NULL_HANDLE;
     }
-    
-    CopyBuffer( globalStagingBuffer.buffer, indexBuffer, indexBufferSize );
+
+    UploadBuffer( vertexData, vertexBufferSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, vertexBuffer, vertexMem, "vertex buffer" );
+    UploadBuffer( indexData, indexBufferSize, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, indexBuffer, indexMem, "index buffer" );
 
     CreateInputState( vertexStride );
 }
 
+void ae3d::VertexBuffer::GeneratePacked( const void* indices, IndexType aIndexType, int faceCount, const void* vertices, VertexFormat aVertexFormat, int vertexCount,
+                                         const Vec4& aPositionDequantization )
+{
+    System::Assert( aVertexFormat == VertexFormat::PTNTC || aVertexFormat == VertexFormat::PTNTC_Skinned ||
+                    aVertexFormat == VertexFormat::PTNTC_Compact || aVertexFormat == VertexFormat::PTNTC_Compact_Skinned, "GeneratePacked: unsupported vertex format" );
+    System::Assert( aIndexType == IndexType::UInt32 || vertexCount <= 65536, "GeneratePacked: too many vertices for 16-bit indices" );
+
+    vertexFormat = aVertexFormat;
+    indexType = aIndexType;
+    elementCount = faceCount * 3;
+    positionDequantization = aPositionDequantization;
+
+    const int stride = GetVertexSize( vertexFormat );
+    GenerateVertexBuffer( vertices, vertexCount * stride, stride, indices, elementCount * GetIndexSize() );
+}
+
+void ae3d::VertexBuffer::GenerateDepthStreamBuffers( const void* positions, int positionsSize, const void* positionsNormals, int positionsNormalsSize )
+{
+    System::Assert( vertexBuffer != VK_NULL_HANDLE, "GenerateDepthStreams must be called after Generate" );
+
+    if (depthStreams[ 0 ] != VK_NULL_HANDLE)
+    {
+        MarkForFreeing( depthStreams[ 0 ], depthStreamMems[ 0 ], depthStreams[ 1 ], depthStreamMems[ 1 ] );
+    }
+
+    UploadBuffer( positions, positionsSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, depthStreams[ 0 ], depthStreamMems[ 0 ], "position stream" );
+    UploadBuffer( positionsNormals, positionsNormalsSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, depthStreams[ 1 ], depthStreamMems[ 1 ], "position normal stream" );
+}
+
+void ae3d::VertexBuffer::GenerateDepthStreams( const Vec3* positions, const VertexPN* positionsNormals, int vertexCount )
+{
+    System::Assert( vertexFormat == VertexFormat::PTNTC || vertexFormat == VertexFormat::PTN, "Depth streams need a non-skinned float vertex format" );
+    GenerateDepthStreamBuffers( positions, vertexCount * sizeof( Vec3 ), positionsNormals, vertexCount * sizeof( VertexPN ) );
+}
+
+void ae3d::VertexBuffer::GenerateDepthStreams( const VertexP_Compact* positions, const VertexPN_Compact* positionsNormals, int vertexCount )
+{
+    System::Assert( vertexFormat == VertexFormat::PTNTC_Compact, "Depth streams need PTNTC_Compact vertex format" );
+    GenerateDepthStreamBuffers( positions, vertexCount * sizeof( VertexP_Compact ), positionsNormals, vertexCount * sizeof( VertexPN_Compact ) );
+}
+
+VkPipelineVertexInputStateCreateInfo* ae3d::VertexBuffer::GetInputState( Shader::VertexInput input )
+{
+    if (GetBoundInput( input ) == Shader::VertexInput::All)
+    {
+        return GetInputState();
+    }
+
+    const int streamIndex = (int)input - 1;
+    const bool isCompact = vertexFormat == VertexFormat::PTNTC_Compact;
+    const bool hasNormal = input == Shader::VertexInput::PositionNormal;
+
+    VkVertexInputBindingDescription& binding = depthBindingDescriptions[ streamIndex ];
+    binding.binding = VERTEX_BUFFER_BIND_ID;
+    binding.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+    if (hasNormal)
+    {
+        binding.stride = isCompact ? sizeof( VertexPN_Compact ) : sizeof( VertexPN );
+    }
+    else
+    {
+        binding.stride = isCompact ? sizeof( VertexP_Compact ) : sizeof( Vec3 );
+    }
+
+    // Location 0 : Position
+    VkVertexInputAttributeDescription* attributes = depthAttributeDescriptions[ streamIndex ];
+    attributes[ 0 ].binding = VERTEX_BUFFER_BIND_ID;
+    attributes[ 0 ].location = posChannel;
+    attributes[ 0 ].format = isCompact ? VK_FORMAT_R16G16B16A16_UNORM : VK_FORMAT_R32G32B32_SFLOAT;
+    attributes[ 0 ].offset = 0;
+
+    // Location 3 : Normal
+    attributes[ 1 ].binding = VERTEX_BUFFER_BIND_ID;
+    attributes[ 1 ].location = normalChannel;
+    attributes[ 1 ].format = isCompact ? VK_FORMAT_R8G8B8A8_SNORM : VK_FORMAT_R32G32B32_SFLOAT;
+    attributes[ 1 ].offset = isCompact ? offsetof( VertexPN_Compact, normal ) : offsetof( VertexPN, normal );
+
+    VkPipelineVertexInputStateCreateInfo& state = depthInputStates[ streamIndex ];
+    state.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    state.pNext = nullptr;
+    state.vertexBindingDescriptionCount = 1;
+    state.pVertexBindingDescriptions = &binding;
+    state.vertexAttributeDescriptionCount = hasNormal ? 2 : 1;
+    state.pVertexAttributeDescriptions = attributes;
+
+    return &state;
+}
+
 void ae3d::VertexBuffer::CreateInputState( int vertexStride )
 {
     bindingDescriptions.binding = VERTEX_BUFFER_BIND_ID;
@@ -345,6 +449,53 @@ void ae3d::VertexBuffer::CreateInputState( int vertexStride )
         attributeDescriptions[ 6 ].format = VK_FORMAT_R32G32B32A32_UINT;
         attributeDescriptions[ 6 ].offset = sizeof( float ) * 20;
     }
+    else if (vertexFormat == VertexFormat::PTNTC_Compact || vertexFormat == VertexFormat::PTNTC_Compact_Skinned)
+    {
+        // Normalized formats are expanded to floats by the input assembler, so shaders are shared with PTNTC.
+        attributeCount = vertexFormat == VertexFormat::PTNTC_Compact ? 5 : 7;
+
+        // Location 0 : Position
+        attributeDescriptions[ 0 ].binding = VERTEX_BUFFER_BIND_ID;
+        attributeDescriptions[ 0 ].location = posChannel;
+        attributeDescriptions[ 0 ].format = VK_FORMAT_R16G16B16A16_UNORM;
+        attributeDescriptions[ 0 ].offset = offsetof( VertexPTNTC_Compact_Skinned, position );
+
+        // Location 1 : TexCoord
+        attributeDescriptions[ 1 ].binding = VERTEX_BUFFER_BIND_ID;
+        attributeDescriptions[ 1 ].location = uvChannel;
+        attributeDescriptions[ 1 ].format = VK_FORMAT_R16G16_SFLOAT;
+        attributeDescriptions[ 1 ].offset = offsetof( VertexPTNTC_Compact_Skinned, uv );
+
+        // Location 2 : Normal
+        attributeDescriptions[ 2 ].binding = VERTEX_BUFFER_BIND_ID;
+        attributeDescriptions[ 2 ].location = normalChannel;
+        attributeDescriptions[ 2 ].format = VK_FORMAT_R8G8B8A8_SNORM;
+        attributeDescriptions[ 2 ].offset = offsetof( VertexPTNTC_Compact_Skinned, normal );
+
+        // Location 3 : Tangent
+        attributeDescriptions[ 3 ].binding = VERTEX_BUFFER_BIND_ID;
+        attributeDescriptions[ 3 ].location = tangentChannel;
+        attributeDescriptions[ 3 ].format = VK_FORMAT_R8G8B8A8_SNORM;
+        attributeDescriptions[ 3 ].offset = offsetof( VertexPTNTC_Compact_Skinned, tangent );
+
+        // Location 4 : Color
+        attributeDescriptions[ 4 ].binding = VERTEX_BUFFER_BIND_ID;
+        attributeDescriptions[ 4 ].location = colorChannel;
+        attributeDescriptions[ 4 ].format = VK_FORMAT_R8G8B8A8_UNORM;
+        attributeDescriptions[ 4 ].offset = offsetof( VertexPTNTC_Compact_Skinned, color );
+
+        // Location 5 : Weights
+        attributeDescriptions[ 5 ].binding = VERTEX_BUFFER_BIND_ID;
+        attributeDescriptions[ 5 ].location = weightChannel;
+        attributeDescriptions[ 5 ].format = VK_FORMAT_R8G8B8A8_UNORM;
+        attributeDescriptions[ 5 ].offset = offsetof( VertexPTNTC_Compact_Skinned, weights );
+
+        // Location 6 : Bones
+        attributeDescriptions[ 6 ].binding = VERTEX_BUFFER_BIND_ID;
+        attributeDescriptions[ 6 ].location = boneChannel;
+        attributeDescriptions[ 6 ].format = VK_FORMAT_R8G8B8A8_UINT;
+        attributeDescriptions[ 6 ].offset = offsetof( VertexPTNTC_Compact_Skinned, bones );
+    }
     else
     {
         System::Assert( false, "unhandled vertex format" );
@@ -362,6 +513,7 @@ void ae3d::VertexBuffer::GenerateDynamic( int faceCount, int vertexCount )
 {
     vertexFormat = VertexFormat::PTNTC;
     elementCount = faceCount * 3;
+    indexType = vertexCount > 65536 ? IndexType::UInt32 : IndexType::UInt16;
 
     CreateBuffer( stagingBuffers.vertices.buffer, vertexCount * sizeof( VertexPTNTC ), stagingBuffers.vertices.memory, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, "dynamic vertex buffer" );
     stagingBuffers.vertices.size = vertexCount * sizeof( VertexPTNTC );
@@ -369,8 +521,8 @@ void ae3d::VertexBuffer::GenerateDynamic( int faceCount, int vertexCount )
     VkResult err = vkMapMemory( GfxDeviceGlobal::device, stagingBuffers.vertices.memory, 0, stagingBuffers.vertices.size, 0, &stagingBuffers.vertices.mappedData );
     AE3D_CHECK_VULKAN( err, "vkMapMemory GenerateDynamic" );
 
-    CreateBuffer( stagingBuffers.indices.buffer, elementCount * 2, stagingBuffers.indices.memory, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, "dynamic index buffer" );
-    stagingBuffers.indices.size = elementCount * 2;
+    CreateBuffer( stagingBuffers.indices.buffer, elementCount * GetIndexSize(), stagingBuffers.indices.memory, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, "dynamic index buffer" );
+    stagingBuffers.indices.size = elementCount * GetIndexSize();
 
     err = vkMapMemory( GfxDeviceGlobal::device, stagingBuffers.indices.memory, 0, stagingBuffers.indices.size, 0, &stagingBuffers.indices.mappedData );
     AE3D_CHECK_VULKAN( err, "vkMapMemory GenerateDynamic" );
@@ -387,11 +539,41 @@ void ae3d::VertexBuffer::UpdateDynamic( const Face* faces, int faceCount, const
 {
     System::Assert( stagingBuffers.indices.mappedData != nullptr, "Index buffer not initialized!" );
     System::Assert( stagingBuffers.indices.buffer != VK_NULL_HANDLE, "Index buffer not initialized!" );
+    System::Assert( stagingBuffers.indices.size >= faceCount * 3 * GetIndexSize(), "Index buffer too small!" );
+    System::Assert( (std::size_t)stagingBuffers.vertices.size >= vertexCount * sizeof( VertexPTNTC ), "Vertex buffer too small!" );
+
+    if (indexType == IndexType::UInt32)
+    {
+        std::memcpy( stagingBuffers.indices.mappedData, faces, faceCount * 3 * 4 );
+    }
+    else
+    {
+        unsigned short* indices = static_cast< unsigned short* >( stagingBuffers.indices.mappedData );
+
+        for (int f = 0; f < faceCount; ++f)
+        {
+            indices[ f * 3 + 0 ] = (unsigned short)faces[ f ].a;
+            indices[ f * 3 + 1 ] = (unsigned short)faces[ f ].b;
+            indices[ f * 3 + 2 ] = (unsigned short)faces[ f ].c;
+        }
+    }
+
+    UpdateDynamicVertices( vertices, vertexCount );
+}
+
+void ae3d::VertexBuffer::UpdateDynamic( const unsigned short* indices, int faceCount, const VertexPTC* vertices, int vertexCount )
+{
+    System::Assert( stagingBuffers.indices.mappedData != nullptr, "Index buffer not initialized!" );
+    System::Assert( indexType == IndexType::UInt16, "Buffer has 32-bit indices!" );
     System::Assert( stagingBuffers.indices.size >= faceCount * 3 * 2, "Index buffer too small!" );
     System::Assert( (std::size_t)stagingBuffers.vertices.size >= vertexCount * sizeof( VertexPTNTC ), "Vertex buffer too small!" );
 
-    std::memcpy( stagingBuffers.indices.mappedData, faces, faceCount * 3 * 2 );
+    std::memcpy( stagingBuffers.indices.mappedData, indices, faceCount * 3 * 2 );
+    UpdateDynamicVertices( vertices, vertexCount );
+}
 
+void ae3d::VertexBuffer::UpdateDynamicVertices( const VertexPTC* vertices, int vertexCount )
+{
     for (unsigned vertexInd = 0; vertexInd < verticesPTNTC.count; ++vertexInd)
     {
         verticesPTNTC[ vertexInd ].position = vertices[ vertexInd ].position;
@@ -410,6 +592,9 @@ void ae3d::VertexBuffer::Generate( const Face* faces, int faceCount, const Verte
     vertexFormat = VertexFormat::PTNTC;
     elementCount = faceCount * 3;
 
+    Array< unsigned short > indices16;
+    const void* indices = PackIndices( faces, faceCount, vertexCount, indices16 );
+
     Array< VertexPTNTC > verticesPTNTC2;
     verticesPTNTC2.Allocate( vertexCount );
     
@@ -423,7 +608,7 @@ void ae3d::VertexBuffer::Generate( const Face* faces, int faceCount, const Verte
         verticesPTNTC2[ vertexInd ].color = vertices[ vertexInd ].color;
     }
 
-    GenerateVertexBuffer( static_cast< const void*>( verticesPTNTC2.elements ), vertexCount * sizeof( VertexPTNTC ), sizeof( VertexPTNTC ), static_cast< const void* >(faces), elementCount * 2 );
+    GenerateVertexBuffer( static_cast< const void*>( verticesPTNTC2.elements ), vertexCount * sizeof( VertexPTNTC ), sizeof( VertexPTNTC ), indices, elementCount * GetIndexSize() );
 }
 
 void ae3d::VertexBuffer::Generate( const Face* faces, int faceCount, const VertexPTN* vertices, int vertexCount )
@@ -431,6 +616,9 @@ void ae3d::VertexBuffer::Generate( const Face* faces, int faceCount, const Verte
     vertexFormat = VertexFormat::PTNTC;
     elementCount = faceCount * 3;
 
+    Array< unsigned short > indices16;
+    const void* indices = PackIndices( faces, faceCount, vertexCount, indices16 );
+
     Array< VertexPTNTC > verticesPTNTC2;
     verticesPTNTC2.Allocate( vertexCount );
 
@@ -444,19 +632,47 @@ void ae3d::VertexBuffer::Generate( const Face* faces, int faceCount, const Verte
         verticesPTNTC2[ vertexInd ].color = Vec4( 1, 1, 1, 1 );
     }
 
-    GenerateVertexBuffer( static_cast< const void*>( verticesPTNTC2.elements ), vertexCount * sizeof( VertexPTNTC ), sizeof( VertexPTNTC ), static_cast< const void* >( faces ), elementCount * 2 );
+    GenerateVertexBuffer( static_cast< const void*>( verticesPTNTC2.elements ), vertexCount * sizeof( VertexPTNTC ), sizeof( VertexPTNTC ), indices, elementCount * GetIndexSize() );
 }
 
 void ae3d::VertexBuffer::Generate( const Face* faces, int faceCount, const VertexPTNTC* vertices, int vertexCount )
 {
     vertexFormat = VertexFormat::PTNTC;
     elementCount = faceCount * 3;
-    GenerateVertexBuffer( static_cast< const void*>( vertices ), vertexCount * sizeof( VertexPTNTC ), sizeof( VertexPTNTC ), static_cast< const void*>( faces ), elementCount * 2 );
+
+    Array< unsigned short > indices16;
+    const void* indices = PackIndices( faces, faceCount, vertexCount, indices16 );
+    GenerateVertexBuffer( static_cast< const void*>( vertices ), vertexCount * sizeof( VertexPTNTC ), sizeof( VertexPTNTC ), indices, elementCount * GetIndexSize() );
 }
 
 void ae3d::VertexBuffer::Generate( const Face* faces, int faceCount, const VertexPTNTC_Skinned* vertices, int vertexCount )
 {
     vertexFormat = VertexFormat::PTNTC_Skinned;
     elementCount = faceCount * 3;
-    GenerateVertexBuffer( static_cast< const void*>( vertices ), vertexCount * sizeof( VertexPTNTC_Skinned ), sizeof( VertexPTNTC_Skinned ), static_cast< const void*>( faces ), elementCount * 2 );
+
+    Array< unsigned short > indices16;
+    const void* indices = PackIndices( faces, faceCount, vertexCount, indices16 );
+    GenerateVertexBuffer( static_cast< const void*>( vertices ), vertexCount * sizeof( VertexPTNTC_Skinned ), sizeof( VertexPTNTC_Skinned ), indices, elementCount * GetIndexSize() );
+}
+
+void ae3d::VertexBuffer::Generate( const Face* faces, int faceCount, const VertexPTNTC_Compact* vertices, int vertexCount, const Vec3& positionOffset, float positionScale )
+{
+    vertexFormat = VertexFormat::PTNTC_Compact;
+    elementCount = faceCount * 3;
+    positionDequantization = Vec4( positionOffset, positionScale );
+
+    Array< unsigned short > indices16;
+    const void* indices = PackIndices( faces, faceCount, vertexCount, indices16 );
+    GenerateVertexBuffer( static_cast< const void*>( vertices ), vertexCount * sizeof( VertexPTNTC_Compact ), sizeof( VertexPTNTC_Compact ), indices, elementCount * GetIndexSize() );
+}
+
+void ae3d::VertexBuffer::Generate( const Face* faces, int faceCount, const VertexPTNTC_Compact_Skinned* vertices, int vertexCount, const Vec3& positionOffset, float positionScale )
+{
+    vertexFormat = VertexFormat::PTNTC_Compact_Skinned;
+    elementCount = faceCount * 3;
+    positionDequantization = Vec4( positionOffset, positionScale );
+
+    Array< unsigned short > indices16;
+    const void* indices = PackIndices( faces, faceCount, vertexCount, indices16 );
+    GenerateVertexBuffer( static_cast< const void*>( vertices ), vertexCount * sizeof( VertexPTNTC_Compact_Skinned ), sizeof( VertexPTNTC_Compact_Skinned ), indices, elementCount * GetIndexSize() );
 }
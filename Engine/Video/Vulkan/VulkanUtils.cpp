@@ -208,6 +208,7 @@ namespace ae3d
         outResult += ((unsigned)fillMode) * 8;
         outResult += ((ptrdiff_t)renderPass) * 16;
         outResult += ((unsigned)topology) * 32;
+        outResult += ((unsigned)vertexBuffer.GetBoundInput( shader.GetVertexInput() )) * 64;
 
         return outResult;
     }
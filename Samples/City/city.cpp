@@ -113,6 +113,7 @@ int main()
 
     Window::SetTitle( "City 2021" );
     System::LoadBuiltinAssets();
+    System::SetCommandRecordingThreadCount( 3 );
     System::InitAudio();
     System::InitGamePad();
 
@@ -283,6 +284,8 @@ int main()
     scene.Add( &camera2d );
     scene.Add( &statsContainer );
     scene.Add( &dirLight );
+    scene.CreatePipelineStates( cityGameObjects );
+    scene.CreatePipelineStates( cityGameObjects2 );
 
     constexpr int PointLightCount = 50 * 40;
     GameObject pointLights[ PointLightCount ];
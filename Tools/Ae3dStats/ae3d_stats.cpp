@@ -0,0 +1,343 @@
+/**
+  Prints vertex cache, overdraw and vertex fetch statistics of .ae3d meshes.
+
+  Usage: ae3d_stats file.ae3d [file2.ae3d ...]
+
+  Reads versions a9, b0, b1, b2 and c0.
+*/
+#include <cstdio>
+#include "../common.hpp"
+#include "MeshCodec.hpp"
+
+/// Reads little-endian data from a file in memory.
+struct Reader
+{
+    const std::vector< unsigned char >& data;
+    std::size_t position;
+
+    bool Read( void* destination, std::size_t size )
+    {
+        if (size > data.size() - position)
+        {
+            return false;
+        }
+
+        std::memcpy( destination, &data[ position ], size );
+        position += size;
+        return true;
+    }
+
+    bool Skip( std::size_t size )
+    {
+        if (size > data.size() - position)
+        {
+            return false;
+        }
+
+        position += size;
+        return true;
+    }
+};
+
+struct SubMeshInfo
+{
+    std::string name;
+    std::vector< ae3d::Vec3 > positions;
+    std::vector< VertexInd > faces;
+    std::size_t vertexSize = 0;
+};
+
+static std::size_t GetFormatVertexSize( unsigned char format )
+{
+    static const std::size_t sizes[ 5 ] = { sizeof( VertexPTNTC ), sizeof( VertexPTN ), sizeof( VertexPTNTC_Skinned ), sizeof( VertexPTNTC_Compact ), sizeof( VertexPTNTC_Compact_Skinned ) };
+    return format < 5 ? sizes[ format ] : 0;
+}
+
+/// Reads positions from vertices. They are at the start of every vertex format.
+static void ReadPositions( const unsigned char* vertices, std::size_t vertexCount, unsigned char format, const ae3d::Vec4& dequantization, SubMeshInfo& outInfo )
+{
+    outInfo.positions.resize( vertexCount );
+    const float scale = dequantization.w / 65535.0f;
+
+    for (std::size_t v = 0; v < vertexCount; ++v)
+    {
+        const unsigned char* vertex = vertices + v * outInfo.vertexSize;
+
+        if (format == 3 || format == 4)
+        {
+            std::uint16_t position[ 3 ];
+            std::memcpy( position, vertex, sizeof( position ) );
+            outInfo.positions[ v ] = ae3d::Vec3( dequantization.x + position[ 0 ] * scale, dequantization.y + position[ 1 ] * scale, dequantization.z + position[ 2 ] * scale );
+        }
+        else
+        {
+            std::memcpy( &outInfo.positions[ v ].x, vertex, 3 * sizeof( float ) );
+        }
+    }
+}
+
+static void ReadFaces( const unsigned char* indices, std::size_t faceCount, unsigned char indexSize, SubMeshInfo& outInfo )
+{
+    outInfo.faces.resize( faceCount );
+
+    for (std::size_t i = 0; i < faceCount * 3; ++i)
+    {
+        std::uint32_t index = 0;
+        std::memcpy( &index, indices + i * indexSize, indexSize );
+        unsigned* corners[ 3 ] = { &outInfo.faces[ i / 3 ].a, &outInfo.faces[ i / 3 ].b, &outInfo.faces[ i / 3 ].c };
+        *corners[ i % 3 ] = index;
+    }
+}
+
+/// Reads a stream of a stream version file. Version b2 streams are compressed.
+static bool ReadStream( Reader& reader, std::vector< unsigned char >& outData, std::size_t count, std::size_t elementSize, bool isCompressed )
+{
+    outData.resize( count * elementSize );
+
+    if (!isCompressed)
+    {
+        return reader.Read( outData.data(), outData.size() );
+    }
+
+    std::uint32_t encodedSize = 0;
+
+    if (!reader.Read( &encodedSize, 4 ) || encodedSize > reader.data.size() - reader.position)
+    {
+        return false;
+    }
+
+    const bool isDecoded = MeshCodec::DecodeVertexBuffer( outData.data(), count, elementSize, &reader.data[ reader.position ], encodedSize );
+    reader.position += encodedSize;
+    return isDecoded;
+}
+
+static bool ReadJoints( Reader& reader )
+{
+    std::uint16_t jointCount = 0;
+
+    if (!reader.Read( &jointCount, 2 ))
+    {
+        return false;
+    }
+
+    for (unsigned j = 0; j < jointCount; ++j)
+    {
+        int nameLength = 0;
+        int animLength = 0;
+
+        if (!reader.Skip( sizeof( ae3d::Matrix44 ) + 4 ) || !reader.Read( &nameLength, 4 ) || nameLength < 0 ||
+            !reader.Skip( nameLength ) || !reader.Read( &animLength, 4 ) || animLength < 0 || !reader.Skip( animLength * sizeof( ae3d::Matrix44 ) ))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/// Reads versions a9, b0, b1 and b2.
+static bool ReadStreamFile( const std::vector< unsigned char >& file, std::vector< SubMeshInfo >& outSubMeshes )
+{
+    const bool isVersionB2 = file[ 0 ] == 'b' && file[ 1 ] == '2';
+    const bool isVersionB1 = (file[ 0 ] == 'b' && file[ 1 ] == '1') || isVersionB2;
+    const bool isVersionB0 = (file[ 0 ] == 'b' && file[ 1 ] == '0') || isVersionB1;
+
+    Reader reader = { file, 2 + 6 * 4 };
+    std::uint16_t subMeshCount = 0;
+
+    if (!reader.Read( &subMeshCount, 2 ))
+    {
+        return false;
+    }
+
+    outSubMeshes.resize( subMeshCount );
+
+    for (SubMeshInfo& info : outSubMeshes)
+    {
+        std::uint16_t nameLength = 0;
+
+        if (!reader.Skip( 6 * 4 ) || !reader.Read( &nameLength, 2 ) || nameLength > file.size() - reader.position)
+        {
+            return false;
+        }
+
+        info.name.assign( (const char*)&file[ reader.position ], nameLength );
+        reader.position += nameLength;
+
+        std::uint32_t vertexCount = 0;
+        unsigned char format = 0;
+        ae3d::Vec4 dequantization;
+
+        if (!reader.Read( &vertexCount, isVersionB0 ? 4 : 2 ) || !reader.Read( &format, 1 ) || GetFormatVertexSize( format ) == 0)
+        {
+            return false;
+        }
+
+        if ((format == 3 || format == 4) && !reader.Read( &dequantization.x, 4 * 4 ))
+        {
+            return false;
+        }
+
+        info.vertexSize = GetFormatVertexSize( format );
+        std::vector< unsigned char > vertices;
+
+        if (!ReadStream( reader, vertices, vertexCount, info.vertexSize, isVersionB2 ))
+        {
+            return false;
+        }
+
+        ReadPositions( vertices.data(), vertexCount, format, dequantization, info );
+
+        std::uint32_t faceCount = 0;
+        unsigned char indexSize = 2;
+
+        if (!reader.Read( &faceCount, isVersionB0 ? 4 : 2 ) || (isVersionB0 && !reader.Read( &indexSize, 1 )) || (indexSize != 2 && indexSize != 4))
+        {
+            return false;
+        }
+
+        if (isVersionB2)
+        {
+            std::uint32_t encodedSize = 0;
+            std::vector< std::uint32_t > indices( faceCount * 3 );
+
+            if (!reader.Read( &encodedSize, 4 ) || encodedSize > file.size() - reader.position ||
+                !MeshCodec::DecodeIndexBuffer( indices.data(), indices.size(), vertexCount, &file[ reader.position ], encodedSize ))
+            {
+                return false;
+            }
+
+            reader.position += encodedSize;
+            ReadFaces( (const unsigned char*)indices.data(), faceCount, 4, info );
+        }
+        else
+        {
+            std::vector< unsigned char > indices( faceCount * 3 * indexSize );
+
+            if (!reader.Read( indices.data(), indices.size() ))
+            {
+                return false;
+            }
+
+            ReadFaces( indices.data(), faceCount, indexSize, info );
+        }
+
+        unsigned char hasDepthStreams = 0;
+
+        if (isVersionB1 && !reader.Read( &hasDepthStreams, 1 ))
+        {
+            return false;
+        }
+
+        if (hasDepthStreams != 0)
+        {
+            std::vector< unsigned char > depthStream;
+            const bool isCompact = format == 3;
+
+            if (!ReadStream( reader, depthStream, vertexCount, isCompact ? 8 : sizeof( ae3d::Vec3 ), isVersionB2 ) ||
+                !ReadStream( reader, depthStream, vertexCount, isCompact ? sizeof( VertexPN_Compact ) : sizeof( VertexPN ), isVersionB2 ))
+            {
+                return false;
+            }
+        }
+
+        if ((format == 2 || format == 4) && !ReadJoints( reader ))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool ReadPackedFile( const std::vector< unsigned char >& file, std::vector< SubMeshInfo >& outSubMeshes )
+{
+    const std::size_t headerSize = 32;
+    const std::size_t entrySize = 96;
+    std::uint16_t subMeshCount = 0;
+    std::memcpy( &subMeshCount, &file[ 2 ], 2 );
+
+    if (file.size() < headerSize + subMeshCount * entrySize)
+    {
+        return false;
+    }
+
+    outSubMeshes.resize( subMeshCount );
+
+    for (std::size_t m = 0; m < subMeshCount; ++m)
+    {
+        const unsigned char* entry = &file[ headerSize + m * entrySize ];
+        ae3d::Vec4 dequantization;
+        std::uint32_t vertexCount, faceCount, nameOffset, nameLength, vertexOffset, indexOffset;
+        std::memcpy( &dequantization.x, entry + 24, 4 * 4 );
+        std::memcpy( &vertexCount, entry + 40, 4 );
+        std::memcpy( &faceCount, entry + 44, 4 );
+        const unsigned char format = entry[ 48 ];
+        const unsigned char indexSize = entry[ 49 ];
+        std::memcpy( &nameOffset, entry + 52, 4 );
+        std::memcpy( &nameLength, entry + 56, 4 );
+        std::memcpy( &vertexOffset, entry + 60, 4 );
+        std::memcpy( &indexOffset, entry + 64, 4 );
+
+        SubMeshInfo& info = outSubMeshes[ m ];
+        info.vertexSize = GetFormatVertexSize( format );
+
+        if (info.vertexSize == 0 || (indexSize != 2 && indexSize != 4) || nameOffset + (std::uint64_t)nameLength > file.size() ||
+            vertexOffset + (std::uint64_t)vertexCount * info.vertexSize > file.size() || indexOffset + (std::uint64_t)faceCount * 3 * indexSize > file.size())
+        {
+            return false;
+        }
+
+        info.name.assign( (const char*)&file[ nameOffset ], nameLength );
+        ReadPositions( &file[ vertexOffset ], vertexCount, format, dequantization, info );
+        ReadFaces( &file[ indexOffset ], faceCount, indexSize, info );
+    }
+
+    return true;
+}
+
+int main( int paramCount, char** params )
+{
+    if (paramCount < 2)
+    {
+        std::cerr << "Usage: ae3d_stats file.ae3d [file2.ae3d ...]" << std::endl;
+        return 1;
+    }
+
+    int result = 0;
+
+    for (int p = 1; p < paramCount; ++p)
+    {
+        std::ifstream ifs( params[ p ], std::ios::binary );
+        const std::vector< unsigned char > file( (std::istreambuf_iterator< char >( ifs )), std::istreambuf_iterator< char >() );
+        std::vector< SubMeshInfo > subMeshes;
+
+        const bool isPacked = file.size() >= 32 && file[ 0 ] == 'c' && file[ 1 ] == '0';
+        const bool isStream = file.size() >= 28 && ((file[ 0 ] == 'a' && file[ 1 ] == '9') || (file[ 0 ] == 'b' && file[ 1 ] >= '0' && file[ 1 ] <= '2'));
+
+        if (!(isPacked ? ReadPackedFile( file, subMeshes ) : (isStream && ReadStreamFile( file, subMeshes ))))
+        {
+            std::cerr << params[ p ] << " is not a valid .ae3d file." << std::endl;
+            result = 1;
+            continue;
+        }
+
+        std::size_t totalFaces = 0;
+
+        for (const SubMeshInfo& info : subMeshes)
+        {
+            totalFaces += info.faces.size();
+        }
+
+        std::printf( "%s: version %c%c, %zu bytes, %zu meshes, %.2f bytes per face\n", params[ p ], file[ 0 ], file[ 1 ], file.size(), subMeshes.size(),
+                     totalFaces > 0 ? (double)file.size() / totalFaces : 0.0 );
+
+        for (const SubMeshInfo& info : subMeshes)
+        {
+            std::printf( "Mesh %s: %zu vertices, %zu faces, %zu-byte vertices\n", info.name.c_str(), info.positions.size(), info.faces.size(), info.vertexSize );
+            PrintStatistics( "stored", AnalyzeMesh( info.faces, info.positions, info.vertexSize ) );
+        }
+    }
+
+    return result;
+}
@@ -0,0 +1,387 @@
+/**
+  Builds assets that are listed in a manifest. Only assets whose inputs, settings or tool changed are rebuilt.
+
+  Usage: AssetBuilder manifest.txt [jobs]
+
+  Every manifest line runs a tool with the given arguments. Empty lines and lines starting with # are ignored:
+
+      convert_obj 2 Assets/sponza.obj packed lods=3
+      convert_fbx Assets/human.fbx compact
+      SDF_Generator Assets/font.png Assets/font_sdf.tga
+      TextureCompressor Assets/wall.png Assets/wall.dds bc7
+      CombineFiles Assets/pak_files.txt Assets/data.pak
+
+  Tools are run from the directory of AssetBuilder, which is aether3d_build when they are built with their Makefiles.
+  Conversions run in parallel in 'jobs' processes, by default one per core. CombineFiles lines run after all conversions,
+  because their inputs are the listed files. Hashes of successful builds are stored in manifest.txt.cache.
+*/
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if _MSC_VER
+#define popen _popen
+#define pclose _pclose
+static const char* executableSuffix = ".exe";
+#else
+static const char* executableSuffix = "";
+#endif
+
+struct Job
+{
+    std::string tool;
+    std::vector< std::string > args;
+    std::vector< std::string > inputs;
+    std::string output;
+    std::uint64_t hash = 0;
+    bool isUpToDate = false;
+    bool isBuilt = false;
+};
+
+namespace BuilderGlobal
+{
+    std::string toolDirectory;
+    std::map< std::string, std::uint64_t > cachedHashes;
+    std::mutex printMutex;
+}
+
+/// FNV-1a.
+static std::uint64_t Hash( std::uint64_t hash, const void* data, std::size_t size )
+{
+    const unsigned char* bytes = (const unsigned char*)data;
+
+    for (std::size_t i = 0; i < size; ++i)
+    {
+        hash = (hash ^ bytes[ i ]) * 1099511628211ull;
+    }
+
+    return hash;
+}
+
+static std::uint64_t HashString( std::uint64_t hash, const std::string& str )
+{
+    // The terminator separates consecutive strings.
+    return Hash( hash, str.c_str(), str.size() + 1 );
+}
+
+/// \return false if the file could not be read.
+static bool HashFile( std::uint64_t& hash, const std::string& path )
+{
+    std::ifstream ifs( path, std::ios::binary );
+
+    if (!ifs.is_open())
+    {
+        return false;
+    }
+
+    std::vector< char > buffer( 1 << 20 );
+
+    while (ifs)
+    {
+        ifs.read( buffer.data(), buffer.size() );
+        hash = Hash( hash, buffer.data(), (std::size_t)ifs.gcount() );
+    }
+
+    hash = HashString( hash, path );
+    return true;
+}
+
+static bool FileExists( const std::string& path )
+{
+    return std::ifstream( path ).is_open();
+}
+
+static std::string GetToolPath( const std::string& tool )
+{
+    return BuilderGlobal::toolDirectory + tool + executableSuffix;
+}
+
+/// Converters replace the extension of their input file with 'ae3d'.
+static std::string GetAe3dPath( const std::string& input )
+{
+    return input.substr( 0, input.length() - 3 ) + "ae3d";
+}
+
+/// Finds the inputs and the output of a job from the tool's arguments.
+static bool ResolveFiles( Job& job )
+{
+    if (job.tool == "convert_obj" && job.args.size() >= 2)
+    {
+        job.inputs.push_back( job.args[ 1 ] );
+        job.output = GetAe3dPath( job.args[ 1 ] );
+    }
+    else if (job.tool == "convert_fbx" && !job.args.empty())
+    {
+        job.inputs.push_back( job.args[ 0 ] );
+        job.output = GetAe3dPath( job.args[ 0 ] );
+    }
+    else if ((job.tool == "SDF_Generator" || job.tool == "CombineFiles") && job.args.size() == 2)
+    {
+        job.inputs.push_back( job.args[ 0 ] );
+        job.output = job.args[ 1 ];
+    }
+    else if (job.tool == "TextureCompressor" && job.args.size() >= 2)
+    {
+        job.inputs.push_back( job.args[ 0 ] );
+        job.output = job.args[ 1 ];
+    }
+    else
+    {
+        return false;
+    }
+
+    // .pak contains the files that are listed in the input file.
+    if (job.tool == "CombineFiles")
+    {
+        std::ifstream fileList( job.args[ 0 ] );
+        std::string line;
+
+        while (std::getline( fileList, line ))
+        {
+            job.inputs.push_back( line );
+        }
+    }
+
+    return true;
+}
+
+/// Hashes the tool, its arguments and inputs and compares the hash to the previous build.
+static bool CheckJob( Job& job )
+{
+    job.hash = 14695981039346656037ull;
+
+    if (!HashFile( job.hash, GetToolPath( job.tool ) ))
+    {
+        std::lock_guard< std::mutex > lock( BuilderGlobal::printMutex );
+        std::cerr << "Could not open tool " << GetToolPath( job.tool ) << std::endl;
+        return false;
+    }
+
+    for (const std::string& arg : job.args)
+    {
+        job.hash = HashString( job.hash, arg );
+    }
+
+    for (const std::string& input : job.inputs)
+    {
+        if (!HashFile( job.hash, input ))
+        {
+            std::lock_guard< std::mutex > lock( BuilderGlobal::printMutex );
+            std::cerr << "Could not open " << input << std::endl;
+            return false;
+        }
+    }
+
+    const auto cached = BuilderGlobal::cachedHashes.find( job.output );
+    job.isUpToDate = cached != BuilderGlobal::cachedHashes.end() && cached->second == job.hash && FileExists( job.output );
+    return true;
+}
+
+/// Runs the tool and prints its output after it has finished, so outputs of parallel jobs don't interleave.
+static bool RunJob( Job& job )
+{
+    std::string command = "\"" + GetToolPath( job.tool ) + "\"";
+
+    for (const std::string& arg : job.args)
+    {
+        command += " \"" + arg + "\"";
+    }
+
+    command += " 2>&1";
+
+    FILE* pipe = popen( command.c_str(), "r" );
+
+    if (pipe == nullptr)
+    {
+        std::lock_guard< std::mutex > lock( BuilderGlobal::printMutex );
+        std::cerr << "Could not run " << command << std::endl;
+        return false;
+    }
+
+    std::string log;
+    char buffer[ 4096 ];
+
+    for (std::size_t count = std::fread( buffer, 1, sizeof( buffer ), pipe ); count > 0; count = std::fread( buffer, 1, sizeof( buffer ), pipe ))
+    {
+        log.append( buffer, count );
+    }
+
+    const int status = pclose( pipe );
+
+    // Tools don't always return an error code, so a missing output is also a failure.
+    job.isBuilt = status == 0 && FileExists( job.output );
+
+    std::lock_guard< std::mutex > lock( BuilderGlobal::printMutex );
+    std::cout << (job.isBuilt ? "Built " : "Failed to build ") << job.output << std::endl;
+
+    if (!job.isBuilt)
+    {
+        std::cout << log << std::endl;
+    }
+
+    return job.isBuilt;
+}
+
+/// Checks and runs jobs in parallel.
+/// \return Number of failed jobs.
+static int RunJobs( std::vector< Job* >& jobs, unsigned threadCount )
+{
+    std::atomic< std::size_t > nextJob( 0 );
+    std::atomic< int > failureCount( 0 );
+    std::vector< std::thread > threads;
+
+    for (unsigned t = 0; t < threadCount; ++t)
+    {
+        threads.push_back( std::thread( [&]()
+        {
+            for (std::size_t j = nextJob++; j < jobs.size(); j = nextJob++)
+            {
+                Job& job = *jobs[ j ];
+
+                if (!CheckJob( job ) || (!job.isUpToDate && !RunJob( job )))
+                {
+                    ++failureCount;
+                }
+            }
+        } ) );
+    }
+
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+
+    return failureCount;
+}
+
+static void ReadCache( const std::string& path )
+{
+    std::ifstream ifs( path );
+    std::string line;
+
+    while (std::getline( ifs, line ))
+    {
+        std::istringstream stream( line );
+        std::uint64_t hash = 0;
+        std::string output;
+
+        if (stream >> std::hex >> hash && std::getline( stream >> std::ws, output ))
+        {
+            BuilderGlobal::cachedHashes[ output ] = hash;
+        }
+    }
+}
+
+/// Writes hashes of jobs that are up-to-date. Hashes of failed jobs are kept from the previous build, so they are not
+/// up-to-date after their inputs are reverted.
+static void WriteCache( const std::string& path, const std::vector< Job >& jobs )
+{
+    for (const Job& job : jobs)
+    {
+        if (job.isUpToDate || job.isBuilt)
+        {
+            BuilderGlobal::cachedHashes[ job.output ] = job.hash;
+        }
+    }
+
+    std::ofstream ofs( path );
+
+    for (const auto& entry : BuilderGlobal::cachedHashes)
+    {
+        ofs << std::hex << entry.second << " " << entry.first << std::endl;
+    }
+}
+
+int main( int argCount, char* args[] )
+{
+    if (argCount < 2 || argCount > 3)
+    {
+        std::cout << "Usage: AssetBuilder manifest.txt [jobs]" << std::endl;
+        return 1;
+    }
+
+    std::ifstream manifest( args[ 1 ] );
+
+    if (!manifest.is_open())
+    {
+        std::cout << "Could not open " << args[ 1 ] << std::endl;
+        return 1;
+    }
+
+    const std::string builderPath = args[ 0 ];
+    const std::size_t separator = builderPath.find_last_of( "/\\" );
+    BuilderGlobal::toolDirectory = separator == std::string::npos ? "./" : builderPath.substr( 0, separator + 1 );
+
+    std::vector< Job > jobs;
+    std::string line;
+    int lineNumber = 0;
+
+    while (std::getline( manifest, line ))
+    {
+        ++lineNumber;
+        std::istringstream stream( line );
+        Job job;
+
+        if (!(stream >> job.tool) || job.tool[ 0 ] == '#')
+        {
+            continue;
+        }
+
+        for (std::string arg; stream >> arg;)
+        {
+            job.args.push_back( arg );
+        }
+
+        if (!ResolveFiles( job ))
+        {
+            std::cout << args[ 1 ] << ":" << lineNumber << ": Unknown tool or wrong arguments: " << line << std::endl;
+            return 1;
+        }
+
+        jobs.push_back( job );
+    }
+
+    const std::string cachePath = std::string( args[ 1 ] ) + ".cache";
+    ReadCache( cachePath );
+
+    const unsigned threadCount = argCount > 2 ? (unsigned)std::max( 1, std::atoi( args[ 2 ] ) ) : std::max( 1u, std::thread::hardware_concurrency() );
+    std::vector< Job* > conversions;
+    std::vector< Job* > paks;
+
+    for (Job& job : jobs)
+    {
+        (job.tool == "CombineFiles" ? paks : conversions).push_back( &job );
+    }
+
+    int failureCount = RunJobs( conversions, threadCount );
+
+    // .pak files would contain stale files.
+    if (failureCount == 0)
+    {
+        failureCount = RunJobs( paks, threadCount );
+    }
+
+    WriteCache( cachePath, jobs );
+
+    std::size_t builtCount = 0;
+    std::size_t upToDateCount = 0;
+
+    for (const Job& job : jobs)
+    {
+        builtCount += job.isBuilt ? 1 : 0;
+        upToDateCount += job.isUpToDate ? 1 : 0;
+    }
+
+    std::cout << builtCount << " built, " << upToDateCount << " up-to-date, " << failureCount << " failed." << std::endl;
+    return failureCount == 0 ? 0 : 1;
+}
@@ -0,0 +1,82 @@
+/**
+  Replays a GfxDevice capture written by System::BeginGfxCapture and prints submission timings.
+
+  Usage: CaptureReplay capture.bin [loops] [width height]
+
+  Run from the directory that contains the shaders referenced by the capture.
+  Window size should match the captured one, because viewports and scissors are replayed as captured.
+*/
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include "System.hpp"
+#include "Window.hpp"
+
+using namespace ae3d;
+
+int main( int argCount, char* args[] )
+{
+    if (argCount < 2)
+    {
+        std::printf( "Usage: CaptureReplay capture.bin [loops] [width height]\n" );
+        return 1;
+    }
+
+    const int loops = argCount > 2 ? std::atoi( args[ 2 ] ) : 10;
+    int width = argCount > 4 ? std::atoi( args[ 3 ] ) : 1920;
+    int height = argCount > 4 ? std::atoi( args[ 4 ] ) : 1080;
+
+    Window::Create( width, height, WindowCreateFlags::Empty );
+    Window::GetSize( width, height );
+    System::LoadBuiltinAssets();
+
+    const int frameCount = System::LoadGfxCapture( args[ 1 ] );
+
+    if (frameCount == 0)
+    {
+        return 1;
+    }
+
+    double totalMs = 0;
+    double minMs = 1000000;
+    double maxMs = 0;
+    int replayedFrames = 0;
+
+    for (int loop = 0; loop < loops && Window::IsOpen(); ++loop)
+    {
+        for (int frame = 0; frame < frameCount && Window::IsOpen(); ++frame)
+        {
+            Window::PumpEvents();
+            WindowEvent event;
+
+            while (Window::PollEvent( event ))
+            {
+            }
+
+            const auto begin = std::chrono::steady_clock::now();
+            System::ReplayGfxCaptureFrame( frame );
+            const double ms = std::chrono::duration< double, std::milli >( std::chrono::steady_clock::now() - begin ).count();
+
+            // The first loop warms up pipeline states and allocations.
+            if (loop > 0 || loops == 1)
+            {
+                totalMs += ms;
+                minMs = ms < minMs ? ms : minMs;
+                maxMs = ms > maxMs ? ms : maxMs;
+                ++replayedFrames;
+            }
+        }
+    }
+
+    if (replayedFrames > 0)
+    {
+        std::printf( "Replayed %d frames: avg %.3f ms, min %.3f ms, max %.3f ms\n", replayedFrames, totalMs / replayedFrames, minMs, maxMs );
+    }
+
+    char statistics[ 1024 ];
+    System::Statistics::GetStatistics( statistics );
+    std::printf( "Last frame:\n%s\n", statistics );
+
+    System::Deinit();
+    return 0;
+}
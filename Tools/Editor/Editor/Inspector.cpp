@@ -225,6 +225,10 @@ void Inspector::Render( unsigned width, unsigned height, GameObject* gameObject,
             //nk_label( &ctx, gameObject->GetName(), NK_TEXT_LEFT );
             nk_edit_string( &ctx, NK_EDIT_FIELD, gameObjectNameField, &gameObjectNameFieldLength, 64, nk_filter_default );
             gameObject->SetName( gameObjectNameField );
+
+            int isStatic = gameObject->IsStatic();
+            nk_checkbox_label( &ctx, "Static", &isStatic );
+            gameObject->SetStatic( isStatic != 0 );
         }
 
         TransformComponent* transform = gameObject ? gameObject->GetComponent< TransformComponent >() : nullptr;
@@ -393,10 +393,10 @@ void ImportMeshNodes( FbxNode* node )
                 gMeshes.back().tcoord.push_back( uv[ j ] );
                 gMeshes.back().nonInterleavedTangents.push_back( tangent[ j ] );
 
-                face.vInd[ j ] = (unsigned short)vertexIndex;
-                face.vnInd[ j ] = (unsigned short)vertexCounter;
-                face.uvInd[ j ] = (unsigned short)vertexCounter;
-                face.tInd[ j ] = (unsigned short)vertexCounter;
+                face.vInd[ j ] = (unsigned)vertexIndex;
+                face.vnInd[ j ] = (unsigned)vertexCounter;
+                face.uvInd[ j ] = (unsigned)vertexCounter;
+                face.tInd[ j ] = (unsigned)vertexCounter;
                 ++vertexCounter;
             }
             
@@ -653,9 +653,15 @@ void LoadFBX( const std::string& path )
 
 int main( int paramCount, char** params )
 {
-    if (paramCount != 2)
-    {
-        std::cerr << "Usage: ./convert_fbx file.fbx" << std::endl;
+    if (paramCount < 2 || paramCount > 9)
+    {
+        std::cerr << "Usage: ./convert_fbx file.fbx [compact] [depthstreams] [packed] [compressed] [lods=N] [lodratio=R] [loderror=E]" << std::endl;
+        std::cerr << "  where compact writes quantized vertices and depthstreams writes position-only streams for shadow and depth-normals passes." << std::endl;
+        std::cerr << "  packed writes the aligned c0 format that the engine uploads directly from a memory-mapped file." << std::endl;
+        std::cerr << "  compressed writes the b2 format with compressed vertex and index streams. Ignored with packed." << std::endl;
+        std::cerr << "  lods=N writes N levels of detail: file.ae3d, file_lod1.ae3d etc. and their errors to file.lods." << std::endl;
+        std::cerr << "  lodratio=R sets the face count of a LOD relative to the previous one. Default: 0.5." << std::endl;
+        std::cerr << "  loderror=E sets the largest error of a LOD relative to the model's size. Default: unlimited." << std::endl;
         return 1;
     }
 
@@ -682,6 +688,35 @@ int main( int paramCount, char** params )
     outFile = outFile.substr( 0, outFile.length() - 3 );
     outFile.append( "ae3d" );
 
-    WriteAe3d( outFile, VertexFormat::PTNTC );
+    bool isCompact = false;
+    bool writeDepthStreams = false;
+    bool isPacked = false;
+    bool isCompressed = false;
+    unsigned lodCount = 1;
+    float lodRatio = 0.5f;
+    float lodError = std::numeric_limits< float >::max();
+
+    for (int p = 2; p < paramCount; ++p)
+    {
+        const std::string param = params[ p ];
+        isCompact = isCompact || param == "compact";
+        writeDepthStreams = writeDepthStreams || param == "depthstreams";
+        isPacked = isPacked || param == "packed";
+        isCompressed = isCompressed || param == "compressed";
+        ParseLodParam( param, lodCount, lodRatio, lodError );
+    }
+
+    if (lodCount > 1)
+    {
+        WriteLods( outFile, isCompact ? VertexFormat::Compact : VertexFormat::PTNTC, writeDepthStreams, isCompressed, isPacked, lodCount, lodRatio, lodError );
+    }
+    else if (isPacked)
+    {
+        WriteAe3dPacked( outFile, isCompact ? VertexFormat::Compact : VertexFormat::PTNTC, writeDepthStreams );
+    }
+    else
+    {
+        WriteAe3d( outFile, isCompact ? VertexFormat::Compact : VertexFormat::PTNTC, writeDepthStreams, isCompressed );
+    }
     return 0;
 }
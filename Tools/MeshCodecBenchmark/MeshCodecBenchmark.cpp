@@ -0,0 +1,160 @@
+/**
+  Measures decode throughput of the compressed .ae3d b2 vertex and index streams.
+
+  Usage: MeshCodecBenchmark [segments] [iterations]
+
+  Encodes a cache-optimized UV sphere in the PTNTC and compact vertex formats, verifies that decoding restores it
+  and prints compression ratios and decode speeds. Build with -DSIMD_SSE3 to use the SSE decoder.
+*/
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include "../common.hpp"
+#include "MeshCodec.hpp"
+
+static void CreateSphere( Mesh& mesh, unsigned segments )
+{
+    const unsigned rings = segments / 2;
+    const float pi = 3.14159265f;
+
+    for (unsigned r = 0; r <= rings; ++r)
+    {
+        for (unsigned s = 0; s <= segments; ++s)
+        {
+            const float theta = pi * r / rings;
+            const float phi = 2 * pi * s / segments;
+
+            VertexPTNTC_Skinned vertex = {};
+            vertex.normal = ae3d::Vec3( std::sin( theta ) * std::cos( phi ), std::cos( theta ), std::sin( theta ) * std::sin( phi ) );
+            vertex.position = vertex.normal * 2.5f;
+            vertex.texCoord.u = (float)s / segments;
+            vertex.texCoord.v = (float)r / rings;
+            vertex.tangent = ae3d::Vec4( -std::sin( phi ), 0, std::cos( phi ), 1 );
+            vertex.color = ae3d::Vec4( 1, 1, 1, 1 );
+            mesh.interleavedVertices.push_back( vertex );
+            mesh.vertex.push_back( vertex.position );
+        }
+    }
+
+    for (unsigned r = 0; r < rings; ++r)
+    {
+        for (unsigned s = 0; s < segments; ++s)
+        {
+            const unsigned a = r * (segments + 1) + s;
+            const unsigned b = a + segments + 1;
+            mesh.indices.push_back( { a, b, a + 1 } );
+            mesh.indices.push_back( { a + 1, b, b + 1 } );
+        }
+    }
+
+    mesh.SolveAABB();
+    mesh.OptimizeFaces();
+    mesh.CopyInterleavedVerticesToPTNTC();
+    mesh.CopyInterleavedVerticesToCompact();
+}
+
+/// \return Decode speed in GB/s of decoded data.
+static double BenchmarkVertices( const char* name, const void* vertices, std::size_t vertexCount, std::size_t vertexSize, int iterations )
+{
+    const std::vector< unsigned char > encoded = EncodeVertexBuffer( vertices, vertexCount, vertexSize );
+    std::vector< unsigned char > decoded( vertexCount * vertexSize );
+
+    if (!MeshCodec::DecodeVertexBuffer( decoded.data(), vertexCount, vertexSize, encoded.data(), encoded.size() ) ||
+        std::memcmp( decoded.data(), vertices, decoded.size() ) != 0)
+    {
+        std::printf( "%s: decoded vertices differ from the original!\n", name );
+        std::exit( 1 );
+    }
+
+    double bestSeconds = 1000;
+
+    for (int i = 0; i < iterations; ++i)
+    {
+        const auto begin = std::chrono::steady_clock::now();
+        MeshCodec::DecodeVertexBuffer( decoded.data(), vertexCount, vertexSize, encoded.data(), encoded.size() );
+        const double seconds = std::chrono::duration< double >( std::chrono::steady_clock::now() - begin ).count();
+        bestSeconds = seconds < bestSeconds ? seconds : bestSeconds;
+    }
+
+    const double gbPerSecond = decoded.size() / bestSeconds / 1e9;
+    std::printf( "%-16s %9zu -> %9zu bytes (%5.1f%%), decode %.2f GB/s\n", name, decoded.size(), encoded.size(), 100.0 * encoded.size() / decoded.size(), gbPerSecond );
+    return gbPerSecond;
+}
+
+static bool IsSameTriangle( const VertexInd& face, const std::uint32_t* decoded )
+{
+    for (int r = 0; r < 3; ++r)
+    {
+        if (face.a == decoded[ r ] && face.b == decoded[ (r + 1) % 3 ] && face.c == decoded[ (r + 2) % 3 ])
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void BenchmarkIndices( const std::vector< VertexInd >& faces, std::size_t vertexCount, int iterations )
+{
+    const std::vector< unsigned char > encoded = EncodeIndexBuffer( faces );
+    std::vector< std::uint32_t > decoded( faces.size() * 3 );
+
+    if (!MeshCodec::DecodeIndexBuffer( decoded.data(), decoded.size(), vertexCount, encoded.data(), encoded.size() ))
+    {
+        std::printf( "Index stream is corrupted!\n" );
+        std::exit( 1 );
+    }
+
+    for (std::size_t f = 0; f < faces.size(); ++f)
+    {
+        if (!IsSameTriangle( faces[ f ], &decoded[ f * 3 ] ))
+        {
+            std::printf( "Decoded triangle %zu differs from the original!\n", f );
+            std::exit( 1 );
+        }
+    }
+
+    double bestSeconds = 1000;
+
+    for (int i = 0; i < iterations; ++i)
+    {
+        const auto begin = std::chrono::steady_clock::now();
+        MeshCodec::DecodeIndexBuffer( decoded.data(), decoded.size(), vertexCount, encoded.data(), encoded.size() );
+        const double seconds = std::chrono::duration< double >( std::chrono::steady_clock::now() - begin ).count();
+        bestSeconds = seconds < bestSeconds ? seconds : bestSeconds;
+    }
+
+    const std::size_t indexSize = vertexCount > 65536 ? 4 : 2;
+    std::printf( "%-16s %9zu -> %9zu bytes (%5.1f%%), %.2f bytes per triangle, decode %.1f M triangles/s\n", "indices", decoded.size() * indexSize, encoded.size(),
+                 100.0 * encoded.size() / (decoded.size() * indexSize), (double)encoded.size() / faces.size(), faces.size() / bestSeconds / 1e6 );
+}
+
+int main( int argCount, char* args[] )
+{
+    const unsigned segments = argCount > 1 ? (unsigned)std::atoi( args[ 1 ] ) : 512;
+    const int iterations = argCount > 2 ? std::atoi( args[ 2 ] ) : 20;
+
+    if (segments < 4 || iterations < 1)
+    {
+        std::printf( "Usage: MeshCodecBenchmark [segments] [iterations]\n" );
+        return 1;
+    }
+
+    Mesh mesh;
+    CreateSphere( mesh, segments );
+
+#if defined( SIMD_SSE3 )
+    std::printf( "SSE decoder, " );
+#elif defined( __ARM_NEON ) || defined( __ARM_NEON__ )
+    std::printf( "NEON decoder, " );
+#else
+    std::printf( "scalar decoder, " );
+#endif
+    std::printf( "%zu vertices, %zu triangles\n", mesh.interleavedVertices.size(), mesh.indices.size() );
+
+    const std::size_t vertexCount = mesh.interleavedVertices.size();
+    BenchmarkVertices( "PTNTC", mesh.interleavedVerticesPTNTC.data(), vertexCount, sizeof( VertexPTNTC ), iterations );
+    BenchmarkVertices( "PTNTC_Compact", mesh.interleavedVerticesCompact.data(), vertexCount, sizeof( VertexPTNTC_Compact ), iterations );
+    BenchmarkIndices( mesh.indices, vertexCount, iterations );
+    return 0;
+}
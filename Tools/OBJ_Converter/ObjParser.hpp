@@ -0,0 +1,567 @@
+// This is an independent project of an individual developer. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++, C#, and Java: http://www.viva64.com
+#ifndef OBJ_PARSER_H
+#define OBJ_PARSER_H
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <thread>
+#include <vector>
+#if _MSC_VER
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include "../common.hpp"
+
+/**
+   Wavefront .obj parser.
+
+   The file is memory-mapped and split into chunks on line boundaries. The first pass counts 'v', 'vt' and 'vn' lines
+   of every chunk in parallel, so every chunk knows where its elements go and can resolve relative indices.
+   The second pass parses chunks in parallel and the last one builds meshes from the chunks' faces in file order.
+   Floats are parsed with the same rounding as std::istream, so the result is the same as with the former parser.
+
+   Limitations:
+
+   Smoothing groups are not supported.
+ */
+
+/// Read-only memory-mapped file.
+class ObjFile
+{
+public:
+    explicit ObjFile( const std::string& path )
+    {
+#if _MSC_VER
+        HANDLE file = CreateFileA( path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr );
+
+        if (file == INVALID_HANDLE_VALUE)
+        {
+            return;
+        }
+
+        LARGE_INTEGER fileSize = {};
+        GetFileSizeEx( file, &fileSize );
+        mapping = fileSize.QuadPart > 0 ? CreateFileMappingA( file, nullptr, PAGE_READONLY, 0, 0, nullptr ) : nullptr;
+        CloseHandle( file );
+        data = mapping ? static_cast< const char* >( MapViewOfFile( mapping, FILE_MAP_READ, 0, 0, 0 ) ) : nullptr;
+        size = data ? (std::size_t)fileSize.QuadPart : 0;
+#else
+        const int file = open( path.c_str(), O_RDONLY );
+
+        if (file == -1)
+        {
+            return;
+        }
+
+        struct stat fileStat = {};
+
+        if (fstat( file, &fileStat ) == 0 && fileStat.st_size > 0)
+        {
+            mapping = mmap( nullptr, (std::size_t)fileStat.st_size, PROT_READ, MAP_PRIVATE, file, 0 );
+        }
+
+        close( file );
+
+        if (mapping != MAP_FAILED)
+        {
+            data = static_cast< const char* >( mapping );
+            size = (std::size_t)fileStat.st_size;
+        }
+#endif
+    }
+
+    ~ObjFile()
+    {
+#if _MSC_VER
+        if (data != nullptr)
+        {
+            UnmapViewOfFile( data );
+        }
+
+        if (mapping != nullptr)
+        {
+            CloseHandle( mapping );
+        }
+#else
+        if (mapping != MAP_FAILED)
+        {
+            munmap( mapping, size );
+        }
+#endif
+    }
+
+    ObjFile( const ObjFile& ) = delete;
+    ObjFile& operator=( const ObjFile& ) = delete;
+
+    const char* data = nullptr;
+    std::size_t size = 0;
+
+private:
+#if _MSC_VER
+    HANDLE mapping = nullptr;
+#else
+    void* mapping = MAP_FAILED;
+#endif
+};
+
+/// Face corner's 0-based position, texture coordinate and normal index in the whole file. Missing indices are -1.
+struct ObjCorner
+{
+    int v, t, n;
+};
+
+/// Part of an .obj file that ends on a line boundary.
+struct ObjChunk
+{
+    const char* begin = nullptr;
+    const char* end = nullptr;
+
+    /// Counts of 'v', 'vt' and 'vn' lines in previous chunks.
+    unsigned vertexBase = 0, texCoordBase = 0, normalBase = 0;
+    /// Counts of 'v', 'vt' and 'vn' lines in this chunk.
+    unsigned vertexCount = 0, texCoordCount = 0, normalCount = 0;
+
+    std::vector< ObjCorner > corners;
+    /// Faces, 'o' and 'g' lines in file order. Faces contain their corner count, 'o' and 'g' contain 0.
+    std::vector< unsigned > statements;
+    /// Names of 'o' and 'g' lines. Empty if the line has no name.
+    std::vector< std::string > groupNames;
+    bool hasSmoothingGroups = false;
+};
+
+/// Maps indices of the whole file to indices of the current mesh.
+struct ObjIndexMap
+{
+    explicit ObjIndexMap( std::size_t count ) : localIndices( count ), generations( count, 0 ) {}
+
+    std::vector< unsigned > localIndices;
+    /// A local index is valid if its generation is the current one. The generation changes for every mesh.
+    std::vector< unsigned > generations;
+};
+
+/// Calls function( i ) for i in [0, count), each in its own thread.
+template< typename Function >
+static void ParallelFor( std::size_t count, Function function )
+{
+    std::vector< std::thread > threads;
+
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        threads.push_back( std::thread( function, i ) );
+    }
+
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+}
+
+static bool IsObjSpace( char c )
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+static const char* SkipObjSpaces( const char* p, const char* end )
+{
+    while (p < end && IsObjSpace( *p ))
+    {
+        ++p;
+    }
+
+    return p;
+}
+
+/// \return Keyword of a line: "v", "vt", "vn", "f", "o", "g", "s" or an unused one.
+static std::size_t GetObjKeyword( const char*& p, const char* end )
+{
+    p = SkipObjSpaces( p, end );
+    const char* keyword = p;
+
+    while (p < end && !IsObjSpace( *p ))
+    {
+        ++p;
+    }
+
+    return (std::size_t)(p - keyword);
+}
+
+/// Parses a float with the same result as std::istream in the "C" locale. Invalid numbers are parsed as 0.
+static const char* ParseObjFloat( const char* p, const char* end, float& outValue )
+{
+    p = SkipObjSpaces( p, end );
+
+    // Fast path for numbers like -12.3456 whose digits fit into a float's mantissa. Dividing them by an exact power of 10 is correctly rounded.
+    static const float powersOf10[ 11 ] = { 1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f };
+    const char* digit = p < end && (*p == '-' || *p == '+') ? p + 1 : p;
+    std::uint32_t mantissa = 0;
+    int digitCount = 0;
+    int fractionDigits = -1;
+
+    for (; digit < end && digitCount < 9; ++digit)
+    {
+        if (*digit >= '0' && *digit <= '9')
+        {
+            mantissa = mantissa * 10 + (std::uint32_t)(*digit - '0');
+            ++digitCount;
+            fractionDigits += fractionDigits >= 0 ? 1 : 0;
+        }
+        else if (*digit == '.' && fractionDigits < 0)
+        {
+            fractionDigits = 0;
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    const bool isNumberEnd = digit == end || IsObjSpace( *digit ) || *digit == '\n';
+
+    if (digitCount > 0 && isNumberEnd && mantissa <= (1u << 24) && fractionDigits <= 10)
+    {
+        outValue = (float)mantissa / powersOf10[ fractionDigits < 0 ? 0 : fractionDigits ];
+        outValue = *p == '-' ? -outValue : outValue;
+        return digit;
+    }
+
+    char buffer[ 64 ];
+    std::size_t length = 0;
+
+    while (p + length < end && length < sizeof( buffer ) - 1 && !IsObjSpace( p[ length ] ) && p[ length ] != '\n')
+    {
+        ++length;
+    }
+
+    std::memcpy( buffer, p, length );
+    buffer[ length ] = 0;
+    char* numberEnd = buffer;
+    outValue = std::strtof( buffer, &numberEnd );
+    return p + (numberEnd - buffer);
+}
+
+/// Parses a 1-based or relative index into a 0-based index.
+/// \param count Count of elements before this line, used by relative indices.
+/// \return Position after the index. outIndex is -1 if there is no index.
+static const char* ParseObjIndex( const char* p, const char* end, unsigned count, int& outIndex )
+{
+    const bool isRelative = p < end && *p == '-';
+    const char* digit = isRelative ? p + 1 : p;
+    long long index = 0;
+
+    while (digit < end && *digit >= '0' && *digit <= '9' && index < (1ll << 40))
+    {
+        index = index * 10 + (*digit - '0');
+        ++digit;
+    }
+
+    if (digit == (isRelative ? p + 1 : p))
+    {
+        outIndex = -1;
+        return p;
+    }
+
+    // 0 and out-of-range indices become invalid indices, checked when the mesh is built.
+    index = isRelative ? (long long)count - index : index - 1;
+    outIndex = (index < 0 || index > (1ll << 31) - 2) ? std::numeric_limits< int >::max() : (int)index;
+    return digit;
+}
+
+/// Counts 'v', 'vt' and 'vn' lines of a chunk.
+static void CountObjElements( ObjChunk& chunk )
+{
+    for (const char* line = chunk.begin; line < chunk.end; )
+    {
+        const char* lineEnd = static_cast< const char* >( std::memchr( line, '\n', (std::size_t)(chunk.end - line) ) );
+        lineEnd = lineEnd ? lineEnd : chunk.end;
+
+        const char* p = line;
+        const std::size_t keywordLength = GetObjKeyword( p, lineEnd );
+        const char* keyword = p - keywordLength;
+
+        if (keywordLength == 1 && keyword[ 0 ] == 'v')
+        {
+            ++chunk.vertexCount;
+        }
+        else if (keywordLength == 2 && keyword[ 0 ] == 'v' && keyword[ 1 ] == 't')
+        {
+            ++chunk.texCoordCount;
+        }
+        else if (keywordLength == 2 && keyword[ 0 ] == 'v' && keyword[ 1 ] == 'n')
+        {
+            ++chunk.normalCount;
+        }
+
+        line = lineEnd + 1;
+    }
+}
+
+/// Parses a chunk's elements to their place in the whole file's arrays and its faces and groups to the chunk.
+static void ParseObjChunk( ObjChunk& chunk, std::vector< ae3d::Vec3 >& vertices, std::vector< TexCoord >& texCoords, std::vector< ae3d::Vec3 >& normals )
+{
+    unsigned vertexCount = chunk.vertexBase;
+    unsigned texCoordCount = chunk.texCoordBase;
+    unsigned normalCount = chunk.normalBase;
+
+    for (const char* line = chunk.begin; line < chunk.end; )
+    {
+        const char* lineEnd = static_cast< const char* >( std::memchr( line, '\n', (std::size_t)(chunk.end - line) ) );
+        lineEnd = lineEnd ? lineEnd : chunk.end;
+
+        const char* p = line;
+        const std::size_t keywordLength = GetObjKeyword( p, lineEnd );
+        const char* keyword = p - keywordLength;
+
+        if (keywordLength == 1 && keyword[ 0 ] == 'v')
+        {
+            ae3d::Vec3& v = vertices[ vertexCount++ ];
+            p = ParseObjFloat( p, lineEnd, v.x );
+            p = ParseObjFloat( p, lineEnd, v.y );
+            ParseObjFloat( p, lineEnd, v.z );
+        }
+        else if (keywordLength == 2 && keyword[ 0 ] == 'v' && keyword[ 1 ] == 't')
+        {
+            float v = 0;
+            TexCoord& t = texCoords[ texCoordCount++ ];
+            p = ParseObjFloat( p, lineEnd, t.u );
+            ParseObjFloat( p, lineEnd, v );
+            t.v = 1.0f - v;
+        }
+        else if (keywordLength == 2 && keyword[ 0 ] == 'v' && keyword[ 1 ] == 'n')
+        {
+            ae3d::Vec3& n = normals[ normalCount++ ];
+            p = ParseObjFloat( p, lineEnd, n.x );
+            p = ParseObjFloat( p, lineEnd, n.y );
+            ParseObjFloat( p, lineEnd, n.z );
+        }
+        else if (keywordLength == 1 && keyword[ 0 ] == 'f')
+        {
+            unsigned cornerCount = 0;
+
+            for (p = SkipObjSpaces( p, lineEnd ); p < lineEnd; p = SkipObjSpaces( p, lineEnd ))
+            {
+                ObjCorner corner = { -1, -1, -1 };
+                const char* indexStart = p;
+                p = ParseObjIndex( p, lineEnd, vertexCount, corner.v );
+
+                if (p < lineEnd && *p == '/')
+                {
+                    p = ParseObjIndex( p + 1, lineEnd, texCoordCount, corner.t );
+
+                    if (p < lineEnd && *p == '/')
+                    {
+                        p = ParseObjIndex( p + 1, lineEnd, normalCount, corner.n );
+                    }
+                }
+
+                if (p == indexStart)
+                {
+                    break;
+                }
+
+                chunk.corners.push_back( corner );
+                ++cornerCount;
+
+                while (p < lineEnd && !IsObjSpace( *p ))
+                {
+                    ++p;
+                }
+            }
+
+            chunk.statements.push_back( cornerCount );
+        }
+        else if (keywordLength == 1 && (keyword[ 0 ] == 'o' || keyword[ 0 ] == 'g'))
+        {
+            const std::size_t nameLength = GetObjKeyword( p, lineEnd );
+            chunk.groupNames.push_back( std::string( p - nameLength, nameLength ) );
+            chunk.statements.push_back( 0 );
+        }
+        else if (keywordLength == 1 && keyword[ 0 ] == 's')
+        {
+            const std::size_t nameLength = GetObjKeyword( p, lineEnd );
+            chunk.hasSmoothingGroups = chunk.hasSmoothingGroups || std::string( p - nameLength, nameLength ) != "off";
+        }
+
+        line = lineEnd + 1;
+    }
+}
+
+/// Maps an index of the whole file to an index of the current mesh, copying the element to the mesh when it's first used.
+/// \return false if the index is invalid.
+template< typename T >
+static bool GetObjLocalIndex( int index, const std::vector< T >& elements, std::vector< T >& meshElements, ObjIndexMap& map, unsigned generation, unsigned& outLocalIndex )
+{
+    if (index < 0 || index >= (int)elements.size())
+    {
+        return false;
+    }
+
+    if (map.generations[ index ] != generation)
+    {
+        map.generations[ index ] = generation;
+        map.localIndices[ index ] = (unsigned)meshElements.size();
+        meshElements.push_back( elements[ index ] );
+    }
+
+    outLocalIndex = map.localIndices[ index ];
+    return true;
+}
+
+/**
+   Loads a Wavefront .obj model into gMeshes. Polygons are triangulated as fans.
+
+   \param path Path.
+ */
+void LoadObj( const std::string& path )
+{
+    const std::string extension = path.length() >= 3 ? path.substr( path.length() - 3 ) : path;
+
+    if (extension != "obj" && extension != "OBJ")
+    {
+        std::cerr << path << " is not .obj!" << std::endl;
+        exit( 1 );
+    }
+
+    ObjFile file( path );
+
+    if (file.data == nullptr)
+    {
+        std::cerr << "Couldn't open file " << path << std::endl;
+        exit( 1 );
+    }
+
+    // Chunks are at least 1 MB, so small files don't pay for threads.
+    const std::size_t maxChunkCount = 1 + file.size / (1024 * 1024);
+    const std::size_t chunkCount = std::max< std::size_t >( 1, std::min< std::size_t >( maxChunkCount, std::thread::hardware_concurrency() ) );
+    std::vector< ObjChunk > chunks( chunkCount );
+    const char* fileEnd = file.data + file.size;
+
+    for (std::size_t c = 0; c < chunkCount; ++c)
+    {
+        chunks[ c ].begin = c == 0 ? file.data : chunks[ c - 1 ].end;
+        const char* end = c + 1 == chunkCount ? fileEnd : file.data + file.size * (c + 1) / chunkCount;
+        end = std::max( end, chunks[ c ].begin );
+        const char* newLine = static_cast< const char* >( std::memchr( end, '\n', (std::size_t)(fileEnd - end) ) );
+        chunks[ c ].end = newLine ? newLine + 1 : fileEnd;
+    }
+
+    ParallelFor( chunkCount, [ &chunks ]( std::size_t c ) { CountObjElements( chunks[ c ] ); } );
+
+    for (std::size_t c = 1; c < chunkCount; ++c)
+    {
+        chunks[ c ].vertexBase = chunks[ c - 1 ].vertexBase + chunks[ c - 1 ].vertexCount;
+        chunks[ c ].texCoordBase = chunks[ c - 1 ].texCoordBase + chunks[ c - 1 ].texCoordCount;
+        chunks[ c ].normalBase = chunks[ c - 1 ].normalBase + chunks[ c - 1 ].normalCount;
+    }
+
+    std::vector< ae3d::Vec3 > vertex( chunks.back().vertexBase + chunks.back().vertexCount );
+    std::vector< TexCoord > tcoord( chunks.back().texCoordBase + chunks.back().texCoordCount );
+    std::vector< ae3d::Vec3 > vnormal( chunks.back().normalBase + chunks.back().normalCount );
+
+    ParallelFor( chunkCount, [ &chunks, &vertex, &tcoord, &vnormal ]( std::size_t c ) { ParseObjChunk( chunks[ c ], vertex, tcoord, vnormal ); } );
+
+    for (const ObjChunk& chunk : chunks)
+    {
+        if (chunk.hasSmoothingGroups)
+        {
+            std::cout << "Warning: The file contains smoothing groups. They are not supported by the converter." << std::endl;
+            break;
+        }
+    }
+
+    if (vnormal.empty())
+    {
+        std::cout << std::endl << "Warning: The file doesn't contain normals. Generating..." << std::endl;
+    }
+
+    std::cout << "Reading meshes." << std::endl;
+
+    ObjIndexMap vertGlobalLocal( vertex.size() );
+    ObjIndexMap tcoordGlobalLocal( tcoord.size() );
+    ObjIndexMap normGlobalLocal( vnormal.size() );
+    unsigned generation = 1;
+    std::vector< Face > polygon;
+
+    gMeshes.push_back( Mesh() );
+
+    for (const ObjChunk& chunk : chunks)
+    {
+        std::size_t corner = 0;
+        std::size_t group = 0;
+
+        for (unsigned cornerCount : chunk.statements)
+        {
+            // Object name.
+            if (cornerCount == 0)
+            {
+                if (gMeshes.back().name != "unnamed")
+                {
+                    // Some exporters use 'g' without specifying geometry for it, so remove them.
+                    if (gMeshes.back().face.empty())
+                    {
+                        gMeshes.pop_back();
+                    }
+
+                    gMeshes.push_back( Mesh() );
+                }
+
+                if (!chunk.groupNames[ group ].empty())
+                {
+                    gMeshes.back().name = chunk.groupNames[ group ];
+                }
+
+                ++group;
+                ++generation;
+                continue;
+            }
+
+            Mesh& mesh = gMeshes.back();
+            bool isValid = cornerCount >= 3;
+            polygon.assign( cornerCount, Face() );
+
+            for (unsigned c = 0; c < cornerCount && isValid; ++c)
+            {
+                // Polygon corners are collected into the first corner of Faces.
+                const ObjCorner& objCorner = chunk.corners[ corner + c ];
+                isValid = GetObjLocalIndex( objCorner.v, vertex, mesh.vertex, vertGlobalLocal, generation, polygon[ c ].vInd[ 0 ] ) &&
+                          (objCorner.t == -1 || GetObjLocalIndex( objCorner.t, tcoord, mesh.tcoord, tcoordGlobalLocal, generation, polygon[ c ].uvInd[ 0 ] )) &&
+                          (objCorner.n == -1 || GetObjLocalIndex( objCorner.n, vnormal, mesh.vnormal, normGlobalLocal, generation, polygon[ c ].vnInd[ 0 ] ));
+            }
+
+            if (!isValid)
+            {
+                std::cerr << path << " has a face with an invalid index or less than 3 vertices!" << std::endl;
+                exit( 1 );
+            }
+
+            // Triangulates as a fan where each triangle starts from the previous one's last vertex: (0, 1, 2), (2, 3, 0), (3, 4, 0) etc.
+            for (unsigned c = 2; c < cornerCount; ++c)
+            {
+                const unsigned fanCorners[ 3 ] = { c == 2 ? 0u : c - 1, c == 2 ? 1u : c, c == 2 ? 2u : 0u };
+                Face face;
+
+                for (int i = 0; i < 3; ++i)
+                {
+                    face.vInd[ i ] = polygon[ fanCorners[ i ] ].vInd[ 0 ];
+                    face.uvInd[ i ] = polygon[ fanCorners[ i ] ].uvInd[ 0 ];
+                    face.vnInd[ i ] = polygon[ fanCorners[ i ] ].vnInd[ 0 ];
+                }
+
+                mesh.face.push_back( face );
+            }
+
+            corner += cornerCount;
+        }
+    }
+}
+
+#endif
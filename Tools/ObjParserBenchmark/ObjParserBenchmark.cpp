@@ -0,0 +1,78 @@
+/**
+  Compares the .obj parser of convert_obj against the former line-based parser.
+
+  Usage: ObjParserBenchmark file.obj [iterations]
+
+  Parses the file with both parsers, verifies that they produce the same meshes and prints the parse speeds.
+*/
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include "../OBJ_Converter/ObjParser.hpp"
+#include "LegacyObjParser.hpp"
+
+template< typename T >
+static bool AreEqual( const std::vector< T >& a, const std::vector< T >& b )
+{
+    return a.size() == b.size() && (a.empty() || std::memcmp( a.data(), b.data(), a.size() * sizeof( T ) ) == 0);
+}
+
+/// \return Best parse time in seconds. The meshes of the last iteration are in gMeshes.
+template< typename Function >
+static double Benchmark( Function loadObj, const std::string& path, int iterations )
+{
+    double bestSeconds = 1e9;
+
+    for (int i = 0; i < iterations; ++i)
+    {
+        gMeshes.clear();
+        const auto begin = std::chrono::steady_clock::now();
+        loadObj( path );
+        const double seconds = std::chrono::duration< double >( std::chrono::steady_clock::now() - begin ).count();
+        bestSeconds = seconds < bestSeconds ? seconds : bestSeconds;
+    }
+
+    return bestSeconds;
+}
+
+int main( int argCount, char* args[] )
+{
+    const int iterations = argCount > 2 ? std::atoi( args[ 2 ] ) : 3;
+
+    if (argCount < 2 || iterations < 1)
+    {
+        std::printf( "Usage: ObjParserBenchmark file.obj [iterations]\n" );
+        return 1;
+    }
+
+    const std::string path = args[ 1 ];
+    std::ifstream ifs( path, std::ios::binary | std::ios::ate );
+    const double megabytes = (double)ifs.tellg() / (1024 * 1024);
+
+    const double legacySeconds = Benchmark( Legacy::LoadObj, path, iterations );
+    std::vector< Mesh > legacyMeshes;
+    legacyMeshes.swap( gMeshes );
+    const double seconds = Benchmark( LoadObj, path, iterations );
+
+    bool areEqual = legacyMeshes.size() == gMeshes.size();
+
+    for (std::size_t m = 0; m < gMeshes.size() && areEqual; ++m)
+    {
+        const Mesh& a = legacyMeshes[ m ];
+        const Mesh& b = gMeshes[ m ];
+        areEqual = a.name == b.name && AreEqual( a.vertex, b.vertex ) && AreEqual( a.vnormal, b.vnormal ) && AreEqual( a.tcoord, b.tcoord ) && a.face.size() == b.face.size();
+
+        for (std::size_t f = 0; f < a.face.size() && areEqual; ++f)
+        {
+            areEqual = std::memcmp( a.face[ f ].vInd, b.face[ f ].vInd, sizeof( a.face[ f ].vInd ) ) == 0 &&
+                       std::memcmp( a.face[ f ].uvInd, b.face[ f ].uvInd, sizeof( a.face[ f ].uvInd ) ) == 0 &&
+                       std::memcmp( a.face[ f ].vnInd, b.face[ f ].vnInd, sizeof( a.face[ f ].vnInd ) ) == 0;
+        }
+    }
+
+    std::printf( "\n%s: %.1f MB, %zu meshes\n", path.c_str(), megabytes, gMeshes.size() );
+    std::printf( "legacy parser: %8.1f ms, %7.1f MB/s\n", legacySeconds * 1000, megabytes / legacySeconds );
+    std::printf( "parser:        %8.1f ms, %7.1f MB/s, %u threads, %.1fx faster\n", seconds * 1000, megabytes / seconds, std::thread::hardware_concurrency(), legacySeconds / seconds );
+    std::printf( "Meshes are %s.\n", areEqual ? "equal" : "different. The legacy parser misreads 'f v/t' faces, relative indices and a last line without a newline" );
+    return areEqual ? 0 : 1;
+}
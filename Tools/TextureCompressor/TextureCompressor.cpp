@@ -0,0 +1,975 @@
+/**
+  Compresses a PNG, JPEG or TGA image into a block-compressed .dds file with a full mip chain.
+
+  Usage: TextureCompressor input.png output.dds [bc1|bc3|bc5|bc7] [linear] [threads=N]
+
+  The format defaults to bc1 for opaque images and bc3 for images with alpha. bc1 ignores alpha, bc5 stores red and green
+  for normal maps and bc7 blocks use mode 6. Color is filtered in linear space when mips are generated unless 'linear'
+  is given, which should be used for data like masks. bc5 is always linear and its mips are renormalized.
+  Blocks are compressed on 'threads' threads, by default one per core, using SSE when built with -DSIMD_SSE3.
+  Width and height must be powers of two, because DDSLoader expects them.
+*/
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#if defined( SIMD_SSE3 )
+#include <emmintrin.h>
+#endif
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.c"
+
+enum class Format { BC1, BC3, BC5, BC7 };
+
+/// RGBA of 4x4 pixels, each channel in its own array so that 4 pixels can be processed at once. Values are 0-255.
+struct Block
+{
+    float channels[ 4 ][ 16 ];
+};
+
+/// Mip level with linear RGBA values 0-1.
+struct FloatImage
+{
+    int width = 0;
+    int height = 0;
+    std::vector< float > pixels;
+};
+
+namespace CompressorGlobal
+{
+    float srgbToLinear[ 256 ];
+}
+
+static float LinearToSrgb( float value )
+{
+    return value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow( value, 1.0f / 2.4f ) - 0.055f;
+}
+
+static std::uint8_t ToByte( float value )
+{
+    return (std::uint8_t)(std::min( std::max( value, 0.0f ), 1.0f ) * 255.0f + 0.5f);
+}
+
+static bool IsPowerOfTwo( int value )
+{
+    return value > 0 && (value & (value - 1)) == 0;
+}
+
+/// Converts the image into linear values for filtering.
+static FloatImage ToFloatImage( const std::uint8_t* rgba, int width, int height, bool isSrgb )
+{
+    FloatImage image;
+    image.width = width;
+    image.height = height;
+    image.pixels.resize( width * height * 4 );
+
+    for (std::size_t i = 0; i < image.pixels.size(); ++i)
+    {
+        const bool isColor = (i % 4) != 3;
+        image.pixels[ i ] = (isColor && isSrgb) ? CompressorGlobal::srgbToLinear[ rgba[ i ] ] : rgba[ i ] / 255.0f;
+    }
+
+    return image;
+}
+
+static std::vector< std::uint8_t > ToBytes( const FloatImage& image, bool isSrgb )
+{
+    std::vector< std::uint8_t > rgba( image.pixels.size() );
+
+    for (std::size_t i = 0; i < image.pixels.size(); ++i)
+    {
+        const bool isColor = (i % 4) != 3;
+        rgba[ i ] = ToByte( (isColor && isSrgb) ? LinearToSrgb( image.pixels[ i ] ) : image.pixels[ i ] );
+    }
+
+    return rgba;
+}
+
+/// Box filters the image to half its size.
+/// \param isNormalMap If true, RGB is a normal that is renormalized.
+static FloatImage Downsample( const FloatImage& source, bool isNormalMap )
+{
+    FloatImage mip;
+    mip.width = std::max( source.width / 2, 1 );
+    mip.height = std::max( source.height / 2, 1 );
+    mip.pixels.resize( mip.width * mip.height * 4 );
+
+    for (int y = 0; y < mip.height; ++y)
+    {
+        const int y0 = std::min( y * 2, source.height - 1 );
+        const int y1 = std::min( y * 2 + 1, source.height - 1 );
+
+        for (int x = 0; x < mip.width; ++x)
+        {
+            const int x0 = std::min( x * 2, source.width - 1 );
+            const int x1 = std::min( x * 2 + 1, source.width - 1 );
+            float* pixel = &mip.pixels[ (y * mip.width + x) * 4 ];
+
+            for (int c = 0; c < 4; ++c)
+            {
+                pixel[ c ] = 0.25f * (source.pixels[ (y0 * source.width + x0) * 4 + c ] + source.pixels[ (y0 * source.width + x1) * 4 + c ] +
+                                      source.pixels[ (y1 * source.width + x0) * 4 + c ] + source.pixels[ (y1 * source.width + x1) * 4 + c ]);
+            }
+
+            if (isNormalMap)
+            {
+                const float nx = pixel[ 0 ] * 2 - 1;
+                const float ny = pixel[ 1 ] * 2 - 1;
+                const float nz = pixel[ 2 ] * 2 - 1;
+                const float length = std::sqrt( nx * nx + ny * ny + nz * nz );
+
+                if (length > 0.0001f)
+                {
+                    pixel[ 0 ] = (nx / length) * 0.5f + 0.5f;
+                    pixel[ 1 ] = (ny / length) * 0.5f + 0.5f;
+                    pixel[ 2 ] = (nz / length) * 0.5f + 0.5f;
+                }
+            }
+        }
+    }
+
+    return mip;
+}
+
+/// Reads a 4x4 block. Pixels outside small mips repeat the edge.
+static void LoadBlock( const std::uint8_t* rgba, int width, int height, int blockX, int blockY, Block& outBlock )
+{
+    for (int i = 0; i < 16; ++i)
+    {
+        const int x = std::min( blockX * 4 + (i % 4), width - 1 );
+        const int y = std::min( blockY * 4 + (i / 4), height - 1 );
+
+        for (int c = 0; c < 4; ++c)
+        {
+            outBlock.channels[ c ][ i ] = rgba[ (y * width + x) * 4 + c ];
+        }
+    }
+}
+
+/// Finds the closest palette entry of every pixel.
+/// \param palette RGBA entries 0-255.
+/// \param weights Weights of channels in the error. Channels with zero weight are ignored.
+/// \param outIndices Palette index of every pixel.
+/// \return Sum of weighted squared errors.
+static float FindClosest( const Block& block, const float (*palette)[ 4 ], int paletteSize, const float weights[ 4 ], std::uint8_t outIndices[ 16 ] )
+{
+    float totalError = 0;
+
+#if defined( SIMD_SSE3 )
+    const __m128 weightR = _mm_set1_ps( weights[ 0 ] );
+    const __m128 weightG = _mm_set1_ps( weights[ 1 ] );
+    const __m128 weightB = _mm_set1_ps( weights[ 2 ] );
+    const __m128 weightA = _mm_set1_ps( weights[ 3 ] );
+
+    for (int i = 0; i < 16; i += 4)
+    {
+        const __m128 r = _mm_loadu_ps( &block.channels[ 0 ][ i ] );
+        const __m128 g = _mm_loadu_ps( &block.channels[ 1 ][ i ] );
+        const __m128 b = _mm_loadu_ps( &block.channels[ 2 ][ i ] );
+        const __m128 a = _mm_loadu_ps( &block.channels[ 3 ][ i ] );
+        __m128 bestError = _mm_set1_ps( 1e30f );
+        __m128i bestIndex = _mm_setzero_si128();
+
+        for (int k = 0; k < paletteSize; ++k)
+        {
+            const __m128 dr = _mm_sub_ps( r, _mm_set1_ps( palette[ k ][ 0 ] ) );
+            const __m128 dg = _mm_sub_ps( g, _mm_set1_ps( palette[ k ][ 1 ] ) );
+            const __m128 db = _mm_sub_ps( b, _mm_set1_ps( palette[ k ][ 2 ] ) );
+            const __m128 da = _mm_sub_ps( a, _mm_set1_ps( palette[ k ][ 3 ] ) );
+            const __m128 error = _mm_add_ps( _mm_add_ps( _mm_mul_ps( _mm_mul_ps( dr, dr ), weightR ), _mm_mul_ps( _mm_mul_ps( dg, dg ), weightG ) ),
+                                             _mm_add_ps( _mm_mul_ps( _mm_mul_ps( db, db ), weightB ), _mm_mul_ps( _mm_mul_ps( da, da ), weightA ) ) );
+            const __m128i isBetter = _mm_castps_si128( _mm_cmplt_ps( error, bestError ) );
+            bestError = _mm_min_ps( error, bestError );
+            bestIndex = _mm_or_si128( _mm_and_si128( isBetter, _mm_set1_epi32( k ) ), _mm_andnot_si128( isBetter, bestIndex ) );
+        }
+
+        alignas( 16 ) float errors[ 4 ];
+        alignas( 16 ) std::int32_t indices[ 4 ];
+        _mm_store_ps( errors, bestError );
+        _mm_store_si128( (__m128i*)indices, bestIndex );
+
+        for (int j = 0; j < 4; ++j)
+        {
+            outIndices[ i + j ] = (std::uint8_t)indices[ j ];
+            totalError += errors[ j ];
+        }
+    }
+#else
+    for (int i = 0; i < 16; ++i)
+    {
+        float bestError = 1e30f;
+
+        for (int k = 0; k < paletteSize; ++k)
+        {
+            float error = 0;
+
+            for (int c = 0; c < 4; ++c)
+            {
+                const float difference = block.channels[ c ][ i ] - palette[ k ][ c ];
+                error += difference * difference * weights[ c ];
+            }
+
+            if (error < bestError)
+            {
+                bestError = error;
+                outIndices[ i ] = (std::uint8_t)k;
+            }
+        }
+
+        totalError += bestError;
+    }
+#endif
+
+    return totalError;
+}
+
+/// Finds the principal axis of the block's colors.
+/// \param channelCount 3 for RGB or 4 for RGBA.
+static void GetPrincipalAxis( const Block& block, int channelCount, float outMean[ 4 ], float outAxis[ 4 ] )
+{
+    for (int c = 0; c < 4; ++c)
+    {
+        outMean[ c ] = 0;
+
+        for (int i = 0; i < 16; ++i)
+        {
+            outMean[ c ] += block.channels[ c ][ i ] / 16;
+        }
+    }
+
+    float covariance[ 4 ][ 4 ] = {};
+
+    for (int i = 0; i < 16; ++i)
+    {
+        for (int c0 = 0; c0 < channelCount; ++c0)
+        {
+            for (int c1 = 0; c1 < channelCount; ++c1)
+            {
+                covariance[ c0 ][ c1 ] += (block.channels[ c0 ][ i ] - outMean[ c0 ]) * (block.channels[ c1 ][ i ] - outMean[ c1 ]);
+            }
+        }
+    }
+
+    // Power iteration.
+    float axis[ 4 ] = { 1, 1, 1, channelCount == 4 ? 1.0f : 0.0f };
+
+    for (int iteration = 0; iteration < 8; ++iteration)
+    {
+        float next[ 4 ] = {};
+        float lengthSquared = 0;
+
+        for (int c0 = 0; c0 < channelCount; ++c0)
+        {
+            for (int c1 = 0; c1 < channelCount; ++c1)
+            {
+                next[ c0 ] += covariance[ c0 ][ c1 ] * axis[ c1 ];
+            }
+
+            lengthSquared += next[ c0 ] * next[ c0 ];
+        }
+
+        if (lengthSquared < 1e-12f)
+        {
+            break;
+        }
+
+        const float invLength = 1.0f / std::sqrt( lengthSquared );
+
+        for (int c = 0; c < 4; ++c)
+        {
+            axis[ c ] = next[ c ] * invLength;
+        }
+    }
+
+    std::memcpy( outAxis, axis, sizeof( axis ) );
+}
+
+/// Finds endpoints at the extremes of the block's colors along the principal axis.
+static void GetAxisEndpoints( const Block& block, int channelCount, float outEndpoint0[ 4 ], float outEndpoint1[ 4 ] )
+{
+    float mean[ 4 ];
+    float axis[ 4 ];
+    GetPrincipalAxis( block, channelCount, mean, axis );
+
+    float minT = 0;
+    float maxT = 0;
+
+    for (int i = 0; i < 16; ++i)
+    {
+        float t = 0;
+
+        for (int c = 0; c < channelCount; ++c)
+        {
+            t += (block.channels[ c ][ i ] - mean[ c ]) * axis[ c ];
+        }
+
+        minT = std::min( minT, t );
+        maxT = std::max( maxT, t );
+    }
+
+    for (int c = 0; c < 4; ++c)
+    {
+        outEndpoint0[ c ] = std::min( std::max( mean[ c ] + axis[ c ] * maxT, 0.0f ), 255.0f );
+        outEndpoint1[ c ] = std::min( std::max( mean[ c ] + axis[ c ] * minT, 0.0f ), 255.0f );
+    }
+}
+
+/// Finds endpoints that minimize the squared error of the given indices.
+/// \param weights Weight of endpoint 1 for every palette index.
+/// \return false if the indices don't determine the endpoints.
+static bool FitEndpoints( const Block& block, const std::uint8_t indices[ 16 ], const float* weights, float outEndpoint0[ 4 ], float outEndpoint1[ 4 ] )
+{
+    float aa = 0, ab = 0, bb = 0;
+    float ax[ 4 ] = {};
+    float bx[ 4 ] = {};
+
+    for (int i = 0; i < 16; ++i)
+    {
+        const float b = weights[ indices[ i ] ];
+        const float a = 1 - b;
+        aa += a * a;
+        ab += a * b;
+        bb += b * b;
+
+        for (int c = 0; c < 4; ++c)
+        {
+            ax[ c ] += a * block.channels[ c ][ i ];
+            bx[ c ] += b * block.channels[ c ][ i ];
+        }
+    }
+
+    const float determinant = aa * bb - ab * ab;
+
+    if (std::abs( determinant ) < 1e-6f)
+    {
+        return false;
+    }
+
+    for (int c = 0; c < 4; ++c)
+    {
+        outEndpoint0[ c ] = std::min( std::max( (bb * ax[ c ] - ab * bx[ c ]) / determinant, 0.0f ), 255.0f );
+        outEndpoint1[ c ] = std::min( std::max( (aa * bx[ c ] - ab * ax[ c ]) / determinant, 0.0f ), 255.0f );
+    }
+
+    return true;
+}
+
+static std::uint16_t To565( const float color[ 4 ] )
+{
+    const int r = (int)(color[ 0 ] * 31 / 255 + 0.5f);
+    const int g = (int)(color[ 1 ] * 63 / 255 + 0.5f);
+    const int b = (int)(color[ 2 ] * 31 / 255 + 0.5f);
+    return (std::uint16_t)((r << 11) | (g << 5) | b);
+}
+
+static void From565( std::uint16_t color, float outColor[ 4 ] )
+{
+    const int r = (color >> 11) & 31;
+    const int g = (color >> 5) & 63;
+    const int b = color & 31;
+    outColor[ 0 ] = (float)((r << 3) | (r >> 2));
+    outColor[ 1 ] = (float)((g << 2) | (g >> 4));
+    outColor[ 2 ] = (float)((b << 3) | (b >> 2));
+    outColor[ 3 ] = 0;
+}
+
+/// Quantizes endpoints and finds the indices of the 4-color palette.
+/// \return Squared error.
+static float EvaluateColorEndpoints( const Block& block, const float endpoint0[ 4 ], const float endpoint1[ 4 ], std::uint16_t& outColor0,
+                                     std::uint16_t& outColor1, std::uint8_t outIndices[ 16 ] )
+{
+    static const float rgbWeights[ 4 ] = { 1, 1, 1, 0 };
+
+    outColor0 = To565( endpoint0 );
+    outColor1 = To565( endpoint1 );
+
+    float palette[ 4 ][ 4 ];
+    From565( outColor0, palette[ 0 ] );
+    From565( outColor1, palette[ 1 ] );
+
+    for (int c = 0; c < 4; ++c)
+    {
+        palette[ 2 ][ c ] = (2 * palette[ 0 ][ c ] + palette[ 1 ][ c ]) / 3;
+        palette[ 3 ][ c ] = (palette[ 0 ][ c ] + 2 * palette[ 1 ][ c ]) / 3;
+    }
+
+    return FindClosest( block, palette, 4, rgbWeights, outIndices );
+}
+
+/// Encodes RGB of a block as 8 bytes in the BC1 4-color mode, which is also the color part of BC3.
+static void EncodeColorBlock( const Block& block, std::uint8_t* out )
+{
+    // Weight of endpoint 1 for every palette index.
+    static const float indexWeights[ 4 ] = { 0, 1, 1.0f / 3, 2.0f / 3 };
+
+    float endpoint0[ 4 ];
+    float endpoint1[ 4 ];
+    GetAxisEndpoints( block, 3, endpoint0, endpoint1 );
+
+    std::uint16_t color0, color1;
+    std::uint8_t indices[ 16 ];
+    float error = EvaluateColorEndpoints( block, endpoint0, endpoint1, color0, color1, indices );
+
+    for (int iteration = 0; iteration < 2 && error > 0; ++iteration)
+    {
+        if (!FitEndpoints( block, indices, indexWeights, endpoint0, endpoint1 ))
+        {
+            break;
+        }
+
+        std::uint16_t fitColor0, fitColor1;
+        std::uint8_t fitIndices[ 16 ];
+        const float fitError = EvaluateColorEndpoints( block, endpoint0, endpoint1, fitColor0, fitColor1, fitIndices );
+
+        if (fitError >= error)
+        {
+            break;
+        }
+
+        error = fitError;
+        color0 = fitColor0;
+        color1 = fitColor1;
+        std::memcpy( indices, fitIndices, sizeof( indices ) );
+    }
+
+    // color0 > color1 selects the 4-color mode in BC1.
+    if (color0 < color1)
+    {
+        std::swap( color0, color1 );
+
+        for (int i = 0; i < 16; ++i)
+        {
+            indices[ i ] ^= 1;
+        }
+    }
+    else if (color0 == color1)
+    {
+        std::memset( indices, 0, sizeof( indices ) );
+    }
+
+    std::uint32_t indexBits = 0;
+
+    for (int i = 0; i < 16; ++i)
+    {
+        indexBits |= (std::uint32_t)indices[ i ] << (i * 2);
+    }
+
+    out[ 0 ] = (std::uint8_t)(color0 & 0xFF);
+    out[ 1 ] = (std::uint8_t)(color0 >> 8);
+    out[ 2 ] = (std::uint8_t)(color1 & 0xFF);
+    out[ 3 ] = (std::uint8_t)(color1 >> 8);
+
+    for (int i = 0; i < 4; ++i)
+    {
+        out[ 4 + i ] = (std::uint8_t)(indexBits >> (i * 8));
+    }
+}
+
+/// Builds the palette of a BC4 block. value0 > value1 selects 8 interpolated values, otherwise 6 and 0 and 255.
+static void GetSingleChannelPalette( int value0, int value1, int channel, float outPalette[ 8 ][ 4 ] )
+{
+    std::memset( outPalette, 0, sizeof( float ) * 8 * 4 );
+    outPalette[ 0 ][ channel ] = (float)value0;
+    outPalette[ 1 ][ channel ] = (float)value1;
+
+    if (value0 > value1)
+    {
+        for (int k = 1; k < 7; ++k)
+        {
+            outPalette[ k + 1 ][ channel ] = (float)(((7 - k) * value0 + k * value1) / 7);
+        }
+    }
+    else
+    {
+        for (int k = 1; k < 5; ++k)
+        {
+            outPalette[ k + 1 ][ channel ] = (float)(((5 - k) * value0 + k * value1) / 5);
+        }
+
+        outPalette[ 6 ][ channel ] = 0;
+        outPalette[ 7 ][ channel ] = 255;
+    }
+}
+
+/// Encodes a channel of a block as 8 bytes in BC4, which is also the alpha part of BC3 and each half of BC5.
+static void EncodeSingleChannelBlock( const Block& block, int channel, std::uint8_t* out )
+{
+    float weights[ 4 ] = {};
+    weights[ channel ] = 1;
+
+    int minValue = 255, maxValue = 0;
+    int minInnerValue = 255, maxInnerValue = 0;
+
+    for (int i = 0; i < 16; ++i)
+    {
+        const int value = (int)block.channels[ channel ][ i ];
+        minValue = std::min( minValue, value );
+        maxValue = std::max( maxValue, value );
+
+        if (value != 0 && value != 255)
+        {
+            minInnerValue = std::min( minInnerValue, value );
+            maxInnerValue = std::max( maxInnerValue, value );
+        }
+    }
+
+    if (minInnerValue > maxInnerValue)
+    {
+        minInnerValue = 0;
+        maxInnerValue = 255;
+    }
+
+    // The 8-value mode spans the whole range, the 6-value mode spans values between 0 and 255, which it has exactly.
+    const int candidates[ 2 ][ 2 ] = { { maxValue, minValue }, { minInnerValue, maxInnerValue } };
+    float bestError = 1e30f;
+    int bestCandidate = 0;
+    std::uint8_t bestIndices[ 16 ] = {};
+
+    for (int candidate = 0; candidate < 2; ++candidate)
+    {
+        float palette[ 8 ][ 4 ];
+        GetSingleChannelPalette( candidates[ candidate ][ 0 ], candidates[ candidate ][ 1 ], channel, palette );
+
+        std::uint8_t indices[ 16 ];
+        const float error = FindClosest( block, palette, 8, weights, indices );
+
+        if (error < bestError)
+        {
+            bestError = error;
+            bestCandidate = candidate;
+            std::memcpy( bestIndices, indices, sizeof( indices ) );
+        }
+    }
+
+    std::uint64_t indexBits = 0;
+
+    for (int i = 0; i < 16; ++i)
+    {
+        indexBits |= (std::uint64_t)bestIndices[ i ] << (i * 3);
+    }
+
+    out[ 0 ] = (std::uint8_t)candidates[ bestCandidate ][ 0 ];
+    out[ 1 ] = (std::uint8_t)candidates[ bestCandidate ][ 1 ];
+
+    for (int i = 0; i < 6; ++i)
+    {
+        out[ 2 + i ] = (std::uint8_t)(indexBits >> (i * 8));
+    }
+}
+
+/// BC7 mode 6 endpoints: 7 bits per channel and a p-bit per endpoint, which is the lowest bit of all its channels.
+struct Mode6Endpoints
+{
+    int values[ 2 ][ 4 ];
+    int pBits[ 2 ];
+};
+
+static const int mode6IndexWeights[ 16 ] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+/// Quantizes endpoints with every p-bit combination and finds the indices of the best one.
+/// \return Squared error.
+static float EvaluateMode6Endpoints( const Block& block, const float endpoint0[ 4 ], const float endpoint1[ 4 ], Mode6Endpoints& outEndpoints,
+                                     std::uint8_t outIndices[ 16 ] )
+{
+    static const float rgbaWeights[ 4 ] = { 1, 1, 1, 1 };
+    const float* endpoints[ 2 ] = { endpoint0, endpoint1 };
+    float bestError = 1e30f;
+
+    for (int pBitCombination = 0; pBitCombination < 4; ++pBitCombination)
+    {
+        Mode6Endpoints quantized;
+        int expanded[ 2 ][ 4 ];
+
+        for (int e = 0; e < 2; ++e)
+        {
+            quantized.pBits[ e ] = (pBitCombination >> e) & 1;
+
+            for (int c = 0; c < 4; ++c)
+            {
+                const int value = (int)std::floor( (endpoints[ e ][ c ] - quantized.pBits[ e ]) / 2 + 0.5f );
+                quantized.values[ e ][ c ] = std::min( std::max( value, 0 ), 127 );
+                expanded[ e ][ c ] = (quantized.values[ e ][ c ] << 1) | quantized.pBits[ e ];
+            }
+        }
+
+        float palette[ 16 ][ 4 ];
+
+        for (int k = 0; k < 16; ++k)
+        {
+            for (int c = 0; c < 4; ++c)
+            {
+                palette[ k ][ c ] = (float)(((64 - mode6IndexWeights[ k ]) * expanded[ 0 ][ c ] + mode6IndexWeights[ k ] * expanded[ 1 ][ c ] + 32) >> 6);
+            }
+        }
+
+        std::uint8_t indices[ 16 ];
+        const float error = FindClosest( block, palette, 16, rgbaWeights, indices );
+
+        if (error < bestError)
+        {
+            bestError = error;
+            outEndpoints = quantized;
+            std::memcpy( outIndices, indices, 16 );
+        }
+    }
+
+    return bestError;
+}
+
+/// Writes bits from the lowest bit of a 128-bit block.
+struct BitWriter
+{
+    std::uint8_t* bytes;
+    int position;
+
+    void Write( unsigned value, int bitCount )
+    {
+        for (int i = 0; i < bitCount; ++i, ++position)
+        {
+            bytes[ position / 8 ] |= (std::uint8_t)(((value >> i) & 1) << (position % 8));
+        }
+    }
+};
+
+/// Encodes a block as 16 bytes in BC7 mode 6, which has one RGBA subset and 4-bit indices.
+static void EncodeBC7Block( const Block& block, std::uint8_t* out )
+{
+    float indexWeights[ 16 ];
+
+    for (int k = 0; k < 16; ++k)
+    {
+        indexWeights[ k ] = mode6IndexWeights[ k ] / 64.0f;
+    }
+
+    float endpoint0[ 4 ];
+    float endpoint1[ 4 ];
+    GetAxisEndpoints( block, 4, endpoint0, endpoint1 );
+
+    Mode6Endpoints endpoints;
+    std::uint8_t indices[ 16 ];
+    float error = EvaluateMode6Endpoints( block, endpoint0, endpoint1, endpoints, indices );
+
+    for (int iteration = 0; iteration < 2 && error > 0; ++iteration)
+    {
+        if (!FitEndpoints( block, indices, indexWeights, endpoint0, endpoint1 ))
+        {
+            break;
+        }
+
+        Mode6Endpoints fitEndpoints;
+        std::uint8_t fitIndices[ 16 ];
+        const float fitError = EvaluateMode6Endpoints( block, endpoint0, endpoint1, fitEndpoints, fitIndices );
+
+        if (fitError >= error)
+        {
+            break;
+        }
+
+        error = fitError;
+        endpoints = fitEndpoints;
+        std::memcpy( indices, fitIndices, sizeof( indices ) );
+    }
+
+    // The highest index bit of the first pixel is not stored, so it must be 0.
+    if (indices[ 0 ] >= 8)
+    {
+        for (int c = 0; c < 4; ++c)
+        {
+            std::swap( endpoints.values[ 0 ][ c ], endpoints.values[ 1 ][ c ] );
+        }
+
+        std::swap( endpoints.pBits[ 0 ], endpoints.pBits[ 1 ] );
+
+        for (int i = 0; i < 16; ++i)
+        {
+            indices[ i ] = (std::uint8_t)(15 - indices[ i ]);
+        }
+    }
+
+    std::memset( out, 0, 16 );
+    BitWriter writer = { out, 0 };
+    writer.Write( 1 << 6, 7 );
+
+    for (int c = 0; c < 4; ++c)
+    {
+        writer.Write( (unsigned)endpoints.values[ 0 ][ c ], 7 );
+        writer.Write( (unsigned)endpoints.values[ 1 ][ c ], 7 );
+    }
+
+    writer.Write( (unsigned)endpoints.pBits[ 0 ], 1 );
+    writer.Write( (unsigned)endpoints.pBits[ 1 ], 1 );
+
+    for (int i = 0; i < 16; ++i)
+    {
+        writer.Write( indices[ i ], i == 0 ? 3 : 4 );
+    }
+}
+
+static int GetBlockSize( Format format )
+{
+    return format == Format::BC1 ? 8 : 16;
+}
+
+static void EncodeBlock( const Block& block, Format format, std::uint8_t* out )
+{
+    if (format == Format::BC1)
+    {
+        EncodeColorBlock( block, out );
+    }
+    else if (format == Format::BC3)
+    {
+        EncodeSingleChannelBlock( block, 3, out );
+        EncodeColorBlock( block, out + 8 );
+    }
+    else if (format == Format::BC5)
+    {
+        EncodeSingleChannelBlock( block, 0, out );
+        EncodeSingleChannelBlock( block, 1, out + 8 );
+    }
+    else
+    {
+        EncodeBC7Block( block, out );
+    }
+}
+
+/// Compresses a mip level. Threads take rows of blocks until all are compressed.
+static std::vector< std::uint8_t > CompressLevel( const std::vector< std::uint8_t >& rgba, int width, int height, Format format, unsigned threadCount )
+{
+    const int blocksX = (width + 3) / 4;
+    const int blocksY = (height + 3) / 4;
+    const int blockSize = GetBlockSize( format );
+    std::vector< std::uint8_t > compressed( blocksX * blocksY * blockSize );
+    std::atomic< int > nextRow( 0 );
+
+    auto compressRows = [&]()
+    {
+        Block block;
+
+        for (int y = nextRow++; y < blocksY; y = nextRow++)
+        {
+            for (int x = 0; x < blocksX; ++x)
+            {
+                LoadBlock( rgba.data(), width, height, x, y, block );
+                EncodeBlock( block, format, &compressed[ (y * blocksX + x) * blockSize ] );
+            }
+        }
+    };
+
+    std::vector< std::thread > threads;
+
+    for (unsigned i = 1; i < std::min( threadCount, (unsigned)blocksY ); ++i)
+    {
+        threads.push_back( std::thread( compressRows ) );
+    }
+
+    compressRows();
+
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    return compressed;
+}
+
+static void Write32( std::vector< std::uint8_t >& bytes, std::uint32_t value )
+{
+    for (int i = 0; i < 4; ++i)
+    {
+        bytes.push_back( (std::uint8_t)(value >> (i * 8)) );
+    }
+}
+
+static std::uint32_t MakeFourCC( const char* code )
+{
+    return (std::uint32_t)code[ 0 ] | ((std::uint32_t)code[ 1 ] << 8) | ((std::uint32_t)code[ 2 ] << 16) | ((std::uint32_t)code[ 3 ] << 24);
+}
+
+/// \return DDS header and for BC7 the DX10 header that follows it.
+static std::vector< std::uint8_t > CreateDDSHeader( int width, int height, int mipCount, std::uint32_t topLevelSize, Format format, bool isSrgb )
+{
+    const std::uint32_t DDSD_CAPS = 0x1, DDSD_HEIGHT = 0x2, DDSD_WIDTH = 0x4, DDSD_PIXELFORMAT = 0x1000, DDSD_MIPMAPCOUNT = 0x20000, DDSD_LINEARSIZE = 0x80000;
+    const std::uint32_t DDPF_FOURCC = 0x4;
+    const std::uint32_t DDSCAPS_COMPLEX = 0x8, DDSCAPS_TEXTURE = 0x1000, DDSCAPS_MIPMAP = 0x400000;
+    const char* fourCCs[] = { "DXT1", "DXT5", "ATI2", "DX10" };
+
+    std::vector< std::uint8_t > header;
+    Write32( header, MakeFourCC( "DDS " ) );
+    Write32( header, 124 );
+    Write32( header, DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_MIPMAPCOUNT | DDSD_LINEARSIZE );
+    Write32( header, (std::uint32_t)height );
+    Write32( header, (std::uint32_t)width );
+    Write32( header, topLevelSize );
+    Write32( header, 0 );
+    Write32( header, (std::uint32_t)mipCount );
+
+    for (int i = 0; i < 11; ++i)
+    {
+        Write32( header, 0 );
+    }
+
+    Write32( header, 32 );
+    Write32( header, DDPF_FOURCC );
+    Write32( header, MakeFourCC( fourCCs[ (int)format ] ) );
+
+    for (int i = 0; i < 5; ++i)
+    {
+        Write32( header, 0 );
+    }
+
+    Write32( header, DDSCAPS_TEXTURE | (mipCount > 1 ? (DDSCAPS_COMPLEX | DDSCAPS_MIPMAP) : 0) );
+
+    for (int i = 0; i < 4; ++i)
+    {
+        Write32( header, 0 );
+    }
+
+    if (format == Format::BC7)
+    {
+        const std::uint32_t DXGI_FORMAT_BC7_UNORM = 98, DXGI_FORMAT_BC7_UNORM_SRGB = 99, DDS_DIMENSION_TEXTURE2D = 3;
+        Write32( header, isSrgb ? DXGI_FORMAT_BC7_UNORM_SRGB : DXGI_FORMAT_BC7_UNORM );
+        Write32( header, DDS_DIMENSION_TEXTURE2D );
+        Write32( header, 0 );
+        Write32( header, 1 );
+        Write32( header, 0 );
+    }
+
+    return header;
+}
+
+int main( int argCount, char* args[] )
+{
+    if (argCount < 3)
+    {
+        std::cout << "Usage: TextureCompressor input.png output.dds [bc1|bc3|bc5|bc7] [linear] [threads=N]" << std::endl;
+        return 1;
+    }
+
+    bool hasFormat = false;
+    Format format = Format::BC1;
+    bool isSrgb = true;
+    unsigned threadCount = std::max( std::thread::hardware_concurrency(), 1u );
+
+    for (int i = 3; i < argCount; ++i)
+    {
+        const std::string arg = args[ i ];
+        const char* formatNames[] = { "bc1", "bc3", "bc5", "bc7" };
+        const auto formatName = std::find( std::begin( formatNames ), std::end( formatNames ), arg );
+
+        if (formatName != std::end( formatNames ))
+        {
+            format = (Format)(formatName - std::begin( formatNames ));
+            hasFormat = true;
+        }
+        else if (arg == "linear")
+        {
+            isSrgb = false;
+        }
+        else if (arg.compare( 0, 8, "threads=" ) == 0)
+        {
+            threadCount = (unsigned)std::max( std::atoi( arg.c_str() + 8 ), 1 );
+        }
+        else
+        {
+            std::cerr << "Unknown argument " << arg << std::endl;
+            return 1;
+        }
+    }
+
+    int width, height, components;
+    std::uint8_t* imageData = stbi_load( args[ 1 ], &width, &height, &components, 4 );
+
+    if (imageData == nullptr)
+    {
+        std::cerr << "Failed to load " << args[ 1 ] << ". Reason: " << stbi_failure_reason() << std::endl;
+        return 1;
+    }
+
+    if (!IsPowerOfTwo( width ) || !IsPowerOfTwo( height ))
+    {
+        std::cerr << args[ 1 ] << " is " << width << "x" << height << " but dimensions must be powers of two." << std::endl;
+        stbi_image_free( imageData );
+        return 1;
+    }
+
+    std::vector< std::uint8_t > rgba( imageData, imageData + width * height * 4 );
+    stbi_image_free( imageData );
+
+    if (!hasFormat)
+    {
+        bool hasAlpha = false;
+
+        for (std::size_t i = 3; i < rgba.size(); i += 4)
+        {
+            hasAlpha |= rgba[ i ] != 255;
+        }
+
+        format = hasAlpha ? Format::BC3 : Format::BC1;
+    }
+
+    const bool isNormalMap = format == Format::BC5;
+    isSrgb &= !isNormalMap;
+
+    for (int i = 0; i < 256; ++i)
+    {
+        const float value = i / 255.0f;
+        CompressorGlobal::srgbToLinear[ i ] = value <= 0.04045f ? value / 12.92f : std::pow( (value + 0.055f) / 1.055f, 2.4f );
+    }
+
+    const auto startTime = std::chrono::steady_clock::now();
+
+    std::vector< std::uint8_t > mips;
+    std::uint32_t topLevelSize = 0;
+    int mipCount = 0;
+    FloatImage level = ToFloatImage( rgba.data(), width, height, isSrgb );
+
+    while (true)
+    {
+        // The top level is compressed from the source bytes so that filtering doesn't change it.
+        const std::vector< std::uint8_t > compressed = CompressLevel( mipCount == 0 ? rgba : ToBytes( level, isSrgb ), level.width, level.height, format, threadCount );
+        topLevelSize = mipCount == 0 ? (std::uint32_t)compressed.size() : topLevelSize;
+        mips.insert( std::end( mips ), std::begin( compressed ), std::end( compressed ) );
+        ++mipCount;
+
+        if (level.width == 1 && level.height == 1)
+        {
+            break;
+        }
+
+        level = Downsample( level, isNormalMap );
+    }
+
+    const double seconds = std::chrono::duration< double >( std::chrono::steady_clock::now() - startTime ).count();
+
+    std::ofstream ofs( args[ 2 ], std::ios::binary );
+
+    if (!ofs.is_open())
+    {
+        std::cerr << "Could not open " << args[ 2 ] << " for writing." << std::endl;
+        return 1;
+    }
+
+    const std::vector< std::uint8_t > header = CreateDDSHeader( width, height, mipCount, topLevelSize, format, isSrgb );
+    ofs.write( (const char*)header.data(), header.size() );
+    ofs.write( (const char*)mips.data(), mips.size() );
+
+    if (!ofs)
+    {
+        std::cerr << "Could not write " << args[ 2 ] << std::endl;
+        return 1;
+    }
+
+    const char* formatNames[] = { "BC1", "BC3", "BC5", "BC7" };
+    std::printf( "Wrote %s: %dx%d %s, %d mips, %u bytes, compressed in %.2f s on %u threads\n", args[ 2 ], width, height, formatNames[ (int)format ],
+                 mipCount, (unsigned)(header.size() + mips.size()), seconds, threadCount );
+    return 0;
+}
@@ -5,12 +5,20 @@
 
 #include <cassert>
 #include <cmath>
+#include <cstddef>
 #include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <fstream>
 #include <iostream>
+#include <limits>
 #include <algorithm>
+#include <atomic>
 #include <map>
+#include <unordered_map>
 #include <string>
+#include <thread>
 #include <vector>
 #include "Matrix.hpp"
 #include "Vec3.hpp"
@@ -68,10 +76,10 @@ struct Face
 // a, b and c are indices to Mesh::interleavedVertices.
 struct VertexInd
 {
-    unsigned short a, b, c;
+    unsigned a, b, c;
 };
 
-enum class VertexFormat { PTNTC_Skinned, PTNTC, PTN };
+enum class VertexFormat { PTNTC_Skinned, PTNTC, PTN, Compact };
 
 struct VertexPTNTC_Skinned
 {
@@ -100,6 +108,38 @@ struct VertexPTN
     ae3d::Vec3 normal;
 };
 
+// Quantized PTNTC. Position is 16-bit unorm inside the mesh's AABB, texcoord is half float,
+// normal and tangent are 8-bit snorm and color is 8-bit unorm.
+struct VertexPTNTC_Compact
+{
+    std::uint16_t position[ 4 ];
+    std::uint16_t texCoord[ 2 ];
+    std::int8_t normal[ 4 ];
+    std::int8_t tangent[ 4 ];
+    std::uint8_t color[ 4 ];
+};
+
+// Quantized PTNTC_Skinned. Weights are 8-bit unorm and bone indices 8-bit uint.
+struct VertexPTNTC_Compact_Skinned
+{
+    VertexPTNTC_Compact vertex;
+    std::uint8_t weights[ 4 ];
+    std::uint8_t bones[ 4 ];
+};
+
+// Depth stream vertices, read by shadow and depth-normals passes instead of the full vertex.
+struct VertexPN
+{
+    ae3d::Vec3 position;
+    ae3d::Vec3 normal;
+};
+
+struct VertexPN_Compact
+{
+    std::uint16_t position[ 4 ];
+    std::int8_t normal[ 4 ];
+};
+
 struct VertexData
 {
     float    score = 0;
@@ -142,8 +182,12 @@ struct Mesh
     void SolveVertexTangents();
     void CopyInterleavedVerticesToPTN();
     void CopyInterleavedVerticesToPTNTC();
+    void CopyInterleavedVerticesToCompact();
     
     void OptimizeFaces(); // Implements https://tomforsyth1000.github.io/papers/fast_vert_cache_opt.html
+    void OptimizeOverdraw( float threshold );
+    void OptimizeVertexFetch();
+    float Simplify( std::size_t targetFaceCount, float maxError );
     bool ComputeVertexScores();
 
     bool AlmostEquals( const ae3d::Vec3& v1, const ae3d::Vec3& v2 ) const;
@@ -166,6 +210,10 @@ struct Mesh
     std::vector< VertexPTNTC_Skinned > interleavedVertices;
     std::vector< VertexPTNTC > interleavedVerticesPTNTC;
     std::vector< VertexPTN > interleavedVerticesPTN;
+    std::vector< VertexPTNTC_Compact > interleavedVerticesCompact;
+    std::vector< VertexPTNTC_Compact_Skinned > interleavedVerticesCompactSkinned;
+    // Compact position range: position = xyz + quantized position (0-1) * w.
+    ae3d::Vec4 positionDequantization;
     std::vector< VertexInd > indices;
 
     // Used to calculate tangent-space handedness.
@@ -216,6 +264,125 @@ void Mesh::CopyInterleavedVerticesToPTNTC()
     }
 }
 
+static std::uint16_t FloatToHalf( float f )
+{
+    std::uint32_t bits;
+    std::memcpy( &bits, &f, 4 );
+
+    const std::uint16_t sign = (std::uint16_t)((bits >> 16) & 0x8000);
+    const int exponent = (int)((bits >> 23) & 0xFF) - 127 + 15;
+    std::uint32_t mantissa = bits & 0x7FFFFF;
+
+    if (exponent <= 0)
+    {
+        // Too small for a normalized half, flushes to zero.
+        return sign;
+    }
+
+    if (exponent >= 31)
+    {
+        // Clamps to the largest half.
+        return (std::uint16_t)(sign | 0x7BFF);
+    }
+
+    // Rounds to nearest. A carry from the mantissa correctly increments the exponent.
+    mantissa += 0x1000;
+    return (std::uint16_t)(sign | (((std::uint32_t)exponent << 10) + (mantissa >> 13)));
+}
+
+static std::int8_t PackSnorm8( float f )
+{
+    const float clamped = f < -1 ? -1 : (f > 1 ? 1 : f);
+    return (std::int8_t)std::lround( clamped * 127.0f );
+}
+
+static std::uint8_t PackUnorm8( float f )
+{
+    const float clamped = f < 0 ? 0 : (f > 1 ? 1 : f);
+    return (std::uint8_t)std::lround( clamped * 255.0f );
+}
+
+void Mesh::CopyInterleavedVerticesToCompact()
+{
+    const ae3d::Vec3 extent = aabbMax - aabbMin;
+    float scale = extent.x > extent.y ? extent.x : extent.y;
+    scale = scale > extent.z ? scale : extent.z;
+
+    // Uniform scale keeps normals correct when the dequantization is folded into object matrices.
+    positionDequantization = ae3d::Vec4( aabbMin, scale > 0 ? scale : 1 );
+
+    interleavedVerticesCompact.resize( interleavedVertices.size() );
+    interleavedVerticesCompactSkinned.resize( joints.empty() ? 0 : interleavedVertices.size() );
+
+    for (std::size_t i = 0; i < interleavedVertices.size(); ++i)
+    {
+        const VertexPTNTC_Skinned& in = interleavedVertices[ i ];
+        VertexPTNTC_Compact& out = interleavedVerticesCompact[ i ];
+
+        const ae3d::Vec3 position = (in.position - aabbMin) * (1.0f / positionDequantization.w);
+        const float positions[ 3 ] = { position.x, position.y, position.z };
+
+        for (int c = 0; c < 3; ++c)
+        {
+            const float clamped = positions[ c ] < 0 ? 0 : (positions[ c ] > 1 ? 1 : positions[ c ]);
+            out.position[ c ] = (std::uint16_t)std::lround( clamped * 65535.0f );
+        }
+
+        out.position[ 3 ] = 65535;
+        out.texCoord[ 0 ] = FloatToHalf( in.texCoord.u );
+        out.texCoord[ 1 ] = FloatToHalf( in.texCoord.v );
+
+        const ae3d::Vec3 normal = in.normal.Normalized();
+        out.normal[ 0 ] = PackSnorm8( normal.x );
+        out.normal[ 1 ] = PackSnorm8( normal.y );
+        out.normal[ 2 ] = PackSnorm8( normal.z );
+        out.normal[ 3 ] = 0;
+
+        const ae3d::Vec3 tangent = ae3d::Vec3( in.tangent.x, in.tangent.y, in.tangent.z ).Normalized();
+        out.tangent[ 0 ] = PackSnorm8( tangent.x );
+        out.tangent[ 1 ] = PackSnorm8( tangent.y );
+        out.tangent[ 2 ] = PackSnorm8( tangent.z );
+        out.tangent[ 3 ] = in.tangent.w < 0 ? -127 : 127;
+
+        out.color[ 0 ] = PackUnorm8( in.color.x );
+        out.color[ 1 ] = PackUnorm8( in.color.y );
+        out.color[ 2 ] = PackUnorm8( in.color.z );
+        out.color[ 3 ] = PackUnorm8( in.color.w );
+
+        if (joints.empty())
+        {
+            continue;
+        }
+
+        VertexPTNTC_Compact_Skinned& outSkinned = interleavedVerticesCompactSkinned[ i ];
+        outSkinned.vertex = out;
+
+        const float boneWeights[ 4 ] = { in.weights.x, in.weights.y, in.weights.z, in.weights.w };
+        int weightSum = 0;
+        int largestWeight = 0;
+
+        for (int b = 0; b < 4; ++b)
+        {
+            if (in.bones[ b ] < 0 || in.bones[ b ] > 255)
+            {
+                std::cerr << "Mesh " << name << " has bone index " << in.bones[ b ] << " that doesn't fit into 8 bits!" << std::endl;
+                exit( 1 );
+            }
+
+            outSkinned.bones[ b ] = (std::uint8_t)in.bones[ b ];
+            outSkinned.weights[ b ] = PackUnorm8( boneWeights[ b ] );
+            weightSum += outSkinned.weights[ b ];
+            largestWeight = outSkinned.weights[ b ] > outSkinned.weights[ largestWeight ] ? b : largestWeight;
+        }
+
+        // Rounding error is moved into the largest weight so the weights still sum to 1.
+        if (weightSum > 0)
+        {
+            outSkinned.weights[ largestWeight ] = (std::uint8_t)(outSkinned.weights[ largestWeight ] + 255 - weightSum);
+        }
+    }
+}
+
 float ComputeVertexCacheScore( int cachePosition, int vertexCacheSize )
 {
     const float findVertexScore_CacheDecayPower = 1.5f;
@@ -312,7 +479,11 @@ bool Mesh::ComputeVertexScores()
 
 void Mesh::OptimizeFaces()
 {
-    verticesWithCachedata.resize( interleavedVertices.size() );
+    // Cache and valence score tables are shared by all meshes.
+    static const bool areScoresComputed = ComputeVertexScores();
+    (void)areScoresComputed;
+
+    verticesWithCachedata.assign( interleavedVertices.size(), VertexPTNTCWithData() );
 
     for (std::size_t i = 0; i < interleavedVertices.size(); ++i)
     {
@@ -355,7 +526,7 @@ void Mesh::OptimizeFaces()
     // fill out face list per vertex
     for (unsigned i = 0; i < static_cast< unsigned >( indices.size() ); ++i)
     {
-        unsigned short index = indices[ i ].a;
+        unsigned index = indices[ i ].a;
         VertexPTNTCWithData& vertexDataA = verticesWithCachedata[ index ];
         activeFaceList[ vertexDataA.data.activeFaceListStart + vertexDataA.data.activeFaceListSize ] = i;
         ++vertexDataA.data.activeFaceListSize;
@@ -374,9 +545,9 @@ void Mesh::OptimizeFaces()
     std::vector<std::uint8_t> processedFaceList;
     processedFaceList.resize( indices.size() );
 
-    unsigned short vertexCacheBuffer[ (MaxVertexCacheSize + 3) * 2 ];
-    unsigned short* cache0 = vertexCacheBuffer;
-    unsigned short* cache1 = vertexCacheBuffer + (MaxVertexCacheSize + 3);
+    unsigned vertexCacheBuffer[ (MaxVertexCacheSize + 3) * 2 ];
+    unsigned* cache0 = vertexCacheBuffer;
+    unsigned* cache1 = vertexCacheBuffer + (MaxVertexCacheSize + 3);
     unsigned short entriesInCache0 = 0;
 
     unsigned bestFace = 0;
@@ -399,19 +570,19 @@ void Mesh::OptimizeFaces()
                     unsigned fface = j;
                     float faceScore = 0.f;
                    
-                    unsigned short indexA = indices[ fface ].a;
+                    unsigned indexA = indices[ fface ].a;
                     VertexPTNTCWithData& vertexDataA = verticesWithCachedata[ indexA ];
                     assert( vertexDataA.data.activeFaceListSize > 0 );
                     assert( vertexDataA.data.cachePos0 >= lruCacheSize );
                     faceScore += vertexDataA.data.score;
 
-                    unsigned short indexB = indices[ fface ].b;
+                    unsigned indexB = indices[ fface ].b;
                     VertexPTNTCWithData& vertexDataB = verticesWithCachedata[ indexB ];
                     assert( vertexDataB.data.activeFaceListSize > 0 );
                     assert( vertexDataB.data.cachePos0 >= lruCacheSize );
                     faceScore += vertexDataB.data.score;
 
-                    unsigned short indexC = indices[ fface ].c;
+                    unsigned indexC = indices[ fface ].c;
                     VertexPTNTCWithData& vertexDataC = verticesWithCachedata[ indexC ];
                     assert( vertexDataC.data.activeFaceListSize > 0 );
                     assert( vertexDataC.data.cachePos0 >= lruCacheSize );
@@ -438,7 +609,7 @@ void Mesh::OptimizeFaces()
 
         // add bestFace to LRU cache and to newIndexList
         {
-            unsigned short indexA = indices[ bestFace ].a;
+            unsigned indexA = indices[ bestFace ].a;
             newIndexList[ i ].a = indexA;
 
             VertexPTNTCWithData& vertexData = verticesWithCachedata[ indexA ];
@@ -470,7 +641,7 @@ void Mesh::OptimizeFaces()
         }
 
         {
-            unsigned short indexB = indices[ bestFace ].b;
+            unsigned indexB = indices[ bestFace ].b;
             newIndexList[ i ].b = indexB;
 
             VertexPTNTCWithData& vertexData = verticesWithCachedata[ indexB ];
@@ -502,7 +673,7 @@ void Mesh::OptimizeFaces()
         }
 
         {
-            unsigned short indexC = indices[ bestFace ].c;
+            unsigned indexC = indices[ bestFace ].c;
             newIndexList[ i ].c = indexC;
 
             VertexPTNTCWithData& vertexData = verticesWithCachedata[ indexC ];
@@ -535,7 +706,7 @@ void Mesh::OptimizeFaces()
         // move the rest of the old verts in the cache down and compute their new scores
         for (unsigned c0 = 0; c0 < entriesInCache0; ++c0)
         {
-            unsigned short index = cache0[ c0 ];
+            unsigned index = cache0[ c0 ];
             VertexPTNTCWithData& vertexData = verticesWithCachedata[ index ];
 
             if (vertexData.data.cachePos1 >= entriesInCache1)
@@ -550,7 +721,7 @@ void Mesh::OptimizeFaces()
         bestScore = -1.f;
         for (unsigned c1 = 0; c1 < entriesInCache1; ++c1)
         {
-            unsigned short index = cache1[ c1 ];
+            unsigned index = cache1[ c1 ];
             VertexPTNTCWithData& vertexData = verticesWithCachedata[ index ];
             vertexData.data.cachePos0 = vertexData.data.cachePos1;
             vertexData.data.cachePos1 = kEvictedCacheIndex;
@@ -559,15 +730,15 @@ void Mesh::OptimizeFaces()
                 unsigned fface = activeFaceList[ vertexData.data.activeFaceListStart + j ];
                 float faceScore = 0.f;
                     
-                unsigned short faceIndexA = indices[ fface ].a;
+                unsigned faceIndexA = indices[ fface ].a;
                 VertexPTNTCWithData& faceVertexDataA = verticesWithCachedata[ faceIndexA ];
                 faceScore += faceVertexDataA.data.score;
 
-                unsigned short faceIndexB = indices[ fface ].b;
+                unsigned faceIndexB = indices[ fface ].b;
                 VertexPTNTCWithData& faceVertexDataB = verticesWithCachedata[ faceIndexB ];
                 faceScore += faceVertexDataB.data.score;
 
-                unsigned short faceIndexC = indices[ fface ].c;
+                unsigned faceIndexC = indices[ fface ].c;
                 VertexPTNTCWithData& faceVertexDataC = verticesWithCachedata[ faceIndexC ];
                 faceScore += faceVertexDataC.data.score;
 
@@ -586,419 +757,1654 @@ void Mesh::OptimizeFaces()
     indices = newIndexList;
 }
 
-void Mesh::SolveAABB()
+/// Simulates a FIFO post-transform vertex cache. \return Number of cache misses of a face.
+static unsigned SimulateVertexCache( const VertexInd& face, std::vector< unsigned >& timestamps, unsigned& time, unsigned cacheSize )
 {
-    const float maxValue = 99999999.0f;
-
-    aabbMin = ae3d::Vec3(  maxValue,  maxValue,  maxValue );
-    aabbMax = ae3d::Vec3( -maxValue, -maxValue, -maxValue );
+    const unsigned corners[ 3 ] = { face.a, face.b, face.c };
+    unsigned misses = 0;
 
-    for (std::size_t v = 0; v < vertex.size(); ++v)
+    for (unsigned v : corners)
     {
-        const ae3d::Vec3& pos = vertex[ v ];
-
-        if (pos.x > maxValue || pos.y > maxValue || pos.z > maxValue)
+        if (time - timestamps[ v ] > cacheSize)
         {
-            std::cerr << "AABB's max value is too low in file " << __FILE__ << " near line " << __LINE__ << std::endl;
-            std::cerr << "Vertex " << v << ": " << pos.x << ", " << pos.y << ", " << pos.z << std::endl;
-        }
-        
-        if (pos.x < -maxValue || pos.y < -maxValue || pos.z < -maxValue)
-        {
-            std::cerr << "AABB's min value is too high in file " << __FILE__ << " near line " << __LINE__ << std::endl;
-            std::cerr << "Vertex " << v << ": " << pos.x << ", " << pos.y << ", " << pos.z << std::endl;
+            timestamps[ v ] = time++;
+            ++misses;
         }
-
-        aabbMin = ae3d::Vec3::Min2( aabbMin, pos );
-        aabbMax = ae3d::Vec3::Max2( aabbMax, pos );
     }
-}
-
-void Mesh::SolveFaceNormals()
-{
-    fnormal.resize( indices.size() );
-
-    for (std::size_t faceInd = 0; faceInd < indices.size(); ++faceInd)
-    {
-        const unsigned short& faceA = indices[ faceInd ].a;
-        const unsigned short& faceB = indices[ faceInd ].b;
-        const unsigned short& faceC = indices[ faceInd ].c;
-
-        const ae3d::Vec3 va = interleavedVertices[ faceA ].position;
-        ae3d::Vec3 vb = interleavedVertices[ faceB ].position;
-        ae3d::Vec3 vc = interleavedVertices[ faceC ].position;
-
-        vb -= va;
-        vc -= va;
-
-        vb = ae3d::Vec3::Cross( vb, vc ).Normalized();
 
-        fnormal[ faceInd ] = vb;
-    }
+    return misses;
 }
 
 /**
- Generates tangents for faces.
-
- Tangent vector (u-axis) will point in the direction of increasing U-coordinate.
- Bitangent vector (v-axis) will point in the direction of increasing V-coordinate.
+ Reorders clusters of cache-optimized faces so that faces that are likely to occlude others are drawn first.
+ Implements "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw" by Sander, Nehab and Barczak.
+ Must be called after OptimizeFaces().
+ \param threshold How much the ACMR is allowed to grow, 1.05 allows 5% more vertex transforms.
  */
-void Mesh::SolveFaceTangents()
+void Mesh::OptimizeOverdraw( float threshold )
 {
-    assert( !indices.empty() );
+    const unsigned cacheSize = 16;
+    std::vector< unsigned > timestamps( interleavedVertices.size(), 0 );
+    unsigned time = cacheSize + 1;
 
-    tangents.resize  ( indices.size() );
-    bitangents.resize( indices.size() );
-
-    bool degenerateFound = false;
+    // Hard boundaries are where the cache was flushed, ie. all vertices of a face missed.
+    std::vector< std::size_t > hardBoundaries;
+    std::vector< unsigned > faceMisses( indices.size() );
 
-    // Algorithm source:
-    // http://www.opengl-tutorial.org/intermediate-tutorials/tutorial-13-normal-mapping/#header-3
     for (std::size_t f = 0; f < indices.size(); ++f)
     {
-        const ae3d::Vec3& p1 = interleavedVertices[ indices[ f ].a ].position;
-        const ae3d::Vec3& p2 = interleavedVertices[ indices[ f ].b ].position;
-        const ae3d::Vec3& p3 = interleavedVertices[ indices[ f ].c ].position;
+        faceMisses[ f ] = SimulateVertexCache( indices[ f ], timestamps, time, cacheSize );
 
-        const TexCoord& uv1 = interleavedVertices[ indices[ f ].a ].texCoord;
-        const TexCoord& uv2 = interleavedVertices[ indices[ f ].b ].texCoord;
-        const TexCoord& uv3 = interleavedVertices[ indices[ f ].c ].texCoord;
+        if (faceMisses[ f ] == 3)
+        {
+            hardBoundaries.push_back( f );
+        }
+    }
 
-        const TexCoord deltaUV1 = uv2 - uv1;
-        const TexCoord deltaUV2 = uv3 - uv1;
+    hardBoundaries.push_back( indices.size() );
 
-        const float area = deltaUV1.u * deltaUV2.v - deltaUV1.v * deltaUV2.u;
+    // Soft boundaries split hard clusters where the cluster so far has an ACMR within the threshold of the whole cluster's.
+    std::vector< std::size_t > clusters;
 
-        ae3d::Vec3 tangent;
-        ae3d::Vec3 bitangent;
+    for (std::size_t h = 0; h + 1 < hardBoundaries.size(); ++h)
+    {
+        const std::size_t start = hardBoundaries[ h ];
+        const std::size_t end = hardBoundaries[ h + 1 ];
+        unsigned clusterMisses = 0;
 
-        if (std::fabs( area ) > 0.00001f)
+        for (std::size_t f = start; f < end; ++f)
         {
-            const ae3d::Vec3 deltaP1 = p2 - p1;
-            const ae3d::Vec3 deltaP2 = p3 - p1;
+            clusterMisses += faceMisses[ f ];
+        }
 
-            tangent   = (deltaP1 * deltaUV2.v - deltaP2 * deltaUV1.v) / area;
-            bitangent = (deltaP2 * deltaUV1.u - deltaP1 * deltaUV2.u) / area;
+        const float clusterThreshold = threshold * clusterMisses / (end - start);
+        time += cacheSize + 1;
+        unsigned misses = 0;
+        std::size_t faces = 0;
+        clusters.push_back( start );
+
+        for (std::size_t f = start; f < end; ++f)
+        {
+            misses += SimulateVertexCache( indices[ f ], timestamps, time, cacheSize );
+            ++faces;
+
+            if (f + 1 < end && (float)misses / faces <= clusterThreshold)
+            {
+                clusters.push_back( f + 1 );
+                time += cacheSize + 1;
+                misses = 0;
+                faces = 0;
+            }
         }
-        else
+    }
+
+    clusters.push_back( indices.size() );
+
+    // Clusters that face away from the mesh's center are drawn first.
+    ae3d::Vec3 meshCentroid;
+    float meshArea = 0;
+    std::vector< ae3d::Vec3 > clusterCentroids( clusters.size() - 1 );
+    std::vector< ae3d::Vec3 > clusterNormals( clusters.size() - 1 );
+
+    for (std::size_t c = 0; c + 1 < clusters.size(); ++c)
+    {
+        float clusterArea = 0;
+
+        for (std::size_t f = clusters[ c ]; f < clusters[ c + 1 ]; ++f)
         {
-            degenerateFound = true;
+            const ae3d::Vec3& p0 = interleavedVertices[ indices[ f ].a ].position;
+            const ae3d::Vec3& p1 = interleavedVertices[ indices[ f ].b ].position;
+            const ae3d::Vec3& p2 = interleavedVertices[ indices[ f ].c ].position;
+            const ae3d::Vec3 normal = ae3d::Vec3::Cross( p1 - p0, p2 - p0 );
+            const float area = normal.Length();
+            const ae3d::Vec3 centroid = (p0 + p1 + p2) * (area / 3);
+
+            clusterCentroids[ c ] += centroid;
+            clusterNormals[ c ] += normal;
+            clusterArea += area;
+            meshCentroid += centroid;
         }
 
-        const ae3d::Vec4 tangent4( tangent.x, tangent.y, tangent.z, 0.0f );
-        tangents[ f ]   = tangent4;
-        bitangents[ f ] = bitangent;
+        clusterCentroids[ c ] = clusterCentroids[ c ] * (clusterArea > 0 ? 1 / clusterArea : 0);
+        meshArea += clusterArea;
     }
 
-    if (degenerateFound)
+    meshCentroid = meshCentroid * (meshArea > 0 ? 1 / meshArea : 0);
+
+    std::vector< float > sortKeys( clusters.size() - 1 );
+    std::vector< std::size_t > order( clusters.size() - 1 );
+
+    for (std::size_t c = 0; c < order.size(); ++c)
     {
-        std::cout << std::endl << "Warning: Degenerate UV map in mesh " << name << ".  Author needs to separate texture points." << std::endl;
+        sortKeys[ c ] = ae3d::Vec3::Dot( clusterCentroids[ c ] - meshCentroid, clusterNormals[ c ].Normalized() );
+        order[ c ] = c;
     }
-}
 
-void Mesh::SolveVertexNormals()
-{
-    vnormal.resize( vertex.size() );
-    
-    // For every vertex, check how many faces touches
-    // it and calculate the average of those face normals.
-    for (std::size_t vertInd = 0; vertInd < vertex.size(); ++vertInd)
-    {
-        ae3d::Vec3 normal;
+    std::stable_sort( order.begin(), order.end(), [&sortKeys]( std::size_t a, std::size_t b ) { return sortKeys[ a ] > sortKeys[ b ]; } );
 
-        for (std::size_t faceInd = 0; faceInd < face.size(); ++faceInd)
-        {
-            face[ faceInd ].vnInd[ 0 ] = face[ faceInd ].vInd[ 0 ];
-            face[ faceInd ].vnInd[ 1 ] = face[ faceInd ].vInd[ 1 ];
-            face[ faceInd ].vnInd[ 2 ] = face[ faceInd ].vInd[ 2 ];
+    std::vector< VertexInd > sortedIndices;
+    sortedIndices.reserve( indices.size() );
+
+    for (std::size_t c : order)
+    {
+        sortedIndices.insert( sortedIndices.end(), indices.begin() + clusters[ c ], indices.begin() + clusters[ c + 1 ] );
+    }
 
-            const unsigned short& faceA = face[ faceInd ].vInd[ 0 ];
-            const unsigned short& faceB = face[ faceInd ].vInd[ 1 ];
-            const unsigned short& faceC = face[ faceInd ].vInd[ 2 ];
+    indices.swap( sortedIndices );
+}
 
-            const ae3d::Vec3 va = vertex[ faceA ];
-            ae3d::Vec3 vb = vertex[ faceB ] - va;
-            const ae3d::Vec3 vc = vertex[ faceC ] - va;
+/// Reorders vertices in the order of their first use in faces, so vertex fetches read memory mostly sequentially.
+/// Removes vertices that are not used by any face.
+void Mesh::OptimizeVertexFetch()
+{
+    std::vector< unsigned > remap( interleavedVertices.size(), ~0u );
+    std::vector< VertexPTNTC_Skinned > vertices;
+    vertices.reserve( interleavedVertices.size() );
 
-            vb = ae3d::Vec3::Cross( vb, vc ).Normalized();
+    for (VertexInd& triangle : indices)
+    {
+        unsigned* corners[ 3 ] = { &triangle.a, &triangle.b, &triangle.c };
 
-            if (face[ faceInd ].vInd[ 0 ] == vertInd ||
-                face[ faceInd ].vInd[ 1 ] == vertInd ||
-                face[ faceInd ].vInd[ 2 ] == vertInd)
+        for (unsigned* v : corners)
+        {
+            if (remap[ *v ] == ~0u)
             {
-                normal = normal + vb;
+                remap[ *v ] = (unsigned)vertices.size();
+                vertices.push_back( interleavedVertices[ *v ] );
             }
+
+            *v = remap[ *v ];
         }
-        
-        vnormal[ vertInd ] = normal.Normalized();
     }
+
+    interleavedVertices.swap( vertices );
 }
 
-void Mesh::SolveVertexTangents()
+/// Quadric of a point p: p^T A p + 2 b^T p + c, where A is symmetric and stored as its upper triangle.
+struct Quadric
 {
-    assert( !tangents.empty() );
+    double a00 = 0, a01 = 0, a02 = 0, a11 = 0, a12 = 0, a22 = 0;
+    double b0 = 0, b1 = 0, b2 = 0;
+    double c = 0;
+    /// Sum of the weights of the faces that contributed to the quadric.
+    double weight = 0;
 
-    for (std::size_t v = 0; v < interleavedVertices.size(); ++v)
+    void Add( const Quadric& q )
     {
-        interleavedVertices[ v ].tangent = ae3d::Vec4( 0, 0, 0, 0 );
+        a00 += q.a00; a01 += q.a01; a02 += q.a02; a11 += q.a11; a12 += q.a12; a22 += q.a22;
+        b0 += q.b0; b1 += q.b1; b2 += q.b2;
+        c += q.c;
+        weight += q.weight;
     }
 
-    std::vector< ae3d::Vec3 > vbitangents( interleavedVertices.size() );
+    /// Adds the squared value of n.p + d, scaled by aWeight. n is a plane normal or an attribute gradient.
+    void AddSquared( const double n[ 3 ], double d, double aWeight )
+    {
+        a00 += aWeight * n[ 0 ] * n[ 0 ]; a01 += aWeight * n[ 0 ] * n[ 1 ]; a02 += aWeight * n[ 0 ] * n[ 2 ];
+        a11 += aWeight * n[ 1 ] * n[ 1 ]; a12 += aWeight * n[ 1 ] * n[ 2 ]; a22 += aWeight * n[ 2 ] * n[ 2 ];
+        b0 += aWeight * n[ 0 ] * d; b1 += aWeight * n[ 1 ] * d; b2 += aWeight * n[ 2 ] * d;
+        c += aWeight * d * d;
+    }
 
-    for (std::size_t vertInd = 0; vertInd < interleavedVertices.size(); ++vertInd)
+    double Evaluate( const double p[ 3 ] ) const
     {
-        ae3d::Vec4 tangent( 0.0f, 0.0f, 0.0f, 0.0f );
-        ae3d::Vec3 bitangent;
+        const double x = p[ 0 ], y = p[ 1 ], z = p[ 2 ];
+        return x * (a00 * x + 2 * (a01 * y + a02 * z + b0)) + y * (a11 * y + 2 * (a12 * z + b1)) + z * (a22 * z + 2 * b2) + c;
+    }
+};
+
+/// UV and normal are preserved by simplification.
+static const int simplifyAttributeCount = 5;
 
-        for (std::size_t faceInd = 0; faceInd < indices.size(); ++faceInd)
+/// Attribute part of a vertex's quadric (Hoppe, "New Quadric Metric for Simplifying Meshes with Appearance Attributes").
+/// An attribute is interpolated linearly over a face as g.p + d. The error of attribute value s at p is the sum of (g.p + d - s)^2 over faces,
+/// whose terms without s are in the vertex's Quadric and the rest need weighted sums of g and d.
+struct AttributeQuadric
+{
+    Quadric quadric;
+    double gradients[ simplifyAttributeCount ][ 3 ] = {};
+    double offsets[ simplifyAttributeCount ] = {};
+
+    void Add( const AttributeQuadric& q )
+    {
+        quadric.Add( q.quadric );
+
+        for (int i = 0; i < simplifyAttributeCount; ++i)
         {
-            if (indices[ faceInd ].a == vertInd ||
-                indices[ faceInd ].b == vertInd ||
-                indices[ faceInd ].c == vertInd)
-            {
-                tangent   += tangents  [ faceInd ];
-                bitangent += bitangents[ faceInd ];
-            }
+            gradients[ i ][ 0 ] += q.gradients[ i ][ 0 ];
+            gradients[ i ][ 1 ] += q.gradients[ i ][ 1 ];
+            gradients[ i ][ 2 ] += q.gradients[ i ][ 2 ];
+            offsets[ i ] += q.offsets[ i ];
         }
-
-        interleavedVertices[ vertInd ].tangent = tangent;
-        vbitangents[ vertInd ] = bitangent;
     }
 
-    for (std::size_t v = 0; v < interleavedVertices.size(); ++v)
+    double Evaluate( const double p[ 3 ], const double attributes[ simplifyAttributeCount ] ) const
     {
-        ae3d::Vec4& tangent = interleavedVertices[ v ].tangent;
-        const ae3d::Vec3& normal = interleavedVertices[ v ].normal;
-        const ae3d::Vec4 normal4( normal.x, normal.y, normal.z, 0 );
+        double error = quadric.Evaluate( p );
 
-        // Gram-Schmidt orthonormalization.
-        tangent -= normal4 * normal4.Dot( tangent );
-        tangent.Normalize();
+        for (int i = 0; i < simplifyAttributeCount; ++i)
+        {
+            const double s = attributes[ i ];
+            error += s * s * quadric.weight - 2 * s * (gradients[ i ][ 0 ] * p[ 0 ] + gradients[ i ][ 1 ] * p[ 1 ] + gradients[ i ][ 2 ] * p[ 2 ] + offsets[ i ]);
+        }
 
-        // Handedness. TBN must form a right-handed coordinate system,
-        // i.e. cross(n,t) must have the same orientation as b.
-        const ae3d::Vec3 cp = ae3d::Vec3::Cross( normal, ae3d::Vec3( tangent.x, tangent.y, tangent.z ) );
-        tangent.w = ae3d::Vec3::Dot( cp, vbitangents[v] ) >= 0 ? 1.0f : -1.0f;
+        return error;
     }
+};
+
+static std::uint64_t GetEdgeKey( unsigned a, unsigned b )
+{
+    return a < b ? ((std::uint64_t)a << 32) | b : ((std::uint64_t)b << 32) | a;
 }
 
-// Creates an interleaved vertex array.
-void Mesh::Interleave()
+/// Simplifies the mesh with half-edge collapses in the order of quadric error that includes UV and normal errors.
+/// Vertices on open borders only collapse along the border. Vertices on UV seams and hard edges only collapse along the seam,
+/// so both sides of a seam stay connected. Unused vertices are left in interleavedVertices for OptimizeVertexFetch to remove.
+/// \param targetFaceCount Face count to reach.
+/// \param maxError Largest allowed distance between the simplified and original surface in model units.
+/// \return Largest distance between the simplified and original surface in model units, estimated by the quadrics.
+float Mesh::Simplify( std::size_t targetFaceCount, float maxError )
 {
-    VertexInd newFace;
+    const std::size_t vertexCount = interleavedVertices.size();
 
-    for (std::size_t f = 0; f < face.size(); ++f)
+    if (indices.size() <= targetFaceCount || vertexCount == 0)
     {
-        // vertind 0
-        ae3d::Vec3 tvertex = vertex [ face[ f ].vInd [ 0 ] ];
-        ae3d::Vec3 tnormal = vnormal[ face[ f ].vnInd[ 0 ] ];
-        TexCoord ttcoord = tcoord.empty() ? TexCoord() : tcoord[ face[ f ].uvInd[ 0 ] ];
-        ae3d::Vec4 tcolor = colors.empty() ? ae3d::Vec4( 0, 0, 0, 1 ) : colors[ face[ f ].colInd[ 0 ] ];
-        ae3d::Vec4 ttangent = nonInterleavedTangents.empty() ? ae3d::Vec4( 0, 0, 0, 1 ) : nonInterleavedTangents[ face[ f ].tInd[ 0 ] ];
+        return 0;
+    }
 
-        // Searches face f's vertex a from the vertex list.
-        // If it's not found, it's added.
-        bool found = false;
-        
-        for (std::size_t i = 0; i < indices.size(); ++i)
-        {
-            if (AlmostEquals( interleavedVertices[ indices[ i ].a ].position, tvertex ) &&
-                AlmostEquals( interleavedVertices[ indices[ i ].a ].normal,   tnormal ) &&
-                AlmostEquals( interleavedVertices[ indices[ i ].a ].texCoord, ttcoord ) &&
-                AlmostEquals( interleavedVertices[ indices[ i ].a ].tangent, ttangent ) &&
-                AlmostEquals( interleavedVertices[ indices[ i ].a ].color, tcolor ))
-            {
-                found = true;
-                newFace.a = indices[ i ].a;
-                break;
-            }
-        }
+    // Positions are scaled into a unit cube, so position and attribute errors are comparable in all meshes.
+    ae3d::Vec3 boundsMin = interleavedVertices[ 0 ].position;
+    ae3d::Vec3 boundsMax = interleavedVertices[ 0 ].position;
 
-        if (!found)
-        {
-            VertexPTNTC_Skinned newVertex;
-            newVertex.position = tvertex;
-            newVertex.normal   = tnormal;
-            newVertex.texCoord = ttcoord;
-            newVertex.color    = tcolor;
-            newVertex.tangent  = ttangent;
-            
-            if (!weights.empty())
-            {
-                newVertex.weights  = weights[ face[ f ].vInd[ 0 ] ];
-            }
-            if (!bones.empty())
-            {
-                newVertex.bones[ 0 ] = bones[ face[ f ].vInd[ 0 ] ].a;
-                newVertex.bones[ 1 ] = bones[ face[ f ].vInd[ 0 ] ].b;
-                newVertex.bones[ 2 ] = bones[ face[ f ].vInd[ 0 ] ].c;
-                newVertex.bones[ 3 ] = bones[ face[ f ].vInd[ 0 ] ].d;
-            }
-            
-            interleavedVertices.push_back( newVertex );
-            
-            newFace.a = (unsigned short)(interleavedVertices.size() - 1);
-        }
+    for (const VertexPTNTC_Skinned& v : interleavedVertices)
+    {
+        boundsMin = ae3d::Vec3::Min2( boundsMin, v.position );
+        boundsMax = ae3d::Vec3::Max2( boundsMax, v.position );
+    }
 
-        // vertind 1
-        tvertex = vertex [ face[ f ].vInd [ 1 ] ];
-        tnormal = vnormal[ face[ f ].vnInd[ 1 ] ];
-        ttcoord = tcoord.empty() ? TexCoord() : tcoord [ face[ f ].uvInd[ 1 ] ];
-        tcolor = colors.empty() ? ae3d::Vec4( 0, 0, 0, 1 ) : colors[ face[ f ].colInd[ 1 ] ];
-        ttangent = nonInterleavedTangents.empty() ? ae3d::Vec4( 0, 0, 0, 1 ) : nonInterleavedTangents[ face[ f ].tInd[ 1 ] ];
-        
-        found = false;
+    const double extent = (double)std::max( std::max( boundsMax.x - boundsMin.x, boundsMax.y - boundsMin.y ), boundsMax.z - boundsMin.z );
+    const double scale = extent > 0 ? 1 / extent : 1;
+    const double uvWeight = 1;
+    const double normalWeight = 0.5;
+    const double borderWeight = 10;
 
-        for (std::size_t i = 0; i < indices.size(); ++i)
-        {
-            if (AlmostEquals( interleavedVertices[ indices[ i ].b ].position, tvertex ) &&
-                AlmostEquals( interleavedVertices[ indices[ i ].b ].normal,   tnormal ) &&
-                AlmostEquals( interleavedVertices[ indices[ i ].b ].texCoord, ttcoord ) &&
-                AlmostEquals( interleavedVertices[ indices[ i ].b ].tangent, ttangent ) &&
-                AlmostEquals( interleavedVertices[ indices[ i ].b ].color, tcolor ))
-                
-            {
-                found = true;
+    std::vector< double > positions( vertexCount * 3 );
+    std::vector< double > attributes( vertexCount * simplifyAttributeCount );
 
-                newFace.b = indices[ i ].b;
-                break;
-            }
-        }
+    for (std::size_t v = 0; v < vertexCount; ++v)
+    {
+        const VertexPTNTC_Skinned& source = interleavedVertices[ v ];
+        positions[ v * 3 + 0 ] = (double)(source.position.x - boundsMin.x) * scale;
+        positions[ v * 3 + 1 ] = (double)(source.position.y - boundsMin.y) * scale;
+        positions[ v * 3 + 2 ] = (double)(source.position.z - boundsMin.z) * scale;
+
+        double* attribute = &attributes[ v * simplifyAttributeCount ];
+        attribute[ 0 ] = (double)source.texCoord.u * uvWeight;
+        attribute[ 1 ] = (double)source.texCoord.v * uvWeight;
+        attribute[ 2 ] = (double)source.normal.x * normalWeight;
+        attribute[ 3 ] = (double)source.normal.y * normalWeight;
+        attribute[ 4 ] = (double)source.normal.z * normalWeight;
+    }
 
-        if (!found)
+    // Interleave() doesn't merge equal vertices of different face corners, but they must be one wedge so they don't look like a seam.
+    // Tangents are ignored because they are solved again after simplification.
+    {
+        auto compare = [this]( unsigned a, unsigned b )
         {
-            VertexPTNTC_Skinned newVertex;
-            newVertex.position = tvertex;
-            newVertex.normal   = tnormal;
-            newVertex.texCoord = ttcoord;
-            newVertex.color    = tcolor;
-            newVertex.tangent  = ttangent;
-            
-            if (!weights.empty())
-            {
-                newVertex.weights  = weights[ face[ f ].vInd[ 1 ] ];
-            }
-            if (!bones.empty())
-            {
-                newVertex.bones[ 0 ] = bones[ face[ f ].vInd[ 1 ] ].a;
-                newVertex.bones[ 1 ] = bones[ face[ f ].vInd[ 1 ] ].b;
-                newVertex.bones[ 2 ] = bones[ face[ f ].vInd[ 1 ] ].c;
-                newVertex.bones[ 3 ] = bones[ face[ f ].vInd[ 1 ] ].d;
-            }
-            
-            interleavedVertices.push_back( newVertex );
+            const unsigned char* vertexA = (const unsigned char*)&interleavedVertices[ a ];
+            const unsigned char* vertexB = (const unsigned char*)&interleavedVertices[ b ];
+            const std::size_t tangentBegin = offsetof( VertexPTNTC_Skinned, tangent );
+            const std::size_t tangentEnd = offsetof( VertexPTNTC_Skinned, color );
+            const int comparison = std::memcmp( vertexA, vertexB, tangentBegin );
+            return comparison != 0 ? comparison : std::memcmp( vertexA + tangentEnd, vertexB + tangentEnd, sizeof( VertexPTNTC_Skinned ) - tangentEnd );
+        };
+
+        std::vector< unsigned > order( vertexCount );
 
-            newFace.b = (unsigned short)(interleavedVertices.size() - 1);
+        for (std::size_t v = 0; v < vertexCount; ++v)
+        {
+            order[ v ] = (unsigned)v;
         }
 
-        // vertind 2
-        tvertex = vertex [ face[ f ].vInd [ 2 ] ];
-        tnormal = vnormal[ face[ f ].vnInd[ 2 ] ];
-        ttcoord = tcoord.empty() ? TexCoord() :  tcoord [ face[ f ].uvInd[ 2 ] ];
-        tcolor = colors.empty() ? ae3d::Vec4( 0, 0, 0, 1 ) : colors[ face[ f ].colInd[ 2 ] ];
-        ttangent = nonInterleavedTangents.empty() ? ae3d::Vec4( 0, 0, 0, 1 ) : nonInterleavedTangents[ face[ f ].tInd[ 2 ] ];
+        auto isLess = [&compare]( unsigned a, unsigned b )
+        {
+            const int comparison = compare( a, b );
+            return comparison < 0 || (comparison == 0 && a < b);
+        };
 
-        found = false;
+        std::sort( order.begin(), order.end(), isLess );
+        std::vector< unsigned > remap( vertexCount );
 
-        for (std::size_t i = 0; i < indices.size(); ++i)
+        for (std::size_t i = 0; i < vertexCount; ++i)
         {
-            if (AlmostEquals( interleavedVertices[ indices[ i ].c ].position, tvertex ) &&
-                AlmostEquals( interleavedVertices[ indices[ i ].c ].normal,   tnormal ) &&
-                AlmostEquals( interleavedVertices[ indices[ i ].c ].texCoord, ttcoord ) &&
-                AlmostEquals( interleavedVertices[ indices[ i ].c ].tangent, ttangent ) &&
-                AlmostEquals( interleavedVertices[ indices[ i ].c ].color, tcolor ))
-            {
-                found = true;
-
-                newFace.c = indices[ i ].c;
-                break;
-            }
+            const bool isDuplicate = i > 0 && compare( order[ i - 1 ], order[ i ] ) == 0;
+            remap[ order[ i ] ] = isDuplicate ? remap[ order[ i - 1 ] ] : order[ i ];
         }
 
-        if (!found)
+        for (VertexInd& triangle : indices)
         {
-            VertexPTNTC_Skinned newVertex;
-            newVertex.position = tvertex;
-            newVertex.normal   = tnormal;
-            newVertex.texCoord = ttcoord;
-            newVertex.color    = tcolor;
-            newVertex.tangent  = ttangent;
+            triangle.a = remap[ triangle.a ];
+            triangle.b = remap[ triangle.b ];
+            triangle.c = remap[ triangle.c ];
+        }
+    }
+
+    // Vertices with the same position are wedges of one position, which differ by their attributes.
+    std::vector< unsigned > vertexPosition( vertexCount );
+    std::vector< unsigned > positionVertex; // A wedge of each position.
+    {
+        std::vector< unsigned > order( vertexCount );
+
+        for (std::size_t v = 0; v < vertexCount; ++v)
+        {
+            order[ v ] = (unsigned)v;
+        }
+
+        auto isLess = [this]( unsigned a, unsigned b )
+        {
+            return std::memcmp( &interleavedVertices[ a ].position, &interleavedVertices[ b ].position, sizeof( ae3d::Vec3 ) ) < 0;
+        };
+
+        std::sort( order.begin(), order.end(), isLess );
+
+        for (std::size_t i = 0; i < vertexCount; ++i)
+        {
+            if (i == 0 || isLess( order[ i - 1 ], order[ i ] ))
+            {
+                positionVertex.push_back( order[ i ] );
+            }
+
+            vertexPosition[ order[ i ] ] = (unsigned)positionVertex.size() - 1;
+        }
+    }
+
+    const std::size_t positionCount = positionVertex.size();
+    std::vector< Quadric > positionQuadrics( positionCount );
+    std::vector< AttributeQuadric > vertexQuadrics( vertexCount );
+    std::unordered_map< std::uint64_t, unsigned > edgeFaceCounts;
+
+    auto countEdges = [&]()
+    {
+        edgeFaceCounts.clear();
+
+        for (const VertexInd& triangle : indices)
+        {
+            const unsigned a = vertexPosition[ triangle.a ], b = vertexPosition[ triangle.b ], c = vertexPosition[ triangle.c ];
+            ++edgeFaceCounts[ GetEdgeKey( a, b ) ];
+            ++edgeFaceCounts[ GetEdgeKey( b, c ) ];
+            ++edgeFaceCounts[ GetEdgeKey( c, a ) ];
+        }
+    };
+
+    auto getFaceNormal = []( const double* p0, const double* p1, const double* p2, double outNormal[ 3 ] )
+    {
+        const double e1[ 3 ] = { p1[ 0 ] - p0[ 0 ], p1[ 1 ] - p0[ 1 ], p1[ 2 ] - p0[ 2 ] };
+        const double e2[ 3 ] = { p2[ 0 ] - p0[ 0 ], p2[ 1 ] - p0[ 1 ], p2[ 2 ] - p0[ 2 ] };
+        outNormal[ 0 ] = e1[ 1 ] * e2[ 2 ] - e1[ 2 ] * e2[ 1 ];
+        outNormal[ 1 ] = e1[ 2 ] * e2[ 0 ] - e1[ 0 ] * e2[ 2 ];
+        outNormal[ 2 ] = e1[ 0 ] * e2[ 1 ] - e1[ 1 ] * e2[ 0 ];
+    };
+
+    countEdges();
+
+    // Every triangle adds its plane to its positions and its attribute gradients to its vertices, weighted by area.
+    // Border edges add a plane that is perpendicular to the triangle, so borders keep their shape.
+    for (const VertexInd& triangle : indices)
+    {
+        const unsigned corners[ 3 ] = { triangle.a, triangle.b, triangle.c };
+        const double* p[ 3 ] = { &positions[ triangle.a * 3 ], &positions[ triangle.b * 3 ], &positions[ triangle.c * 3 ] };
+        double normal[ 3 ];
+        getFaceNormal( p[ 0 ], p[ 1 ], p[ 2 ], normal );
+        const double length = std::sqrt( normal[ 0 ] * normal[ 0 ] + normal[ 1 ] * normal[ 1 ] + normal[ 2 ] * normal[ 2 ] );
+
+        if (length == 0)
+        {
+            continue;
+        }
+
+        const double area = length / 2;
+        normal[ 0 ] /= length; normal[ 1 ] /= length; normal[ 2 ] /= length;
+        const double distance = -(normal[ 0 ] * p[ 0 ][ 0 ] + normal[ 1 ] * p[ 0 ][ 1 ] + normal[ 2 ] * p[ 0 ][ 2 ]);
+
+        for (int c = 0; c < 3; ++c)
+        {
+            Quadric& quadric = positionQuadrics[ vertexPosition[ corners[ c ] ] ];
+            quadric.AddSquared( normal, distance, area );
+            quadric.weight += area;
+
+            const unsigned next = corners[ (c + 1) % 3 ];
+
+            if (edgeFaceCounts[ GetEdgeKey( vertexPosition[ corners[ c ] ], vertexPosition[ next ] ) ] == 1)
+            {
+                const double* p0 = p[ c ];
+                const double* p1 = p[ (c + 1) % 3 ];
+                const double edge[ 3 ] = { p1[ 0 ] - p0[ 0 ], p1[ 1 ] - p0[ 1 ], p1[ 2 ] - p0[ 2 ] };
+                double borderNormal[ 3 ] = { edge[ 1 ] * normal[ 2 ] - edge[ 2 ] * normal[ 1 ], edge[ 2 ] * normal[ 0 ] - edge[ 0 ] * normal[ 2 ], edge[ 0 ] * normal[ 1 ] - edge[ 1 ] * normal[ 0 ] };
+                const double edgeLengthSquared = edge[ 0 ] * edge[ 0 ] + edge[ 1 ] * edge[ 1 ] + edge[ 2 ] * edge[ 2 ];
+                const double borderLength = std::sqrt( edgeLengthSquared );
+
+                if (borderLength > 0)
+                {
+                    borderNormal[ 0 ] /= borderLength; borderNormal[ 1 ] /= borderLength; borderNormal[ 2 ] /= borderLength;
+                    const double borderDistance = -(borderNormal[ 0 ] * p0[ 0 ] + borderNormal[ 1 ] * p0[ 1 ] + borderNormal[ 2 ] * p0[ 2 ]);
+
+                    for (unsigned endpoint : { corners[ c ], next })
+                    {
+                        Quadric& borderQuadric = positionQuadrics[ vertexPosition[ endpoint ] ];
+                        borderQuadric.AddSquared( borderNormal, borderDistance, edgeLengthSquared * borderWeight );
+                        borderQuadric.weight += edgeLengthSquared * borderWeight;
+                    }
+                }
+            }
+        }
+
+        // Gradient g of an attribute s lies on the triangle's plane and satisfies g.e1 = s1 - s0 and g.e2 = s2 - s0.
+        const double e1[ 3 ] = { p[ 1 ][ 0 ] - p[ 0 ][ 0 ], p[ 1 ][ 1 ] - p[ 0 ][ 1 ], p[ 1 ][ 2 ] - p[ 0 ][ 2 ] };
+        const double e2[ 3 ] = { p[ 2 ][ 0 ] - p[ 0 ][ 0 ], p[ 2 ][ 1 ] - p[ 0 ][ 1 ], p[ 2 ][ 2 ] - p[ 0 ][ 2 ] };
+        const double e1e1 = e1[ 0 ] * e1[ 0 ] + e1[ 1 ] * e1[ 1 ] + e1[ 2 ] * e1[ 2 ];
+        const double e1e2 = e1[ 0 ] * e2[ 0 ] + e1[ 1 ] * e2[ 1 ] + e1[ 2 ] * e2[ 2 ];
+        const double e2e2 = e2[ 0 ] * e2[ 0 ] + e2[ 1 ] * e2[ 1 ] + e2[ 2 ] * e2[ 2 ];
+        const double determinant = e1e1 * e2e2 - e1e2 * e1e2;
+
+        if (determinant <= 0)
+        {
+            continue;
+        }
+
+        for (int i = 0; i < simplifyAttributeCount; ++i)
+        {
+            const double s0 = attributes[ corners[ 0 ] * simplifyAttributeCount + i ];
+            const double ds1 = attributes[ corners[ 1 ] * simplifyAttributeCount + i ] - s0;
+            const double ds2 = attributes[ corners[ 2 ] * simplifyAttributeCount + i ] - s0;
+            const double alpha = (ds1 * e2e2 - ds2 * e1e2) / determinant;
+            const double beta = (ds2 * e1e1 - ds1 * e1e2) / determinant;
+            const double gradient[ 3 ] = { alpha * e1[ 0 ] + beta * e2[ 0 ], alpha * e1[ 1 ] + beta * e2[ 1 ], alpha * e1[ 2 ] + beta * e2[ 2 ] };
+            const double offset = s0 - (gradient[ 0 ] * p[ 0 ][ 0 ] + gradient[ 1 ] * p[ 0 ][ 1 ] + gradient[ 2 ] * p[ 0 ][ 2 ]);
+
+            for (unsigned corner : corners)
+            {
+                AttributeQuadric& quadric = vertexQuadrics[ corner ];
+                quadric.quadric.AddSquared( gradient, offset, area );
+                quadric.gradients[ i ][ 0 ] += area * gradient[ 0 ];
+                quadric.gradients[ i ][ 1 ] += area * gradient[ 1 ];
+                quadric.gradients[ i ][ 2 ] += area * gradient[ 2 ];
+                quadric.offsets[ i ] += area * offset;
+            }
+        }
+
+        for (unsigned corner : corners)
+        {
+            vertexQuadrics[ corner ].quadric.weight += area;
+        }
+    }
+
+    struct Collapse
+    {
+        unsigned from, to; // Positions.
+        double cost;
+        double error;
+    };
+
+    const double maxScaledError = (double)maxError * scale;
+    double resultError = 0;
+    std::vector< unsigned > positionFaceStarts;
+    std::vector< unsigned > positionFaces;
+    std::vector< std::uint8_t > isBorder( positionCount );
+    std::vector< std::uint8_t > isLocked( positionCount );
+    std::vector< std::pair< unsigned, unsigned > > wedgeMap;
+    std::vector< std::pair< unsigned, unsigned > > bestWedgeMap;
+    std::vector< unsigned > neighbors;
+
+    // Maps wedges of position 'from' to wedges of 'to' that share an edge with them. Fails if a wedge would map to more than one wedge
+    // or two wedges to the same one, because the collapse would then move a seam.
+    auto mapWedges = [&]( unsigned from, unsigned to, std::vector< std::pair< unsigned, unsigned > >& outMap )
+    {
+        outMap.clear();
+
+        for (unsigned i = positionFaceStarts[ from ]; i < positionFaceStarts[ from + 1 ]; ++i)
+        {
+            const VertexInd& triangle = indices[ positionFaces[ i ] ];
+            const unsigned corners[ 3 ] = { triangle.a, triangle.b, triangle.c };
+            unsigned fromVertex = 0;
+            unsigned toVertex = ~0u;
+
+            for (unsigned corner : corners)
+            {
+                fromVertex = vertexPosition[ corner ] == from ? corner : fromVertex;
+                toVertex = vertexPosition[ corner ] == to ? corner : toVertex;
+            }
+
+            bool isFound = false;
+
+            for (std::pair< unsigned, unsigned >& entry : outMap)
+            {
+                if (entry.first == fromVertex)
+                {
+                    if (toVertex != ~0u && entry.second != ~0u && entry.second != toVertex)
+                    {
+                        return false;
+                    }
+
+                    entry.second = toVertex != ~0u ? toVertex : entry.second;
+                    isFound = true;
+                }
+            }
+
+            if (!isFound)
+            {
+                outMap.push_back( std::make_pair( fromVertex, toVertex ) );
+            }
+        }
+
+        for (std::size_t i = 0; i < outMap.size(); ++i)
+        {
+            for (std::size_t j = 0; j < i; ++j)
+            {
+                if (outMap[ i ].second == outMap[ j ].second)
+                {
+                    return false;
+                }
+            }
+
+            if (outMap[ i ].second == ~0u)
+            {
+                return false;
+            }
+        }
+
+        return !outMap.empty();
+    };
+
+    auto gatherNeighbors = [&]( unsigned position, std::size_t offset )
+    {
+        for (unsigned i = positionFaceStarts[ position ]; i < positionFaceStarts[ position + 1 ]; ++i)
+        {
+            const VertexInd& triangle = indices[ positionFaces[ i ] ];
+
+            for (unsigned corner : { triangle.a, triangle.b, triangle.c })
+            {
+                const unsigned neighbor = vertexPosition[ corner ];
+
+                if (neighbor != position && std::find( neighbors.begin() + offset, neighbors.end(), neighbor ) == neighbors.end())
+                {
+                    neighbors.push_back( neighbor );
+                }
+            }
+        }
+    };
+
+    while (indices.size() > targetFaceCount)
+    {
+        // Faces of every position.
+        positionFaceStarts.assign( positionCount + 1, 0 );
+        positionFaces.resize( indices.size() * 3 );
+
+        for (const VertexInd& triangle : indices)
+        {
+            ++positionFaceStarts[ vertexPosition[ triangle.a ] + 1 ];
+            ++positionFaceStarts[ vertexPosition[ triangle.b ] + 1 ];
+            ++positionFaceStarts[ vertexPosition[ triangle.c ] + 1 ];
+        }
+
+        for (std::size_t p = 0; p < positionCount; ++p)
+        {
+            positionFaceStarts[ p + 1 ] += positionFaceStarts[ p ];
+        }
+
+        {
+            std::vector< unsigned > fill( positionFaceStarts.begin(), positionFaceStarts.end() - 1 );
+
+            for (std::size_t f = 0; f < indices.size(); ++f)
+            {
+                positionFaces[ fill[ vertexPosition[ indices[ f ].a ] ]++ ] = (unsigned)f;
+                positionFaces[ fill[ vertexPosition[ indices[ f ].b ] ]++ ] = (unsigned)f;
+                positionFaces[ fill[ vertexPosition[ indices[ f ].c ] ]++ ] = (unsigned)f;
+            }
+        }
+
+        // Borders have edges with 1 triangle. Positions with edges of more than 2 faces are non-manifold and are not moved.
+        countEdges();
+        std::fill( isBorder.begin(), isBorder.end(), 0 );
+        std::fill( isLocked.begin(), isLocked.end(), 0 );
+
+        for (const std::pair< const std::uint64_t, unsigned >& edge : edgeFaceCounts)
+        {
+            const unsigned a = (unsigned)(edge.first >> 32);
+            const unsigned b = (unsigned)edge.first;
+            isBorder[ a ] |= edge.second == 1;
+            isBorder[ b ] |= edge.second == 1;
+            isLocked[ a ] |= edge.second > 2;
+            isLocked[ b ] |= edge.second > 2;
+        }
+
+        // The cheapest collapse of every position.
+        std::vector< Collapse > collapses;
+
+        for (unsigned from = 0; from < positionCount; ++from)
+        {
+            if (isLocked[ from ] || positionFaceStarts[ from ] == positionFaceStarts[ from + 1 ])
+            {
+                continue;
+            }
+
+            Collapse best = { from, 0, std::numeric_limits< double >::max(), 0 };
+            neighbors.clear();
+            gatherNeighbors( from, 0 );
+
+            for (unsigned to : neighbors)
+            {
+                if ((isBorder[ from ] && edgeFaceCounts[ GetEdgeKey( from, to ) ] != 1) || !mapWedges( from, to, wedgeMap ))
+                {
+                    continue;
+                }
+
+                const double* target = &positions[ positionVertex[ to ] * 3 ];
+                const Quadric& quadric = positionQuadrics[ from ];
+                const double distanceSquared = std::max( 0.0, quadric.Evaluate( target ) );
+                double cost = distanceSquared;
+
+                for (const std::pair< unsigned, unsigned >& wedge : wedgeMap)
+                {
+                    cost += std::max( 0.0, vertexQuadrics[ wedge.first ].Evaluate( target, &attributes[ wedge.second * simplifyAttributeCount ] ) );
+                }
+
+                cost /= quadric.weight > 0 ? quadric.weight : 1;
+
+                if (cost < best.cost)
+                {
+                    best.to = to;
+                    best.cost = cost;
+                    best.error = std::sqrt( distanceSquared / (quadric.weight > 0 ? quadric.weight : 1) );
+                }
+            }
+
+            if (best.cost < std::numeric_limits< double >::max() && best.error <= maxScaledError)
+            {
+                collapses.push_back( best );
+            }
+        }
+
+        std::sort( collapses.begin(), collapses.end(), []( const Collapse& a, const Collapse& b ) { return a.cost < b.cost; } );
+
+        // Collapses change faces around 'from', so positions of those faces are locked until the next pass.
+        // A pass considers only as many of the cheapest collapses as are needed, so the order stays close to a global one.
+        const std::size_t facesToRemove = indices.size() - targetFaceCount;
+        const std::size_t candidateCount = std::min( collapses.size(), facesToRemove / 2 + 1 );
+        std::fill( isLocked.begin(), isLocked.end(), 0 );
+        std::size_t removedFaces = 0;
+        std::size_t collapseCount = 0;
+
+        for (std::size_t i = 0; i < candidateCount && removedFaces < facesToRemove; ++i)
+        {
+            const Collapse& collapse = collapses[ i ];
+
+            if (isLocked[ collapse.from ] || isLocked[ collapse.to ] || !mapWedges( collapse.from, collapse.to, bestWedgeMap ))
+            {
+                continue;
+            }
+
+            // Faces must not flip.
+            const double* target = &positions[ positionVertex[ collapse.to ] * 3 ];
+            unsigned sharedFaces = 0;
+            bool isFlipped = false;
+
+            for (unsigned j = positionFaceStarts[ collapse.from ]; j < positionFaceStarts[ collapse.from + 1 ]; ++j)
+            {
+                const VertexInd& triangle = indices[ positionFaces[ j ] ];
+                const unsigned corners[ 3 ] = { triangle.a, triangle.b, triangle.c };
+                const double* before[ 3 ];
+                const double* after[ 3 ];
+                bool isShared = false;
+
+                for (int c = 0; c < 3; ++c)
+                {
+                    before[ c ] = &positions[ corners[ c ] * 3 ];
+                    after[ c ] = vertexPosition[ corners[ c ] ] == collapse.from ? target : before[ c ];
+                    isShared = isShared || vertexPosition[ corners[ c ] ] == collapse.to;
+                }
+
+                if (isShared)
+                {
+                    ++sharedFaces;
+                    continue;
+                }
+
+                double normalBefore[ 3 ], normalAfter[ 3 ];
+                getFaceNormal( before[ 0 ], before[ 1 ], before[ 2 ], normalBefore );
+                getFaceNormal( after[ 0 ], after[ 1 ], after[ 2 ], normalAfter );
+                isFlipped = isFlipped || normalBefore[ 0 ] * normalAfter[ 0 ] + normalBefore[ 1 ] * normalAfter[ 1 ] + normalBefore[ 2 ] * normalAfter[ 2 ] <= 0;
+            }
+
+            // Link condition: the positions may only share the neighbors of their shared faces, otherwise the collapse makes the mesh non-manifold.
+            neighbors.clear();
+            gatherNeighbors( collapse.from, 0 );
+            const std::size_t fromNeighborCount = neighbors.size();
+            gatherNeighbors( collapse.to, fromNeighborCount );
+            std::size_t commonNeighbors = 0;
+
+            for (std::size_t j = fromNeighborCount; j < neighbors.size(); ++j)
+            {
+                commonNeighbors += std::find( neighbors.begin(), neighbors.begin() + fromNeighborCount, neighbors[ j ] ) != neighbors.begin() + fromNeighborCount ? 1 : 0;
+            }
+
+            if (isFlipped || commonNeighbors != sharedFaces)
+            {
+                continue;
+            }
+
+            for (unsigned j = positionFaceStarts[ collapse.from ]; j < positionFaceStarts[ collapse.from + 1 ]; ++j)
+            {
+                VertexInd& triangle = indices[ positionFaces[ j ] ];
+
+                for (unsigned* corner : { &triangle.a, &triangle.b, &triangle.c })
+                {
+                    isLocked[ vertexPosition[ *corner ] ] = 1;
+
+                    for (const std::pair< unsigned, unsigned >& wedge : bestWedgeMap)
+                    {
+                        *corner = *corner == wedge.first ? wedge.second : *corner;
+                    }
+                }
+            }
+
+            positionQuadrics[ collapse.to ].Add( positionQuadrics[ collapse.from ] );
+
+            for (const std::pair< unsigned, unsigned >& wedge : bestWedgeMap)
+            {
+                vertexQuadrics[ wedge.second ].Add( vertexQuadrics[ wedge.first ] );
+            }
+
+            isLocked[ collapse.to ] = 1;
+            removedFaces += sharedFaces;
+            resultError = std::max( resultError, collapse.error );
+            ++collapseCount;
+        }
+
+        // Shared faces of collapsed positions are now degenerate.
+        std::size_t faceCount = 0;
+
+        for (const VertexInd& triangle : indices)
+        {
+            const unsigned a = vertexPosition[ triangle.a ], b = vertexPosition[ triangle.b ], c = vertexPosition[ triangle.c ];
+
+            if (a != b && b != c && c != a)
+            {
+                indices[ faceCount++ ] = triangle;
+            }
+        }
+
+        indices.resize( faceCount );
+
+        if (collapseCount == 0)
+        {
+            break;
+        }
+    }
+
+    return (float)(resultError / scale);
+}
+
+/// Vertex processing and rasterization efficiency of a mesh.
+struct MeshStatistics
+{
+    float acmr = 0; ///< Average cache miss ratio: vertex transforms per face with a 16-entry FIFO cache. 0.5 is ideal, 3 the worst.
+    float atvr = 0; ///< Average transform to vertex ratio: vertex transforms per used vertex. 1 is ideal.
+    float overdraw = 0; ///< Shaded pixels per covered pixel in 6 axis-aligned views with a depth test. 1 is ideal.
+    float fetchEfficiency = 0; ///< Used vertex bytes per byte fetched through a 16 KB cache of 64-byte lines. 1 is ideal.
+};
+
+/// Rasterizes faces in submission order with a depth test from 6 axis-aligned directions.
+/// \return Shaded pixels per covered pixel. Front and back faces are counted separately.
+static float AnalyzeOverdraw( const std::vector< VertexInd >& indices, const std::vector< ae3d::Vec3 >& positions )
+{
+    const int gridSize = 256;
+    ae3d::Vec3 aabbMin( 1e30f, 1e30f, 1e30f );
+    ae3d::Vec3 aabbMax( -1e30f, -1e30f, -1e30f );
+
+    for (const ae3d::Vec3& position : positions)
+    {
+        aabbMin = ae3d::Vec3::Min2( aabbMin, position );
+        aabbMax = ae3d::Vec3::Max2( aabbMax, position );
+    }
+
+    const ae3d::Vec3 extent = aabbMax - aabbMin;
+    const float maxExtent = std::max( extent.x, std::max( extent.y, extent.z ) );
+
+    if (indices.empty() || !(maxExtent > 0))
+    {
+        return 1;
+    }
+
+    const float scale = (gridSize - 1) / maxExtent;
+    std::vector< float > depth( gridSize * gridSize * 2 );
+    std::size_t shaded = 0;
+    std::size_t covered = 0;
+
+    for (int view = 0; view < 6; ++view)
+    {
+        std::fill( depth.begin(), depth.end(), 1e30f );
+        const int axis = view / 2;
+        const float depthSign = (view & 1) ? -1.0f : 1.0f;
+
+        for (const VertexInd& face : indices)
+        {
+            float x[ 3 ], y[ 3 ], z[ 3 ];
+            const unsigned corners[ 3 ] = { face.a, face.b, face.c };
+
+            for (int i = 0; i < 3; ++i)
+            {
+                const ae3d::Vec3 p = (positions[ corners[ i ] ] - aabbMin) * scale;
+                const float coords[ 3 ] = { p.x, p.y, p.z };
+                x[ i ] = coords[ (axis + 1) % 3 ];
+                y[ i ] = coords[ (axis + 2) % 3 ];
+                z[ i ] = coords[ axis ] * depthSign;
+            }
+
+            const float area = (x[ 1 ] - x[ 0 ]) * (y[ 2 ] - y[ 0 ]) - (x[ 2 ] - x[ 0 ]) * (y[ 1 ] - y[ 0 ]);
+
+            if (area == 0)
+            {
+                continue;
+            }
+
+            float* faceDepth = &depth[ area > 0 ? 0 : gridSize * gridSize ];
+            const int minX = std::max( 0, (int)std::min( x[ 0 ], std::min( x[ 1 ], x[ 2 ] ) ) );
+            const int maxX = std::min( gridSize - 1, (int)std::max( x[ 0 ], std::max( x[ 1 ], x[ 2 ] ) ) );
+            const int minY = std::max( 0, (int)std::min( y[ 0 ], std::min( y[ 1 ], y[ 2 ] ) ) );
+            const int maxY = std::min( gridSize - 1, (int)std::max( y[ 0 ], std::max( y[ 1 ], y[ 2 ] ) ) );
+
+            for (int py = minY; py <= maxY; ++py)
+            {
+                for (int px = minX; px <= maxX; ++px)
+                {
+                    // Sample offset avoids exact hits on edges that are shared by two faces.
+                    const float sx = px + 0.5001f;
+                    const float sy = py + 0.5003f;
+                    const float w0 = ((x[ 2 ] - x[ 1 ]) * (sy - y[ 1 ]) - (y[ 2 ] - y[ 1 ]) * (sx - x[ 1 ])) / area;
+                    const float w1 = ((x[ 0 ] - x[ 2 ]) * (sy - y[ 2 ]) - (y[ 0 ] - y[ 2 ]) * (sx - x[ 2 ])) / area;
+                    const float w2 = 1 - w0 - w1;
+
+                    if (w0 < 0 || w1 < 0 || w2 < 0)
+                    {
+                        continue;
+                    }
+
+                    const float pixelDepth = w0 * z[ 0 ] + w1 * z[ 1 ] + w2 * z[ 2 ];
+                    float& storedDepth = faceDepth[ py * gridSize + px ];
+
+                    if (pixelDepth < storedDepth)
+                    {
+                        covered += storedDepth == 1e30f ? 1 : 0;
+                        storedDepth = pixelDepth;
+                        ++shaded;
+                    }
+                }
+            }
+        }
+    }
+
+    return covered > 0 ? (float)shaded / covered : 1;
+}
+
+/// \param vertexSize Vertex size in bytes in the written vertex format.
+MeshStatistics AnalyzeMesh( const std::vector< VertexInd >& indices, const std::vector< ae3d::Vec3 >& positions, std::size_t vertexSize )
+{
+    MeshStatistics statistics;
+
+    if (indices.empty())
+    {
+        return statistics;
+    }
+
+    const unsigned cacheSize = 16;
+    const std::size_t lineSize = 64;
+    const unsigned cacheLineCount = 256;
+    std::vector< unsigned > vertexTimestamps( positions.size(), 0 );
+    std::vector< unsigned > lineTimestamps( (positions.size() * vertexSize) / lineSize + 1, 0 );
+    std::vector< bool > isUsed( positions.size(), false );
+    unsigned vertexTime = cacheSize + 1;
+    unsigned lineTime = cacheLineCount + 1;
+    std::size_t transforms = 0;
+    std::size_t usedVertices = 0;
+    std::size_t fetchedBytes = 0;
+
+    for (const VertexInd& face : indices)
+    {
+        const unsigned corners[ 3 ] = { face.a, face.b, face.c };
+
+        for (unsigned v : corners)
+        {
+            if (!isUsed[ v ])
+            {
+                isUsed[ v ] = true;
+                ++usedVertices;
+            }
+
+            if (vertexTime - vertexTimestamps[ v ] <= cacheSize)
+            {
+                continue;
+            }
+
+            vertexTimestamps[ v ] = vertexTime++;
+            ++transforms;
+
+            for (std::size_t line = v * vertexSize / lineSize; line <= (v * vertexSize + vertexSize - 1) / lineSize; ++line)
+            {
+                if (lineTime - lineTimestamps[ line ] > cacheLineCount)
+                {
+                    lineTimestamps[ line ] = lineTime++;
+                    fetchedBytes += lineSize;
+                }
+            }
+        }
+    }
+
+    statistics.acmr = (float)transforms / indices.size();
+    statistics.atvr = (float)transforms / usedVertices;
+    statistics.overdraw = AnalyzeOverdraw( indices, positions );
+    statistics.fetchEfficiency = (float)(usedVertices * vertexSize) / fetchedBytes;
+    return statistics;
+}
+
+void PrintStatistics( const char* label, const MeshStatistics& statistics )
+{
+    std::printf( "  %-8s ACMR %.3f, ATVR %.3f, overdraw %.3f, fetch efficiency %.3f\n", label, (double)statistics.acmr, (double)statistics.atvr, (double)statistics.overdraw, (double)statistics.fetchEfficiency );
+}
+
+void Mesh::SolveAABB()
+{
+    const float maxValue = 99999999.0f;
+
+    aabbMin = ae3d::Vec3(  maxValue,  maxValue,  maxValue );
+    aabbMax = ae3d::Vec3( -maxValue, -maxValue, -maxValue );
+
+    for (std::size_t v = 0; v < vertex.size(); ++v)
+    {
+        const ae3d::Vec3& pos = vertex[ v ];
+
+        if (pos.x > maxValue || pos.y > maxValue || pos.z > maxValue)
+        {
+            std::cerr << "AABB's max value is too low in file " << __FILE__ << " near line " << __LINE__ << std::endl;
+            std::cerr << "Vertex " << v << ": " << pos.x << ", " << pos.y << ", " << pos.z << std::endl;
+        }
+        
+        if (pos.x < -maxValue || pos.y < -maxValue || pos.z < -maxValue)
+        {
+            std::cerr << "AABB's min value is too high in file " << __FILE__ << " near line " << __LINE__ << std::endl;
+            std::cerr << "Vertex " << v << ": " << pos.x << ", " << pos.y << ", " << pos.z << std::endl;
+        }
+
+        aabbMin = ae3d::Vec3::Min2( aabbMin, pos );
+        aabbMax = ae3d::Vec3::Max2( aabbMax, pos );
+    }
+}
+
+void Mesh::SolveFaceNormals()
+{
+    fnormal.resize( indices.size() );
+
+    for (std::size_t faceInd = 0; faceInd < indices.size(); ++faceInd)
+    {
+        const unsigned faceA = indices[ faceInd ].a;
+        const unsigned faceB = indices[ faceInd ].b;
+        const unsigned faceC = indices[ faceInd ].c;
+
+        const ae3d::Vec3 va = interleavedVertices[ faceA ].position;
+        ae3d::Vec3 vb = interleavedVertices[ faceB ].position;
+        ae3d::Vec3 vc = interleavedVertices[ faceC ].position;
+
+        vb -= va;
+        vc -= va;
+
+        vb = ae3d::Vec3::Cross( vb, vc ).Normalized();
+
+        fnormal[ faceInd ] = vb;
+    }
+}
+
+/**
+ Generates tangents for faces.
+
+ Tangent vector (u-axis) will point in the direction of increasing U-coordinate.
+ Bitangent vector (v-axis) will point in the direction of increasing V-coordinate.
+ */
+void Mesh::SolveFaceTangents()
+{
+    assert( !indices.empty() );
+
+    tangents.resize  ( indices.size() );
+    bitangents.resize( indices.size() );
+
+    bool degenerateFound = false;
+
+    // Algorithm source:
+    // http://www.opengl-tutorial.org/intermediate-tutorials/tutorial-13-normal-mapping/#header-3
+    for (std::size_t f = 0; f < indices.size(); ++f)
+    {
+        const ae3d::Vec3& p1 = interleavedVertices[ indices[ f ].a ].position;
+        const ae3d::Vec3& p2 = interleavedVertices[ indices[ f ].b ].position;
+        const ae3d::Vec3& p3 = interleavedVertices[ indices[ f ].c ].position;
+
+        const TexCoord& uv1 = interleavedVertices[ indices[ f ].a ].texCoord;
+        const TexCoord& uv2 = interleavedVertices[ indices[ f ].b ].texCoord;
+        const TexCoord& uv3 = interleavedVertices[ indices[ f ].c ].texCoord;
+
+        const TexCoord deltaUV1 = uv2 - uv1;
+        const TexCoord deltaUV2 = uv3 - uv1;
+
+        const float area = deltaUV1.u * deltaUV2.v - deltaUV1.v * deltaUV2.u;
+
+        ae3d::Vec3 tangent;
+        ae3d::Vec3 bitangent;
+
+        if (std::fabs( area ) > 0.00001f)
+        {
+            const ae3d::Vec3 deltaP1 = p2 - p1;
+            const ae3d::Vec3 deltaP2 = p3 - p1;
+
+            tangent   = (deltaP1 * deltaUV2.v - deltaP2 * deltaUV1.v) / area;
+            bitangent = (deltaP2 * deltaUV1.u - deltaP1 * deltaUV2.u) / area;
+        }
+        else
+        {
+            degenerateFound = true;
+        }
+
+        const ae3d::Vec4 tangent4( tangent.x, tangent.y, tangent.z, 0.0f );
+        tangents[ f ]   = tangent4;
+        bitangents[ f ] = bitangent;
+    }
+
+    if (degenerateFound)
+    {
+        std::cout << std::endl << "Warning: Degenerate UV map in mesh " << name << ".  Author needs to separate texture points." << std::endl;
+    }
+}
+
+void Mesh::SolveVertexNormals()
+{
+    // Every vertex gets the average of the normals of faces that touch it.
+    // Faces are summed in order, so the result is the same as summing them separately for each vertex.
+    std::vector< ae3d::Vec3 > normals( vertex.size() );
+
+    for (std::size_t faceInd = 0; faceInd < face.size(); ++faceInd)
+    {
+        face[ faceInd ].vnInd[ 0 ] = face[ faceInd ].vInd[ 0 ];
+        face[ faceInd ].vnInd[ 1 ] = face[ faceInd ].vInd[ 1 ];
+        face[ faceInd ].vnInd[ 2 ] = face[ faceInd ].vInd[ 2 ];
+
+        const unsigned faceA = face[ faceInd ].vInd[ 0 ];
+        const unsigned faceB = face[ faceInd ].vInd[ 1 ];
+        const unsigned faceC = face[ faceInd ].vInd[ 2 ];
+
+        const ae3d::Vec3 va = vertex[ faceA ];
+        ae3d::Vec3 vb = vertex[ faceB ] - va;
+        const ae3d::Vec3 vc = vertex[ faceC ] - va;
+
+        vb = ae3d::Vec3::Cross( vb, vc ).Normalized();
+
+        // A degenerate face that touches a vertex more than once is summed only once.
+        normals[ faceA ] = normals[ faceA ] + vb;
+
+        if (faceB != faceA)
+        {
+            normals[ faceB ] = normals[ faceB ] + vb;
+        }
+
+        if (faceC != faceA && faceC != faceB)
+        {
+            normals[ faceC ] = normals[ faceC ] + vb;
+        }
+    }
+
+    vnormal.resize( vertex.size() );
+
+    for (std::size_t vertInd = 0; vertInd < vertex.size(); ++vertInd)
+    {
+        vnormal[ vertInd ] = normals[ vertInd ].Normalized();
+    }
+}
+
+void Mesh::SolveVertexTangents()
+{
+    assert( !tangents.empty() );
+
+    for (std::size_t v = 0; v < interleavedVertices.size(); ++v)
+    {
+        interleavedVertices[ v ].tangent = ae3d::Vec4( 0, 0, 0, 0 );
+    }
+
+    std::vector< ae3d::Vec3 > vbitangents( interleavedVertices.size() );
+
+    // Faces are summed in order, so the result is the same as summing them separately for each vertex.
+    for (std::size_t faceInd = 0; faceInd < indices.size(); ++faceInd)
+    {
+        const unsigned corners[ 3 ] = { indices[ faceInd ].a, indices[ faceInd ].b, indices[ faceInd ].c };
+
+        for (int c = 0; c < 3; ++c)
+        {
+            if ((c > 0 && corners[ c ] == corners[ 0 ]) || (c > 1 && corners[ c ] == corners[ 1 ]))
+            {
+                continue;
+            }
+
+            interleavedVertices[ corners[ c ] ].tangent += tangents[ faceInd ];
+            vbitangents[ corners[ c ] ] += bitangents[ faceInd ];
+        }
+    }
+
+    for (std::size_t v = 0; v < interleavedVertices.size(); ++v)
+    {
+        ae3d::Vec4& tangent = interleavedVertices[ v ].tangent;
+        const ae3d::Vec3& normal = interleavedVertices[ v ].normal;
+        const ae3d::Vec4 normal4( normal.x, normal.y, normal.z, 0 );
+
+        // Gram-Schmidt orthonormalization.
+        tangent -= normal4 * normal4.Dot( tangent );
+        tangent.Normalize();
+
+        // Handedness. TBN must form a right-handed coordinate system,
+        // i.e. cross(n,t) must have the same orientation as b.
+        const ae3d::Vec3 cp = ae3d::Vec3::Cross( normal, ae3d::Vec3( tangent.x, tangent.y, tangent.z ) );
+        tangent.w = ae3d::Vec3::Dot( cp, vbitangents[v] ) >= 0 ? 1.0f : -1.0f;
+    }
+}
+
+/// Cell size of the vertex welding grid. It's larger than weldRadius, so a vertex can only match vertices in 1-2 cells per axis.
+static const float weldCellSize = 0.001f;
+/// AlmostEquals' epsilon with a margin for rounding at cell borders.
+static const float weldRadius = 0.0002f;
+
+/// Maps a hashed grid cell to indices of interleaved vertices whose position is inside the cell, in ascending order.
+/// Different cells can have the same hash, so matches must still be compared.
+typedef std::unordered_map< std::uint64_t, std::vector< unsigned > > WeldGrid;
+
+static std::int64_t GetWeldCell( float coordinate )
+{
+    return std::isfinite( coordinate ) ? (std::int64_t)std::floor( coordinate / weldCellSize ) : 0;
+}
+
+static std::uint64_t GetWeldCellHash( std::int64_t x, std::int64_t y, std::int64_t z )
+{
+    return ((std::uint64_t)x * 73856093u) ^ ((std::uint64_t)y * 19349663u) ^ ((std::uint64_t)z * 83492791u);
+}
+
+// Creates an interleaved vertex array.
+void Mesh::Interleave()
+{
+    // Face corners are welded only with the same corner of earlier faces and the oldest match wins.
+    // This was the order of the former linear search, so each corner has its own grid to keep the output unchanged.
+    WeldGrid cornerGrids[ 3 ];
+
+    indices.reserve( indices.size() + face.size() );
+
+    for (std::size_t f = 0; f < face.size(); ++f)
+    {
+        unsigned newFace[ 3 ];
+        bool isNewVertex[ 3 ];
+
+        for (int corner = 0; corner < 3; ++corner)
+        {
+            VertexPTNTC_Skinned newVertex = {};
+            newVertex.position = vertex [ face[ f ].vInd [ corner ] ];
+            newVertex.normal   = vnormal[ face[ f ].vnInd[ corner ] ];
+            newVertex.texCoord = tcoord.empty() ? TexCoord() : tcoord[ face[ f ].uvInd[ corner ] ];
+            newVertex.color    = colors.empty() ? ae3d::Vec4( 0, 0, 0, 1 ) : colors[ face[ f ].colInd[ corner ] ];
+            newVertex.tangent  = nonInterleavedTangents.empty() ? ae3d::Vec4( 0, 0, 0, 1 ) : nonInterleavedTangents[ face[ f ].tInd[ corner ] ];
+
+            // Searches all cells that can contain a matching vertex.
+            const ae3d::Vec3& p = newVertex.position;
+            unsigned found = std::numeric_limits< unsigned >::max();
+
+            for (std::int64_t x = GetWeldCell( p.x - weldRadius ); x <= GetWeldCell( p.x + weldRadius ); ++x)
+            {
+                for (std::int64_t y = GetWeldCell( p.y - weldRadius ); y <= GetWeldCell( p.y + weldRadius ); ++y)
+                {
+                    for (std::int64_t z = GetWeldCell( p.z - weldRadius ); z <= GetWeldCell( p.z + weldRadius ); ++z)
+                    {
+                        const auto cell = cornerGrids[ corner ].find( GetWeldCellHash( x, y, z ) );
+
+                        if (cell == cornerGrids[ corner ].end())
+                        {
+                            continue;
+                        }
+
+                        for (unsigned v : cell->second)
+                        {
+                            if (v >= found)
+                            {
+                                break;
+                            }
+
+                            if (AlmostEquals( interleavedVertices[ v ].position, newVertex.position ) &&
+                                AlmostEquals( interleavedVertices[ v ].normal,   newVertex.normal ) &&
+                                AlmostEquals( interleavedVertices[ v ].texCoord, newVertex.texCoord ) &&
+                                AlmostEquals( interleavedVertices[ v ].tangent,  newVertex.tangent ) &&
+                                AlmostEquals( interleavedVertices[ v ].color,    newVertex.color ))
+                            {
+                                found = v;
+                                break;
+                            }
+                        }
+                    }
+                }
+            }
+
+            isNewVertex[ corner ] = found == std::numeric_limits< unsigned >::max();
+
+            if (!isNewVertex[ corner ])
+            {
+                newFace[ corner ] = found;
+                continue;
+            }
 
             if (!weights.empty())
             {
-                newVertex.weights  = weights[ face[ f ].vInd[ 2 ] ];
+                newVertex.weights  = weights[ face[ f ].vInd[ corner ] ];
             }
             if (!bones.empty())
             {
-                newVertex.bones[ 0 ] = bones[ face[ f ].vInd[ 2 ] ].a;
-                newVertex.bones[ 1 ] = bones[ face[ f ].vInd[ 2 ] ].b;
-                newVertex.bones[ 2 ] = bones[ face[ f ].vInd[ 2 ] ].c;
-                newVertex.bones[ 3 ] = bones[ face[ f ].vInd[ 2 ] ].d;
+                newVertex.bones[ 0 ] = bones[ face[ f ].vInd[ corner ] ].a;
+                newVertex.bones[ 1 ] = bones[ face[ f ].vInd[ corner ] ].b;
+                newVertex.bones[ 2 ] = bones[ face[ f ].vInd[ corner ] ].c;
+                newVertex.bones[ 3 ] = bones[ face[ f ].vInd[ corner ] ].d;
             }
-            
+
             interleavedVertices.push_back( newVertex );
+            newFace[ corner ] = (unsigned)(interleavedVertices.size() - 1);
+        }
+
+        // New vertices can be welded starting from the next face.
+        for (int corner = 0; corner < 3; ++corner)
+        {
+            if (isNewVertex[ corner ])
+            {
+                const ae3d::Vec3& p = interleavedVertices[ newFace[ corner ] ].position;
+                cornerGrids[ corner ][ GetWeldCellHash( GetWeldCell( p.x ), GetWeldCell( p.y ), GetWeldCell( p.z ) ) ].push_back( newFace[ corner ] );
+            }
+        }
+
+        indices.push_back( { newFace[ 0 ], newFace[ 1 ], newFace[ 2 ] } );
+    }
+}
+
+bool Mesh::AlmostEquals( const ae3d::Vec3& v1, const ae3d::Vec3& v2 ) const
+{
+    if (std::fabs( v1.x - v2.x ) > 0.0001f) { return false; }
+    if (std::fabs( v1.y - v2.y ) > 0.0001f) { return false; }
+    if (std::fabs( v1.z - v2.z ) > 0.0001f) { return false; }
+    return true;
+}
+
+bool Mesh::AlmostEquals( const ae3d::Vec4& v1, const ae3d::Vec4& v2 ) const
+{
+    if (std::fabs( v1.x - v2.x ) > 0.0001f) { return false; }
+    if (std::fabs( v1.y - v2.y ) > 0.0001f) { return false; }
+    if (std::fabs( v1.z - v2.z ) > 0.0001f) { return false; }
+    if (std::fabs( v1.w - v2.w ) > 0.0001f) { return false; }
+    return true;
+}
+
+bool Mesh::AlmostEquals( const TexCoord& t1, const TexCoord& t2 ) const
+{
+    if (std::fabs( t1.u - t2.u ) > 0.0001f) { return false; }
+    if (std::fabs( t1.v - t2.v ) > 0.0001f) { return false; }
+    return true;
+}
+
+/// \return Vertex size in bytes of a mesh written in a vertex format.
+static std::size_t GetVertexSize( const Mesh& mesh, VertexFormat vertexFormat )
+{
+    if (vertexFormat == VertexFormat::Compact)
+    {
+        return mesh.joints.empty() ? sizeof( VertexPTNTC_Compact ) : sizeof( VertexPTNTC_Compact_Skinned );
+    }
+
+    if (vertexFormat == VertexFormat::PTNTC_Skinned || !mesh.joints.empty())
+    {
+        return sizeof( VertexPTNTC_Skinned );
+    }
+
+    return vertexFormat == VertexFormat::PTN ? sizeof( VertexPTN ) : sizeof( VertexPTNTC );
+}
+
+static std::vector< ae3d::Vec3 > GetPositions( const Mesh& mesh )
+{
+    std::vector< ae3d::Vec3 > positions( mesh.interleavedVertices.size() );
+
+    for (std::size_t v = 0; v < positions.size(); ++v)
+    {
+        positions[ v ] = mesh.interleavedVertices[ v ].position;
+    }
+
+    return positions;
+}
+
+/// Solves AABBs, normals and tangents and optimizes faces and vertices of all meshes before writing.
+/// Prints mesh statistics before and after optimization.
+/// \param outAabbMin Model's AABB min.
+/// \param outAabbMax Model's AABB max.
+/// \param vertexFormat Vertex format that is written. Affects vertex fetch statistics.
+void PrepareMeshesForWriting( ae3d::Vec3& outAabbMin, ae3d::Vec3& outAabbMax, VertexFormat vertexFormat )
+{
+    // Meshes are independent until they are written, so the slowest steps are run in parallel.
+    std::atomic< std::size_t > nextMesh( 0 );
+    const unsigned threadCount = std::max( 1u, std::min( (unsigned)gMeshes.size(), std::thread::hardware_concurrency() ) );
+    std::vector< std::thread > threads;
+
+    for (unsigned t = 0; t < threadCount; ++t)
+    {
+        threads.push_back( std::thread( [&nextMesh]()
+        {
+            for (std::size_t m = nextMesh++; m < gMeshes.size(); m = nextMesh++)
+            {
+                gMeshes[ m ].SolveAABB();
+
+                if (gMeshes[ m ].vnormal.empty())
+                {
+                    gMeshes[ m ].SolveVertexNormals();
+                }
+
+                // Meshes of LODs are already interleaved.
+                if (gMeshes[ m ].interleavedVertices.empty())
+                {
+                    gMeshes[ m ].Interleave();
+                }
+            }
+        } ) );
+    }
+
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+
+    for (std::size_t m = 0; m < gMeshes.size(); ++m)
+    {
+        const std::size_t vertexSize = GetVertexSize( gMeshes[ m ], vertexFormat );
+        const MeshStatistics before = AnalyzeMesh( gMeshes[ m ].indices, GetPositions( gMeshes[ m ] ), vertexSize );
+
+        gMeshes[ m ].OptimizeFaces();
+        gMeshes[ m ].OptimizeOverdraw( 1.05f );
+
+        gMeshes[ m ].SolveFaceNormals();
+
+        if (gMeshes[ m ].nonInterleavedTangents.empty())
+        {
+            gMeshes[ m ].SolveFaceTangents();
+            gMeshes[ m ].SolveVertexTangents();
+        }
+
+        gMeshes[ m ].OptimizeVertexFetch();
+
+        std::printf( "\nMesh %s: %zu vertices, %zu faces\n", gMeshes[ m ].name.c_str(), gMeshes[ m ].interleavedVertices.size(), gMeshes[ m ].indices.size() );
+        PrintStatistics( "before:", before );
+        PrintStatistics( "after:", AnalyzeMesh( gMeshes[ m ].indices, GetPositions( gMeshes[ m ] ), vertexSize ) );
+    }
+
+    // Calculates model's AABB by finding extreme values from meshes' AABBs.
+    const float maxValue = 99999999.0f;
+    outAabbMin = ae3d::Vec3(  maxValue,  maxValue,  maxValue );
+    outAabbMax = ae3d::Vec3( -maxValue, -maxValue, -maxValue );
+
+    for (std::size_t m = 0; m < gMeshes.size(); ++m)
+    {
+        outAabbMin = ae3d::Vec3::Min2( outAabbMin, gMeshes[ m ].aabbMin );
+        outAabbMax = ae3d::Vec3::Max2( outAabbMax, gMeshes[ m ].aabbMax );
+    }
+}
+
+/// Encodes a vertex stream for .ae3d version b2. The format is documented in Engine/Core/MeshCodec.hpp.
+/// \param vertexSize Vertex size in bytes. Must be a multiple of 4 and at most 256.
+std::vector< unsigned char > EncodeVertexBuffer( const void* aVertices, std::size_t vertexCount, std::size_t vertexSize )
+{
+    assert( vertexSize % 4 == 0 && vertexSize <= 256 );
+
+    const unsigned char* vertices = (const unsigned char*)aVertices;
+    std::vector< unsigned char > encoded;
+    unsigned char previous[ 256 ] = {};
+
+    for (std::size_t first = 0; first < vertexCount; first += 16)
+    {
+        const std::size_t headerOffset = encoded.size();
+        encoded.resize( encoded.size() + vertexSize / 4, 0 );
+
+        for (std::size_t k = 0; k < vertexSize; ++k)
+        {
+            unsigned char differences[ 16 ];
+            unsigned char maxDifference = 0;
+
+            for (std::size_t i = 0; i < 16; ++i)
+            {
+                const unsigned char value = first + i < vertexCount ? vertices[ (first + i) * vertexSize + k ] : previous[ k ];
+                const unsigned char difference = (unsigned char)(value - previous[ k ]);
+                differences[ i ] = (unsigned char)((difference << 1) ^ (difference >> 7 ? 0xFF : 0));
+                maxDifference = std::max( maxDifference, differences[ i ] );
+                previous[ k ] = value;
+            }
+
+            const unsigned mode = maxDifference == 0 ? 0 : (maxDifference < 4 ? 1 : (maxDifference < 16 ? 2 : 3));
+            encoded[ headerOffset + k / 4 ] |= (unsigned char)(mode << ((k % 4) * 2));
+
+            if (mode == 3)
+            {
+                encoded.insert( encoded.end(), differences, differences + 16 );
+            }
+            else if (mode != 0)
+            {
+                const unsigned bits = mode * 2;
+                const std::size_t packedOffset = encoded.size();
+                encoded.resize( encoded.size() + bits * 2, 0 );
+
+                for (unsigned i = 0; i < 16; ++i)
+                {
+                    encoded[ packedOffset + i * bits / 8 ] |= (unsigned char)(differences[ i ] << ((i * bits) % 8));
+                }
+            }
+        }
+    }
+
+    return encoded;
+}
+
+static void AppendVarint( std::vector< unsigned char >& encoded, std::uint64_t value )
+{
+    while (value >= 128)
+    {
+        encoded.push_back( (unsigned char)((value & 127) | 128) );
+        value >>= 7;
+    }
+
+    encoded.push_back( (unsigned char)value );
+}
+
+static std::uint64_t Zigzag( std::uint32_t from, std::uint32_t to )
+{
+    const std::int64_t difference = (std::int64_t)(std::int32_t)(to - from);
+    return ((std::uint64_t)difference << 1) ^ (std::uint64_t)(difference >> 63);
+}
+
+/// Encodes an index stream for .ae3d version b2. Triangles can be rotated, but keep their winding.
+/// The format is documented in Engine/Core/MeshCodec.hpp.
+std::vector< unsigned char > EncodeIndexBuffer( const std::vector< VertexInd >& faces )
+{
+    std::vector< unsigned char > encoded;
+    encoded.reserve( faces.size() * 2 );
+
+    unsigned edgeFifo[ 16 ][ 2 ];
+    unsigned vertexFifo[ 16 ];
+    std::fill( &edgeFifo[ 0 ][ 0 ], &edgeFifo[ 0 ][ 0 ] + 32, ~0u );
+    std::fill( vertexFifo, vertexFifo + 16, ~0u );
+    unsigned edgeHead = 0;
+    unsigned vertexHead = 0;
+    unsigned next = 0;
+    unsigned last = 0;
+
+    auto pushEdge = [&]( unsigned a, unsigned b )
+    {
+        edgeFifo[ edgeHead & 15 ][ 0 ] = a;
+        edgeFifo[ edgeHead & 15 ][ 1 ] = b;
+        ++edgeHead;
+    };
+
+    auto pushVertex = [&]( unsigned v )
+    {
+        vertexFifo[ vertexHead & 15 ] = v;
+        ++vertexHead;
+    };
+
+    // \return Index of a vertex in the vertex FIFO, or 16 if it's not there.
+    auto findVertex = [&]( unsigned v )
+    {
+        unsigned i = 0;
+
+        while (i < 16 && vertexFifo[ (vertexHead - 1 - i) & 15 ] != v)
+        {
+            ++i;
+        }
+
+        return i;
+    };
+
+    for (const VertexInd& face : faces)
+    {
+        const unsigned corners[ 3 ] = { face.a, face.b, face.c };
+        unsigned edge = 15;
+        unsigned rotation = 0;
+
+        for (unsigned r = 0; r < 3 && edge == 15; ++r)
+        {
+            for (unsigned e = 0; e < 15; ++e)
+            {
+                const unsigned* fifoEdge = edgeFifo[ (edgeHead - 1 - e) & 15 ];
+
+                if (fifoEdge[ 0 ] == corners[ (r + 1) % 3 ] && fifoEdge[ 1 ] == corners[ r ])
+                {
+                    edge = e;
+                    rotation = r;
+                    break;
+                }
+            }
+        }
+
+        if (edge < 15)
+        {
+            const unsigned a = corners[ rotation ];
+            const unsigned b = corners[ (rotation + 1) % 3 ];
+            const unsigned c = corners[ (rotation + 2) % 3 ];
+            const unsigned fifoIndex = findVertex( c );
+
+            if (c == next)
+            {
+                encoded.push_back( (unsigned char)(edge << 4) );
+                ++next;
+                pushVertex( c );
+            }
+            else if (fifoIndex < 14)
+            {
+                encoded.push_back( (unsigned char)((edge << 4) | (fifoIndex + 1)) );
+            }
+            else
+            {
+                encoded.push_back( (unsigned char)((edge << 4) | 15) );
+                AppendVarint( encoded, Zigzag( last, c ) );
+                pushVertex( c );
+            }
 
-            newFace.c = (unsigned short)(interleavedVertices.size() - 1);
+            last = c;
+            pushEdge( b, c );
+            pushEdge( c, a );
         }
+        else
+        {
+            encoded.push_back( 0xF0 );
 
-        indices.push_back( newFace );
-    }
+            for (unsigned v : corners)
+            {
+                const unsigned fifoIndex = findVertex( v );
 
-    if (interleavedVertices.size() > 65536)
-    {
-        std::cerr << "Mesh " << name << " has more than 65536 vertices!" << std::endl;
-        exit( 1 );
+                if (v == next)
+                {
+                    AppendVarint( encoded, 0 );
+                    ++next;
+                    pushVertex( v );
+                }
+                else if (fifoIndex < 16)
+                {
+                    AppendVarint( encoded, fifoIndex + 1 );
+                }
+                else
+                {
+                    AppendVarint( encoded, Zigzag( last, v ) + 17 );
+                    pushVertex( v );
+                }
+
+                last = v;
+            }
+
+            pushEdge( corners[ 0 ], corners[ 1 ] );
+            pushEdge( corners[ 1 ], corners[ 2 ] );
+            pushEdge( corners[ 2 ], corners[ 0 ] );
+        }
     }
-}
 
-bool Mesh::AlmostEquals( const ae3d::Vec3& v1, const ae3d::Vec3& v2 ) const
-{
-    if (std::fabs( v1.x - v2.x ) > 0.0001f) { return false; }
-    if (std::fabs( v1.y - v2.y ) > 0.0001f) { return false; }
-    if (std::fabs( v1.z - v2.z ) > 0.0001f) { return false; }
-    return true;
+    return encoded;
 }
 
-bool Mesh::AlmostEquals( const ae3d::Vec4& v1, const ae3d::Vec4& v2 ) const
+/// Writes a vertex stream. If compress is true, it's encoded and prefixed with its encoded size in bytes.
+static void WriteVertexStream( std::ofstream& ofs, const void* vertices, std::size_t vertexCount, std::size_t vertexSize, bool compress )
 {
-    if (std::fabs( v1.x - v2.x ) > 0.0001f) { return false; }
-    if (std::fabs( v1.y - v2.y ) > 0.0001f) { return false; }
-    if (std::fabs( v1.z - v2.z ) > 0.0001f) { return false; }
-    if (std::fabs( v1.w - v2.w ) > 0.0001f) { return false; }
-    return true;
-}
+    if (!compress)
+    {
+        ofs.write( (const char*)vertices, vertexCount * vertexSize );
+        return;
+    }
 
-bool Mesh::AlmostEquals( const TexCoord& t1, const TexCoord& t2 ) const
-{
-    if (std::fabs( t1.u - t2.u ) > 0.0001f) { return false; }
-    if (std::fabs( t1.v - t2.v ) > 0.0001f) { return false; }
-    return true;
+    const std::vector< unsigned char > encoded = EncodeVertexBuffer( vertices, vertexCount, vertexSize );
+    const std::uint32_t encodedSize = (std::uint32_t)encoded.size();
+    ofs.write( (const char*)&encodedSize, 4 );
+    ofs.write( (const char*)encoded.data(), encoded.size() );
 }
 
 /**
  bytes  data
- (2)    magic number, e.g. "a7"
+ (2)    magic number, e.g. "b1"
  (4*6)  Object's AABB min, AABB max.
  (2)    # of meshes
  (4*6)      Mesh's AABB min, AABB max.
  (2)        mesh name length in bytes.
  (*)        mesh name (1 character = 1 byte)
- (2)        # of vertices.
+ (4)        # of vertices. 2 bytes if magic number is <= a9
+ (1)        vertex format: 0 PTNTC, 1 PTN, 2 PTNTC_Skinned, 3 PTNTC_Compact, 4 PTNTC_Compact_Skinned
+ (4*4)      position offset and scale, only in compact formats: position = offset + quantized position (0-1) * scale
  (*)        Vertex data array of type Vertex.
- (2)        # of faces
+ (4)        # of faces. 2 bytes if magic number is <= a9
+ (1)        index size in bytes, 2 or 4. Not present if magic number is <= a9, where it's 2.
  (*)        faces
+ (1)        1 if depth streams follow, otherwise 0. Not present if magic number is <= b0. Always 0 in skinned formats.
+ (*)        position stream: Vec3, or ushort[ 4 ] in compact format.
+ (*)        position-normal stream: Vec3 position, Vec3 normal, or ushort[ 4 ] position, snorm8[ 4 ] normal in compact format.
  (2)        # of joints if magic number is >= a8
  (*)        joints
  (1)    terminator byte: 100
+
+ Version b2 is b1 with compressed streams: vertex data, faces and depth streams are each written as
+ (4) encoded size in bytes, (*) encoded data. The codec is documented in Engine/Core/MeshCodec.hpp and the decoded indices are 32-bit.
  */
 
 /// Writes a .ae3d model to a file.
 /// \param aOutFile File name to save the model into.
-void WriteAe3d( const std::string& aOutFile, VertexFormat vertexFormat )
+/// \param writeDepthStreams Writes position and position-normal streams for depth-only passes. Skinned meshes don't get them.
+/// \param compress Writes version b2 with compressed vertex, index and depth streams.
+void WriteAe3d( const std::string& aOutFile, VertexFormat vertexFormat, bool writeDepthStreams = false, bool compress = false )
 {
     static_assert( sizeof( VertexPTNTC) == 64, "" );
+    static_assert( sizeof( VertexPTNTC_Compact ) == 24, "" );
+    static_assert( sizeof( VertexPTNTC_Compact_Skinned ) == 32, "" );
+    static_assert( sizeof( VertexPN ) == 24, "" );
+    static_assert( sizeof( VertexPN_Compact ) == 12, "" );
     static_assert( sizeof( ae3d::Vec3 ) == 12, "" );
-    static_assert( sizeof( VertexInd  ) ==  6, "" );
+    static_assert( sizeof( VertexInd  ) == 12, "" );
 
     if (gMeshes.empty())
     {
@@ -1014,40 +2420,12 @@ void WriteAe3d( const std::string& aOutFile, VertexFormat vertexFormat )
         exit( 1 );
     }
 
-    for (std::size_t m = 0; m < gMeshes.size(); ++m)
-    {
-        gMeshes[ m ].SolveAABB();
-
-        if (gMeshes[ m ].vnormal.empty())
-        {
-            gMeshes[ m ].SolveVertexNormals();
-        }
-
-        gMeshes[ m ].Interleave();
-        gMeshes[ m ].OptimizeFaces();
-
-        gMeshes[ m ].SolveFaceNormals();
-
-        if (gMeshes[ m ].nonInterleavedTangents.empty())
-        {
-            gMeshes[ m ].SolveFaceTangents();
-            gMeshes[ m ].SolveVertexTangents();
-        }
-    }
-
-    // Calculates model's AABB by finding extreme values from meshes' AABBs.
-    const float maxValue = 99999999.0f;
-    ae3d::Vec3 aabbMin(  maxValue,  maxValue,  maxValue );
-    ae3d::Vec3 aabbMax( -maxValue, -maxValue, -maxValue );
-
-    for (std::size_t m = 0; m < gMeshes.size(); ++m)
-    {
-        aabbMin = ae3d::Vec3::Min2( aabbMin, gMeshes[ m ].aabbMin );
-        aabbMax = ae3d::Vec3::Max2( aabbMax, gMeshes[ m ].aabbMax );
-    }
+    ae3d::Vec3 aabbMin;
+    ae3d::Vec3 aabbMax;
+    PrepareMeshesForWriting( aabbMin, aabbMax, vertexFormat );
 
     // The file starts with identification bytes.
-    const char* gAe3dVersion = "a9";
+    const char* gAe3dVersion = compress ? "b2" : "b1";
     ofs.write( gAe3dVersion, 2 );
 
     ofs.write( reinterpret_cast< char* >( &aabbMin.x ), 3 * 4 );
@@ -1073,16 +2451,33 @@ void WriteAe3d( const std::string& aOutFile, VertexFormat vertexFormat )
                   nameLength);
         
         // Writes # of vertices.
-        const unsigned short nVertices = (unsigned short)gMeshes[ m ].interleavedVertices.size();
-        ofs.write( reinterpret_cast< char* >((char*)&nVertices), 2 );
+        const std::uint32_t nVertices = (std::uint32_t)gMeshes[ m ].interleavedVertices.size();
+        ofs.write( reinterpret_cast< char* >((char*)&nVertices), 4 );
 
         // Writes vertex data.
-        if (vertexFormat == VertexFormat::PTNTC_Skinned || !gMeshes[ m ].joints.empty())
+        if (vertexFormat == VertexFormat::Compact)
+        {
+            gMeshes[ m ].CopyInterleavedVerticesToCompact();
+
+            const unsigned char format = gMeshes[ m ].joints.empty() ? 3 : 4;
+            ofs.write( (char*)&format, 1 );
+            ofs.write( (char*)&gMeshes[ m ].positionDequantization.x, 4 * 4 );
+
+            if (gMeshes[ m ].joints.empty())
+            {
+                WriteVertexStream( ofs, gMeshes[ m ].interleavedVerticesCompact.data(), nVertices, sizeof( VertexPTNTC_Compact ), compress );
+            }
+            else
+            {
+                WriteVertexStream( ofs, gMeshes[ m ].interleavedVerticesCompactSkinned.data(), nVertices, sizeof( VertexPTNTC_Compact_Skinned ), compress );
+            }
+        }
+        else if (vertexFormat == VertexFormat::PTNTC_Skinned || !gMeshes[ m ].joints.empty())
         {
             const unsigned char format = 2;
             ofs.write( (char*)&format, 1 );
 
-            ofs.write( (char*)&gMeshes[ m ].interleavedVertices[ 0 ], gMeshes[ m ].interleavedVertices.size() * sizeof( VertexPTNTC_Skinned ) );
+            WriteVertexStream( ofs, gMeshes[ m ].interleavedVertices.data(), nVertices, sizeof( VertexPTNTC_Skinned ), compress );
         }
         else if (vertexFormat == VertexFormat::PTNTC)
         {
@@ -1091,7 +2486,7 @@ void WriteAe3d( const std::string& aOutFile, VertexFormat vertexFormat )
             const unsigned char format = 0;
             ofs.write( (char*)&format, 1 );
             
-            ofs.write( (char*)&gMeshes[ m ].interleavedVerticesPTNTC[ 0 ], gMeshes[ m ].interleavedVerticesPTNTC.size() * sizeof( VertexPTNTC ) );
+            WriteVertexStream( ofs, gMeshes[ m ].interleavedVerticesPTNTC.data(), nVertices, sizeof( VertexPTNTC ), compress );
         }
         else if (vertexFormat == VertexFormat::PTN)
         {
@@ -1100,7 +2495,7 @@ void WriteAe3d( const std::string& aOutFile, VertexFormat vertexFormat )
             const unsigned char format = 1;
             ofs.write( (char*)&format, 1 );
         
-            ofs.write( (char*)&gMeshes[m].interleavedVerticesPTN[ 0 ], gMeshes[ m ].interleavedVerticesPTN.size() * sizeof( VertexPTN ) );
+            WriteVertexStream( ofs, gMeshes[ m ].interleavedVerticesPTN.data(), nVertices, sizeof( VertexPTN ), compress );
         }
         else
         {
@@ -1109,11 +2504,72 @@ void WriteAe3d( const std::string& aOutFile, VertexFormat vertexFormat )
         }
         
         // Writes # of indices.
-        const unsigned short indexCount = (unsigned short)gMeshes[m].indices.size();
-        ofs.write( reinterpret_cast< char* >((char*)&indexCount), 2 );
+        const std::uint32_t indexCount = (std::uint32_t)gMeshes[m].indices.size();
+        ofs.write( reinterpret_cast< char* >((char*)&indexCount), 4 );
+
+        // Writes indices. 16 bits are enough for most meshes.
+        const unsigned char indexSize = nVertices > 65536 ? 4 : 2;
+        ofs.write( (char*)&indexSize, 1 );
+
+        if (compress)
+        {
+            const std::vector< unsigned char > encoded = EncodeIndexBuffer( gMeshes[ m ].indices );
+            const std::uint32_t encodedSize = (std::uint32_t)encoded.size();
+            ofs.write( (const char*)&encodedSize, 4 );
+            ofs.write( (const char*)encoded.data(), encoded.size() );
+        }
+        else if (indexSize == 4)
+        {
+            ofs.write( (char*)&gMeshes[m].indices[ 0 ], gMeshes[m].indices.size() * sizeof( VertexInd ) );
+        }
+        else
+        {
+            std::vector< std::uint16_t > indices16( gMeshes[ m ].indices.size() * 3 );
+
+            for (std::size_t f = 0; f < gMeshes[ m ].indices.size(); ++f)
+            {
+                indices16[ f * 3 + 0 ] = (std::uint16_t)gMeshes[ m ].indices[ f ].a;
+                indices16[ f * 3 + 1 ] = (std::uint16_t)gMeshes[ m ].indices[ f ].b;
+                indices16[ f * 3 + 2 ] = (std::uint16_t)gMeshes[ m ].indices[ f ].c;
+            }
+
+            ofs.write( (char*)indices16.data(), indices16.size() * sizeof( std::uint16_t ) );
+        }
+
+        const unsigned char hasDepthStreams = (writeDepthStreams && gMeshes[ m ].joints.empty() && vertexFormat != VertexFormat::PTNTC_Skinned) ? 1 : 0;
+        ofs.write( (char*)&hasDepthStreams, 1 );
+
+        if (hasDepthStreams && vertexFormat == VertexFormat::Compact)
+        {
+            std::vector< std::uint16_t > positions( nVertices * 4 );
+            std::vector< VertexPN_Compact > positionsNormals( nVertices );
+
+            for (std::size_t v = 0; v < nVertices; ++v)
+            {
+                const VertexPTNTC_Compact& vertex = gMeshes[ m ].interleavedVerticesCompact[ v ];
+                std::memcpy( &positions[ v * 4 ], vertex.position, sizeof( vertex.position ) );
+                std::memcpy( positionsNormals[ v ].position, vertex.position, sizeof( vertex.position ) );
+                std::memcpy( positionsNormals[ v ].normal, vertex.normal, sizeof( vertex.normal ) );
+            }
+
+            WriteVertexStream( ofs, positions.data(), nVertices, 4 * sizeof( std::uint16_t ), compress );
+            WriteVertexStream( ofs, positionsNormals.data(), nVertices, sizeof( VertexPN_Compact ), compress );
+        }
+        else if (hasDepthStreams)
+        {
+            std::vector< ae3d::Vec3 > positions( nVertices );
+            std::vector< VertexPN > positionsNormals( nVertices );
+
+            for (std::size_t v = 0; v < nVertices; ++v)
+            {
+                positions[ v ] = gMeshes[ m ].interleavedVertices[ v ].position;
+                positionsNormals[ v ].position = gMeshes[ m ].interleavedVertices[ v ].position;
+                positionsNormals[ v ].normal = gMeshes[ m ].interleavedVertices[ v ].normal;
+            }
 
-        // Writes indices.
-        ofs.write( (char*)&gMeshes[m].indices[ 0 ], gMeshes[m].indices.size() * sizeof( VertexInd ) );
+            WriteVertexStream( ofs, positions.data(), nVertices, sizeof( ae3d::Vec3 ), compress );
+            WriteVertexStream( ofs, positionsNormals.data(), nVertices, sizeof( VertexPN ), compress );
+        }
 
         if (vertexFormat == VertexFormat::PTNTC_Skinned || !gMeshes[ m ].joints.empty())
         {
@@ -1142,4 +2598,348 @@ void WriteAe3d( const std::string& aOutFile, VertexFormat vertexFormat )
 
     std::cout << "Wrote " << aOutFile << std::endl;
 }
+
+/// Appends data at the next 16-byte boundary of a file being built in memory.
+/// \return Offset of data from the start of the file.
+std::uint32_t AppendAligned( std::vector< unsigned char >& file, const void* data, std::size_t size )
+{
+    file.resize( (file.size() + 15) & ~std::size_t( 15 ), 0 );
+    const std::uint32_t offset = (std::uint32_t)file.size();
+    file.insert( file.end(), (const unsigned char*)data, (const unsigned char*)data + size );
+    return offset;
+}
+
+/**
+ Packed .ae3d layout, magic number "c0". Offsets are from the start of the file.
+ Vertex, index and depth stream data are 16-byte aligned, so the engine can upload them directly from a memory-mapped file.
+
+ bytes  data
+ (2)    magic number "c0"
+ (2)    # of meshes
+ (4)    file size in bytes
+ (4*6)  Object's AABB min, AABB max.
+ (96)   per mesh:
+ (4*6)      Mesh's AABB min, AABB max.
+ (4*4)      position offset and scale, only used in compact formats
+ (4)        # of vertices
+ (4)        # of faces
+ (1)        vertex format: 0 PTNTC, 1 PTN, 2 PTNTC_Skinned, 3 PTNTC_Compact, 4 PTNTC_Compact_Skinned
+ (1)        index size in bytes, 2 or 4
+ (1)        1 if depth streams are present, otherwise 0
+ (1)        reserved
+ (4*2)      name offset and length
+ (4*4)      vertex, index, position stream and position-normal stream offsets
+ (4*2)      joint data offset and size. Joints are encoded like in "b1".
+ (4*3)      reserved
+ (*)    name, vertex, index, depth stream and joint data
+ */
+
+/// Writes a packed .ae3d model to a file.
+/// \param aOutFile File name to save the model into.
+/// \param writeDepthStreams Writes position and position-normal streams for depth-only passes. Skinned meshes don't get them.
+void WriteAe3dPacked( const std::string& aOutFile, VertexFormat vertexFormat, bool writeDepthStreams = false )
+{
+    if (gMeshes.empty())
+    {
+        std::cerr << "Model doesn't contain any meshes, aborting!" << std::endl;
+        return;
+    }
+
+    if (gMeshes.size() > 65535)
+    {
+        std::cerr << "Model has too many meshes, aborting!" << std::endl;
+        return;
+    }
+
+    ae3d::Vec3 aabbMin;
+    ae3d::Vec3 aabbMax;
+    PrepareMeshesForWriting( aabbMin, aabbMax, vertexFormat );
+
+    const std::size_t headerSize = 32;
+    const std::size_t entrySize = 96;
+    std::vector< unsigned char > file( headerSize + gMeshes.size() * entrySize, 0 );
+
+    for (std::size_t m = 0; m < gMeshes.size(); ++m)
+    {
+        Mesh& mesh = gMeshes[ m ];
+        const bool isSkinned = vertexFormat == VertexFormat::PTNTC_Skinned || !mesh.joints.empty();
+        const std::uint32_t vertexCount = (std::uint32_t)mesh.interleavedVertices.size();
+        const std::uint32_t faceCount = (std::uint32_t)mesh.indices.size();
+        const unsigned char indexSize = vertexCount > 65536 ? 4 : 2;
+        unsigned char format = 0;
+        std::uint32_t vertexOffset = 0;
+
+        if (vertexFormat == VertexFormat::Compact)
+        {
+            mesh.CopyInterleavedVerticesToCompact();
+            format = mesh.joints.empty() ? 3 : 4;
+
+            if (mesh.joints.empty())
+            {
+                vertexOffset = AppendAligned( file, mesh.interleavedVerticesCompact.data(), mesh.interleavedVerticesCompact.size() * sizeof( VertexPTNTC_Compact ) );
+            }
+            else
+            {
+                vertexOffset = AppendAligned( file, mesh.interleavedVerticesCompactSkinned.data(), mesh.interleavedVerticesCompactSkinned.size() * sizeof( VertexPTNTC_Compact_Skinned ) );
+            }
+        }
+        else if (isSkinned)
+        {
+            format = 2;
+            vertexOffset = AppendAligned( file, mesh.interleavedVertices.data(), mesh.interleavedVertices.size() * sizeof( VertexPTNTC_Skinned ) );
+        }
+        else if (vertexFormat == VertexFormat::PTNTC)
+        {
+            mesh.CopyInterleavedVerticesToPTNTC();
+            format = 0;
+            vertexOffset = AppendAligned( file, mesh.interleavedVerticesPTNTC.data(), mesh.interleavedVerticesPTNTC.size() * sizeof( VertexPTNTC ) );
+        }
+        else if (vertexFormat == VertexFormat::PTN)
+        {
+            mesh.CopyInterleavedVerticesToPTN();
+            format = 1;
+            vertexOffset = AppendAligned( file, mesh.interleavedVerticesPTN.data(), mesh.interleavedVerticesPTN.size() * sizeof( VertexPTN ) );
+        }
+        else
+        {
+            std::cerr << "WriteAe3dPacked: Unhandled Vertex format!" << std::endl;
+            exit( 1 );
+        }
+
+        std::uint32_t indexOffset = 0;
+
+        if (indexSize == 4)
+        {
+            indexOffset = AppendAligned( file, mesh.indices.data(), mesh.indices.size() * sizeof( VertexInd ) );
+        }
+        else
+        {
+            std::vector< std::uint16_t > indices16( mesh.indices.size() * 3 );
+
+            for (std::size_t f = 0; f < mesh.indices.size(); ++f)
+            {
+                indices16[ f * 3 + 0 ] = (std::uint16_t)mesh.indices[ f ].a;
+                indices16[ f * 3 + 1 ] = (std::uint16_t)mesh.indices[ f ].b;
+                indices16[ f * 3 + 2 ] = (std::uint16_t)mesh.indices[ f ].c;
+            }
+
+            indexOffset = AppendAligned( file, indices16.data(), indices16.size() * sizeof( std::uint16_t ) );
+        }
+
+        const unsigned char hasDepthStreams = (writeDepthStreams && !isSkinned) ? 1 : 0;
+        std::uint32_t positionStreamOffset = 0;
+        std::uint32_t positionNormalStreamOffset = 0;
+
+        if (hasDepthStreams && vertexFormat == VertexFormat::Compact)
+        {
+            std::vector< std::uint16_t > positions( vertexCount * 4 );
+            std::vector< VertexPN_Compact > positionsNormals( vertexCount );
+
+            for (std::size_t v = 0; v < vertexCount; ++v)
+            {
+                const VertexPTNTC_Compact& vertex = mesh.interleavedVerticesCompact[ v ];
+                std::memcpy( &positions[ v * 4 ], vertex.position, sizeof( vertex.position ) );
+                std::memcpy( positionsNormals[ v ].position, vertex.position, sizeof( vertex.position ) );
+                std::memcpy( positionsNormals[ v ].normal, vertex.normal, sizeof( vertex.normal ) );
+            }
+
+            positionStreamOffset = AppendAligned( file, positions.data(), positions.size() * sizeof( std::uint16_t ) );
+            positionNormalStreamOffset = AppendAligned( file, positionsNormals.data(), positionsNormals.size() * sizeof( VertexPN_Compact ) );
+        }
+        else if (hasDepthStreams)
+        {
+            std::vector< ae3d::Vec3 > positions( vertexCount );
+            std::vector< VertexPN > positionsNormals( vertexCount );
+
+            for (std::size_t v = 0; v < vertexCount; ++v)
+            {
+                positions[ v ] = mesh.interleavedVertices[ v ].position;
+                positionsNormals[ v ].position = mesh.interleavedVertices[ v ].position;
+                positionsNormals[ v ].normal = mesh.interleavedVertices[ v ].normal;
+            }
+
+            positionStreamOffset = AppendAligned( file, positions.data(), positions.size() * sizeof( ae3d::Vec3 ) );
+            positionNormalStreamOffset = AppendAligned( file, positionsNormals.data(), positionsNormals.size() * sizeof( VertexPN ) );
+        }
+
+        std::uint32_t jointOffset = 0;
+        std::uint32_t jointSize = 0;
+
+        if (isSkinned)
+        {
+            std::vector< unsigned char > joints;
+            auto append = [&joints]( const void* data, std::size_t size ) { joints.insert( joints.end(), (const unsigned char*)data, (const unsigned char*)data + size ); };
+
+            const unsigned short jointCount = (unsigned short)mesh.joints.size();
+            append( &jointCount, 2 );
+
+            for (std::size_t j = 0; j < mesh.joints.size(); ++j)
+            {
+                append( &mesh.joints[ j ].globalBindposeInverse, sizeof( ae3d::Matrix44 ) );
+                append( &mesh.joints[ j ].parentIndex, 4 );
+                const int jointNameLength = (int)mesh.joints[ j ].name.length();
+                append( &jointNameLength, sizeof( int ) );
+                append( mesh.joints[ j ].name.data(), jointNameLength );
+                const int animLength = (int)mesh.joints[ j ].animTransforms.size();
+                append( &animLength, sizeof( int ) );
+                append( mesh.joints[ j ].animTransforms.data(), mesh.joints[ j ].animTransforms.size() * sizeof( ae3d::Matrix44 ) );
+            }
+
+            jointOffset = AppendAligned( file, joints.data(), joints.size() );
+            jointSize = (std::uint32_t)joints.size();
+        }
+
+        const std::uint32_t nameOffset = AppendAligned( file, mesh.name.data(), mesh.name.length() );
+        const std::uint32_t nameLength = (std::uint32_t)mesh.name.length();
+
+        unsigned char* entry = &file[ headerSize + m * entrySize ];
+        std::memcpy( entry + 0, &mesh.aabbMin.x, 3 * 4 );
+        std::memcpy( entry + 12, &mesh.aabbMax.x, 3 * 4 );
+
+        if (vertexFormat == VertexFormat::Compact)
+        {
+            std::memcpy( entry + 24, &mesh.positionDequantization.x, 4 * 4 );
+        }
+
+        std::memcpy( entry + 40, &vertexCount, 4 );
+        std::memcpy( entry + 44, &faceCount, 4 );
+        entry[ 48 ] = format;
+        entry[ 49 ] = indexSize;
+        entry[ 50 ] = hasDepthStreams;
+        std::memcpy( entry + 52, &nameOffset, 4 );
+        std::memcpy( entry + 56, &nameLength, 4 );
+        std::memcpy( entry + 60, &vertexOffset, 4 );
+        std::memcpy( entry + 64, &indexOffset, 4 );
+        std::memcpy( entry + 68, &positionStreamOffset, 4 );
+        std::memcpy( entry + 72, &positionNormalStreamOffset, 4 );
+        std::memcpy( entry + 76, &jointOffset, 4 );
+        std::memcpy( entry + 80, &jointSize, 4 );
+    }
+
+    const std::uint16_t meshCount = (std::uint16_t)gMeshes.size();
+    const std::uint32_t fileSize = (std::uint32_t)file.size();
+    file[ 0 ] = 'c';
+    file[ 1 ] = '0';
+    std::memcpy( &file[ 2 ], &meshCount, 2 );
+    std::memcpy( &file[ 4 ], &fileSize, 4 );
+    std::memcpy( &file[ 8 ], &aabbMin.x, 3 * 4 );
+    std::memcpy( &file[ 20 ], &aabbMax.x, 3 * 4 );
+
+    std::ofstream ofs( aOutFile.c_str(), std::ios::binary );
+
+    if (!ofs.is_open())
+    {
+        std::cerr << "Couldn't open file for writing!" << std::endl;
+        exit( 1 );
+    }
+
+    ofs.write( (const char*)file.data(), file.size() );
+
+    std::cout << "Wrote " << aOutFile << std::endl;
+}
+/// Parses converter parameters lods=N, lodratio=R and loderror=E. Other parameters are ignored.
+void ParseLodParam( const std::string& param, unsigned& outLodCount, float& outLodRatio, float& outLodError )
+{
+    if (param.compare( 0, 5, "lods=" ) == 0)
+    {
+        outLodCount = (unsigned)std::max( 1, std::atoi( param.c_str() + 5 ) );
+    }
+    else if (param.compare( 0, 9, "lodratio=" ) == 0)
+    {
+        outLodRatio = std::min( std::max( (float)std::atof( param.c_str() + 9 ), 0.01f ), 0.99f );
+    }
+    else if (param.compare( 0, 9, "loderror=" ) == 0)
+    {
+        outLodError = std::max( (float)std::atof( param.c_str() + 9 ), 0.0f );
+    }
+}
+
+/// Writes gMeshes as LOD 0 to aOutFile and simplified LODs to sibling files named <base>_lod1.ae3d, <base>_lod2.ae3d etc.
+/// Every LOD is simplified from the previous one. The chain ends early if a LOD can't be simplified further.
+/// LOD files and their errors are listed in <base>.lods, so an application can select a LOD whose error projects to less than a pixel.
+/// \param lodCount Number of LODs, including LOD 0.
+/// \param lodRatio Face count of a LOD relative to the previous LOD.
+/// \param maxRelativeError Largest allowed distance between a LOD and LOD 0 relative to the diagonal of the model's AABB.
+void WriteLods( const std::string& aOutFile, VertexFormat vertexFormat, bool writeDepthStreams, bool compress, bool packed, unsigned lodCount, float lodRatio, float maxRelativeError )
+{
+    const std::string base = aOutFile.substr( 0, aOutFile.rfind( ".ae3d" ) );
+    std::ofstream manifest( (base + ".lods").c_str() );
+
+    if (!manifest.is_open())
+    {
+        std::cerr << "Couldn't open file for writing!" << std::endl;
+        exit( 1 );
+    }
+
+    manifest << "# ae3d LOD chain: file, face count, error in model units" << std::endl;
+    float error = 0;
+    float maxError = 0;
+    std::size_t previousFaceCount = 0;
+
+    for (unsigned lod = 0; lod < lodCount && !gMeshes.empty(); ++lod)
+    {
+        std::size_t faceCount = 0;
+
+        if (lod > 0)
+        {
+            float lodError = 0;
+
+            for (Mesh& mesh : gMeshes)
+            {
+                lodError = std::max( lodError, mesh.Simplify( (std::size_t)(mesh.indices.size() * lodRatio), maxError - error ) );
+                mesh.OptimizeVertexFetch();
+                faceCount += mesh.indices.size();
+            }
+
+            error += lodError;
+
+            // Further LODs would be almost identical.
+            if (faceCount > previousFaceCount * 0.9f)
+            {
+                std::cout << "LOD " << lod << " would remove too few faces, ending the LOD chain." << std::endl;
+                break;
+            }
+        }
+
+        const std::string lodFile = lod == 0 ? aOutFile : base + "_lod" + std::to_string( lod ) + ".ae3d";
+
+        if (packed)
+        {
+            WriteAe3dPacked( lodFile, vertexFormat, writeDepthStreams );
+        }
+        else
+        {
+            WriteAe3d( lodFile, vertexFormat, writeDepthStreams, compress );
+        }
+
+        // Faces of LOD 0 are created while writing.
+        faceCount = 0;
+
+        for (const Mesh& mesh : gMeshes)
+        {
+            faceCount += mesh.indices.size();
+        }
+
+        manifest << lodFile.substr( lodFile.find_last_of( "/\\" ) + 1 ) << " " << faceCount << " " << error << std::endl;
+        previousFaceCount = faceCount;
+
+        // Writing solved the AABBs.
+        if (lod == 0)
+        {
+            ae3d::Vec3 aabbMin = gMeshes[ 0 ].aabbMin;
+            ae3d::Vec3 aabbMax = gMeshes[ 0 ].aabbMax;
+
+            for (const Mesh& mesh : gMeshes)
+            {
+                aabbMin = ae3d::Vec3::Min2( aabbMin, mesh.aabbMin );
+                aabbMax = ae3d::Vec3::Max2( aabbMax, mesh.aabbMax );
+            }
+
+            maxError = (aabbMax - aabbMin).Length() * maxRelativeError;
+        }
+    }
+
+    std::cout << "Wrote " << base << ".lods" << std::endl;
+}
+
 #endif